@@ -67,6 +67,18 @@ extern cl::opt<bool> UseSegmentSetForPhysRegs;
     /// Live interval pointers for all the virtual registers.
     IndexedMap<LiveInterval*, VirtReg2IndexFunctor> VirtRegIntervals;
 
+    /// Pool for the live intervals and register unit live ranges of the
+    /// current function, so that building and releasing them does not go
+    /// through the heap once per interval. The storage of removed intervals
+    /// is only reclaimed when the whole pool is reset.
+    ///
+    /// FIXME: This only pools the range objects. Segments that do not fit in
+    /// a range's inline storage are still allocated by the range itself, and
+    /// SlotIndexes is still a linked list. Pooling the segments and flattening
+    /// SlotIndexes is left for a change that can show its effect on the
+    /// register allocator.
+    BumpPtrAllocator IntervalAllocator;
+
     /// RegMaskSlots - Sorted list of instructions with register mask operands.
     /// Always use the 'r' slot, RegMasks are normal clobbers, not early
     /// clobbers.
@@ -138,7 +150,8 @@ extern cl::opt<bool> UseSegmentSetForPhysRegs;
 
     // Interval removal.
     void removeInterval(unsigned Reg) {
-      delete VirtRegIntervals[Reg];
+      if (LiveInterval *LI = VirtRegIntervals[Reg])
+        destroyInterval(LI);
       VirtRegIntervals[Reg] = nullptr;
     }
 
@@ -376,8 +389,7 @@ extern cl::opt<bool> UseSegmentSetForPhysRegs;
       LiveRange *LR = RegUnitRanges[Unit];
       if (!LR) {
         // Compute missing ranges on demand.
-        // Use segment set to speed-up initial computation of the live range.
-        RegUnitRanges[Unit] = LR = new LiveRange(UseSegmentSetForPhysRegs);
+        RegUnitRanges[Unit] = LR = createRegUnitRange();
         computeRegUnitRange(*LR, Unit);
       }
       return *LR;
@@ -419,7 +431,9 @@ extern cl::opt<bool> UseSegmentSetForPhysRegs;
     bool computeDeadValues(LiveInterval &LI,
                            SmallVectorImpl<MachineInstr*> *dead);
 
-    static LiveInterval* createInterval(unsigned Reg);
+    LiveInterval* createInterval(unsigned Reg);
+    void destroyInterval(LiveInterval *LI);
+    LiveRange *createRegUnitRange();
 
     void printInstrs(raw_ostream &O) const;
     void dumpInstrs() const;
@@ -471,6 +471,12 @@ namespace llvm {
   ///
   FunctionPass *createGreedyRegisterAllocator();
 
+  /// LinearScanRegisterAllocation Pass - This pass implements a global linear
+  /// scan register allocator with second-chance binpacking. It is cheaper than
+  /// the greedy allocator, at some cost in code quality.
+  ///
+  FunctionPass *createLinearScanRegisterAllocator();
+
   /// PBQPRegisterAllocation Pass - This pass implements the Partitioned Boolean
   /// Quadratic Prograaming (PBQP) based register allocator.
   ///
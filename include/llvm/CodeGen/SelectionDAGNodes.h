@@ -365,6 +365,11 @@ private:
   // this ordering.
   unsigned IROrder;
 
+  /// Position of this node in the DAGCombiner worklist, or -1 if it is not on
+  /// the worklist. -2 means it is not on the worklist but has been combined at
+  /// least once during the current combiner run.
+  int CombinerWorklistIndex;
+
   /// Source line information.
   DebugLoc debugLoc;
 
@@ -445,6 +450,12 @@ public:
   /// Set unique node id.
   void setNodeId(int Id) { NodeId = Id; }
 
+  /// Return the DAGCombiner worklist state of this node.
+  int getCombinerWorklistIndex() const { return CombinerWorklistIndex; }
+
+  /// Set the DAGCombiner worklist state of this node.
+  void setCombinerWorklistIndex(int Index) { CombinerWorklistIndex = Index; }
+
   /// Return the node ordering.
   unsigned getIROrder() const { return IROrder; }
 
@@ -736,7 +747,8 @@ protected:
         SubclassData(0), NodeId(-1),
         OperandList(Ops.size() ? new SDUse[Ops.size()] : nullptr),
         ValueList(VTs.VTs), UseList(nullptr), NumOperands(Ops.size()),
-        NumValues(VTs.NumVTs), IROrder(Order), debugLoc(std::move(dl)) {
+        NumValues(VTs.NumVTs), IROrder(Order),
+        CombinerWorklistIndex(-1), debugLoc(std::move(dl)) {
     assert(debugLoc.hasTrivialDestructor() && "Expected trivial destructor");
     assert(NumOperands == Ops.size() &&
            "NumOperands wasn't wide enough for its operands!");
@@ -756,7 +768,7 @@ protected:
       : NodeType(Opc), OperandsNeedDelete(false), HasDebugValue(false),
         SubclassData(0), NodeId(-1), OperandList(nullptr), ValueList(VTs.VTs),
         UseList(nullptr), NumOperands(0), NumValues(VTs.NumVTs),
-        IROrder(Order), debugLoc(std::move(dl)) {
+        IROrder(Order), CombinerWorklistIndex(-1), debugLoc(std::move(dl)) {
     assert(debugLoc.hasTrivialDestructor() && "Expected trivial destructor");
     assert(NumValues == VTs.NumVTs &&
            "NumValues wasn't wide enough for its operands!");
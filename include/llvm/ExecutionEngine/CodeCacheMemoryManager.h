@@ -0,0 +1,262 @@
+//===- CodeCacheMemoryManager.h - Reusable memory for JIT code --*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares JITCodeCache, a pool of page-aligned memory that outlives
+// the objects loaded into it, and CodeCacheMemoryManager, an RTDyld memory
+// manager that allocates from a JITCodeCache and gives the memory back when it
+// is destroyed.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_EXECUTIONENGINE_CODECACHEMEMORYMANAGER_H
+#define LLVM_EXECUTIONENGINE_CODECACHEMEMORYMANAGER_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/Support/Memory.h"
+#include "llvm/Support/Mutex.h"
+#include <map>
+#include <set>
+#include <vector>
+
+namespace llvm {
+
+class raw_ostream;
+
+/// A thread-safe pool of memory for JIT clients that load and discard many
+/// small objects.
+///
+/// Memory is mapped from the operating system in large slabs and handed out
+/// in page multiples. Released ranges are coalesced with their free neighbours
+/// and kept on segregated free lists, one per power-of-two size class, so that
+/// later requests are served by best fit without another mapping. Slabs that
+/// become entirely free are unmapped once the amount of free memory exceeds the
+/// retention limit, or when compact() is called. Code already in use is never
+/// moved, so compaction only trims memory; it does not relocate allocations.
+///
+/// Sections of up to a quarter page are not given pages of their own. They
+/// take a slot of a power-of-two size class in a page shared by every memory
+/// manager of the cache, one set of pages per kind of memory, so that many
+/// small modules fit into a single page. Permissions are changed per page:
+/// a shared page is sealed (made read-execute or read-only) once all of its
+/// slots are taken and finalized, and made read-write again once all of them
+/// are released. Until then shared code pages are writable and executable,
+/// so that code finalized in one slot can run while other slots are written.
+class JITCodeCache {
+  JITCodeCache(const JITCodeCache &) = delete;
+  void operator=(const JITCodeCache &) = delete;
+
+public:
+  /// A snapshot of the cache's memory use.
+  struct Statistics {
+    /// Memory currently mapped from the operating system.
+    uint64_t MappedBytes;
+    /// Memory handed out to memory managers and not yet released.
+    uint64_t AllocatedBytes;
+    /// The part of AllocatedBytes occupied by sections, including the padding
+    /// needed to align them.
+    uint64_t SectionBytes;
+    /// Mapped memory that is not allocated.
+    uint64_t FreeBytes;
+    /// The number of disjoint free ranges and the size of the largest one.
+    uint64_t NumFreeRanges;
+    uint64_t LargestFreeRange;
+    /// The number of slabs currently mapped.
+    uint64_t NumSlabs;
+    /// Allocations served from free memory rather than a new mapping.
+    uint64_t NumReusedAllocations;
+    /// Allocations that needed a new slab to be mapped.
+    uint64_t NumMappedAllocations;
+    /// Calls made to change page permissions.
+    uint64_t NumProtectCalls;
+    /// Pages shared by small sections, how many of them have been sealed, and
+    /// the number of sections they hold.
+    uint64_t NumSlotPages;
+    uint64_t NumSealedSlotPages;
+    uint64_t NumSlots;
+
+    /// The fraction of free memory that cannot be used for an allocation of
+    /// the largest free range's size: 1 - LargestFreeRange / FreeBytes.
+    double getExternalFragmentation() const;
+
+    /// The fraction of allocated memory not occupied by sections.
+    double getInternalFragmentation() const;
+
+    void print(raw_ostream &OS) const;
+  };
+
+  /// Create an empty cache. New slabs are \p SlabSize bytes (rounded up to
+  /// the page size) unless a larger request needs more. Entirely free slabs
+  /// are unmapped while more than \p RetainedBytes of memory is free.
+  explicit JITCodeCache(size_t SlabSize = 1024 * 1024,
+                        size_t RetainedBytes = 16 * 1024 * 1024);
+  ~JITCodeCache();
+
+  /// Unmap every slab that has no allocated memory in it.
+  void compact();
+
+  Statistics getStatistics() const;
+
+private:
+  friend class CodeCacheMemoryManager;
+
+  static const unsigned NumSizeClasses = 16;
+
+  /// Slots of shared pages are 16 << C bytes for C < NumSlotClasses, and at
+  /// most a quarter page.
+  static const unsigned NumSlotClasses = 7;
+
+  enum PoolKind { CodePool, RODataPool, RWDataPool, NumPools };
+
+  /// A page whose slots hold the small sections of any memory manager.
+  struct SlotPage {
+    PoolKind Kind;
+    unsigned SlotSize;
+    /// Slots handed out, and how many of those are not finalized yet.
+    unsigned NumLive;
+    unsigned NumPending;
+    bool Sealed;
+    /// Indices of the free slots. Slots freed after the page was sealed are
+    /// not reused until the whole page is free.
+    std::vector<uint16_t> FreeSlots;
+  };
+
+  /// Allocate read-write memory of at least \p Size bytes. Returns an empty
+  /// block if the memory could not be mapped.
+  sys::MemoryBlock allocate(size_t Size);
+
+  /// Allocate a slot for a section of \p Size bytes and \p Alignment in a
+  /// page of kind \p Kind shared with other memory managers. Returns null if
+  /// the section is too large for a slot or no page could be made ready.
+  uint8_t *allocateSlot(PoolKind Kind, size_t Size, unsigned Alignment);
+
+  /// Record that the sections in \p Slots are complete. Code slots are made
+  /// visible to instruction fetch, and pages left with no free or pending
+  /// slots are sealed.
+  std::error_code finalizeSlots(ArrayRef<uint8_t *> Slots);
+
+  /// Return slots to their pages. \p Pending are slots that were never
+  /// finalized.
+  void releaseSlots(ArrayRef<uint8_t *> Finalized,
+                    ArrayRef<uint8_t *> Pending);
+
+  /// Return \p Blocks to the cache, making them read-write again.
+  void release(ArrayRef<sys::MemoryBlock> Blocks);
+
+  /// Apply \p Flags to \p Blocks, merging blocks that are adjacent within the
+  /// same slab into a single call.
+  std::error_code protect(ArrayRef<sys::MemoryBlock> Blocks, unsigned Flags);
+
+  /// Record that sections now occupy \p Delta more (or fewer) bytes.
+  void addSectionBytes(int64_t Delta);
+
+  unsigned getSizeClass(size_t Size) const;
+  uintptr_t getSlabBase(uintptr_t Addr) const;
+  void addFreeRange(uintptr_t Addr, size_t Size);
+  void removeFreeRange(uintptr_t Addr, size_t Size);
+  void compactLocked();
+  sys::MemoryBlock allocateLocked(size_t Size);
+  void releaseLocked(ArrayRef<sys::MemoryBlock> Blocks);
+  std::error_code protectLocked(ArrayRef<sys::MemoryBlock> Blocks,
+                                unsigned Flags);
+  void releaseSlot(uintptr_t Addr, bool Pending);
+  void releaseSlotPage(uintptr_t Base);
+
+  mutable sys::Mutex Lock;
+  size_t PageSize;
+  size_t SlabSize;
+  size_t RetainedBytes;
+
+  /// Mapped slabs, keyed by base address.
+  std::map<uintptr_t, size_t> Slabs;
+  /// Free ranges keyed by address, for coalescing.
+  std::map<uintptr_t, size_t> FreeByAddr;
+  /// Free ranges as (size, address) pairs, segregated by size class.
+  std::set<std::pair<size_t, uintptr_t>> FreeBySize[NumSizeClasses];
+
+  /// Shared pages keyed by base address, and those with free slots that are
+  /// not sealed, per kind and slot class.
+  DenseMap<uintptr_t, SlotPage> SlotPages;
+  std::vector<uintptr_t> OpenSlotPages[NumPools][NumSlotClasses];
+  /// Set if the system refused to make a shared page writable and
+  /// executable, after which code only goes into private regions.
+  bool NoSharedCode = false;
+
+  sys::MemoryBlock Near;
+  Statistics Stats;
+};
+
+/// An RTDyld memory manager that allocates sections from a JITCodeCache.
+///
+/// Small sections go into the cache's shared pages. Larger ones are
+/// bump-allocated from page-aligned regions obtained from the cache, which are
+/// reserved up front when RuntimeDyld reports more than a page of a kind for
+/// an object, and later small sections fill up the rest of such a region
+/// first. finalizeMemory() flips all regions of a kind with as few permission
+/// changes as possible, and regions are never writable and executable at the
+/// same time: code is written while read-write and only made executable once
+/// finalized. Sections allocated after finalization go into fresh regions or
+/// slots.
+///
+/// Destroying the memory manager returns all of its memory to the cache. With
+/// the Orc ObjectLinkingLayer, giving each object set its own
+/// CodeCacheMemoryManager therefore releases a module's memory when it is
+/// removed from the JIT.
+class CodeCacheMemoryManager : public RTDyldMemoryManager {
+  CodeCacheMemoryManager(const CodeCacheMemoryManager &) = delete;
+  void operator=(const CodeCacheMemoryManager &) = delete;
+
+public:
+  explicit CodeCacheMemoryManager(JITCodeCache &Cache) : Cache(Cache) {}
+  ~CodeCacheMemoryManager() override;
+
+  uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                               unsigned SectionID,
+                               StringRef SectionName) override;
+
+  uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
+                               unsigned SectionID, StringRef SectionName,
+                               bool IsReadOnly) override;
+
+  bool needsToReserveAllocationSpace() override { return true; }
+  void reserveAllocationSpace(uintptr_t CodeSize, uintptr_t DataSizeRO,
+                              uintptr_t DataSizeRW) override;
+
+  /// \brief Make code read-execute and read-only data read-only.
+  ///
+  /// \returns true if an error occurred, false otherwise.
+  bool finalizeMemory(std::string *ErrMsg = nullptr) override;
+
+private:
+  struct Region {
+    sys::MemoryBlock Block;
+    uintptr_t Used;
+    bool Finalized;
+  };
+
+  typedef JITCodeCache::PoolKind PoolKind;
+  static const unsigned NumPools = JITCodeCache::NumPools;
+
+  void addRegion(PoolKind Kind, size_t Size);
+  uint8_t *allocateSection(PoolKind Kind, uintptr_t Size, unsigned Alignment);
+
+  JITCodeCache &Cache;
+  SmallVector<Region, 2> Pools[NumPools];
+  /// Slots in the cache's shared pages, in allocation order. The first
+  /// NumFinalizedSlots have been finalized.
+  SmallVector<uint8_t *, 8> Slots;
+  unsigned NumFinalizedSlots = 0;
+  uint64_t SectionBytes = 0;
+};
+
+} // end namespace llvm
+
+#endif
@@ -92,6 +92,25 @@ public:
 
 using FunctionCreator = std::function<void *(const std::string &)>;
 
+/// \brief Native entry point for a function run by tiered execution.
+///
+/// The function's arguments are passed in \p Args, one 64-bit slot each:
+/// integers zero-extended, float and double as their bit patterns, and
+/// pointers as integers. The return value, if any, is stored to \p Result the
+/// same way.
+typedef void (*TieredEntryPoint)(uint64_t *Args, uint64_t *Result);
+
+/// \brief Returns true if values of type \p Ty can be passed to or returned
+/// from a TieredEntryPoint.
+inline bool isTieredSlotType(Type *Ty) {
+  return (Ty->isIntegerTy() && Ty->getIntegerBitWidth() <= 64) ||
+         Ty->isFloatTy() || Ty->isDoubleTy() || Ty->isPointerTy();
+}
+
+/// \brief Compiles a function for tiered execution. Returns null if the
+/// function could not be compiled.
+using TierUpCompiler = std::function<TieredEntryPoint(Function &)>;
+
 /// \brief Abstract interface for implementation execution of LLVM modules,
 /// designed to support both interpreter and just-in-time (JIT) compiler
 /// implementations.
@@ -419,6 +438,17 @@ public:
     llvm_unreachable("No support for ProcessAllSections option");
   }
 
+  /// setTierUpCompiler (Interpreter only): Hand each function to \p Compiler
+  /// once it has been called, or has taken a loop back-edge, \p Threshold
+  /// times in total, and from then on call the native code it returns instead
+  /// of interpreting the function. Functions whose native code could observe
+  /// a difference from interpretation (such as calls through function
+  /// pointers) stay interpreted. There is no on-stack replacement: a function
+  /// that becomes hot while it runs switches to native code on its next call.
+  virtual void setTierUpCompiler(unsigned Threshold, TierUpCompiler Compiler) {
+    llvm_unreachable("No support for tiered execution");
+  }
+
   /// Return the target machine (if available).
   virtual TargetMachine *getTargetMachine() { return nullptr; }
 
@@ -0,0 +1,76 @@
+//===-- FileObjectCache.h - Persistent on-disk ObjectCache ------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file declares FileObjectCache, an ObjectCache that keeps compiled
+// objects in a directory shared between processes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_EXECUTIONENGINE_FILEOBJECTCACHE_H
+#define LLVM_EXECUTIONENGINE_FILEOBJECTCACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include <string>
+
+namespace llvm {
+
+class TargetMachine;
+
+/// An ObjectCache storing objects in a directory, under the hash of the
+/// module's bitcode and of the target configuration that compiled it. A module
+/// therefore hits the cache in any process compiling the same IR the same
+/// way, whatever its identifier.
+///
+/// Objects are written to a temporary file and renamed into place, so
+/// concurrent processes never see a partially written object, and are mapped
+/// rather than read when loaded. Once the cache grows past its size limit the
+/// least recently used objects are deleted.
+class FileObjectCache : public ObjectCache {
+public:
+  struct Statistics {
+    unsigned Hits;
+    unsigned Misses;
+    unsigned Stores;
+    unsigned Pruned;
+  };
+
+  /// Create a cache in CacheDir for objects compiled by TM, keeping at most
+  /// MaxSize bytes of objects, or any amount if MaxSize is 0.
+  FileObjectCache(StringRef CacheDir, const TargetMachine &TM,
+                  uint64_t MaxSize = 0);
+  ~FileObjectCache() override;
+
+  void notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) override;
+  std::unique_ptr<MemoryBuffer> getObject(const Module *M) override;
+
+  /// Delete the least recently used objects until the cache fits its size
+  /// limit.
+  void prune();
+
+  Statistics getStatistics() const { return Stats; }
+
+private:
+  std::string getCacheKey(const Module *M);
+  std::string getCachePath(StringRef Key) const;
+
+  SmallString<128> CacheDir;
+  std::string TargetKey;
+  uint64_t MaxSize;
+  Statistics Stats;
+
+  /// Keys computed by getObject for modules that missed the cache, so that
+  /// notifyObjectCompiled does not have to hash them again.
+  DenseMap<const Module *, std::string> PendingKeys;
+};
+
+} // end namespace llvm
+
+#endif
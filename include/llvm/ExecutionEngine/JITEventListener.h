@@ -16,9 +16,12 @@
 #define LLVM_EXECUTIONENGINE_JITEVENTLISTENER_H
 
 #include "RuntimeDyld.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/Config/llvm-config.h"
 #include "llvm/IR/DebugLoc.h"
 #include "llvm/Support/DataTypes.h"
+#include "llvm/Support/TimeValue.h"
+#include "llvm/Support/Timer.h"
 #include <vector>
 
 namespace llvm {
@@ -78,6 +81,40 @@ public:
   /// a previously emitted object is released.
   virtual void NotifyFreeingObject(const object::ObjectFile &Obj) {}
 
+  /// The steps of turning a module into executable code that are reported to
+  /// NotifyCompilePhase.
+  enum CompilePhase {
+    /// Code generation from IR to an object: instruction selection, register
+    /// allocation and MC emission, plus the IR passes the code generator
+    /// runs first.
+    CodeGenPhase,
+    /// RuntimeDyld loading an object into memory.
+    ObjectLoadPhase,
+    /// RuntimeDyld resolving relocations, registering EH frames and
+    /// finalizing memory permissions.
+    RelocationPhase
+  };
+
+  /// getCompilePhaseName - Return a short lowercase name for Phase.
+  static const char *getCompilePhaseName(CompilePhase Phase);
+
+  struct CompilePhaseInfo {
+    CompilePhase Phase;
+    /// The identifier of the module the phase worked on, or an empty string
+    /// if it covered several modules at once.
+    StringRef Name;
+    /// Wall clock time at the start and end of the phase.
+    sys::TimeValue Start;
+    sys::TimeValue End;
+    /// The size in bytes of the object produced or loaded, or 0 if the phase
+    /// does not work on a single object.
+    uint64_t Size;
+  };
+
+  /// NotifyCompilePhase - Called at the end of each compile phase. This may
+  /// be called from several threads at once.
+  virtual void NotifyCompilePhase(const CompilePhaseInfo &Info) {}
+
   // Get a pointe to the GDB debugger registration listener.
   static JITEventListener *createGDBRegistrationListener();
 
@@ -117,6 +154,29 @@ private:
   virtual void anchor();
 };
 
+/// JITCompilePhaseTimer - Times a compile phase for as long as it is in
+/// scope, then reports it to the given listeners. With -time-passes the phase
+/// is also added to the "JIT Compile Phases" timer group. Phases may be timed
+/// on several threads at once: the timers of the group are shared, so they
+/// are only started and stopped under a global lock.
+class JITCompilePhaseTimer {
+public:
+  JITCompilePhaseTimer(JITEventListener::CompilePhase Phase, StringRef Name,
+                       ArrayRef<JITEventListener *> Listeners);
+  ~JITCompilePhaseTimer();
+
+  /// Set the number of bytes the phase produced or loaded.
+  void setSize(uint64_t Size) { Info.Size = Size; }
+
+private:
+  JITCompilePhaseTimer(const JITCompilePhaseTimer &) = delete;
+  void operator=(const JITCompilePhaseTimer &) = delete;
+
+  ArrayRef<JITEventListener *> Listeners;
+  JITEventListener::CompilePhaseInfo Info;
+  Timer *PhaseTimer;
+};
+
 } // end namespace llvm.
 
 #endif // defined LLVM_EXECUTIONENGINE_JITEVENTLISTENER_H
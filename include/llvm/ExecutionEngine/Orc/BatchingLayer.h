@@ -0,0 +1,349 @@
+//===- BatchingLayer.h - Link small modules into larger batches -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Contains the definition for a layer that links the modules added to it into
+// batches before passing them on to the layer below.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_EXECUTIONENGINE_ORC_BATCHINGLAYER_H
+#define LLVM_EXECUTIONENGINE_ORC_BATCHINGLAYER_H
+
+#include "JITSymbol.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/ErrorHandling.h"
+#include <algorithm>
+#include <list>
+#include <vector>
+
+namespace llvm {
+namespace orc {
+
+/// @brief Module batching IR layer.
+///
+///   This layer accepts sets of LLVM IR Modules (via addModuleSet), but rather
+/// than passing each set to the layer below on its own it links the modules of
+/// consecutive sets into a single batch module. A batch is emitted to the base
+/// layer as one module set once it holds at least MaxBatchSize instructions, or
+/// when the address of a symbol defined in it is first requested, or when
+/// flush is called. Each batch is compiled by a single code generator run and
+/// linked into one set of sections, so adding many tiny modules costs one
+/// pass pipeline, one object file and one set of page allocations per batch
+/// instead of per module.
+///
+///   Handles returned by addModuleSet still refer to the individual sets:
+/// findSymbolIn only finds the symbols the set itself defines, and the batch
+/// is removed from the base layer once every set in it has been removed. The
+/// sets of a batch share the memory manager of the first set in it, and
+/// references to external symbols are resolved by the first of their symbol
+/// resolvers that knows the symbol.
+///
+///   Only modules with the same context, data layout and triple are batched
+/// together, and a module defining a symbol that is already defined in the
+/// pending batch starts a new one. Symbols with local linkage may be renamed
+/// by the linker, so they cannot be found through this layer. ModuleSetT must
+/// be a container of std::unique_ptr<Module>.
+template <typename BaseLayerT> class BatchingLayer {
+public:
+  typedef typename BaseLayerT::ModuleSetHandleT BaseLayerHandleT;
+
+private:
+  // Keeps a set's memory manager and symbol resolver alive for as long as the
+  // batch that uses them.
+  class SetResources {
+  public:
+    virtual ~SetResources() {}
+  };
+
+  template <typename MemoryManagerPtrT, typename SymbolResolverPtrT>
+  class SetResourcesImpl : public SetResources {
+  public:
+    SetResourcesImpl(MemoryManagerPtrT MemMgr, SymbolResolverPtrT Resolver)
+        : MemMgr(std::move(MemMgr)), Resolver(std::move(Resolver)) {}
+
+  private:
+    MemoryManagerPtrT MemMgr;
+    SymbolResolverPtrT Resolver;
+  };
+
+  class Batch : public RuntimeDyld::SymbolResolver {
+  public:
+    Batch(std::unique_ptr<Module> M)
+        : M(std::move(M)), Size(0), NumSets(0), MemMgr(nullptr),
+          EmitState(NotEmitted) {}
+
+    RuntimeDyld::SymbolInfo findSymbol(const std::string &Name) override {
+      for (auto *R : Resolvers)
+        if (auto Sym = R->findSymbol(Name))
+          return Sym;
+      return nullptr;
+    }
+
+    RuntimeDyld::SymbolInfo
+    findSymbolInLogicalDylib(const std::string &Name) override {
+      for (auto *R : Resolvers)
+        if (auto Sym = R->findSymbolInLogicalDylib(Name))
+          return Sym;
+      return nullptr;
+    }
+
+    std::unique_ptr<Module> M;
+    unsigned Size;
+    unsigned NumSets;
+    StringMap<JITSymbolFlags> Definitions;
+    RuntimeDyld::MemoryManager *MemMgr;
+    std::vector<RuntimeDyld::SymbolResolver *> Resolvers;
+    std::vector<std::unique_ptr<SetResources>> Resources;
+    enum { NotEmitted, Emitting, Emitted } EmitState;
+    BaseLayerHandleT Handle;
+  };
+
+  typedef std::list<std::unique_ptr<Batch>> BatchListT;
+
+  struct BatchedSet {
+    typename BatchListT::iterator B;
+    StringMap<JITSymbolFlags> Symbols;
+  };
+
+  typedef std::list<BatchedSet> BatchedSetListT;
+
+public:
+  /// @brief Handle to a set of added modules.
+  typedef typename BatchedSetListT::iterator ModuleSetHandleT;
+
+  /// @brief Construct a BatchingLayer that emits a batch to BaseLayer once it
+  ///        holds at least MaxBatchSize instructions.
+  BatchingLayer(BaseLayerT &BaseLayer, unsigned MaxBatchSize = 4096)
+      : BaseLayer(BaseLayer), MaxBatchSize(MaxBatchSize),
+        PendingBatch(Batches.end()) {}
+
+  /// @brief Link the modules in the given set into the pending batch, emitting
+  ///        the batch if that makes it large enough.
+  ///
+  /// @return A handle for the added modules.
+  template <typename ModuleSetT, typename MemoryManagerPtrT,
+            typename SymbolResolverPtrT>
+  ModuleSetHandleT addModuleSet(ModuleSetT Ms,
+                                MemoryManagerPtrT MemMgr,
+                                SymbolResolverPtrT Resolver) {
+    BatchedSet Set;
+    unsigned SetSize = 0;
+    for (auto &M : Ms) {
+      addDefinitions(Set.Symbols, *M);
+      for (auto &F : *M)
+        for (auto &BB : F)
+          SetSize += BB.size();
+    }
+
+    if (PendingBatch != Batches.end() &&
+        (!canJoinPendingBatch(Ms, Set.Symbols) ||
+         (*PendingBatch)->Size + SetSize > MaxBatchSize))
+      flush();
+
+    for (auto &M : Ms) {
+      if (PendingBatch == Batches.end())
+        PendingBatch =
+            Batches.insert(Batches.end(), llvm::make_unique<Batch>(std::move(M)));
+      else if (!(*PendingBatch)->M)
+        (*PendingBatch)->M = std::move(M);
+      else if (Linker::LinkModules((*PendingBatch)->M.get(), M.get()))
+        report_fatal_error("Could not link module into the pending batch");
+    }
+
+    // An empty set still gets a handle, but has nothing to put in a batch.
+    if (PendingBatch == Batches.end())
+      PendingBatch = Batches.insert(Batches.end(), llvm::make_unique<Batch>(
+                                                       nullptr));
+
+    Batch &B = **PendingBatch;
+    B.Size += SetSize;
+    ++B.NumSets;
+    for (auto &S : Set.Symbols)
+      B.Definitions[S.first()] = S.second;
+    if (!B.MemMgr)
+      B.MemMgr = &*MemMgr;
+    B.Resolvers.push_back(&*Resolver);
+    B.Resources.push_back(
+        llvm::make_unique<
+            SetResourcesImpl<MemoryManagerPtrT, SymbolResolverPtrT>>(
+            std::move(MemMgr), std::move(Resolver)));
+
+    Set.B = PendingBatch;
+    ModuleSetHandleT H = Sets.insert(Sets.end(), std::move(Set));
+    for (auto &S : H->Symbols)
+      SymbolOwners[S.first()].push_back(H);
+
+    if (B.Size >= MaxBatchSize)
+      flush();
+
+    return H;
+  }
+
+  /// @brief Remove the module set represented by the given handle. The code
+  ///        of its batch is freed once every set in the batch is removed.
+  void removeModuleSet(ModuleSetHandleT H) {
+    for (auto &S : H->Symbols) {
+      auto I = SymbolOwners.find(S.first());
+      auto &Owners = I->second;
+      Owners.erase(std::find(Owners.begin(), Owners.end(), H));
+      if (Owners.empty())
+        SymbolOwners.erase(I);
+    }
+
+    auto BI = H->B;
+    Sets.erase(H);
+    if (--(*BI)->NumSets)
+      return;
+    if ((*BI)->EmitState == Batch::Emitted)
+      BaseLayer.removeModuleSet((*BI)->Handle);
+    if (BI == PendingBatch)
+      PendingBatch = Batches.end();
+    Batches.erase(BI);
+  }
+
+  /// @brief Search for the given named symbol.
+  /// @param Name The name of the symbol to search for.
+  /// @param ExportedSymbolsOnly If true, search only for exported symbols.
+  /// @return A handle for the given named symbol, if it exists.
+  JITSymbol findSymbol(const std::string &Name, bool ExportedSymbolsOnly) {
+    // As in the base layers, the earliest definition wins.
+    auto I = SymbolOwners.find(Name);
+    if (I == SymbolOwners.end())
+      return nullptr;
+    return findSymbolIn(I->second.front(), Name, ExportedSymbolsOnly);
+  }
+
+  /// @brief Get the address of the given symbol in the context of the set of
+  ///        modules represented by the handle H. If the set's batch has not
+  ///        been emitted yet, it is emitted when the address is requested.
+  JITSymbol findSymbolIn(ModuleSetHandleT H, const std::string &Name,
+                         bool ExportedSymbolsOnly) {
+    auto I = H->Symbols.find(Name);
+    if (I == H->Symbols.end())
+      return nullptr;
+    JITSymbolFlags Flags = I->second;
+    if (ExportedSymbolsOnly && !JITSymbolBase(Flags).isExported())
+      return nullptr;
+
+    auto BI = H->B;
+    switch ((*BI)->EmitState) {
+    case Batch::NotEmitted: {
+      // FIXME: Use capture-init when we move to C++14.
+      std::string PName = Name;
+      auto GetAddress = [this, BI, PName]() -> TargetAddress {
+        if ((*BI)->EmitState == Batch::Emitting)
+          return 0;
+        if ((*BI)->EmitState == Batch::NotEmitted)
+          emitBatch(BI);
+        return BaseLayer.findSymbolIn((*BI)->Handle, PName, false)
+            .getAddress();
+      };
+      return JITSymbol(std::move(GetAddress), Flags);
+    }
+    case Batch::Emitting:
+      // Emitting the batch can look up external symbols, but the batch's own
+      // definitions are already visible to the linker.
+      return nullptr;
+    case Batch::Emitted:
+      return BaseLayer.findSymbolIn((*BI)->Handle, Name, false);
+    }
+    llvm_unreachable("Invalid emit-state.");
+  }
+
+  /// @brief Immediately emit and finalize the batch containing the module set
+  ///        represented by the given handle.
+  /// @param H Handle for module set to emit/finalize.
+  void emitAndFinalize(ModuleSetHandleT H) {
+    auto BI = H->B;
+    assert((*BI)->EmitState != Batch::Emitting &&
+           "Cannot emitAndFinalize while already emitting");
+    if ((*BI)->EmitState == Batch::NotEmitted)
+      emitBatch(BI);
+    BaseLayer.emitAndFinalize((*BI)->Handle);
+  }
+
+  /// @brief Emit the pending batch, if any, to the base layer.
+  void flush() {
+    if (PendingBatch != Batches.end())
+      emitBatch(PendingBatch);
+  }
+
+private:
+  static void addDefinitions(StringMap<JITSymbolFlags> &Symbols,
+                             const Module &M) {
+    Mangler Mang;
+    auto AddGV = [&](const GlobalValue &GV) {
+      if (GV.isDeclaration() || GV.hasLocalLinkage() || !GV.hasName())
+        return;
+      std::string MangledName;
+      {
+        raw_string_ostream MangledNameStream(MangledName);
+        Mang.getNameWithPrefix(MangledNameStream, &GV, false);
+      }
+      Symbols[MangledName] = JITSymbolBase::flagsFromGlobalValue(GV);
+    };
+    for (const auto &F : M)
+      AddGV(F);
+    for (const auto &GV : M.globals())
+      AddGV(GV);
+    for (const auto &A : M.aliases())
+      AddGV(A);
+  }
+
+  template <typename ModuleSetT>
+  bool canJoinPendingBatch(const ModuleSetT &Ms,
+                           const StringMap<JITSymbolFlags> &Symbols) const {
+    const Batch &B = **PendingBatch;
+    if (!B.M)
+      return true;
+    for (auto &M : Ms)
+      if (&M->getContext() != &B.M->getContext() ||
+          M->getDataLayout() != B.M->getDataLayout() ||
+          M->getTargetTriple() != B.M->getTargetTriple())
+        return false;
+    for (auto &S : Symbols)
+      if (B.Definitions.count(S.first()))
+        return false;
+    return true;
+  }
+
+  void emitBatch(typename BatchListT::iterator BI) {
+    Batch &B = **BI;
+    assert(B.EmitState == Batch::NotEmitted && "Batch already emitted");
+    if (BI == PendingBatch)
+      PendingBatch = Batches.end();
+
+    B.EmitState = Batch::Emitting;
+    std::vector<std::unique_ptr<Module>> Ms;
+    if (B.M)
+      Ms.push_back(std::move(B.M));
+    B.Handle = BaseLayer.addModuleSet(std::move(Ms), B.MemMgr,
+                                      static_cast<RuntimeDyld::SymbolResolver *>(
+                                          &B));
+    B.EmitState = Batch::Emitted;
+  }
+
+  BaseLayerT &BaseLayer;
+  unsigned MaxBatchSize;
+  BatchListT Batches;
+  typename BatchListT::iterator PendingBatch;
+  BatchedSetListT Sets;
+  StringMap<SmallVector<ModuleSetHandleT, 1>> SymbolOwners;
+};
+
+} // End namespace orc.
+} // End namespace llvm.
+
+#endif // LLVM_EXECUTIONENGINE_ORC_BATCHINGLAYER_H
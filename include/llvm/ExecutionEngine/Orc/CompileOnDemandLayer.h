@@ -18,10 +18,24 @@
 #include "IndirectionUtils.h"
 #include "LambdaResolver.h"
 #include "LogicalDylib.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/thread.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <list>
+#include <map>
+#include <mutex>
 #include <set>
 
 #include "llvm/Support/Debug.h"
@@ -32,10 +46,26 @@ namespace orc {
 /// @brief Compile-on-demand layer.
 ///
 ///   When a module is added to this layer a stub is created for each of its
-/// function definitions. The stubs and other global values are immediately
-/// added to the layer below. When a stub is called it triggers the extraction
-/// of the function body from the original module. The extracted body is then
-/// compiled and executed.
+/// function definitions. The stubs are immediately added to the layer below.
+/// When a stub is called it triggers the extraction of the function body from
+/// the original module. The extracted body is then compiled and executed.
+///
+///   Global variable definitions are emitted lazily too. A global is added to
+/// the layer below, together with the globals its initializer refers to, when
+/// the first partition referring to it is emitted or when its address is
+/// looked up, so tables that no compiled code touches are never emitted.
+///
+///   Optionally, partitions can also be compiled on a set of background
+/// threads. Once a partition has been compiled its direct callees are queued
+/// for speculative compilation, so that by the time they are first called
+/// their stubs usually already point at compiled code. The thread that hits a
+/// stub still compiles the function itself if no background thread has
+/// started on it yet. With background threads, each partition is extracted
+/// from the shared source module under a layer-wide lock and then cloned into
+/// an LLVMContext owned by the compiling thread, which compiles it without
+/// holding the lock. Several partitions can therefore be compiled at once,
+/// provided that the base layer accepts modules from several threads, e.g. an
+/// IRCompileLayer with concurrent compiles enabled.
 template <typename BaseLayerT, typename CompileCallbackMgrT,
           typename PartitioningFtor =
             std::function<std::set<Function*>(Function&)>>
@@ -79,6 +109,13 @@ private:
   struct LogicalModuleResources {
     std::shared_ptr<Module> SourceModule;
     std::set<const Function*> StubsToClone;
+    // Global variables of SourceModule whose definitions have not been
+    // emitted yet, by mangled name.
+    StringMap<GlobalVariable*> PendingGlobals;
+    // Memory manager shared by all the modules emitted by emitGlobals for
+    // this logical module, so that small variables emitted one partition at
+    // a time share pages instead of taking a fresh allocation each.
+    std::unique_ptr<RuntimeDyld::MemoryManager> GlobalsMemMgr;
   };
 
   struct LogicalDylibResources {
@@ -94,15 +131,69 @@ private:
   typedef typename CODLogicalDylib::LogicalModuleHandle LogicalModuleHandle;
   typedef std::list<CODLogicalDylib> LogicalDylibList;
 
+  // Where a function definition is in being compiled, when compile threads
+  // are in use.
+  enum class CompileStatus { NotStarted, Queued, Compiling, Done };
+
+  struct FunctionCompileState {
+    CODLogicalDylib *LD;
+    LogicalModuleHandle LMH;
+    CompileStatus Status;
+    // How many speculative steps away from a called function this one was
+    // queued. Functions compiled because their stub was hit have depth 0.
+    unsigned Depth;
+    TargetAddress Addr;
+  };
+
 public:
   /// @brief Handle to a set of loaded modules.
   typedef typename LogicalDylibList::iterator ModuleSetHandleT;
 
+  /// @brief Builder for the memory manager of each module set this layer
+  ///        adds to the base layer.
+  typedef std::function<std::unique_ptr<RuntimeDyld::MemoryManager>()>
+    MemoryManagerBuilderT;
+
   /// @brief Construct a compile-on-demand layer instance.
+  ///
+  /// @param NumCompileThreads If non-zero, start this many background threads
+  ///        to compile partitions on. Ignored if LLVM was built without thread
+  ///        support. BaseLayer.addModuleSet must then be safe to call from
+  ///        several threads at once.
+  /// @param SpeculationDepth How many levels of direct callees of a compiled
+  ///        partition to queue for compilation on the background threads.
+  ///        The background threads only do speculative work, so none are
+  ///        started if this is zero.
   CompileOnDemandLayer(BaseLayerT &BaseLayer, CompileCallbackMgrT &CallbackMgr,
-                       bool CloneStubsIntoPartitions)
+                       bool CloneStubsIntoPartitions,
+                       unsigned NumCompileThreads = 0,
+                       unsigned SpeculationDepth = 0)
       : BaseLayer(BaseLayer), CompileCallbackMgr(CallbackMgr),
-        CloneStubsIntoPartitions(CloneStubsIntoPartitions) {}
+        CloneStubsIntoPartitions(CloneStubsIntoPartitions),
+        SpeculationDepth(SpeculationDepth), ShuttingDown(false) {
+#if LLVM_ENABLE_THREADS
+    if (SpeculationDepth != 0)
+      for (unsigned I = 0; I != NumCompileThreads; ++I)
+        CompileThreads.push_back(
+          llvm::thread([this]() { this->runCompileThread(); }));
+#endif
+  }
+
+  ~CompileOnDemandLayer() {
+    {
+      std::lock_guard<std::mutex> Lock(StateMutex);
+      ShuttingDown = true;
+    }
+    WorkAvailable.notify_all();
+    for (auto &T : CompileThreads)
+      T.join();
+  }
+
+  /// @brief Build the memory managers of the module sets added to the base
+  ///        layer with Builder. By default each gets a SectionMemoryManager.
+  void setMemoryManagerBuilder(MemoryManagerBuilderT Builder) {
+    BuildMemoryManager = std::move(Builder);
+  }
 
   /// @brief Add a module to the compile-on-demand layer.
   template <typename ModuleSetT, typename MemoryManagerPtrT,
@@ -114,6 +205,7 @@ public:
     assert(MemMgr == nullptr &&
            "User supplied memory managers not supported with COD yet.");
 
+    MutexGuard Lock(IRLock);
     LogicalDylibs.push_back(CODLogicalDylib(BaseLayer));
     auto &LDResources = LogicalDylibs.back().getDylibResources();
 
@@ -142,6 +234,35 @@ public:
   ///   This will remove all modules in the layers below that were derived from
   /// the module represented by H.
   void removeModuleSet(ModuleSetHandleT H) {
+    if (!CompileThreads.empty()) {
+      std::unique_lock<std::mutex> Lock(StateMutex);
+      CODLogicalDylib *LD = &*H;
+
+      // Drop queued work for this dylib and wait for compiles already under
+      // way to finish before its modules go away.
+      CompileQueue.erase(
+        std::remove_if(CompileQueue.begin(), CompileQueue.end(),
+                       [&](Function *F) {
+                         auto I = FunctionStates.find(F);
+                         return I != FunctionStates.end() &&
+                                I->second.LD == LD;
+                       }),
+        CompileQueue.end());
+      FunctionCompiled.wait(Lock, [&]() {
+        for (const auto &KV : FunctionStates)
+          if (KV.second.LD == LD &&
+              KV.second.Status == CompileStatus::Compiling)
+            return false;
+        return true;
+      });
+      for (auto I = FunctionStates.begin(), E = FunctionStates.end(); I != E;)
+        if (I->second.LD == LD)
+          FunctionStates.erase(I++);
+        else
+          ++I;
+    }
+
+    MutexGuard Lock(IRLock);
     LogicalDylibs.erase(H);
   }
 
@@ -150,18 +271,166 @@ public:
   /// @param ExportedSymbolsOnly If true, search only for exported symbols.
   /// @return A handle for the given named symbol, if it exists.
   JITSymbol findSymbol(StringRef Name, bool ExportedSymbolsOnly) {
-    return BaseLayer.findSymbol(Name, ExportedSymbolsOnly);
+    MutexGuard Lock(IRLock);
+    if (auto Sym = BaseLayer.findSymbol(Name, ExportedSymbolsOnly))
+      return lockSymbol(Sym);
+    for (auto &LD : LogicalDylibs)
+      if (auto Sym = findPendingGlobal(LD, Name, ExportedSymbolsOnly))
+        return Sym;
+    return nullptr;
   }
 
   /// @brief Get the address of a symbol provided by this layer, or some layer
   ///        below this one.
   JITSymbol findSymbolIn(ModuleSetHandleT H, const std::string &Name,
                          bool ExportedSymbolsOnly) {
-    return H->findSymbol(Name, ExportedSymbolsOnly);
+    MutexGuard Lock(IRLock);
+    if (auto Sym = H->findSymbol(Name, ExportedSymbolsOnly))
+      return lockSymbol(Sym);
+    return findPendingGlobal(*H, Name, ExportedSymbolsOnly);
   }
 
 private:
 
+  std::unique_ptr<RuntimeDyld::MemoryManager> createMemoryManager() {
+    if (BuildMemoryManager)
+      return BuildMemoryManager();
+    return llvm::make_unique<SectionMemoryManager>();
+  }
+
+  // Materializing a symbol may link objects in the base layer, which must not
+  // race with the compile threads adding partitions to it.
+  JITSymbol lockSymbol(JITSymbol Sym) {
+    if (CompileThreads.empty() || !Sym)
+      return Sym;
+    JITSymbolFlags Flags = Sym.getFlags();
+    return JITSymbol(
+      [this, Sym]() mutable {
+        MutexGuard Lock(IRLock);
+        return Sym.getAddress();
+      },
+      Flags);
+  }
+
+  // Look for Name among the global variables of LD that have not been
+  // emitted yet. Asking for the address of the returned symbol emits the
+  // variable. Must be called with IRLock held.
+  JITSymbol findPendingGlobal(CODLogicalDylib &LD, const std::string &Name,
+                              bool ExportedSymbolsOnly) {
+    for (auto LMH = LD.logicalModulesBegin(), E = LD.logicalModulesEnd();
+         LMH != E; ++LMH) {
+      auto &PendingGlobals = LD.getLogicalModuleResources(LMH).PendingGlobals;
+      auto I = PendingGlobals.find(Name);
+      if (I == PendingGlobals.end())
+        continue;
+      GlobalVariable *GV = I->second;
+      JITSymbolFlags Flags = JITSymbolBase::flagsFromGlobalValue(*GV);
+      if (ExportedSymbolsOnly &&
+          (Flags & JITSymbolFlags::Exported) != JITSymbolFlags::Exported)
+        return nullptr;
+      return JITSymbol(
+        [this, &LD, LMH, GV, Name]() {
+          MutexGuard Lock(IRLock);
+          emitGlobals(LD, LMH, GV);
+          return LD.findSymbolInLogicalModule(LMH, Name).getAddress();
+        },
+        Flags);
+    }
+    return nullptr;
+  }
+
+  // Resolve Name for a module emitted for logical module LMH.
+  JITSymbol findSymbolForEmittedModule(CODLogicalDylib &LD,
+                                       LogicalModuleHandle LMH,
+                                       const std::string &Name) {
+    if (auto Symbol = LD.findSymbolInternally(LMH, Name))
+      return Symbol;
+    return findPendingGlobal(LD, Name, false);
+  }
+
+  // Find the global variables that are referenced by C and still have to be
+  // emitted, without looking through function references: those go through
+  // stubs, which are always emitted.
+  static void findPendingGlobals(const Constant *C,
+                                 std::vector<GlobalVariable*> &Pending,
+                                 SmallPtrSetImpl<const Constant*> &Visited) {
+    if (isa<Function>(C) || !Visited.insert(C).second)
+      return;
+    if (auto *GV = dyn_cast<GlobalVariable>(C)) {
+      if (GV->hasInitializer())
+        Pending.push_back(const_cast<GlobalVariable*>(GV));
+      return;
+    }
+    if (isa<GlobalValue>(C))
+      return;
+    for (const Use &Op : C->operands())
+      if (auto *OpC = dyn_cast<Constant>(Op))
+        findPendingGlobals(OpC, Pending, Visited);
+  }
+
+  // Emit the global variables in Roots that have not been emitted yet, and
+  // those their initializers refer to, as one module in the layer below.
+  // Must be called with IRLock held.
+  void emitGlobals(CODLogicalDylib &LD, LogicalModuleHandle LMH,
+                   ArrayRef<GlobalVariable*> Roots) {
+    auto &LMResources = LD.getLogicalModuleResources(LMH);
+    Module &SrcM = *LMResources.SourceModule;
+
+    std::vector<GlobalVariable*> Worklist;
+    std::vector<GlobalVariable*> Globals;
+    SmallPtrSet<const Constant*, 16> Visited;
+    for (auto *GV : reverse(Roots))
+      if (Visited.insert(GV).second)
+        Worklist.push_back(GV);
+    while (!Worklist.empty()) {
+      GlobalVariable *GV = Worklist.back();
+      Worklist.pop_back();
+      // Variables leave PendingGlobals once they have been emitted.
+      if (GV->getParent() != &SrcM ||
+          !LMResources.PendingGlobals.count(Mangle(GV->getName(),
+                                                   SrcM.getDataLayout())))
+        continue;
+      Globals.push_back(GV);
+      findPendingGlobals(GV->getInitializer(), Worklist, Visited);
+    }
+    if (Globals.empty())
+      return;
+
+    auto M = llvm::make_unique<Module>(
+               (SrcM.getName() + ".globals." + Globals.front()->getName()).str(),
+               SrcM.getContext());
+    M->setDataLayout(SrcM.getDataLayout());
+    ValueToValueMapTy VMap;
+    GlobalDeclMaterializer GDM(*M);
+    for (auto *GV : Globals)
+      cloneGlobalVariableDecl(*M, *GV, &VMap);
+    for (auto *GV : Globals) {
+      moveGlobalVariableInitializer(*GV, VMap, &GDM);
+      LMResources.PendingGlobals.erase(Mangle(GV->getName(),
+                                              SrcM.getDataLayout()));
+    }
+
+    auto Resolver = createLambdaResolver(
+        [this, &LD, LMH](const std::string &Name) {
+          if (auto Symbol = findSymbolForEmittedModule(LD, LMH, Name))
+            return RuntimeDyld::SymbolInfo(Symbol.getAddress(),
+                                           Symbol.getFlags());
+          return LD.getDylibResources().ExternalSymbolResolver(Name);
+        },
+        [](const std::string &Name) {
+          return RuntimeDyld::SymbolInfo(nullptr);
+        });
+    std::vector<std::unique_ptr<Module>> GlobalsMSet;
+    GlobalsMSet.push_back(std::move(M));
+    if (!LMResources.GlobalsMemMgr)
+      LMResources.GlobalsMemMgr = createMemoryManager();
+    auto GlobalsH =
+      BaseLayer.addModuleSet(std::move(GlobalsMSet),
+                             LMResources.GlobalsMemMgr.get(),
+                             std::move(Resolver));
+    LD.addToLogicalModule(LMH, GlobalsH);
+  }
+
   void addLogicalModule(CODLogicalDylib &LD, std::shared_ptr<Module> SrcM) {
 
     // Bump the linkage and rename any anonymous/privote members in SrcM to
@@ -194,6 +463,16 @@ private:
       if (CloneStubsIntoPartitions)
         LMResources.StubsToClone.insert(&F);
 
+      if (!CompileThreads.empty()) {
+        std::lock_guard<std::mutex> Lock(StateMutex);
+        FunctionCompileState &State = FunctionStates[&F];
+        State.LD = &LD;
+        State.LMH = LMH;
+        State.Status = CompileStatus::NotStarted;
+        State.Depth = 0;
+        State.Addr = 0;
+      }
+
       // For each definition: create a callback, a stub, and a function body
       // pointer. Initialize the function body pointer to point at the callback,
       // and set the callback to compile the function body.
@@ -207,24 +486,34 @@ private:
       makeStub(*StubF, *FnBodyPtr);
       CCInfo.setCompileAction(
         [this, &LD, LMH, &F]() {
-          return this->extractAndCompile(LD, LMH, F);
+          return this->compileFunction(LD, LMH, F);
         });
     }
 
-    // Now clone the global variable declarations.
+    // Global variable definitions are left in the source module until they
+    // are referenced, except for the llvm.* variables, which code never
+    // refers to. Clone those into the stubs module now.
     GlobalDeclMaterializer GDMat(*GVsAndStubsM);
-    for (auto &GV : SrcM->globals())
-      if (!GV.isDeclaration())
+    std::vector<GlobalVariable*> IntrinsicGlobals;
+    for (auto &GV : SrcM->globals()) {
+      if (GV.isDeclaration())
+        continue;
+      if (GV.getName().startswith("llvm.")) {
         cloneGlobalVariableDecl(*GVsAndStubsM, GV, &VMap);
-
-    // Then clone the initializers.
-    for (auto &GV : SrcM->globals())
-      if (!GV.isDeclaration())
-        moveGlobalVariableInitializer(GV, VMap, &GDMat);
+        IntrinsicGlobals.push_back(&GV);
+      } else
+        LMResources.PendingGlobals[Mangle(GV.getName(),
+                                          SrcM->getDataLayout())] = &GV;
+    }
+    for (auto *GV : IntrinsicGlobals)
+      moveGlobalVariableInitializer(*GV, VMap, &GDMat);
 
     // Build a resolver for the stubs module and add it to the base layer.
     auto GVsAndStubsResolver = createLambdaResolver(
-        [&LD](const std::string &Name) {
+        [this, &LD, LMH](const std::string &Name) {
+          if (auto Symbol = findSymbolForEmittedModule(LD, LMH, Name))
+            return RuntimeDyld::SymbolInfo(Symbol.getAddress(),
+                                           Symbol.getFlags());
           return LD.getDylibResources().ExternalSymbolResolver(Name);
         },
         [](const std::string &Name) {
@@ -235,7 +524,7 @@ private:
     GVsAndStubsMSet.push_back(std::move(GVsAndStubsM));
     auto GVsAndStubsH =
       BaseLayer.addModuleSet(std::move(GVsAndStubsMSet),
-                             llvm::make_unique<SectionMemoryManager>(),
+                             createMemoryManager(),
                              std::move(GVsAndStubsResolver));
     LD.addToLogicalModule(LMH, GVsAndStubsH);
   }
@@ -249,20 +538,195 @@ private:
     return MangledName;
   }
 
+  // Compile F for a call through its stub on the executing thread.
+  TargetAddress compileFunction(CODLogicalDylib &LD, LogicalModuleHandle LMH,
+                                Function &F) {
+    if (CompileThreads.empty()) {
+      MutexGuard Lock(IRLock);
+      return extractAndCompile(LD, LMH, F);
+    }
+
+    {
+      std::unique_lock<std::mutex> Lock(StateMutex);
+      auto I = FunctionStates.find(&F);
+      assert(I != FunctionStates.end() && "Called a removed function");
+      FunctionCompileState &State = I->second;
+      // If a compile thread is already working on F, wait for it.
+      FunctionCompiled.wait(Lock, [&]() {
+        return State.Status != CompileStatus::Compiling;
+      });
+      if (State.Status == CompileStatus::Done)
+        return State.Addr;
+      // Otherwise compile F here rather than wait for it to be dequeued.
+      State.Status = CompileStatus::Compiling;
+      State.Depth = 0;
+    }
+
+    // Compile in a context of our own, like the compile threads do, so that
+    // they are not held up while this thread generates code.
+    LLVMContext Ctx;
+    return compileClaimedFunction(F, Ctx);
+  }
+
+  // Compile F, which the calling thread has marked as Compiling, in Ctx, then
+  // queue its callees for speculative compilation.
+  TargetAddress compileClaimedFunction(Function &F, LLVMContext &Ctx) {
+    std::unique_lock<sys::Mutex> Lock(IRLock);
+    CODLogicalDylib *LD;
+    LogicalModuleHandle LMH;
+    unsigned Depth;
+    {
+      std::lock_guard<std::mutex> StateLock(StateMutex);
+      FunctionCompileState &State = FunctionStates.find(&F)->second;
+      // F may have been compiled as part of another function's partition
+      // while this thread waited for the lock.
+      if (State.Status == CompileStatus::Done)
+        return State.Addr;
+      LD = State.LD;
+      LMH = State.LMH;
+      Depth = State.Depth;
+    }
+
+    // If F's body is gone, another thread has extracted it as part of its own
+    // partition and is still compiling it.
+    if (F.isDeclaration()) {
+      Lock.unlock();
+      return waitForFunction(F);
+    }
+
+    auto Partition = LD->getDylibResources().Partitioner(F);
+    std::vector<Function*> Callees;
+    if (Depth < SpeculationDepth)
+      findCallees(Partition, Callees);
+
+    // Claim the rest of the partition too, so that calls through the other
+    // stubs wait for this compile instead of finding the bodies gone.
+    {
+      std::lock_guard<std::mutex> StateLock(StateMutex);
+      for (auto *SubF : Partition) {
+        auto I = FunctionStates.find(SubF);
+        if (I != FunctionStates.end() &&
+            I->second.Status != CompileStatus::Done)
+          I->second.Status = CompileStatus::Compiling;
+      }
+    }
+
+    // Move the partition into Ctx and compile it there without the lock, so
+    // that other threads can extract and compile partitions meanwhile. The
+    // partition is serialized to bitcode while the lock is held, since it
+    // lives in the shared context, and read back into Ctx after.
+    SmallVector<char, 0> BC;
+    {
+      auto SrcPartM = extractPartition(*LD, LMH, Partition);
+      raw_svector_ostream BCOS(BC);
+      WriteBitcodeToFile(SrcPartM.get(), BCOS);
+    }
+    Lock.unlock();
+    ErrorOr<std::unique_ptr<Module>> PartMOrErr = parseBitcodeFile(
+        MemoryBufferRef(StringRef(BC.data(), BC.size()), "<partition>"), Ctx);
+    if (!PartMOrErr)
+      report_fatal_error("Failed to read partition bitcode");
+    auto PartitionH = addPartition(*LD, LMH, std::move(*PartMOrErr));
+    Lock.lock();
+    TargetAddress Addr = updateBodyPointers(*LD, LMH, PartitionH, Partition, F);
+    Lock.unlock();
+
+    if (!Callees.empty()) {
+      std::lock_guard<std::mutex> StateLock(StateMutex);
+      for (auto *Callee : Callees) {
+        auto I = FunctionStates.find(Callee);
+        if (I == FunctionStates.end() ||
+            I->second.Status != CompileStatus::NotStarted)
+          continue;
+        I->second.Status = CompileStatus::Queued;
+        I->second.Depth = Depth + 1;
+        CompileQueue.push_back(Callee);
+      }
+      WorkAvailable.notify_all();
+    }
+
+    return Addr;
+  }
+
+  // Wait until another thread has finished compiling F and return its
+  // address.
+  TargetAddress waitForFunction(Function &F) {
+    std::unique_lock<std::mutex> Lock(StateMutex);
+    auto I = FunctionStates.end();
+    FunctionCompiled.wait(Lock, [&]() {
+      I = FunctionStates.find(&F);
+      return I == FunctionStates.end() ||
+             I->second.Status == CompileStatus::Done;
+    });
+    return I != FunctionStates.end() ? I->second.Addr : 0;
+  }
+
+  void runCompileThread() {
+    // Partitions are compiled in this thread's own context.
+    LLVMContext Ctx;
+    while (true) {
+      Function *F;
+      {
+        std::unique_lock<std::mutex> Lock(StateMutex);
+        WorkAvailable.wait(Lock, [this]() {
+          return ShuttingDown || !CompileQueue.empty();
+        });
+        if (ShuttingDown)
+          return;
+        F = CompileQueue.front();
+        CompileQueue.pop_front();
+        // The executing thread may have claimed F while it was queued.
+        auto I = FunctionStates.find(F);
+        if (I == FunctionStates.end() ||
+            I->second.Status != CompileStatus::Queued)
+          continue;
+        I->second.Status = CompileStatus::Compiling;
+      }
+      compileClaimedFunction(*F, Ctx);
+    }
+  }
+
+  // Collect the direct callees of the functions in Partition that are still
+  // to be compiled. Must be called before the bodies are moved out of the
+  // source module.
+  template <typename PartitionT>
+  static void findCallees(const PartitionT &Partition,
+                          std::vector<Function*> &Callees) {
+    for (auto *SubF : Partition)
+      for (auto &BB : *SubF)
+        for (auto &I : BB) {
+          CallSite CS(&I);
+          if (!CS)
+            continue;
+          Function *Callee = CS.getCalledFunction();
+          if (Callee && !Callee->isDeclaration() && !Partition.count(Callee))
+            Callees.push_back(Callee);
+        }
+  }
+
+  // Compile F's partition on the calling thread. Must be called with IRLock
+  // held.
   TargetAddress extractAndCompile(CODLogicalDylib &LD,
                                   LogicalModuleHandle LMH,
                                   Function &F) {
-    Module &SrcM = *LD.getLogicalModuleResources(LMH).SourceModule;
-
     // If F is a declaration we must already have compiled it.
     if (F.isDeclaration())
       return 0;
 
-    // Grab the name of the function being called here.
-    std::string CalledFnName = Mangle(F.getName(), SrcM.getDataLayout());
-
     auto Partition = LD.getDylibResources().Partitioner(F);
-    auto PartitionH = emitPartition(LD, LMH, Partition);
+    auto PartitionH =
+      addPartition(LD, LMH, extractPartition(LD, LMH, Partition));
+    return updateBodyPointers(LD, LMH, PartitionH, Partition, F);
+  }
+
+  // Point the stubs of the functions in Partition at their compiled bodies
+  // and return the address of F's body. Must be called with IRLock held.
+  template <typename PartitionT>
+  TargetAddress updateBodyPointers(CODLogicalDylib &LD,
+                                   LogicalModuleHandle LMH,
+                                   BaseLayerModuleSetHandleT PartitionH,
+                                   const PartitionT &Partition, Function &F) {
+    Module &SrcM = *LD.getLogicalModuleResources(LMH).SourceModule;
 
     TargetAddress CalledAddr = 0;
     for (auto *SubF : Partition) {
@@ -287,19 +751,49 @@ private:
       if (SubF == &F)
         CalledAddr = FnBodyAddr;
 
+      // Other threads may be calling through the stub while it is patched.
+      // Make sure the body is visible to them before the pointer to it is.
+      if (!CompileThreads.empty())
+        std::atomic_thread_fence(std::memory_order_release);
       memcpy(FnPtrAddr, &FnBodyAddr, sizeof(uintptr_t));
+
+      if (!CompileThreads.empty()) {
+        std::lock_guard<std::mutex> Lock(StateMutex);
+        auto I = FunctionStates.find(SubF);
+        if (I != FunctionStates.end()) {
+          I->second.Status = CompileStatus::Done;
+          I->second.Addr = FnBodyAddr;
+        }
+      }
     }
 
+    if (!CompileThreads.empty())
+      FunctionCompiled.notify_all();
+
     return CalledAddr;
   }
 
+  // Move the bodies of the functions in Partition out of the source module
+  // into a new module, emitting the global variables they refer to first.
+  // Must be called with IRLock held.
   template <typename PartitionT>
-  BaseLayerModuleSetHandleT emitPartition(CODLogicalDylib &LD,
-                                          LogicalModuleHandle LMH,
-                                          const PartitionT &Partition) {
+  std::unique_ptr<Module> extractPartition(CODLogicalDylib &LD,
+                                           LogicalModuleHandle LMH,
+                                           const PartitionT &Partition) {
     auto &LMResources = LD.getLogicalModuleResources(LMH);
     Module &SrcM = *LMResources.SourceModule;
 
+    // Emit the global variables the partition refers to first.
+    std::vector<GlobalVariable*> Globals;
+    SmallPtrSet<const Constant*, 16> Visited;
+    for (auto *F : Partition)
+      for (auto &BB : *F)
+        for (auto &I : BB)
+          for (const Use &Op : I.operands())
+            if (auto *C = dyn_cast<Constant>(Op))
+              findPendingGlobals(C, Globals, Visited);
+    emitGlobals(LD, LMH, Globals);
+
     // Create the module.
     std::string NewName = SrcM.getName();
     for (auto *F : Partition) {
@@ -320,17 +814,25 @@ private:
     for (auto *F : Partition)
       moveFunctionBody(*F, VMap, &GDM);
 
+    return M;
+  }
+
+  // Add a partition module built by extractPartition, possibly cloned into
+  // another context, to the base layer.
+  BaseLayerModuleSetHandleT addPartition(CODLogicalDylib &LD,
+                                         LogicalModuleHandle LMH,
+                                         std::unique_ptr<Module> M) {
     // Create memory manager and symbol resolver.
-    auto MemMgr = llvm::make_unique<SectionMemoryManager>();
+    auto MemMgr = createMemoryManager();
     auto Resolver = createLambdaResolver(
         [this, &LD, LMH](const std::string &Name) {
-          if (auto Symbol = LD.findSymbolInternally(LMH, Name))
+          if (auto Symbol = findSymbolForEmittedModule(LD, LMH, Name))
             return RuntimeDyld::SymbolInfo(Symbol.getAddress(),
                                            Symbol.getFlags());
           return LD.getDylibResources().ExternalSymbolResolver(Name);
         },
         [this, &LD, LMH](const std::string &Name) {
-          if (auto Symbol = LD.findSymbolInternally(LMH, Name))
+          if (auto Symbol = findSymbolForEmittedModule(LD, LMH, Name))
             return RuntimeDyld::SymbolInfo(Symbol.getAddress(),
                                            Symbol.getFlags());
           return RuntimeDyld::SymbolInfo(nullptr);
@@ -345,6 +847,22 @@ private:
   CompileCallbackMgrT &CompileCallbackMgr;
   LogicalDylibList LogicalDylibs;
   bool CloneStubsIntoPartitions;
+  MemoryManagerBuilderT BuildMemoryManager;
+
+  // Serializes work on the source modules, on the layer's bookkeeping and on
+  // the base layer, except for compiling partitions in a thread's own context.
+  sys::Mutex IRLock;
+
+  // Guards the compile state, the queue and ShuttingDown. May be acquired
+  // while holding IRLock, but not the other way around.
+  std::mutex StateMutex;
+  std::condition_variable WorkAvailable;
+  std::condition_variable FunctionCompiled;
+  std::map<const Function*, FunctionCompileState> FunctionStates;
+  std::deque<Function*> CompileQueue;
+  unsigned SpeculationDepth;
+  bool ShuttingDown;
+  std::vector<llvm::thread> CompileThreads;
 };
 
 } // End namespace orc.
@@ -19,6 +19,11 @@
 #include "llvm/MC/MCContext.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Target/TargetMachine.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 namespace llvm {
 namespace orc {
@@ -41,7 +46,8 @@ public:
       llvm_unreachable("Target does not support MC emission.");
     PM.run(M);
     std::unique_ptr<MemoryBuffer> ObjBuffer(
-        new ObjectMemoryBuffer(std::move(ObjBufferSV)));
+        new ObjectMemoryBuffer(std::move(ObjBufferSV),
+                               M.getModuleIdentifier()));
     ErrorOr<std::unique_ptr<object::ObjectFile>> Obj =
         object::ObjectFile::createObjectFile(ObjBuffer->getMemBufferRef());
     // TODO: Actually report errors helpfully.
@@ -55,6 +61,44 @@ private:
   TargetMachine &TM;
 };
 
+/// @brief Compile functor that may be called from several threads at once.
+///
+///   A TargetMachine cannot generate code for two modules at the same time,
+/// so each calling thread compiles with a TargetMachine of its own, created by
+/// the given builder on the thread's first call. Copies of the functor share
+/// the TargetMachines.
+class ConcurrentIRCompiler {
+public:
+  typedef std::function<std::unique_ptr<TargetMachine>()> TMBuilder;
+
+  /// @brief Construct a concurrent compile functor.
+  ConcurrentIRCompiler(TMBuilder BuildTM)
+      : State(std::make_shared<SharedState>(std::move(BuildTM))) {}
+
+  /// @brief Compile a Module to an ObjectFile.
+  object::OwningBinary<object::ObjectFile> operator()(Module &M) const {
+    return SimpleCompiler(getTargetMachine())(M);
+  }
+
+private:
+  struct SharedState {
+    SharedState(TMBuilder BuildTM) : BuildTM(std::move(BuildTM)) {}
+    TMBuilder BuildTM;
+    std::mutex Mutex;
+    std::map<std::thread::id, std::unique_ptr<TargetMachine>> TMs;
+  };
+
+  TargetMachine &getTargetMachine() const {
+    std::lock_guard<std::mutex> Lock(State->Mutex);
+    std::unique_ptr<TargetMachine> &TM = State->TMs[std::this_thread::get_id()];
+    if (!TM)
+      TM = State->BuildTM();
+    return *TM;
+  }
+
+  std::shared_ptr<SharedState> State;
+};
+
 } // End namespace orc.
 } // End namespace llvm.
 
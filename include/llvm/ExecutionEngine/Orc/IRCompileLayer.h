@@ -15,10 +15,13 @@
 #define LLVM_EXECUTIONENGINE_ORC_IRCOMPILELAYER_H
 
 #include "JITSymbol.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Mutex.h"
 #include <memory>
+#include <mutex>
 
 namespace llvm {
 namespace orc {
@@ -47,11 +50,26 @@ public:
   /// @brief Construct an IRCompileLayer with the given BaseLayer, which must
   ///        implement the ObjectLayer concept.
   IRCompileLayer(BaseLayerT &BaseLayer, CompileFtor Compile)
-      : BaseLayer(BaseLayer), Compile(std::move(Compile)), ObjCache(nullptr) {}
+      : BaseLayer(BaseLayer), Compile(std::move(Compile)), ObjCache(nullptr),
+        Listener(nullptr), ConcurrentCompiles(false) {}
 
   /// @brief Set an ObjectCache to query before compiling.
   void setObjectCache(ObjectCache *NewCache) { ObjCache = NewCache; }
 
+  /// @brief Set a listener to report the time spent compiling modules to.
+  void setEventListener(JITEventListener *NewListener) {
+    Listener = NewListener;
+  }
+
+  /// @brief Allow modules to be added from several threads at once.
+  ///
+  ///   Modules are then compiled without holding a lock, so the compile
+  /// functor must be safe to call concurrently (see ConcurrentIRCompiler), and
+  /// modules added at the same time must live in different LLVMContexts. Work
+  /// on the base layer, including the linking done when a symbol's address is
+  /// first requested, and object cache queries are still serialized.
+  void setConcurrentCompiles(bool Value) { ConcurrentCompiles = Value; }
+
   /// @brief Compile each module in the given module set, then add the resulting
   ///        set of objects to the base layer along with the memory manager and
   ///        symbol resolver.
@@ -69,19 +87,28 @@ public:
       std::unique_ptr<object::ObjectFile> Object;
       std::unique_ptr<MemoryBuffer> Buffer;
 
-      if (ObjCache)
+      if (ObjCache) {
+        auto Lock = lockBaseLayer();
         std::tie(Object, Buffer) = tryToLoadFromObjectCache(*M).takeBinary();
+      }
 
       if (!Object) {
+        JITCompilePhaseTimer Timer(JITEventListener::CodeGenPhase,
+                                   M->getModuleIdentifier(), getListeners());
         std::tie(Object, Buffer) = Compile(*M).takeBinary();
-        if (ObjCache)
+        if (Buffer)
+          Timer.setSize(Buffer->getBufferSize());
+        if (ObjCache) {
+          auto Lock = lockBaseLayer();
           ObjCache->notifyObjectCompiled(&*M, Buffer->getMemBufferRef());
+        }
       }
 
       Objects.push_back(std::move(Object));
       Buffers.push_back(std::move(Buffer));
     }
 
+    auto Lock = lockBaseLayer();
     ModuleSetHandleT H =
       BaseLayer.addObjectSet(Objects, std::move(MemMgr), std::move(Resolver));
 
@@ -91,14 +118,18 @@ public:
   }
 
   /// @brief Remove the module set associated with the handle H.
-  void removeModuleSet(ModuleSetHandleT H) { BaseLayer.removeObjectSet(H); }
+  void removeModuleSet(ModuleSetHandleT H) {
+    auto Lock = lockBaseLayer();
+    BaseLayer.removeObjectSet(H);
+  }
 
   /// @brief Search for the given named symbol.
   /// @param Name The name of the symbol to search for.
   /// @param ExportedSymbolsOnly If true, search only for exported symbols.
   /// @return A handle for the given named symbol, if it exists.
   JITSymbol findSymbol(const std::string &Name, bool ExportedSymbolsOnly) {
-    return BaseLayer.findSymbol(Name, ExportedSymbolsOnly);
+    auto Lock = lockBaseLayer();
+    return lockSymbol(BaseLayer.findSymbol(Name, ExportedSymbolsOnly));
   }
 
   /// @brief Get the address of the given symbol in the context of the set of
@@ -111,17 +142,48 @@ public:
   ///         given module set.
   JITSymbol findSymbolIn(ModuleSetHandleT H, const std::string &Name,
                          bool ExportedSymbolsOnly) {
-    return BaseLayer.findSymbolIn(H, Name, ExportedSymbolsOnly);
+    auto Lock = lockBaseLayer();
+    return lockSymbol(BaseLayer.findSymbolIn(H, Name, ExportedSymbolsOnly));
   }
 
   /// @brief Immediately emit and finalize the moduleOB set represented by the
   ///        given handle.
   /// @param H Handle for module set to emit/finalize.
   void emitAndFinalize(ModuleSetHandleT H) {
+    auto Lock = lockBaseLayer();
     BaseLayer.emitAndFinalize(H);
   }
 
 private:
+  // Holds BaseLayerMutex if compiles may run concurrently. The mutex is
+  // recursive, since linking may call back into this layer through the
+  // symbol resolvers.
+  std::unique_lock<sys::Mutex> lockBaseLayer() {
+    if (!ConcurrentCompiles)
+      return std::unique_lock<sys::Mutex>();
+    return std::unique_lock<sys::Mutex>(BaseLayerMutex);
+  }
+
+  // Linking happens when a symbol's address is first requested, so that has
+  // to be serialized too.
+  JITSymbol lockSymbol(JITSymbol Sym) {
+    if (!ConcurrentCompiles || !Sym)
+      return Sym;
+    JITSymbolFlags Flags = Sym.getFlags();
+    return JITSymbol(
+      [this, Sym]() mutable {
+        auto Lock = lockBaseLayer();
+        return Sym.getAddress();
+      },
+      Flags);
+  }
+
+  ArrayRef<JITEventListener *> getListeners() const {
+    if (!Listener)
+      return None;
+    return Listener;
+  }
+
   object::OwningBinary<object::ObjectFile>
   tryToLoadFromObjectCache(const Module &M) {
     std::unique_ptr<MemoryBuffer> ObjBuffer = ObjCache->getObject(&M);
@@ -140,6 +202,9 @@ private:
   BaseLayerT &BaseLayer;
   CompileFtor Compile;
   ObjectCache *ObjCache;
+  JITEventListener *Listener;
+  bool ConcurrentCompiles;
+  sys::Mutex BaseLayerMutex;
 };
 
 } // End namespace orc.
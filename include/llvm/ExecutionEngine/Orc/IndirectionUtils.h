@@ -282,8 +282,9 @@ GlobalVariable* cloneGlobalVariableDecl(Module &Dst, const GlobalVariable &GV,
 ///   If the target global declaration is not supplied via the NewGV parameter
 /// then it will be looked up via the VMap.
 ///
-///   This will delete the initializer of GV from its original parent module,
-/// but leave its declaration.
+///   The initializer of GV is left in its original parent module; callers
+/// that need to know which variables have been moved must track that
+/// themselves.
 void moveGlobalVariableInitializer(GlobalVariable &OrigGV,
                                    ValueToValueMapTy &VMap,
                                    ValueMaterializer *Materializer = nullptr,
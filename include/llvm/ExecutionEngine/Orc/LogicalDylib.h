@@ -64,6 +64,9 @@ public:
     return std::prev(LogicalModules.end());
   }
 
+  LogicalModuleHandle logicalModulesBegin() { return LogicalModules.begin(); }
+  LogicalModuleHandle logicalModulesEnd() { return LogicalModules.end(); }
+
   void addToLogicalModule(LogicalModuleHandle LMH,
                           BaseLayerModuleSetHandleT BaseLayerHandle) {
     LMH->BaseLayerHandles.push_back(BaseLayerHandle);
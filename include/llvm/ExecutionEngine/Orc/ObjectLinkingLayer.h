@@ -17,6 +17,7 @@
 #include "JITSymbol.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include <list>
 #include <memory>
@@ -68,9 +69,15 @@ protected:
       OwnedBuffers.push_back(std::move(B));
     }
 
+    /// The name reported for this set's compile phases: the name of its only
+    /// object, or an empty string if it holds several.
+    StringRef getName() const { return Name; }
+    void setName(StringRef NewName) { Name = NewName; }
+
   protected:
     std::unique_ptr<RuntimeDyld> RTDyld;
     enum { Raw, Finalizing, Finalized } State;
+    std::string Name;
 
     // FIXME: This ownership hack only exists because RuntimeDyldELF still
     //        wants to be able to inspect the original object when resolving
@@ -158,7 +165,13 @@ public:
       NotifyLoadedFtor NotifyLoaded = NotifyLoadedFtor(),
       NotifyFinalizedFtor NotifyFinalized = NotifyFinalizedFtor())
       : NotifyLoaded(std::move(NotifyLoaded)),
-        NotifyFinalized(std::move(NotifyFinalized)) {}
+        NotifyFinalized(std::move(NotifyFinalized)), Listener(nullptr) {}
+
+  /// @brief Set a listener to report the time spent loading and finalizing
+  ///        objects to.
+  void setEventListener(JITEventListener *NewListener) {
+    Listener = NewListener;
+  }
 
   /// @brief Add a set of objects (or archives) that will be treated as a unit
   ///        for the purposes of symbol lookup and memory management.
@@ -185,8 +198,17 @@ public:
     LinkedObjectSet &LOS = **Handle;
     LoadedObjInfoList LoadedObjInfos;
 
-    for (auto &Obj : Objects)
+    unsigned NumObjects = 0;
+    for (auto &Obj : Objects) {
+      JITCompilePhaseTimer Timer(JITEventListener::ObjectLoadPhase,
+                                 Obj->getFileName(), getListeners());
+      Timer.setSize(Obj->getData().size());
       LoadedObjInfos.push_back(LOS.addObject(*Obj));
+      if (NumObjects++ == 0)
+        LOS.setName(Obj->getFileName());
+      else
+        LOS.setName("");
+    }
 
     NotifyLoaded(Handle, Objects, LoadedObjInfos);
 
@@ -243,11 +265,8 @@ public:
           // functor is called.
           auto GetAddress =
             [this, Addr, H]() {
-              if ((*H)->NeedsFinalization()) {
-                (*H)->Finalize();
-                if (NotifyFinalized)
-                  NotifyFinalized(H);
-              }
+              if ((*H)->NeedsFinalization())
+                finalize(H);
               return Addr;
             };
           return JITSymbol(std::move(GetAddress), Flags);
@@ -264,18 +283,33 @@ public:
   }
 
   /// @brief Immediately emit and finalize the object set represented by the
-  ///        given handle.
+  ///        given handle, then call the NotifyFinalized functor for it.
   /// @param H Handle for object set to emit/finalize.
   void emitAndFinalize(ObjSetHandleT H) {
-    (*H)->Finalize();
+    finalize(H);
+  }
+
+private:
+  ArrayRef<JITEventListener *> getListeners() const {
+    if (!Listener)
+      return None;
+    return Listener;
+  }
+
+  void finalize(ObjSetHandleT H) {
+    {
+      JITCompilePhaseTimer Timer(JITEventListener::RelocationPhase,
+                                 (*H)->getName(), getListeners());
+      (*H)->Finalize();
+    }
     if (NotifyFinalized)
       NotifyFinalized(H);
   }
 
-private:
   LinkedObjectSetListT LinkedObjSetList;
   NotifyLoadedFtor NotifyLoaded;
   NotifyFinalizedFtor NotifyFinalized;
+  JITEventListener *Listener;
 };
 
 } // End namespace orc.
@@ -240,6 +240,14 @@ public:
     this->ProcessAllSections = ProcessAllSections;
   }
 
+  /// Allow resolveRelocations() to apply relocations on up to \p NumThreads
+  /// threads. Symbol and section addresses are still looked up on the calling
+  /// thread, once each; only patching the section contents is spread across
+  /// threads, one section at a time per thread. Formats whose relocation
+  /// handlers are not safe to run concurrently, and link steps with few
+  /// relocations, are always resolved on the calling thread.
+  void setResolveThreads(unsigned NumThreads);
+
 private:
   // RuntimeDyldImpl is the actual class. RuntimeDyld is just the public
   // interface.
@@ -247,6 +255,7 @@ private:
   MemoryManager &MemMgr;
   SymbolResolver &Resolver;
   bool ProcessAllSections;
+  unsigned NumResolveThreads;
   RuntimeDyldCheckerImpl *Checker;
 };
 
@@ -11,12 +11,12 @@
 
 #include "llvm-c/Disassembler.h"
 #include "llvm/ADT/ArrayRef.h"
+#include "llvm/MC/MCInst.h"
 #include "llvm/MC/MCSymbolizer.h"
 #include "llvm/Support/DataTypes.h"
 
 namespace llvm {
 
-class MCInst;
 class MCSubtargetInfo;
 class raw_ostream;
 class MCContext;
@@ -78,6 +78,39 @@ public:
                                       raw_ostream &VStream,
                                       raw_ostream &CStream) const = 0;
 
+  /// One entry of the array filled in by getInstructions().
+  struct DecodedInstruction {
+    MCInst Inst;
+    uint64_t Address;
+    /// The size of the instruction, or the number of bytes skipped when the
+    /// bytes at Address could not be decoded. Always at least one.
+    uint64_t Size;
+    DecodeStatus Status;
+    /// The value of CStream.tell() after decoding this instruction; comments
+    /// for the instruction end here and start where the previous one ended.
+    uint64_t CommentEnd;
+  };
+
+  /// Decodes consecutive instructions, reusing the storage of the MCInsts in
+  /// \p Insts between calls.
+  ///
+  /// \param Insts    - The array to fill in, in address order.
+  /// \param Bytes    - The bytes available to the decoder, starting at
+  ///                   \p Address.
+  /// \param Length   - Only instructions starting in the first \p Length
+  ///                   bytes are decoded, although the last of them may
+  ///                   extend past it.
+  /// \param Address  - The address of the first byte of \p Bytes.
+  /// \param VStream  - The stream to print warnings and diagnostic messages on.
+  /// \param CStream  - The stream to print comments and annotations on.
+  /// \return         - The number of entries of \p Insts filled in. Bytes that
+  ///                   fail to decode are recorded with a Fail status rather
+  ///                   than ending the batch.
+  size_t getInstructions(MutableArrayRef<DecodedInstruction> Insts,
+                         ArrayRef<uint8_t> Bytes, uint64_t Length,
+                         uint64_t Address, raw_ostream &VStream,
+                         raw_ostream &CStream) const;
+
 private:
   MCContext &Ctx;
 
@@ -27,6 +27,12 @@ class StringRef;
 /// Splits the module M into N linkable partitions. The function ModuleCallback
 /// is called N times passing each individual partition as the MPart argument.
 ///
+/// Partitions are balanced by an estimate of the cost of generating code for
+/// their functions. Members of a comdat and aliases and their base objects are
+/// always placed in the same partition. Local symbols are externalized unless
+/// PreserveLocals is set, in which case each local symbol is kept in the same
+/// partition as all of its users.
+///
 /// FIXME: This function does not deal with the somewhat subtle symbol
 /// visibility issues around module splitting, including (but not limited to):
 ///
@@ -36,7 +42,8 @@ class StringRef;
 ///   each partition.
 void SplitModule(
     std::unique_ptr<Module> M, unsigned N,
-    std::function<void(std::unique_ptr<Module> MPart)> ModuleCallback);
+    std::function<void(std::unique_ptr<Module> MPart)> ModuleCallback,
+    bool PreserveLocals = false);
 
 } // End llvm namespace
 
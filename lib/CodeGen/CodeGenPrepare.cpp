@@ -18,6 +18,7 @@
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/InstructionSimplify.h"
+#include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Analysis/TargetTransformInfo.h"
 #include "llvm/IR/CallSite.h"
@@ -68,6 +69,7 @@ STATISTIC(NumDbgValueMoved, "Number of debug value instructions moved");
 STATISTIC(NumSelectsExpanded, "Number of selects turned into branches");
 STATISTIC(NumAndCmpsMoved, "Number of and/cmp's pushed into branches");
 STATISTIC(NumStoreExtractExposed, "Number of store(extractelement) exposed");
+STATISTIC(NumExprsSunk, "Number of instructions sunk into their user's block");
 
 static cl::opt<bool> DisableBranchOpts(
   "disable-cgp-branch-opts", cl::Hidden, cl::init(false),
@@ -107,6 +109,16 @@ static cl::opt<bool> StressExtLdPromotion(
     cl::desc("Stress test ext(promotable(ld)) -> promoted(ext(ld)) "
              "optimization in CodeGenPrepare"));
 
+static cl::opt<bool> EnableRegionSinking(
+    "cgp-region-sinking", cl::Hidden, cl::init(false),
+    cl::desc("Sink single-use expression trees into the block of their user "
+             "so that instruction selection sees them as a whole"));
+
+static cl::opt<unsigned> RegionSinkingLimit(
+    "cgp-region-sinking-limit", cl::Hidden, cl::init(16),
+    cl::desc("Maximum number of instructions sunk into the block of a "
+             "single user"));
+
 namespace {
 typedef SmallPtrSet<Instruction *, 16> SetOfInstrs;
 typedef PointerIntPair<Type *, 1, bool> TypeIsSExt;
@@ -181,6 +193,7 @@ class TypePromotionTransaction;
     bool DupRetToEnableTailCallOpts(BasicBlock *BB);
     bool PlaceDbgValues(Function &F);
     bool sinkAndCmp(Function &F);
+    bool sinkExpressionTrees(Function &F);
     bool ExtLdPromotion(TypePromotionTransaction &TPT, LoadInst *&LI,
                         Instruction *&Inst,
                         const SmallVectorImpl<Instruction *> &Exts,
@@ -243,6 +256,11 @@ bool CodeGenPrepare::runOnFunction(Function &F) {
     EverMadeChange |= splitBranchCondition(F);
   }
 
+  // Give instruction selection, which works one block at a time, whole
+  // expression trees to fold. Do this before OptimizeBlock so that address
+  // and extension optimizations see the sunk trees.
+  EverMadeChange |= sinkExpressionTrees(F);
+
   bool MadeChange = true;
   while (MadeChange) {
     MadeChange = false;
@@ -4531,6 +4549,106 @@ bool CodeGenPrepare::PlaceDbgValues(Function &F) {
   return MadeChange;
 }
 
+/// Returns true if I can be moved next to its only user without changing the
+/// behavior of the program.
+static bool isSafeToSinkToUser(const Instruction *I) {
+  if (isa<PHINode>(I) || isa<TerminatorInst>(I) || isa<AllocaInst>(I) ||
+      isa<CallInst>(I) || I->isEHPad())
+    return false;
+  return !I->mayHaveSideEffects() && !I->mayReadFromMemory();
+}
+
+/// Collects into Tree, operands first, the instructions that compute Root and
+/// can be sunk together with it into UserBB. Code is never moved into a loop
+/// L that does not already contain it. Stops once Budget instructions have
+/// been collected.
+static void collectSinkableTree(Instruction *Root, const BasicBlock *UserBB,
+                                const Loop *L, unsigned &Budget,
+                                SmallVectorImpl<Instruction *> &Tree) {
+  if (!Budget || Root->getParent() == UserBB || !Root->hasOneUse() ||
+      !isSafeToSinkToUser(Root))
+    return;
+  // Code outside of L runs less often than code in it.
+  if (L && !L->contains(Root->getParent()))
+    return;
+  --Budget;
+  for (Value *Op : Root->operands())
+    if (Instruction *I = dyn_cast<Instruction>(Op))
+      collectSinkableTree(I, UserBB, L, Budget, Tree);
+  Tree.push_back(Root);
+}
+
+/// Returns the number of values that would have to become live into UserBB if
+/// the instructions in Tree were moved there.
+static unsigned countNewLiveIns(ArrayRef<Instruction *> Tree,
+                                const BasicBlock *UserBB) {
+  SmallPtrSet<const Instruction *, 8> InTree(Tree.begin(), Tree.end());
+  SmallPtrSet<const Value *, 8> LiveIns;
+  for (const Instruction *I : Tree)
+    for (const Value *Op : I->operands()) {
+      if (!isa<Instruction>(Op) && !isa<Argument>(Op))
+        continue;
+      if (auto *OpI = dyn_cast<Instruction>(Op))
+        if (OpI->getParent() == UserBB || InTree.count(OpI))
+          continue;
+      bool UsedInUserBB = false;
+      for (const User *U : Op->users())
+        if (cast<Instruction>(U)->getParent() == UserBB) {
+          UsedInUserBB = true;
+          break;
+        }
+      if (!UsedInUserBB)
+        LiveIns.insert(Op);
+    }
+  return LiveIns.size();
+}
+
+/// SelectionDAG builds one DAG per basic block, so a value computed in one
+/// block and used in another reaches its user through a virtual register copy
+/// and cannot be folded into it, e.g. into an addressing mode. Sink
+/// single-use, side-effect free expression trees into the block of their
+/// user, as long as that does not make more values live across blocks or move
+/// code into a loop. At most RegionSinkingLimit instructions are sunk for
+/// each user.
+bool CodeGenPrepare::sinkExpressionTrees(Function &F) {
+  if (!EnableRegionSinking)
+    return false;
+
+  DominatorTree DT(F);
+  LoopInfo LI(DT);
+  bool MadeChange = false;
+  for (BasicBlock &BB : F) {
+    if (!DT.isReachableFromEntry(&BB))
+      continue;
+    Loop *L = LI.getLoopFor(&BB);
+    for (Instruction &User : BB) {
+      if (isa<PHINode>(User))
+        continue;
+      unsigned Budget = RegionSinkingLimit;
+      for (Value *Op : User.operands()) {
+        Instruction *Root = dyn_cast<Instruction>(Op);
+        if (!Root)
+          continue;
+        SmallVector<Instruction *, 8> Tree;
+        unsigned TreeBudget = Budget;
+        collectSinkableTree(Root, &BB, L, TreeBudget, Tree);
+        // The tree replaces Root as a value live into BB.
+        if (Tree.empty() || countNewLiveIns(Tree, &BB) > 1)
+          continue;
+        Budget = TreeBudget;
+        for (Instruction *I : Tree) {
+          DEBUG(dbgs() << "CGP: Sinking " << *I << " into " << BB.getName()
+                       << '\n');
+          I->moveBefore(&User);
+        }
+        NumExprsSunk += Tree.size();
+        MadeChange = true;
+      }
+    }
+  }
+  return MadeChange;
+}
+
 // If there is a sequence that branches based on comparing a single bit
 // against zero that can be combined into a single instruction, and the
 // target supports folding these into a single instruction, sink the
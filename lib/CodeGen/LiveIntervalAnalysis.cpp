@@ -97,22 +97,29 @@ LiveIntervals::LiveIntervals() : MachineFunctionPass(ID),
 }
 
 LiveIntervals::~LiveIntervals() {
+  releaseMemory();
   delete LRCalc;
 }
 
 void LiveIntervals::releaseMemory() {
-  // Free the live intervals themselves.
+  // Free the live intervals themselves. Their storage is released with the
+  // pool below.
   for (unsigned i = 0, e = VirtRegIntervals.size(); i != e; ++i)
-    delete VirtRegIntervals[TargetRegisterInfo::index2VirtReg(i)];
+    if (LiveInterval *LI =
+            VirtRegIntervals[TargetRegisterInfo::index2VirtReg(i)])
+      LI->~LiveInterval();
   VirtRegIntervals.clear();
   RegMaskSlots.clear();
   RegMaskBits.clear();
   RegMaskBlocks.clear();
 
   for (unsigned i = 0, e = RegUnitRanges.size(); i != e; ++i)
-    delete RegUnitRanges[i];
+    if (LiveRange *LR = RegUnitRanges[i])
+      LR->~LiveRange();
   RegUnitRanges.clear();
 
+  IntervalAllocator.Reset();
+
   // Release VNInfo memory regions, VNInfo objects don't need to be dtor'd.
   VNInfoAllocator.Reset();
 }
@@ -189,7 +196,18 @@ void LiveIntervals::dumpInstrs() const {
 LiveInterval* LiveIntervals::createInterval(unsigned reg) {
   float Weight = TargetRegisterInfo::isPhysicalRegister(reg) ?
                   llvm::huge_valf : 0.0F;
-  return new LiveInterval(reg, Weight);
+  return new (IntervalAllocator.Allocate<LiveInterval>())
+      LiveInterval(reg, Weight);
+}
+
+void LiveIntervals::destroyInterval(LiveInterval *LI) {
+  LI->~LiveInterval();
+}
+
+LiveRange *LiveIntervals::createRegUnitRange() {
+  // Use segment set to speed-up initial computation of the live range.
+  return new (IntervalAllocator.Allocate<LiveRange>())
+      LiveRange(UseSegmentSetForPhysRegs);
 }
 
 
@@ -310,8 +328,7 @@ void LiveIntervals::computeLiveInRegUnits() {
         unsigned Unit = *Units;
         LiveRange *LR = RegUnitRanges[Unit];
         if (!LR) {
-          // Use segment set to speed-up initial computation of the live range.
-          LR = RegUnitRanges[Unit] = new LiveRange(UseSegmentSetForPhysRegs);
+          LR = RegUnitRanges[Unit] = createRegUnitRange();
           NewRanges.push_back(Unit);
         }
         VNInfo *VNI = LR->createDeadDef(Begin, getVNInfoAllocator());
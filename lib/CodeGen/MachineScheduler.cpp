@@ -14,6 +14,7 @@
 
 #include "llvm/CodeGen/MachineScheduler.h"
 #include "llvm/ADT/PriorityQueue.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/CodeGen/LiveIntervalAnalysis.h"
 #include "llvm/CodeGen/MachineDominators.h"
@@ -26,15 +27,22 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/GraphWriter.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetInstrInfo.h"
+#include "llvm/Target/TargetMachine.h"
 #include <queue>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "misched"
 
+STATISTIC(NumRegions, "Number of scheduling regions");
+STATISTIC(NumWindowedRegions,
+          "Number of scheduling regions cut at the scheduling window");
+
 namespace llvm {
 cl::opt<bool> ForceTopDown("misched-topdown", cl::Hidden,
                            cl::desc("Force top-down list scheduling"));
@@ -76,6 +84,20 @@ static cl::opt<bool> EnableMacroFusion("misched-fusion", cl::Hidden,
 static cl::opt<bool> VerifyScheduling("verify-misched", cl::Hidden,
   cl::desc("Verify machine instrs before and after machine scheduling"));
 
+// Bounded-window mode for fast compiles. Huge straight-line blocks are cut into
+// regions of at most this many instructions, which bounds the cost of building
+// the DAG and of tracking register pressure for each region. Pressure is then
+// only exact within a window; values live across windows are seen as live
+// through.
+static cl::opt<unsigned> SchedWindow("misched-window", cl::Hidden,
+  cl::desc("Maximum number of instructions in a scheduling region "
+           "(0 = unlimited). Defaults to 256 at -O1 and below."));
+
+static const unsigned FastSchedWindow = 256;
+
+static cl::opt<bool> PrintRegionStats("misched-region-stats", cl::Hidden,
+  cl::desc("Print the size and compile time of each scheduling region"));
+
 // DAG subtrees must have at least this many nodes.
 static const unsigned MinSubtreeSize = 8;
 
@@ -388,10 +410,18 @@ static bool isSchedBoundary(MachineBasicBlock::iterator MI,
   return MI->isCall() || TII->isSchedulingBoundary(MI, MBB, *MF);
 }
 
+/// Return the scheduling window for MF, or 0 if regions are unbounded.
+static unsigned getSchedWindow(const MachineFunction &MF) {
+  if (SchedWindow.getNumOccurrences())
+    return SchedWindow;
+  return MF.getTarget().getOptLevel() <= CodeGenOpt::Less ? FastSchedWindow : 0;
+}
+
 /// Main driver for both MachineScheduler and PostMachineScheduler.
 void MachineSchedulerBase::scheduleRegions(ScheduleDAGInstrs &Scheduler) {
   const TargetInstrInfo *TII = MF->getSubtarget().getInstrInfo();
   bool IsPostRA = Scheduler.isPostRA();
+  unsigned Window = getSchedWindow(*MF);
 
   // Visit all machine basic blocks.
   //
@@ -437,13 +467,20 @@ void MachineSchedulerBase::scheduleRegions(ScheduleDAGInstrs &Scheduler) {
 
       // The next region starts above the previous region. Look backward in the
       // instruction stream until we find the nearest boundary.
+      // When the region reaches the window size, stop there. The instruction
+      // above it then serves as the boundary of the next region.
       unsigned NumRegionInstrs = 0;
+      bool Windowed = false;
       MachineBasicBlock::iterator I = RegionEnd;
       for(;I != MBB->begin(); --I, --RemainingInstrs) {
         if (isSchedBoundary(std::prev(I), MBB, MF, TII, IsPostRA))
           break;
         if (!I->isDebugValue())
           ++NumRegionInstrs;
+        if (Window && NumRegionInstrs >= Window) {
+          Windowed = true;
+          break;
+        }
       }
       // Notify the scheduler of the region, even if we may skip scheduling
       // it. Perhaps it still needs to be bundled.
@@ -471,9 +508,27 @@ void MachineSchedulerBase::scheduleRegions(ScheduleDAGInstrs &Scheduler) {
         errs() << " " << MBB->getName() << " \n";
       }
 
+      ++NumRegions;
+      if (Windowed)
+        ++NumWindowedRegions;
+
       // Schedule a region: possibly reorder instructions.
       // This invalidates 'RegionEnd' and 'I'.
+      TimeRecord StartTime;
+      if (PrintRegionStats)
+        StartTime = TimeRecord::getCurrentTime(/*Start=*/true);
       Scheduler.schedule();
+      if (PrintRegionStats) {
+        double Elapsed = TimeRecord::getCurrentTime(/*Start=*/false)
+                             .getWallTime() - StartTime.getWallTime();
+        unsigned NumEdges = 0;
+        for (const SUnit &SU : Scheduler.SUnits)
+          NumEdges += SU.Preds.size();
+        errs() << "misched-region: " << MF->getName() << ":BB#"
+               << MBB->getNumber() << " instrs=" << NumRegionInstrs
+               << " edges=" << NumEdges << (Windowed ? " windowed" : "")
+               << format(" time=%.1fus", Elapsed * 1e6) << '\n';
+      }
 
       // Close the current region.
       Scheduler.exitRegion();
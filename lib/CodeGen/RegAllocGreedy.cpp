@@ -36,6 +36,7 @@
 #include "llvm/CodeGen/RegAllocRegistry.h"
 #include "llvm/CodeGen/RegisterClassInfo.h"
 #include "llvm/CodeGen/VirtRegMap.h"
+#include "llvm/IR/Function.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/PassAnalysisSupport.h"
 #include "llvm/Support/BranchProbability.h"
@@ -54,6 +55,10 @@ using namespace llvm;
 STATISTIC(NumGlobalSplits, "Number of split global live ranges");
 STATISTIC(NumLocalSplits,  "Number of split local live ranges");
 STATISTIC(NumEvicted,      "Number of interferences evicted");
+STATISTIC(NumBudgetExhausted,
+          "Number of functions that exhausted the allocation work budget");
+STATISTIC(NumBudgetSpills,
+          "Number of live ranges spilled because the work budget ran out");
 
 static cl::opt<SplitEditor::ComplementSpillMode>
 SplitSpillMode("split-spill-mode", cl::Hidden,
@@ -100,6 +105,27 @@ CSRFirstTimeCost("regalloc-csr-first-time-cost",
               cl::desc("Cost for first time use of callee-saved register."),
               cl::init(0), cl::Hidden);
 
+// Compile-time bounded allocation, mainly for JIT use. A function can override
+// the limit with the "regalloc-greedy-budget" string attribute.
+static cl::opt<unsigned>
+GreedyWorkBudget("regalloc-greedy-budget", cl::Hidden,
+                 cl::desc("Amount of eviction and splitting work the greedy "
+                          "allocator may do per function before it falls "
+                          "back to spilling (0 = unlimited)"),
+                 cl::init(0));
+
+static cl::opt<unsigned>
+BudgetSplitCandidates("regalloc-greedy-budget-split-cands", cl::Hidden,
+                      cl::desc("Maximum number of registers considered for "
+                               "region splitting in budgeted mode"),
+                      cl::init(8));
+
+static cl::opt<unsigned>
+BudgetEvictionDepth("regalloc-greedy-budget-evict-depth", cl::Hidden,
+                    cl::desc("Maximum number of times a live range may be "
+                             "evicted in budgeted mode"),
+                    cl::init(4));
+
 static RegisterRegAlloc greedyRegAlloc("greedy", "greedy register allocator",
                                        createGreedyRegisterAllocator);
 
@@ -202,7 +228,11 @@ class RAGreedy : public MachineFunctionPass,
     // Cascade - Eviction loop prevention. See canEvictInterference().
     unsigned Cascade;
 
-    RegInfo() : Stage(RS_New), Cascade(0) {}
+    // Evictions - Number of times this live range, or the range it was split
+    // from, has been evicted. Only limited in budgeted mode.
+    unsigned Evictions;
+
+    RegInfo() : Stage(RS_New), Cascade(0), Evictions(0) {}
   };
 
   IndexedMap<RegInfo, VirtReg2IndexFunctor> ExtraRegInfo;
@@ -312,6 +342,26 @@ class RAGreedy : public MachineFunctionPass,
   /// Set of broken hints that may be reconciled later because of eviction.
   SmallSetVector<LiveInterval *, 8> SetOfBrokenHints;
 
+  /// Work budget for the current function, or 0 when allocation is not
+  /// budgeted. Eviction checks and split candidate evaluations are charged
+  /// against it; once it is used up, live ranges that cannot be assigned
+  /// directly are spilled.
+  uint64_t WorkBudget;
+  uint64_t WorkUnits;
+
+  bool isBudgeted() const { return WorkBudget != 0; }
+  bool budgetExhausted() const { return WorkBudget && WorkUnits >= WorkBudget; }
+  void chargeWork(uint64_t Units) {
+    if (!WorkBudget || budgetExhausted())
+      return;
+    WorkUnits += Units;
+    if (budgetExhausted()) {
+      ++NumBudgetExhausted;
+      DEBUG(dbgs() << "Work budget of " << WorkBudget
+                   << " exhausted, spilling remaining ranges\n");
+    }
+  }
+
 public:
   RAGreedy();
 
@@ -722,6 +772,8 @@ bool RAGreedy::shouldEvict(LiveInterval &A, bool IsHint,
 /// @returns True when interference can be evicted cheaper than MaxCost.
 bool RAGreedy::canEvictInterference(LiveInterval &VirtReg, unsigned PhysReg,
                                     bool IsHint, EvictionCost &MaxCost) {
+  chargeWork(1);
+
   // It is only possible to evict virtual register interference.
   if (Matrix->checkInterference(VirtReg, PhysReg) > LiveRegMatrix::IK_VirtReg)
     return false;
@@ -764,6 +816,11 @@ bool RAGreedy::canEvictInterference(LiveInterval &VirtReg, unsigned PhysReg,
         (Intf->isSpillable() ||
          RegClassInfo.getNumAllocatableRegs(MRI->getRegClass(VirtReg.reg)) <
          RegClassInfo.getNumAllocatableRegs(MRI->getRegClass(Intf->reg)));
+      // In budgeted mode, bound eviction chains by refusing to evict ranges
+      // that have been evicted too often already.
+      if (isBudgeted() && !Urgent &&
+          ExtraRegInfo[Intf->reg].Evictions >= BudgetEvictionDepth)
+        return false;
       // Only evict older cascades or live ranges without a cascade.
       unsigned IntfCascade = ExtraRegInfo[Intf->reg].Cascade;
       if (Cascade <= IntfCascade) {
@@ -834,6 +891,7 @@ void RAGreedy::evictInterference(LiveInterval &VirtReg, unsigned PhysReg,
             VirtReg.isSpillable() < Intf->isSpillable()) &&
            "Cannot decrease cascade number, illegal eviction");
     ExtraRegInfo[Intf->reg].Cascade = Cascade;
+    ++ExtraRegInfo[Intf->reg].Evictions;
     ++NumEvicted;
     NewVRegs.push_back(Intf->reg);
   }
@@ -1378,11 +1436,20 @@ unsigned RAGreedy::calculateRegionSplitCost(LiveInterval &VirtReg,
                                             unsigned &NumCands,
                                             bool IgnoreCSR) {
   unsigned BestCand = NoCand;
+  unsigned NumEvaluated = 0;
   Order.rewind();
   while (unsigned PhysReg = Order.next()) {
     if (IgnoreCSR && isUnusedCalleeSavedReg(PhysReg))
       continue;
 
+    // In budgeted mode, only look at the first few registers in the allocation
+    // order, and charge each candidate by the number of blocks it covers.
+    if (isBudgeted()) {
+      if (budgetExhausted() || NumEvaluated++ == BudgetSplitCandidates)
+        break;
+      chargeWork(SA->getUseBlocks().size() + SA->getNumThroughBlocks());
+    }
+
     // Discard bad candidates before we run out of interference cache cursors.
     // This will only affect register classes with a lot of registers (>32).
     if (NumCands == IntfCache.getMaxCursors()) {
@@ -1798,6 +1865,7 @@ unsigned RAGreedy::tryLocalSplit(LiveInterval &VirtReg, AllocationOrder &Order,
 
   Order.rewind();
   while (unsigned PhysReg = Order.next()) {
+    chargeWork(NumGaps);
     // Keep track of the largest spill weight that would need to be evicted in
     // order to make use of PhysReg between UseSlots[i] and UseSlots[i+1].
     calcGapWeights(PhysReg, GapWeight);
@@ -2492,10 +2560,15 @@ unsigned RAGreedy::selectOrSplitImpl(LiveInterval &VirtReg,
   DEBUG(dbgs() << StageName[Stage]
                << " Cascade " << ExtraRegInfo[VirtReg.reg].Cascade << '\n');
 
+  // Once the work budget is used up, live ranges that can be spilled go to
+  // memory directly instead of evicting or splitting.
+  bool SpillNow = budgetExhausted() && VirtReg.isSpillable() &&
+                  Stage < RS_Done;
+
   // Try to evict a less worthy live range, but only for ranges from the primary
   // queue. The RS_Split ranges already failed to do this, and they should not
   // get a second chance until they have been split.
-  if (Stage != RS_Split)
+  if (Stage != RS_Split && !SpillNow)
     if (unsigned PhysReg =
             tryEvict(VirtReg, Order, NewVRegs, CostPerUseLimit)) {
       unsigned Hint = MRI->getSimpleHint(VirtReg.reg);
@@ -2514,7 +2587,7 @@ unsigned RAGreedy::selectOrSplitImpl(LiveInterval &VirtReg,
   // The first time we see a live range, don't try to split or spill.
   // Wait until the second time, when all smaller ranges have been allocated.
   // This gives a better picture of the interference to split around.
-  if (Stage < RS_Split) {
+  if (Stage < RS_Split && !SpillNow) {
     setStage(VirtReg, RS_Split);
     DEBUG(dbgs() << "wait for second round\n");
     NewVRegs.push_back(VirtReg.reg);
@@ -2528,9 +2601,13 @@ unsigned RAGreedy::selectOrSplitImpl(LiveInterval &VirtReg,
                                    Depth);
 
   // Try splitting VirtReg or interferences.
-  unsigned PhysReg = trySplit(VirtReg, Order, NewVRegs);
-  if (PhysReg || !NewVRegs.empty())
-    return PhysReg;
+  if (SpillNow) {
+    ++NumBudgetSpills;
+  } else {
+    unsigned PhysReg = trySplit(VirtReg, Order, NewVRegs);
+    if (PhysReg || !NewVRegs.empty())
+      return PhysReg;
+  }
 
   // Finally spill VirtReg itself.
   if (EnableDeferredSpilling && getStage(VirtReg) < RS_Memory) {
@@ -2569,6 +2646,14 @@ bool RAGreedy::runOnMachineFunction(MachineFunction &mf) {
                         MF->getSubtarget().enableRALocalReassignment(
                             MF->getTarget().getOptLevel());
 
+  WorkBudget = GreedyWorkBudget;
+  WorkUnits = 0;
+  Attribute BudgetAttr =
+      MF->getFunction()->getFnAttribute("regalloc-greedy-budget");
+  if (BudgetAttr.isStringAttribute() &&
+      BudgetAttr.getValueAsString().getAsInteger(10, WorkBudget))
+    report_fatal_error("invalid regalloc-greedy-budget attribute value");
+
   if (VerifyEnabled)
     MF->verify(this, "Before greedy register allocator");
 
@@ -2601,6 +2686,9 @@ bool RAGreedy::runOnMachineFunction(MachineFunction &mf) {
 
   allocatePhysRegs();
   tryHintsRecoloring();
+  DEBUG(if (isBudgeted())
+          dbgs() << "Used " << WorkUnits << " of " << WorkBudget
+                 << " work units\n");
   releaseMemory();
   return true;
 }
@@ -0,0 +1,333 @@
+//===-- RegAllocLinearScan.cpp - Linear Scan Register Allocator -----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the RALinearScan function pass, a global linear scan
+// register allocator in the style of second-chance binpacking.
+//
+// Live ranges are allocated in order of their start index. Assignment goes
+// through the LiveRegMatrix, so a live range can be packed into the lifetime
+// holes of ranges already assigned to a register. When no register is free,
+// the allocator evicts the cheapest interference if it has a smaller spill
+// weight, and otherwise spills the current range.
+//
+// An evicted range gets a second chance: it is queued again and may find
+// another register. Ranges evicted a second time are spilled. Spilling goes
+// through the inline spiller, whose reload and spill ranges are allocated like
+// any other range. This is where binpacking assigns registers to the parts of
+// a spilled range around each use.
+//
+// No live range splitting is done beyond what the spiller does. This keeps
+// the cost of each assignment to one interference check per candidate
+// register, which is much cheaper than the greedy allocator.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/Passes.h"
+#include "AllocationOrder.h"
+#include "LiveDebugVariables.h"
+#include "RegAllocBase.h"
+#include "Spiller.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/CodeGen/CalcSpillWeights.h"
+#include "llvm/CodeGen/LiveIntervalAnalysis.h"
+#include "llvm/CodeGen/LiveRangeEdit.h"
+#include "llvm/CodeGen/LiveRegMatrix.h"
+#include "llvm/CodeGen/LiveStackAnalysis.h"
+#include "llvm/CodeGen/MachineBlockFrequencyInfo.h"
+#include "llvm/CodeGen/MachineFunctionPass.h"
+#include "llvm/CodeGen/MachineLoopInfo.h"
+#include "llvm/CodeGen/MachineRegisterInfo.h"
+#include "llvm/CodeGen/RegAllocRegistry.h"
+#include "llvm/CodeGen/VirtRegMap.h"
+#include "llvm/PassAnalysisSupport.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetRegisterInfo.h"
+#include <queue>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "regalloc"
+
+STATISTIC(NumEvicted,      "Number of interferences evicted");
+STATISTIC(NumSecondChance, "Number of evicted live ranges queued again");
+
+static RegisterRegAlloc linearScanRegAlloc("linearscan",
+                                           "linear scan register allocator",
+                                           createLinearScanRegisterAllocator);
+
+namespace {
+class RALinearScan : public MachineFunctionPass,
+                     public RegAllocBase,
+                     private LiveRangeEdit::Delegate {
+  // context
+  MachineFunction *MF;
+  SlotIndexes *Indexes;
+
+  // state
+  std::unique_ptr<Spiller> SpillerInstance;
+
+  /// Live ranges waiting for assignment, ordered by start index. Entries are
+  /// (~start distance, ~vreg) so the earliest start and then the lowest
+  /// register number is on top.
+  std::priority_queue<std::pair<unsigned, unsigned> > Queue;
+
+  /// Virtual registers that have been evicted once already.
+  BitVector Evicted;
+
+public:
+  RALinearScan();
+
+  /// Return the pass name.
+  const char* getPassName() const override {
+    return "Linear Scan Register Allocator";
+  }
+
+  /// RALinearScan analysis usage.
+  void getAnalysisUsage(AnalysisUsage &AU) const override;
+
+  void releaseMemory() override;
+
+  Spiller &spiller() override { return *SpillerInstance; }
+
+  void enqueue(LiveInterval *LI) override;
+  LiveInterval *dequeue() override;
+
+  unsigned selectOrSplit(LiveInterval &VirtReg,
+                         SmallVectorImpl<unsigned> &SplitVRegs) override;
+
+  /// Perform register allocation.
+  bool runOnMachineFunction(MachineFunction &mf) override;
+
+  static char ID;
+
+private:
+  bool LRE_CanEraseVirtReg(unsigned) override;
+
+  bool wasEvicted(unsigned VirtReg) const {
+    unsigned Idx = TargetRegisterInfo::virtReg2Index(VirtReg);
+    return Idx < Evicted.size() && Evicted.test(Idx);
+  }
+
+  /// Return the largest spill weight of the virtual registers assigned to
+  /// PhysReg or its aliases that interfere with VirtReg, or a negative value
+  /// when some of them cannot be evicted.
+  float getEvictionWeight(LiveInterval &VirtReg, unsigned PhysReg);
+
+  /// Evict the interference on PhysReg. Ranges evicted for the first time are
+  /// returned in SplitVRegs for another assignment attempt, the others are
+  /// spilled.
+  void evictInterference(LiveInterval &VirtReg, unsigned PhysReg,
+                         SmallVectorImpl<unsigned> &SplitVRegs);
+};
+
+char RALinearScan::ID = 0;
+
+} // end anonymous namespace
+
+RALinearScan::RALinearScan(): MachineFunctionPass(ID) {
+  initializeLiveDebugVariablesPass(*PassRegistry::getPassRegistry());
+  initializeLiveIntervalsPass(*PassRegistry::getPassRegistry());
+  initializeSlotIndexesPass(*PassRegistry::getPassRegistry());
+  initializeRegisterCoalescerPass(*PassRegistry::getPassRegistry());
+  initializeMachineSchedulerPass(*PassRegistry::getPassRegistry());
+  initializeLiveStacksPass(*PassRegistry::getPassRegistry());
+  initializeMachineDominatorTreePass(*PassRegistry::getPassRegistry());
+  initializeMachineLoopInfoPass(*PassRegistry::getPassRegistry());
+  initializeVirtRegMapPass(*PassRegistry::getPassRegistry());
+  initializeLiveRegMatrixPass(*PassRegistry::getPassRegistry());
+}
+
+void RALinearScan::getAnalysisUsage(AnalysisUsage &AU) const {
+  AU.setPreservesCFG();
+  AU.addRequired<AAResultsWrapperPass>();
+  AU.addPreserved<AAResultsWrapperPass>();
+  AU.addRequired<LiveIntervals>();
+  AU.addPreserved<LiveIntervals>();
+  AU.addRequired<SlotIndexes>();
+  AU.addPreserved<SlotIndexes>();
+  AU.addRequired<LiveDebugVariables>();
+  AU.addPreserved<LiveDebugVariables>();
+  AU.addRequired<LiveStacks>();
+  AU.addPreserved<LiveStacks>();
+  AU.addRequired<MachineBlockFrequencyInfo>();
+  AU.addPreserved<MachineBlockFrequencyInfo>();
+  AU.addRequiredID(MachineDominatorsID);
+  AU.addPreservedID(MachineDominatorsID);
+  AU.addRequired<MachineLoopInfo>();
+  AU.addPreserved<MachineLoopInfo>();
+  AU.addRequired<VirtRegMap>();
+  AU.addPreserved<VirtRegMap>();
+  AU.addRequired<LiveRegMatrix>();
+  AU.addPreserved<LiveRegMatrix>();
+  MachineFunctionPass::getAnalysisUsage(AU);
+}
+
+void RALinearScan::releaseMemory() {
+  SpillerInstance.reset();
+  Evicted.clear();
+}
+
+bool RALinearScan::LRE_CanEraseVirtReg(unsigned VirtReg) {
+  if (VRM->hasPhys(VirtReg)) {
+    Matrix->unassign(LIS->getInterval(VirtReg));
+    return true;
+  }
+  // Unassigned virtreg is probably in the priority queue.
+  // RegAllocBase will erase it after dequeueing.
+  return false;
+}
+
+void RALinearScan::enqueue(LiveInterval *LI) {
+  unsigned Start =
+      LI->empty() ? 0 : Indexes->getZeroIndex().distance(LI->beginIndex());
+  Queue.push(std::make_pair(~Start, ~LI->reg));
+}
+
+LiveInterval *RALinearScan::dequeue() {
+  if (Queue.empty())
+    return nullptr;
+  LiveInterval *LI = &LIS->getInterval(~Queue.top().second);
+  Queue.pop();
+  return LI;
+}
+
+float RALinearScan::getEvictionWeight(LiveInterval &VirtReg,
+                                      unsigned PhysReg) {
+  float MaxWeight = 0;
+  for (MCRegUnitIterator Units(PhysReg, TRI); Units.isValid(); ++Units) {
+    LiveIntervalUnion::Query &Q = Matrix->query(VirtReg, *Units);
+    Q.collectInterferingVRegs();
+    if (Q.seenUnspillableVReg())
+      return -1;
+    for (LiveInterval *Intf : Q.interferingVRegs()) {
+      if (!Intf->isSpillable())
+        return -1;
+      MaxWeight = std::max(MaxWeight, Intf->weight);
+    }
+  }
+  return MaxWeight;
+}
+
+void RALinearScan::evictInterference(LiveInterval &VirtReg, unsigned PhysReg,
+                                     SmallVectorImpl<unsigned> &SplitVRegs) {
+  // Collect all interfering virtregs first, unassigning them invalidates the
+  // queries.
+  SmallVector<LiveInterval*, 8> Intfs;
+  for (MCRegUnitIterator Units(PhysReg, TRI); Units.isValid(); ++Units) {
+    LiveIntervalUnion::Query &Q = Matrix->query(VirtReg, *Units);
+    assert(Q.seenAllInterferences() && "Didn't check all interfererences.");
+    ArrayRef<LiveInterval*> IVR = Q.interferingVRegs();
+    Intfs.append(IVR.begin(), IVR.end());
+  }
+
+  for (LiveInterval *Intf : Intfs) {
+    // The same VirtReg may be present in multiple RegUnits. Skip duplicates.
+    if (!VRM->hasPhys(Intf->reg))
+      continue;
+    Matrix->unassign(*Intf);
+    ++NumEvicted;
+
+    if (!wasEvicted(Intf->reg)) {
+      DEBUG(dbgs() << "evicting " << *Intf << ", second chance\n");
+      Evicted.resize(MRI->getNumVirtRegs());
+      Evicted.set(TargetRegisterInfo::virtReg2Index(Intf->reg));
+      SplitVRegs.push_back(Intf->reg);
+      ++NumSecondChance;
+      continue;
+    }
+
+    DEBUG(dbgs() << "evicting " << *Intf << " again, spilling\n");
+    LiveRangeEdit LRE(Intf, SplitVRegs, *MF, *LIS, VRM, this);
+    spiller().spill(LRE);
+  }
+}
+
+// Assign VirtReg to the first free register in allocation order, which puts
+// hints first. If every register is taken, evict the cheapest interference
+// when it weighs less than VirtReg, or spill VirtReg itself.
+unsigned RALinearScan::selectOrSplit(LiveInterval &VirtReg,
+                                     SmallVectorImpl<unsigned> &SplitVRegs) {
+  SmallVector<unsigned, 8> EvictionCands;
+
+  AllocationOrder Order(VirtReg.reg, *VRM, RegClassInfo, Matrix);
+  while (unsigned PhysReg = Order.next()) {
+    switch (Matrix->checkInterference(VirtReg, PhysReg)) {
+    case LiveRegMatrix::IK_Free:
+      return PhysReg;
+    case LiveRegMatrix::IK_VirtReg:
+      EvictionCands.push_back(PhysReg);
+      continue;
+    default:
+      // RegMask or RegUnit interference.
+      continue;
+    }
+  }
+
+  // Find the register with the lightest interference.
+  unsigned BestPhys = 0;
+  float BestWeight = VirtReg.weight;
+  for (unsigned PhysReg : EvictionCands) {
+    float Weight = getEvictionWeight(VirtReg, PhysReg);
+    if (Weight >= 0 && Weight < BestWeight) {
+      BestPhys = PhysReg;
+      BestWeight = Weight;
+    }
+  }
+
+  if (BestPhys) {
+    evictInterference(VirtReg, BestPhys, SplitVRegs);
+    assert(!Matrix->checkInterference(VirtReg, BestPhys) &&
+           "Interference after eviction.");
+    return BestPhys;
+  }
+
+  DEBUG(dbgs() << "spilling: " << VirtReg << '\n');
+  if (!VirtReg.isSpillable())
+    return ~0u;
+  LiveRangeEdit LRE(&VirtReg, SplitVRegs, *MF, *LIS, VRM, this);
+  spiller().spill(LRE);
+
+  // The live virtual register requesting allocation was spilled, so tell
+  // the caller not to allocate anything during this round.
+  return 0;
+}
+
+bool RALinearScan::runOnMachineFunction(MachineFunction &mf) {
+  DEBUG(dbgs() << "********** LINEAR SCAN REGISTER ALLOCATION **********\n"
+               << "********** Function: "
+               << mf.getName() << '\n');
+
+  MF = &mf;
+  RegAllocBase::init(getAnalysis<VirtRegMap>(),
+                     getAnalysis<LiveIntervals>(),
+                     getAnalysis<LiveRegMatrix>());
+  Indexes = &getAnalysis<SlotIndexes>();
+
+  calculateSpillWeightsAndHints(*LIS, *MF, VRM,
+                                getAnalysis<MachineLoopInfo>(),
+                                getAnalysis<MachineBlockFrequencyInfo>());
+
+  SpillerInstance.reset(createInlineSpiller(*this, *MF, *VRM));
+
+  allocatePhysRegs();
+
+  // Diagnostic output before rewriting
+  DEBUG(dbgs() << "Post alloc VirtRegMap:\n" << *VRM << "\n");
+
+  releaseMemory();
+  return true;
+}
+
+FunctionPass* llvm::createLinearScanRegisterAllocator()
+{
+  return new RALinearScan();
+}
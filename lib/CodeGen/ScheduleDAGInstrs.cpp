@@ -16,6 +16,7 @@
 #include "llvm/ADT/MapVector.h"
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Analysis/ValueTracking.h"
 #include "llvm/CodeGen/LiveIntervalAnalysis.h"
@@ -42,6 +43,9 @@ using namespace llvm;
 
 #define DEBUG_TYPE "misched"
 
+STATISTIC(NumMemDepBarriers,
+          "Number of memory barriers forced by the dependency window");
+
 static cl::opt<bool> EnableAASchedMI("enable-aa-sched-mi", cl::Hidden,
     cl::ZeroOrMore, cl::init(false),
     cl::desc("Enable use of AA during MI DAG construction"));
@@ -49,6 +53,15 @@ static cl::opt<bool> EnableAASchedMI("enable-aa-sched-mi", cl::Hidden,
 static cl::opt<bool> UseTBAA("use-tbaa-in-sched-mi", cl::Hidden,
     cl::init(true), cl::desc("Enable use of TBAA during MI DAG construction"));
 
+// Every memory instruction is checked against all tracked memory instructions
+// since the last barrier, which is quadratic in huge regions. Once this many
+// are tracked, the next memory instruction is treated as a barrier and the
+// lists start over.
+static cl::opt<unsigned> MemDepWindow("sched-mem-dep-window", cl::Hidden,
+    cl::init(0), cl::desc("Maximum number of memory instructions tracked for "
+                          "chain dependencies before forcing a barrier "
+                          "(0 = unlimited)"));
+
 ScheduleDAGInstrs::ScheduleDAGInstrs(MachineFunction &mf,
                                      const MachineLoopInfo *mli,
                                      bool IsPostRAFlag, bool RemoveKillFlags,
@@ -775,6 +788,9 @@ void ScheduleDAGInstrs::buildSchedGraph(AliasAnalysis *AA,
   MapVector<ValueType, std::vector<SUnit *> > AliasMemUses, NonAliasMemUses;
   std::set<SUnit*> RejectMemNodes;
 
+  // Number of memory instructions tracked since the last barrier.
+  unsigned NumTrackedMemInstrs = 0;
+
   // Remove any stale debug info; sometimes BuildSchedGraph is called again
   // without emitting the info from the previous call.
   DbgValues.clear();
@@ -865,7 +881,14 @@ void ScheduleDAGInstrs::buildSchedGraph(AliasAnalysis *AA,
     // TODO: Use an AliasAnalysis and do real alias-analysis queries, and
     // produce more precise dependence information.
     unsigned TrueMemOrderLatency = MI->mayStore() ? 1 : 0;
-    if (isGlobalMemoryObject(AA, MI)) {
+    bool ForceBarrier = false;
+    if (MemDepWindow && (MI->mayStore() || MI->mayLoad()) &&
+        !MI->isInvariantLoad(AA) && ++NumTrackedMemInstrs > MemDepWindow) {
+      ForceBarrier = true;
+      ++NumMemDepBarriers;
+    }
+    if (ForceBarrier || isGlobalMemoryObject(AA, MI)) {
+      NumTrackedMemInstrs = 0;
       // Be conservative with these and add dependencies on all memory
       // references, even those that are known to not alias.
       for (MapVector<ValueType, std::vector<SUnit *> >::iterator I =
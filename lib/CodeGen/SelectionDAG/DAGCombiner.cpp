@@ -31,13 +31,17 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetLowering.h"
 #include "llvm/Target/TargetOptions.h"
 #include "llvm/Target/TargetRegisterInfo.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
 #include <algorithm>
+#include <map>
 using namespace llvm;
 
 #define DEBUG_TYPE "dagcombine"
@@ -48,6 +52,11 @@ STATISTIC(PostIndexedNodes, "Number of post-indexed nodes created");
 STATISTIC(OpsNarrowed     , "Number of load/op/store narrowed");
 STATISTIC(LdStFP2Int      , "Number of fp load/store pairs transformed to int");
 STATISTIC(SlicedLoads, "Number of load sliced");
+STATISTIC(NodesVisited, "Number of dag nodes the combiner tried to combine");
+STATISTIC(WorklistDuplicates,
+          "Number of worklist insertions of nodes that were already queued");
+STATISTIC(NodesOverBudget,
+          "Number of combines skipped because of the node visit limit");
 
 namespace {
   static cl::opt<bool>
@@ -81,6 +90,68 @@ namespace {
     MaySplitLoadIndex("combiner-split-load-index", cl::Hidden, cl::init(true),
                       cl::desc("DAG combiner may split indexing from loads"));
 
+  static cl::opt<unsigned>
+    CombinerVisitLimit("combiner-node-visit-limit", cl::Hidden, cl::init(0),
+                       cl::desc("Maximum number of times a node is combined "
+                                "in one combiner run (0 = no limit)"));
+
+  static cl::opt<bool>
+    CombinerOpcodeStats("combiner-opcode-stats", cl::Hidden,
+                        cl::desc("Print the number of combine attempts and "
+                                 "successful combines per opcode at exit"));
+
+  /// Combine attempts and successful combines per opcode, accumulated over
+  /// all combiner runs and printed at exit with -combiner-opcode-stats.
+  struct OpcodeCombineCounts {
+    std::string Name;
+    uint64_t Attempts;
+    uint64_t Combined;
+    OpcodeCombineCounts() : Attempts(0), Combined(0) {}
+  };
+
+  struct OpcodeCombineStats {
+    sys::SmartMutex<true> Lock;
+    std::map<std::string, OpcodeCombineCounts> ByName;
+
+    void merge(const DenseMap<unsigned, OpcodeCombineCounts> &Counts) {
+      sys::SmartScopedLock<true> Guard(Lock);
+      for (const auto &C : Counts) {
+        OpcodeCombineCounts &Total = ByName[C.second.Name];
+        Total.Name = C.second.Name;
+        Total.Attempts += C.second.Attempts;
+        Total.Combined += C.second.Combined;
+      }
+    }
+
+    ~OpcodeCombineStats() {
+      std::vector<const OpcodeCombineCounts *> Sorted;
+      for (const auto &C : ByName)
+        Sorted.push_back(&C.second);
+      std::stable_sort(Sorted.begin(), Sorted.end(),
+                       [](const OpcodeCombineCounts *A,
+                          const OpcodeCombineCounts *B) {
+                         return A->Attempts > B->Attempts;
+                       });
+      raw_ostream &OS = errs();
+      OS << "===" << std::string(73, '-') << "===\n"
+         << "                    DAG combiner attempts per opcode\n"
+         << "===" << std::string(73, '-') << "===\n"
+         << "    Attempts    Combined  Hit rate  Opcode\n";
+      for (const OpcodeCombineCounts *C : Sorted)
+        OS << format("%12llu%12llu%9.1f%%  ",
+                     (unsigned long long)C->Attempts,
+                     (unsigned long long)C->Combined,
+                     100.0 * C->Combined / C->Attempts)
+           << C->Name << '\n';
+      OS.flush();
+    }
+  };
+
+}
+
+static ManagedStatic<OpcodeCombineStats> CombineStats;
+
+namespace {
 //------------------------------ DAGCombiner ---------------------------------//
 
   class DAGCombiner {
@@ -98,21 +169,19 @@ namespace {
     /// back and when processing we pop off of the back.
     ///
     /// The worklist will not contain duplicates but may contain null entries
-    /// due to nodes being deleted from the underlying DAG.
+    /// due to nodes being deleted from the underlying DAG. Each node records
+    /// its position on the worklist, and whether it has been combined at least
+    /// once, in its CombinerWorklistIndex, so neither membership tests nor
+    /// removals need a side table.
     SmallVector<SDNode *, 64> Worklist;
 
-    /// \brief Mapping from an SDNode to its position on the worklist.
-    ///
-    /// This is used to find and remove nodes from the worklist (by nulling
-    /// them) when they are deleted from the underlying DAG. It relies on
-    /// stable indices of nodes within the worklist.
-    DenseMap<SDNode *, unsigned> WorklistMap;
+    /// \brief Number of combine attempts per node in this run. Only kept when
+    /// -combiner-node-visit-limit is set.
+    DenseMap<SDNode *, unsigned> VisitCounts;
 
-    /// \brief Set of nodes which have been combined (at least once).
-    ///
-    /// This is used to allow us to reliably add any operands of a DAG node
-    /// which have not yet been combined to the worklist.
-    SmallPtrSet<SDNode *, 64> CombinedNodes;
+    /// \brief Combine attempts per opcode in this run. Only kept when
+    /// -combiner-opcode-stats is set.
+    DenseMap<unsigned, OpcodeCombineCounts> OpcodeCounts;
 
     // AA - Used for DAG load/store alias analysis.
     AliasAnalysis &AA;
@@ -136,21 +205,37 @@ namespace {
       if (N->getOpcode() == ISD::HANDLENODE)
         return;
 
-      if (WorklistMap.insert(std::make_pair(N, Worklist.size())).second)
-        Worklist.push_back(N);
+      if (N->getCombinerWorklistIndex() >= 0) {
+        ++WorklistDuplicates;
+        return;
+      }
+      N->setCombinerWorklistIndex(Worklist.size());
+      Worklist.push_back(N);
     }
 
     /// Remove all instances of N from the worklist.
     void removeFromWorklist(SDNode *N) {
-      CombinedNodes.erase(N);
-
-      auto It = WorklistMap.find(N);
-      if (It == WorklistMap.end())
-        return; // Not in the worklist.
-
+      int Index = N->getCombinerWorklistIndex();
       // Null out the entry rather than erasing it to avoid a linear operation.
-      Worklist[It->second] = nullptr;
-      WorklistMap.erase(It);
+      if (Index >= 0)
+        Worklist[Index] = nullptr;
+      N->setCombinerWorklistIndex(-1);
+      if (CombinerVisitLimit)
+        VisitCounts.erase(N);
+    }
+
+    /// Pop the next node off the worklist, skipping removed entries. Returns
+    /// null once the worklist is empty.
+    SDNode *getNextWorklistEntry() {
+      SDNode *N = nullptr;
+      while (!N && !Worklist.empty())
+        N = Worklist.pop_back_val();
+      if (N) {
+        assert(N->getCombinerWorklistIndex() == (int)Worklist.size() &&
+               "Found a worklist entry with a stale index!");
+        N->setCombinerWorklistIndex(-1);
+      }
+      return N;
     }
 
     void deleteAndRecombine(SDNode *N);
@@ -1234,18 +1319,7 @@ void DAGCombiner::Run(CombineLevel AtLevel) {
 
   // while the worklist isn't empty, find a node and
   // try and combine it.
-  while (!WorklistMap.empty()) {
-    SDNode *N;
-    // The Worklist holds the SDNodes in order, but it may contain null entries.
-    do {
-      N = Worklist.pop_back_val();
-    } while (!N);
-
-    bool GoodWorklistEntry = WorklistMap.erase(N);
-    (void)GoodWorklistEntry;
-    assert(GoodWorklistEntry &&
-           "Found a worklist entry without a corresponding map entry!");
-
+  while (SDNode *N = getNextWorklistEntry()) {
     // If N has no uses, it is dead.  Make sure to revisit all N's operands once
     // N is deleted from the DAG, since they too may now be dead or may have a
     // reduced number of uses, allowing other xforms.
@@ -1270,20 +1344,35 @@ void DAGCombiner::Run(CombineLevel AtLevel) {
 
     DEBUG(dbgs() << "\nCombining: "; N->dump(&DAG));
 
-    // Add any operands of the new node which have not yet been combined to the
-    // worklist as well. Because the worklist uniques things already, this
-    // won't repeatedly process the same operand.
-    CombinedNodes.insert(N);
+    // Add any operands of the new node which are neither queued nor combined
+    // yet to the worklist as well.
+    N->setCombinerWorklistIndex(-2);
     for (const SDValue &ChildN : N->op_values())
-      if (!CombinedNodes.count(ChildN.getNode()))
+      if (ChildN->getCombinerWorklistIndex() == -1)
         AddToWorklist(ChildN.getNode());
 
+    if (CombinerVisitLimit && ++VisitCounts[N] > CombinerVisitLimit) {
+      ++NodesOverBudget;
+      continue;
+    }
+
+    ++NodesVisited;
+    OpcodeCombineCounts *Counts = nullptr;
+    if (CombinerOpcodeStats) {
+      Counts = &OpcodeCounts[N->getOpcode()];
+      if (Counts->Name.empty())
+        Counts->Name = N->getOperationName(&DAG);
+      ++Counts->Attempts;
+    }
+
     SDValue RV = combine(N);
 
     if (!RV.getNode())
       continue;
 
     ++NodesCombined;
+    if (Counts)
+      ++Counts->Combined;
 
     // If we get back the same node we passed in, rather than a new node or
     // zero, we know that the node must have defined multiple values and
@@ -1324,6 +1413,12 @@ void DAGCombiner::Run(CombineLevel AtLevel) {
   // If the root changed (e.g. it was a dead load, update the root).
   DAG.setRoot(Dummy.getValue());
   DAG.RemoveDeadNodes();
+
+  if (CombinerOpcodeStats) {
+    CombineStats->merge(OpcodeCounts);
+    OpcodeCounts.clear();
+  }
+  VisitCounts.clear();
 }
 
 SDValue DAGCombiner::visit(SDNode *N) {
@@ -0,0 +1,562 @@
+//===- CodeCacheMemoryManager.cpp - Reusable memory for JIT code ----------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements JITCodeCache and CodeCacheMemoryManager.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/CodeCacheMemoryManager.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace llvm;
+
+//===----------------------------------------------------------------------===//
+// JITCodeCache
+//===----------------------------------------------------------------------===//
+
+double JITCodeCache::Statistics::getExternalFragmentation() const {
+  if (!FreeBytes)
+    return 0.0;
+  return 1.0 - double(LargestFreeRange) / double(FreeBytes);
+}
+
+double JITCodeCache::Statistics::getInternalFragmentation() const {
+  if (!AllocatedBytes)
+    return 0.0;
+  return 1.0 - double(SectionBytes) / double(AllocatedBytes);
+}
+
+void JITCodeCache::Statistics::print(raw_ostream &OS) const {
+  OS << "JIT code cache:\n"
+     << "  mapped:    " << MappedBytes << " bytes in " << NumSlabs
+     << " slabs\n"
+     << "  allocated: " << AllocatedBytes << " bytes, " << SectionBytes
+     << " used by sections\n"
+     << "  free:      " << FreeBytes << " bytes in " << NumFreeRanges
+     << " ranges, largest " << LargestFreeRange << "\n"
+     << "  allocations: " << NumReusedAllocations << " reused, "
+     << NumMappedAllocations << " newly mapped\n"
+     << "  permission changes: " << NumProtectCalls << "\n"
+     << "  shared pages: " << NumSlotPages << ", " << NumSealedSlotPages
+     << " sealed, holding " << NumSlots << " sections\n"
+     << format("  fragmentation: %.1f%% internal, %.1f%% external\n",
+               getInternalFragmentation() * 100.0,
+               getExternalFragmentation() * 100.0);
+}
+
+JITCodeCache::JITCodeCache(size_t SlabSize, size_t RetainedBytes)
+    : PageSize(sys::Process::getPageSize()), RetainedBytes(RetainedBytes) {
+  this->SlabSize =
+      std::max<size_t>(RoundUpToAlignment(SlabSize, PageSize), PageSize);
+  std::memset(&Stats, 0, sizeof(Stats));
+}
+
+JITCodeCache::~JITCodeCache() {
+  for (const auto &Slab : Slabs) {
+    sys::MemoryBlock MB(reinterpret_cast<void *>(Slab.first), Slab.second);
+    sys::Memory::releaseMappedMemory(MB);
+  }
+}
+
+unsigned JITCodeCache::getSizeClass(size_t Size) const {
+  return std::min<unsigned>(Log2_64(Size / PageSize), NumSizeClasses - 1);
+}
+
+uintptr_t JITCodeCache::getSlabBase(uintptr_t Addr) const {
+  auto I = Slabs.upper_bound(Addr);
+  assert(I != Slabs.begin() && "Address is not in any slab!");
+  --I;
+  assert(Addr < I->first + I->second && "Address is not in any slab!");
+  return I->first;
+}
+
+void JITCodeCache::addFreeRange(uintptr_t Addr, size_t Size) {
+  uintptr_t SlabBase = getSlabBase(Addr);
+
+  // Coalesce with the following free range, if it is in the same slab.
+  auto Next = FreeByAddr.lower_bound(Addr);
+  if (Next != FreeByAddr.end() && Next->first == Addr + Size &&
+      getSlabBase(Next->first) == SlabBase) {
+    size_t NextSize = Next->second;
+    removeFreeRange(Next->first, NextSize);
+    Size += NextSize;
+  }
+
+  // Coalesce with the preceding free range, if it is in the same slab.
+  auto Prev = FreeByAddr.lower_bound(Addr);
+  if (Prev != FreeByAddr.begin()) {
+    --Prev;
+    if (Prev->first + Prev->second == Addr && Prev->first >= SlabBase) {
+      uintptr_t PrevAddr = Prev->first;
+      size_t PrevSize = Prev->second;
+      removeFreeRange(PrevAddr, PrevSize);
+      Addr = PrevAddr;
+      Size += PrevSize;
+    }
+  }
+
+  FreeByAddr[Addr] = Size;
+  FreeBySize[getSizeClass(Size)].insert(std::make_pair(Size, Addr));
+  Stats.FreeBytes += Size;
+}
+
+void JITCodeCache::removeFreeRange(uintptr_t Addr, size_t Size) {
+  FreeByAddr.erase(Addr);
+  FreeBySize[getSizeClass(Size)].erase(std::make_pair(Size, Addr));
+  Stats.FreeBytes -= Size;
+}
+
+sys::MemoryBlock JITCodeCache::allocate(size_t Size) {
+  MutexGuard Locked(Lock);
+  return allocateLocked(Size);
+}
+
+sys::MemoryBlock JITCodeCache::allocateLocked(size_t Size) {
+  Size = RoundUpToAlignment(std::max<size_t>(Size, 1), PageSize);
+
+  // Best fit: the smallest free range in the request's size class that is
+  // large enough, or failing that the smallest range of a larger class.
+  uintptr_t Addr = 0;
+  size_t RangeSize = 0;
+  for (unsigned C = getSizeClass(Size); C != NumSizeClasses; ++C) {
+    auto I = FreeBySize[C].lower_bound(std::make_pair(Size, uintptr_t(0)));
+    if (I != FreeBySize[C].end()) {
+      RangeSize = I->first;
+      Addr = I->second;
+      break;
+    }
+  }
+
+  if (Addr) {
+    ++Stats.NumReusedAllocations;
+  } else {
+    // Nothing free is large enough; map a new slab next to the previous one.
+    size_t NewSlabSize = std::max(SlabSize, Size);
+    std::error_code EC;
+    sys::MemoryBlock MB = sys::Memory::allocateMappedMemory(
+        NewSlabSize, &Near, sys::Memory::MF_READ | sys::Memory::MF_WRITE, EC);
+    if (EC)
+      return sys::MemoryBlock();
+    Near = MB;
+
+    Addr = reinterpret_cast<uintptr_t>(MB.base());
+    RangeSize = MB.size();
+    Slabs[Addr] = RangeSize;
+    Stats.MappedBytes += RangeSize;
+    ++Stats.NumMappedAllocations;
+    addFreeRange(Addr, RangeSize);
+  }
+
+  removeFreeRange(Addr, RangeSize);
+  if (RangeSize > Size)
+    addFreeRange(Addr + Size, RangeSize - Size);
+
+  Stats.AllocatedBytes += Size;
+  return sys::MemoryBlock(reinterpret_cast<void *>(Addr), Size);
+}
+
+void JITCodeCache::release(ArrayRef<sys::MemoryBlock> Blocks) {
+  MutexGuard Locked(Lock);
+  releaseLocked(Blocks);
+}
+
+void JITCodeCache::releaseLocked(ArrayRef<sys::MemoryBlock> Blocks) {
+  // Code and read-only data have to be writable again before reuse.
+  protectLocked(Blocks, sys::Memory::MF_READ | sys::Memory::MF_WRITE);
+
+  for (const sys::MemoryBlock &MB : Blocks) {
+    addFreeRange(reinterpret_cast<uintptr_t>(MB.base()), MB.size());
+    Stats.AllocatedBytes -= MB.size();
+  }
+
+  if (Stats.FreeBytes > RetainedBytes)
+    compactLocked();
+}
+
+std::error_code JITCodeCache::protect(ArrayRef<sys::MemoryBlock> Blocks,
+                                      unsigned Flags) {
+  MutexGuard Locked(Lock);
+  return protectLocked(Blocks, Flags);
+}
+
+std::error_code
+JITCodeCache::protectLocked(ArrayRef<sys::MemoryBlock> Blocks,
+                            unsigned Flags) {
+  SmallVector<sys::MemoryBlock, 8> Sorted(Blocks.begin(), Blocks.end());
+  std::sort(Sorted.begin(), Sorted.end(),
+            [](const sys::MemoryBlock &LHS, const sys::MemoryBlock &RHS) {
+              return LHS.base() < RHS.base();
+            });
+
+  for (unsigned I = 0, E = Sorted.size(); I != E;) {
+    uintptr_t Start = reinterpret_cast<uintptr_t>(Sorted[I].base());
+    uintptr_t End = Start + Sorted[I].size();
+    uintptr_t SlabBase = getSlabBase(Start);
+    // Extend the run over blocks that follow on directly in the same slab.
+    for (++I; I != E; ++I) {
+      uintptr_t NextStart = reinterpret_cast<uintptr_t>(Sorted[I].base());
+      if (NextStart != End || getSlabBase(NextStart) != SlabBase)
+        break;
+      End += Sorted[I].size();
+    }
+
+    ++Stats.NumProtectCalls;
+    sys::MemoryBlock Run(reinterpret_cast<void *>(Start), End - Start);
+    if (std::error_code EC = sys::Memory::protectMappedMemory(Run, Flags))
+      return EC;
+  }
+  return std::error_code();
+}
+
+/// The permissions of a sealed shared page of each kind.
+static const unsigned SealedPermissions[] = {
+    sys::Memory::MF_READ | sys::Memory::MF_EXEC, // CodePool
+    sys::Memory::MF_READ,                        // RODataPool
+    sys::Memory::MF_READ | sys::Memory::MF_WRITE // RWDataPool
+};
+
+uint8_t *JITCodeCache::allocateSlot(PoolKind Kind, size_t Size,
+                                    unsigned Alignment) {
+  size_t SlotSize = std::max<size_t>(std::max<size_t>(Size, Alignment), 16);
+  if (!isPowerOf2_64(SlotSize))
+    SlotSize = NextPowerOf2(SlotSize);
+  if (SlotSize > std::min<size_t>(16 << (NumSlotClasses - 1), PageSize / 4))
+    return nullptr;
+  unsigned Class = Log2_64(SlotSize) - 4;
+
+  MutexGuard Locked(Lock);
+  if (Kind == CodePool && NoSharedCode)
+    return nullptr;
+
+  std::vector<uintptr_t> &Open = OpenSlotPages[Kind][Class];
+  if (Open.empty()) {
+    sys::MemoryBlock MB = allocateLocked(PageSize);
+    if (!MB.base())
+      return nullptr;
+
+    // Code in a shared page runs while other slots are still being written,
+    // so the page is writable and executable until it is sealed.
+    if (Kind == CodePool) {
+      ++Stats.NumProtectCalls;
+      if (sys::Memory::protectMappedMemory(MB, sys::Memory::MF_READ |
+                                                   sys::Memory::MF_WRITE |
+                                                   sys::Memory::MF_EXEC)) {
+        NoSharedCode = true;
+        releaseLocked(MB);
+        return nullptr;
+      }
+    }
+
+    uintptr_t Base = reinterpret_cast<uintptr_t>(MB.base());
+    SlotPage &Page = SlotPages[Base];
+    Page.Kind = Kind;
+    Page.SlotSize = SlotSize;
+    Page.NumLive = 0;
+    Page.NumPending = 0;
+    Page.Sealed = false;
+    // Hand out the slots in address order.
+    for (unsigned I = PageSize / SlotSize; I != 0; --I)
+      Page.FreeSlots.push_back(I - 1);
+    Open.push_back(Base);
+    ++Stats.NumSlotPages;
+  }
+
+  uintptr_t Base = Open.back();
+  SlotPage &Page = SlotPages.find(Base)->second;
+  uintptr_t Addr = Base + Page.FreeSlots.back() * Page.SlotSize;
+  Page.FreeSlots.pop_back();
+  ++Page.NumLive;
+  ++Page.NumPending;
+  if (Page.FreeSlots.empty())
+    Open.pop_back();
+
+  ++Stats.NumSlots;
+  Stats.SectionBytes += Size;
+  return reinterpret_cast<uint8_t *>(Addr);
+}
+
+std::error_code JITCodeCache::finalizeSlots(ArrayRef<uint8_t *> Slots) {
+  MutexGuard Locked(Lock);
+  SmallVector<sys::MemoryBlock, 4> ToSeal[NumPools];
+  for (uint8_t *Slot : Slots) {
+    uintptr_t Base =
+        reinterpret_cast<uintptr_t>(Slot) & ~uintptr_t(PageSize - 1);
+    SlotPage &Page = SlotPages.find(Base)->second;
+
+    // Make sure the code just written is visible to instruction fetch on
+    // targets without coherent instruction caches.
+    if (Page.Kind == CodePool)
+      sys::Memory::InvalidateInstructionCache(Slot, Page.SlotSize);
+
+    --Page.NumPending;
+    if (Page.FreeSlots.empty() && !Page.NumPending && !Page.Sealed &&
+        Page.Kind != RWDataPool) {
+      Page.Sealed = true;
+      ++Stats.NumSealedSlotPages;
+      ToSeal[Page.Kind].push_back(
+          sys::MemoryBlock(reinterpret_cast<void *>(Base), PageSize));
+    }
+  }
+
+  for (unsigned Kind = 0; Kind != NumPools; ++Kind)
+    if (!ToSeal[Kind].empty())
+      if (std::error_code EC =
+              protectLocked(ToSeal[Kind], SealedPermissions[Kind]))
+        return EC;
+  return std::error_code();
+}
+
+void JITCodeCache::releaseSlots(ArrayRef<uint8_t *> Finalized,
+                                ArrayRef<uint8_t *> Pending) {
+  MutexGuard Locked(Lock);
+  for (uint8_t *Slot : Finalized)
+    releaseSlot(reinterpret_cast<uintptr_t>(Slot), false);
+  for (uint8_t *Slot : Pending)
+    releaseSlot(reinterpret_cast<uintptr_t>(Slot), true);
+
+  if (Stats.FreeBytes > RetainedBytes)
+    compactLocked();
+}
+
+void JITCodeCache::releaseSlot(uintptr_t Addr, bool Pending) {
+  uintptr_t Base = Addr & ~uintptr_t(PageSize - 1);
+  SlotPage &Page = SlotPages.find(Base)->second;
+  --Page.NumLive;
+  --Stats.NumSlots;
+  if (Pending)
+    --Page.NumPending;
+
+  if (!Page.NumLive) {
+    releaseSlotPage(Base);
+    return;
+  }
+
+  // A sealed page can't take new sections, so its free slots wait until the
+  // whole page is free.
+  if (Page.Sealed)
+    return;
+  Page.FreeSlots.push_back((Addr - Base) / Page.SlotSize);
+  if (Page.FreeSlots.size() == 1)
+    OpenSlotPages[Page.Kind][Log2_64(Page.SlotSize) - 4].push_back(Base);
+}
+
+void JITCodeCache::releaseSlotPage(uintptr_t Base) {
+  SlotPage &Page = SlotPages.find(Base)->second;
+  if (!Page.FreeSlots.empty() && !Page.Sealed) {
+    std::vector<uintptr_t> &Open =
+        OpenSlotPages[Page.Kind][Log2_64(Page.SlotSize) - 4];
+    Open.erase(std::find(Open.begin(), Open.end(), Base));
+  }
+  if (Page.Sealed)
+    --Stats.NumSealedSlotPages;
+  --Stats.NumSlotPages;
+  SlotPages.erase(Base);
+  releaseLocked(sys::MemoryBlock(reinterpret_cast<void *>(Base), PageSize));
+}
+
+void JITCodeCache::addSectionBytes(int64_t Delta) {
+  MutexGuard Locked(Lock);
+  Stats.SectionBytes += Delta;
+}
+
+void JITCodeCache::compact() {
+  MutexGuard Locked(Lock);
+  compactLocked();
+}
+
+void JITCodeCache::compactLocked() {
+  for (auto I = Slabs.begin(), E = Slabs.end(); I != E;) {
+    uintptr_t Base = I->first;
+    size_t Size = I->second;
+    ++I;
+
+    // Free ranges never span slabs, so an entirely free slab is exactly one
+    // free range.
+    auto Free = FreeByAddr.find(Base);
+    if (Free == FreeByAddr.end() || Free->second != Size)
+      continue;
+
+    removeFreeRange(Base, Size);
+    Slabs.erase(Base);
+    Stats.MappedBytes -= Size;
+    sys::MemoryBlock MB(reinterpret_cast<void *>(Base), Size);
+    sys::Memory::releaseMappedMemory(MB);
+    if (Near.base() == MB.base())
+      Near = sys::MemoryBlock();
+  }
+}
+
+JITCodeCache::Statistics JITCodeCache::getStatistics() const {
+  MutexGuard Locked(Lock);
+  Statistics S = Stats;
+  S.NumSlabs = Slabs.size();
+  S.NumFreeRanges = FreeByAddr.size();
+  S.LargestFreeRange = 0;
+  for (int C = NumSizeClasses - 1; C >= 0; --C) {
+    if (!FreeBySize[C].empty()) {
+      S.LargestFreeRange = FreeBySize[C].rbegin()->first;
+      break;
+    }
+  }
+  return S;
+}
+
+//===----------------------------------------------------------------------===//
+// CodeCacheMemoryManager
+//===----------------------------------------------------------------------===//
+
+CodeCacheMemoryManager::~CodeCacheMemoryManager() {
+  if (!Slots.empty())
+    Cache.releaseSlots(makeArrayRef(Slots).slice(0, NumFinalizedSlots),
+                       makeArrayRef(Slots).slice(NumFinalizedSlots));
+
+  SmallVector<sys::MemoryBlock, 8> Blocks;
+  for (const auto &Pool : Pools)
+    for (const Region &R : Pool)
+      Blocks.push_back(R.Block);
+  if (!Blocks.empty())
+    Cache.release(Blocks);
+  Cache.addSectionBytes(-int64_t(SectionBytes));
+}
+
+void CodeCacheMemoryManager::addRegion(PoolKind Kind, size_t Size) {
+  sys::MemoryBlock MB = Cache.allocate(Size);
+  if (!MB.base())
+    return;
+  Region R;
+  R.Block = MB;
+  R.Used = 0;
+  R.Finalized = false;
+  Pools[Kind].push_back(R);
+}
+
+void CodeCacheMemoryManager::reserveAllocationSpace(uintptr_t CodeSize,
+                                                    uintptr_t DataSizeRO,
+                                                    uintptr_t DataSizeRW) {
+  // Up to a page of a kind is left to the cache's shared pages.
+  size_t PageSize = sys::Process::getPageSize();
+  if (CodeSize > PageSize)
+    addRegion(JITCodeCache::CodePool, CodeSize);
+  if (DataSizeRO > PageSize)
+    addRegion(JITCodeCache::RODataPool, DataSizeRO);
+  if (DataSizeRW > PageSize)
+    addRegion(JITCodeCache::RWDataPool, DataSizeRW);
+}
+
+uint8_t *CodeCacheMemoryManager::allocateSection(PoolKind Kind, uintptr_t Size,
+                                                 unsigned Alignment) {
+  if (!Alignment)
+    Alignment = 16;
+  assert(isPowerOf2_32(Alignment) && "Alignment must be a power of two.");
+
+  // Only the most recent region can have room left; earlier ones were either
+  // filled up or finalized.
+  auto TryRegion = [&](Region &R) -> uint8_t * {
+    if (R.Finalized)
+      return nullptr;
+    uintptr_t Base = reinterpret_cast<uintptr_t>(R.Block.base());
+    uintptr_t Addr = RoundUpToAlignment(Base + R.Used, Alignment);
+    if (Addr + Size > Base + R.Block.size())
+      return nullptr;
+    uintptr_t NewUsed = Addr + Size - Base;
+    Cache.addSectionBytes(NewUsed - R.Used);
+    SectionBytes += NewUsed - R.Used;
+    R.Used = NewUsed;
+    return reinterpret_cast<uint8_t *>(Addr);
+  };
+
+  SmallVectorImpl<Region> &Pool = Pools[Kind];
+  if (!Pool.empty())
+    if (uint8_t *Addr = TryRegion(Pool.back()))
+      return Addr;
+
+  if (uint8_t *Addr = Cache.allocateSlot(Kind, Size, Alignment)) {
+    Slots.push_back(Addr);
+    SectionBytes += Size;
+    return Addr;
+  }
+
+  // The region is page aligned, so extra space is only needed for alignments
+  // larger than a page.
+  size_t PageSize = sys::Process::getPageSize();
+  addRegion(Kind, Size + (Alignment > PageSize ? Alignment : 0));
+  if (Pool.empty())
+    return nullptr;
+  return TryRegion(Pool.back());
+}
+
+uint8_t *CodeCacheMemoryManager::allocateCodeSection(uintptr_t Size,
+                                                     unsigned Alignment,
+                                                     unsigned SectionID,
+                                                     StringRef SectionName) {
+  return allocateSection(JITCodeCache::CodePool, Size, Alignment);
+}
+
+uint8_t *CodeCacheMemoryManager::allocateDataSection(uintptr_t Size,
+                                                     unsigned Alignment,
+                                                     unsigned SectionID,
+                                                     StringRef SectionName,
+                                                     bool IsReadOnly) {
+  return allocateSection(IsReadOnly ? JITCodeCache::RODataPool
+                                    : JITCodeCache::RWDataPool,
+                         Size, Alignment);
+}
+
+bool CodeCacheMemoryManager::finalizeMemory(std::string *ErrMsg) {
+  static const unsigned Permissions[NumPools] = {
+      sys::Memory::MF_READ | sys::Memory::MF_EXEC, // CodePool
+      sys::Memory::MF_READ,                        // RODataPool
+      0                                            // RWDataPool
+  };
+
+  if (NumFinalizedSlots != Slots.size()) {
+    std::error_code EC =
+        Cache.finalizeSlots(makeArrayRef(Slots).slice(NumFinalizedSlots));
+    NumFinalizedSlots = Slots.size();
+    if (EC) {
+      if (ErrMsg)
+        *ErrMsg = EC.message();
+      return true;
+    }
+  }
+
+  for (unsigned Kind = 0; Kind != NumPools; ++Kind) {
+    SmallVector<sys::MemoryBlock, 4> Blocks;
+    for (Region &R : Pools[Kind]) {
+      if (R.Finalized)
+        continue;
+      R.Finalized = true;
+      Blocks.push_back(R.Block);
+    }
+
+    // Read-write data already has the right permissions.
+    if (Blocks.empty() || !Permissions[Kind])
+      continue;
+
+    // Make sure the code just written is visible to instruction fetch on
+    // targets without coherent instruction caches.
+    if (Kind == JITCodeCache::CodePool)
+      for (const sys::MemoryBlock &Block : Blocks)
+        sys::Memory::InvalidateInstructionCache(Block.base(), Block.size());
+
+    if (std::error_code EC = Cache.protect(Blocks, Permissions[Kind])) {
+      if (ErrMsg)
+        *ErrMsg = EC.message();
+      return true;
+    }
+  }
+
+  return false;
+}
@@ -28,10 +28,12 @@
 #include "llvm/IR/ValueHandle.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ObjectFile.h"
+#include "llvm/Pass.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Host.h"
+#include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MutexGuard.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/raw_ostream.h"
@@ -61,6 +63,74 @@ ExecutionEngine *(*ExecutionEngine::InterpCtor)(std::unique_ptr<Module> M,
 
 void JITEventListener::anchor() {}
 
+const char *
+JITEventListener::getCompilePhaseName(JITEventListener::CompilePhase Phase) {
+  switch (Phase) {
+  case CodeGenPhase:    return "codegen";
+  case ObjectLoadPhase: return "load";
+  case RelocationPhase: return "relocation";
+  }
+  llvm_unreachable("Unknown compile phase");
+}
+
+static const char *getCompilePhaseTimerName(JITEventListener::CompilePhase P) {
+  switch (P) {
+  case JITEventListener::CodeGenPhase:    return "Code generation";
+  case JITEventListener::ObjectLoadPhase: return "Object loading";
+  case JITEventListener::RelocationPhase: return "Relocation and finalization";
+  }
+  llvm_unreachable("Unknown compile phase");
+}
+
+namespace {
+/// The timers of the "JIT Compile Phases" group, and the lock that guards
+/// starting and stopping them. Timer itself is not thread safe, but two
+/// overlapping runs of the same timer still add up to the sum of their times.
+struct CompilePhaseTimers {
+  sys::Mutex Lock;
+  TimerGroup Group;
+  std::unique_ptr<Timer> Timers[JITEventListener::RelocationPhase + 1];
+
+  CompilePhaseTimers() : Group("JIT Compile Phases") {}
+
+  Timer &get(JITEventListener::CompilePhase Phase) {
+    if (!Timers[Phase])
+      Timers[Phase].reset(new Timer(getCompilePhaseTimerName(Phase), Group));
+    return *Timers[Phase];
+  }
+};
+}
+
+static ManagedStatic<CompilePhaseTimers> PhaseTimers;
+
+JITCompilePhaseTimer::JITCompilePhaseTimer(
+    JITEventListener::CompilePhase Phase, StringRef Name,
+    ArrayRef<JITEventListener *> Listeners)
+    : Listeners(Listeners), PhaseTimer(nullptr) {
+  Info.Phase = Phase;
+  Info.Name = Name;
+  Info.Size = 0;
+  if (TimePassesIsEnabled) {
+    MutexGuard Lock(PhaseTimers->Lock);
+    PhaseTimer = &PhaseTimers->get(Phase);
+    PhaseTimer->startTimer();
+  }
+  if (!Listeners.empty())
+    Info.Start = sys::TimeValue::now();
+}
+
+JITCompilePhaseTimer::~JITCompilePhaseTimer() {
+  if (PhaseTimer) {
+    MutexGuard Lock(PhaseTimers->Lock);
+    PhaseTimer->stopTimer();
+  }
+  if (Listeners.empty())
+    return;
+  Info.End = sys::TimeValue::now();
+  for (JITEventListener *L : Listeners)
+    L->NotifyCompilePhase(Info);
+}
+
 void ExecutionEngine::Init(std::unique_ptr<Module> M) {
   CompilingLazily         = false;
   GVCompilationDisabled   = false;
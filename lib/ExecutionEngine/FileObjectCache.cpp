@@ -0,0 +1,208 @@
+//===-- FileObjectCache.cpp - Persistent on-disk ObjectCache --------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements FileObjectCache.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/FileObjectCache.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "object-cache"
+
+STATISTIC(NumHits, "Number of objects loaded from the object cache");
+STATISTIC(NumMisses, "Number of modules missing from the object cache");
+STATISTIC(NumStores, "Number of objects written to the object cache");
+STATISTIC(NumPruned, "Number of objects pruned from the object cache");
+
+/// Describe everything besides the IR that decides what object TM generates,
+/// so that changing any of it also changes the cache key.
+static std::string getTargetKey(const TargetMachine &TM) {
+  const TargetOptions &Options = TM.Options;
+  std::string Key;
+  raw_string_ostream OS(Key);
+  OS << "LLVM " LLVM_VERSION_STRING "\n"
+     << TM.getTargetTriple().str() << '\n'
+     << TM.getTargetCPU() << '\n'
+     << TM.getTargetFeatureString() << '\n'
+     << unsigned(TM.getRelocationModel()) << ' '
+     << unsigned(TM.getCodeModel()) << ' '
+     << unsigned(TM.getOptLevel()) << ' '
+     << unsigned(Options.FloatABIType) << ' '
+     << unsigned(Options.AllowFPOpFusion) << ' '
+     << unsigned(Options.ThreadModel) << ' '
+     << Options.StackAlignmentOverride << ' '
+     << Options.LessPreciseFPMADOption << Options.UnsafeFPMath
+     << Options.NoInfsFPMath << Options.NoNaNsFPMath
+     << Options.HonorSignDependentRoundingFPMathOption
+     << Options.NoZerosInBSS << Options.GuaranteedTailCallOpt
+     << Options.EnableFastISel << Options.PositionIndependentExecutable
+     << Options.UseInitArray << Options.FunctionSections
+     << Options.DataSections << Options.UniqueSectionNames
+     << Options.TrapUnreachable << Options.EmulatedTLS;
+  return OS.str();
+}
+
+FileObjectCache::FileObjectCache(StringRef CacheDir, const TargetMachine &TM,
+                                 uint64_t MaxSize)
+    : CacheDir(CacheDir), TargetKey(getTargetKey(TM)), MaxSize(MaxSize),
+      Stats() {}
+
+FileObjectCache::~FileObjectCache() {}
+
+std::string FileObjectCache::getCacheKey(const Module *M) {
+  SmallVector<char, 0> Bitcode;
+  raw_svector_ostream OS(Bitcode);
+  WriteBitcodeToFile(M, OS);
+
+  MD5 Hash;
+  Hash.update(ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(Bitcode.data()), Bitcode.size()));
+  Hash.update(TargetKey);
+  MD5::MD5Result Result;
+  Hash.final(Result);
+
+  SmallString<32> Key;
+  MD5::stringifyResult(Result, Key);
+  return Key.str();
+}
+
+std::string FileObjectCache::getCachePath(StringRef Key) const {
+  SmallString<128> Path(CacheDir);
+  sys::path::append(Path, Key + ".o");
+  return Path.str();
+}
+
+std::unique_ptr<MemoryBuffer> FileObjectCache::getObject(const Module *M) {
+  std::string Key = getCacheKey(M);
+  std::string Path = getCachePath(Key);
+
+  // Large objects are mapped rather than read. RuntimeDyld copies sections out
+  // of the buffer, so the mapping never needs to be writable.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFile(Path, -1, /*RequiresNullTerminator*/ false);
+  bool Valid = Buffer && sys::fs::identify_magic((*Buffer)->getBuffer()) !=
+                            sys::fs::file_magic::unknown;
+  if (!Valid) {
+    // Drop anything that is not an object so the next store replaces it.
+    if (Buffer)
+      sys::fs::remove(Path);
+    ++Stats.Misses;
+    ++NumMisses;
+    PendingKeys[M] = std::move(Key);
+    return nullptr;
+  }
+
+  // Mark the object as recently used for pruning.
+  int FD;
+  if (!sys::fs::openFileForRead(Path, FD)) {
+    sys::fs::setLastModificationAndAccessTime(FD, sys::TimeValue::now());
+    sys::Process::SafelyCloseFileDescriptor(FD);
+  }
+
+  ++Stats.Hits;
+  ++NumHits;
+  return std::move(*Buffer);
+}
+
+void FileObjectCache::notifyObjectCompiled(const Module *M,
+                                           MemoryBufferRef Obj) {
+  std::string Key;
+  auto I = PendingKeys.find(M);
+  if (I != PendingKeys.end()) {
+    Key = std::move(I->second);
+    PendingKeys.erase(I);
+  } else
+    Key = getCacheKey(M);
+
+  // Failing to store an object is not an error: the module is simply compiled
+  // again next time.
+  if (sys::fs::create_directories(CacheDir))
+    return;
+
+  // Write the object under a unique name and rename it into place, so that
+  // other processes only ever see complete objects.
+  SmallString<128> TempPath;
+  int FD;
+  if (sys::fs::createUniqueFile(CacheDir + "/" + Key + "-%%%%%%.tmp", FD,
+                                TempPath))
+    return;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose*/ true);
+    OS.write(Obj.getBufferStart(), Obj.getBufferSize());
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath);
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath, getCachePath(Key))) {
+    sys::fs::remove(TempPath);
+    return;
+  }
+
+  ++Stats.Stores;
+  ++NumStores;
+  prune();
+}
+
+void FileObjectCache::prune() {
+  if (!MaxSize)
+    return;
+
+  struct CacheEntry {
+    std::string Path;
+    uint64_t Size;
+    sys::TimeValue LastUsed;
+  };
+  std::vector<CacheEntry> Entries;
+  uint64_t TotalSize = 0;
+
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(CacheDir, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    if (sys::path::extension(I->path()) != ".o")
+      continue;
+    sys::fs::file_status Status;
+    if (I->status(Status))
+      continue;
+    Entries.push_back({I->path(), Status.getSize(),
+                       Status.getLastModificationTime()});
+    TotalSize += Status.getSize();
+  }
+  if (TotalSize <= MaxSize)
+    return;
+
+  std::sort(Entries.begin(), Entries.end(),
+            [](const CacheEntry &A, const CacheEntry &B) {
+              return A.LastUsed < B.LastUsed;
+            });
+  for (const CacheEntry &Entry : Entries) {
+    if (TotalSize <= MaxSize)
+      break;
+    if (sys::fs::remove(Entry.Path))
+      continue;
+    TotalSize -= Entry.Size;
+    ++Stats.Pruned;
+    ++NumPruned;
+  }
+}
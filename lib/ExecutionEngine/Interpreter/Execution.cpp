@@ -25,6 +25,7 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
+#include <atomic>
 #include <cmath>
 using namespace llvm;
 
@@ -39,8 +40,44 @@ static cl::opt<bool> PrintVolatile("interpreter-print-volatile", cl::Hidden,
 //                     Various Helper Functions
 //===----------------------------------------------------------------------===//
 
-static void SetValue(Value *V, GenericValue Val, ExecutionContext &SF) {
-  SF.Values[V] = Val;
+// SetResult - Set the value of the instruction SF is executing.
+static void SetResult(GenericValue Val, ExecutionContext &SF) {
+  assert(SF.CurOps[0] != FunctionSlots::NoSlot && "Instruction has no value!");
+  SF.Values[SF.CurOps[0]] = std::move(Val);
+}
+
+// readOperand - Return operand OpNo of I, the instruction SF is executing.
+const GenericValue &Interpreter::readOperand(User &I, unsigned OpNo,
+                                             ExecutionContext &SF) {
+  unsigned Ref = SF.CurOps[1 + OpNo];
+  if (Ref < FunctionSlots::ConstantRef)
+    return SF.Values[Ref];
+  if (Ref != FunctionSlots::NoSlot)
+    return SF.Slots->Constants[Ref - FunctionSlots::ConstantRef];
+  return getLazyConstant(cast<Constant>(I.getOperand(OpNo)), SF);
+}
+
+// readRef - Return the value of V, an operand that Ref refers to in the
+// decoded code of SF's function.
+const GenericValue &Interpreter::readRef(unsigned Ref, Value *V,
+                                         ExecutionContext &SF) {
+  if (Ref < FunctionSlots::ConstantRef)
+    return SF.Values[Ref];
+  if (Ref != FunctionSlots::NoSlot)
+    return SF.Slots->Constants[Ref - FunctionSlots::ConstantRef];
+  return getLazyConstant(cast<Constant>(V), SF);
+}
+
+// getLazyConstant - Return the value of a constant operand that was not
+// evaluated when its function was decoded. Each thread evaluates it once; the
+// values are kept in a std::map so references to them stay valid.
+const GenericValue &Interpreter::getLazyConstant(Constant *C,
+                                                 ExecutionContext &SF) {
+  std::map<const Constant *, GenericValue> &Cache = getThread().LazyConstants;
+  auto I = Cache.find(C);
+  if (I == Cache.end())
+    I = Cache.insert(std::make_pair(C, getOperandValue(C, SF))).first;
+  return I->second;
 }
 
 //===----------------------------------------------------------------------===//
@@ -52,8 +89,8 @@ static void SetValue(Value *V, GenericValue Val, ExecutionContext &SF) {
      Dest.TY##Val = Src1.TY##Val OP Src2.TY##Val; \
      break
 
-static void executeFAddInst(GenericValue &Dest, GenericValue Src1,
-                            GenericValue Src2, Type *Ty) {
+static void executeFAddInst(GenericValue &Dest, const GenericValue &Src1,
+                            const GenericValue &Src2, Type *Ty) {
   switch (Ty->getTypeID()) {
     IMPLEMENT_BINARY_OPERATOR(+, Float);
     IMPLEMENT_BINARY_OPERATOR(+, Double);
@@ -63,8 +100,8 @@ static void executeFAddInst(GenericValue &Dest, GenericValue Src1,
   }
 }
 
-static void executeFSubInst(GenericValue &Dest, GenericValue Src1,
-                            GenericValue Src2, Type *Ty) {
+static void executeFSubInst(GenericValue &Dest, const GenericValue &Src1,
+                            const GenericValue &Src2, Type *Ty) {
   switch (Ty->getTypeID()) {
     IMPLEMENT_BINARY_OPERATOR(-, Float);
     IMPLEMENT_BINARY_OPERATOR(-, Double);
@@ -74,8 +111,8 @@ static void executeFSubInst(GenericValue &Dest, GenericValue Src1,
   }
 }
 
-static void executeFMulInst(GenericValue &Dest, GenericValue Src1,
-                            GenericValue Src2, Type *Ty) {
+static void executeFMulInst(GenericValue &Dest, const GenericValue &Src1,
+                            const GenericValue &Src2, Type *Ty) {
   switch (Ty->getTypeID()) {
     IMPLEMENT_BINARY_OPERATOR(*, Float);
     IMPLEMENT_BINARY_OPERATOR(*, Double);
@@ -85,8 +122,8 @@ static void executeFMulInst(GenericValue &Dest, GenericValue Src1,
   }
 }
 
-static void executeFDivInst(GenericValue &Dest, GenericValue Src1, 
-                            GenericValue Src2, Type *Ty) {
+static void executeFDivInst(GenericValue &Dest, const GenericValue &Src1,
+                            const GenericValue &Src2, Type *Ty) {
   switch (Ty->getTypeID()) {
     IMPLEMENT_BINARY_OPERATOR(/, Float);
     IMPLEMENT_BINARY_OPERATOR(/, Double);
@@ -96,8 +133,8 @@ static void executeFDivInst(GenericValue &Dest, GenericValue Src1,
   }
 }
 
-static void executeFRemInst(GenericValue &Dest, GenericValue Src1, 
-                            GenericValue Src2, Type *Ty) {
+static void executeFRemInst(GenericValue &Dest, const GenericValue &Src1,
+                            const GenericValue &Src2, Type *Ty) {
   switch (Ty->getTypeID()) {
   case Type::FloatTyID:
     Dest.FloatVal = fmod(Src1.FloatVal, Src2.FloatVal);
@@ -135,8 +172,8 @@ static void executeFRemInst(GenericValue &Dest, GenericValue Src1,
                             (void*)(intptr_t)Src2.PointerVal); \
       break;
 
-static GenericValue executeICMP_EQ(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeICMP_EQ(const GenericValue &Src1,
+                                   const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(eq,Ty);
@@ -149,8 +186,8 @@ static GenericValue executeICMP_EQ(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_NE(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeICMP_NE(const GenericValue &Src1,
+                                   const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(ne,Ty);
@@ -163,8 +200,8 @@ static GenericValue executeICMP_NE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_ULT(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_ULT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(ult,Ty);
@@ -177,8 +214,8 @@ static GenericValue executeICMP_ULT(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_SLT(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_SLT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(slt,Ty);
@@ -191,8 +228,8 @@ static GenericValue executeICMP_SLT(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_UGT(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_UGT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(ugt,Ty);
@@ -205,8 +242,8 @@ static GenericValue executeICMP_UGT(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_SGT(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_SGT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(sgt,Ty);
@@ -219,8 +256,8 @@ static GenericValue executeICMP_SGT(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_ULE(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_ULE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(ule,Ty);
@@ -233,8 +270,8 @@ static GenericValue executeICMP_ULE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_SLE(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_SLE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(sle,Ty);
@@ -247,8 +284,8 @@ static GenericValue executeICMP_SLE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_UGE(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_UGE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(uge,Ty);
@@ -261,8 +298,8 @@ static GenericValue executeICMP_UGE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeICMP_SGE(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty) {
+static GenericValue executeICMP_SGE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_INTEGER_ICMP(sge,Ty);
@@ -276,10 +313,10 @@ static GenericValue executeICMP_SGE(GenericValue Src1, GenericValue Src2,
 }
 
 void Interpreter::visitICmpInst(ICmpInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Type *Ty    = I.getOperand(0)->getType();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue R;   // Result
   
   switch (I.getPredicate()) {
@@ -298,7 +335,7 @@ void Interpreter::visitICmpInst(ICmpInst &I) {
     llvm_unreachable(nullptr);
   }
  
-  SetValue(&I, R, SF);
+  SetResult(R, SF);
 }
 
 #define IMPLEMENT_FCMP(OP, TY) \
@@ -322,8 +359,8 @@ void Interpreter::visitICmpInst(ICmpInst &I) {
         IMPLEMENT_VECTOR_FCMP_T(OP, Double);                        \
     }
 
-static GenericValue executeFCMP_OEQ(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_OEQ(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_FCMP(==, Float);
@@ -372,9 +409,8 @@ static GenericValue executeFCMP_OEQ(GenericValue Src1, GenericValue Src2,
 
 
 
-static GenericValue executeFCMP_ONE(GenericValue Src1, GenericValue Src2,
-                                    Type *Ty)
-{
+static GenericValue executeFCMP_ONE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   // if input is scalar value and Src1 or Src2 is NaN return false
   IMPLEMENT_SCALAR_NANS(Ty, Src1, Src2)
@@ -398,8 +434,8 @@ static GenericValue executeFCMP_ONE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeFCMP_OLE(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_OLE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_FCMP(<=, Float);
@@ -412,8 +448,8 @@ static GenericValue executeFCMP_OLE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeFCMP_OGE(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_OGE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_FCMP(>=, Float);
@@ -426,8 +462,8 @@ static GenericValue executeFCMP_OGE(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeFCMP_OLT(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_OLT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_FCMP(<, Float);
@@ -440,8 +476,8 @@ static GenericValue executeFCMP_OLT(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeFCMP_OGT(GenericValue Src1, GenericValue Src2,
-                                     Type *Ty) {
+static GenericValue executeFCMP_OGT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   switch (Ty->getTypeID()) {
     IMPLEMENT_FCMP(>, Float);
@@ -475,8 +511,8 @@ static GenericValue executeFCMP_OGT(GenericValue Src1, GenericValue Src2,
     return Dest;                                                               \
   }
 
-static GenericValue executeFCMP_UEQ(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_UEQ(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   IMPLEMENT_UNORDERED(Ty, Src1, Src2)
   MASK_VECTOR_NANS(Ty, Src1, Src2, true)
@@ -485,8 +521,8 @@ static GenericValue executeFCMP_UEQ(GenericValue Src1, GenericValue Src2,
 
 }
 
-static GenericValue executeFCMP_UNE(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_UNE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   IMPLEMENT_UNORDERED(Ty, Src1, Src2)
   MASK_VECTOR_NANS(Ty, Src1, Src2, true)
@@ -494,8 +530,8 @@ static GenericValue executeFCMP_UNE(GenericValue Src1, GenericValue Src2,
   return executeFCMP_ONE(Src1, Src2, Ty);
 }
 
-static GenericValue executeFCMP_ULE(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_ULE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   IMPLEMENT_UNORDERED(Ty, Src1, Src2)
   MASK_VECTOR_NANS(Ty, Src1, Src2, true)
@@ -503,8 +539,8 @@ static GenericValue executeFCMP_ULE(GenericValue Src1, GenericValue Src2,
   return executeFCMP_OLE(Src1, Src2, Ty);
 }
 
-static GenericValue executeFCMP_UGE(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_UGE(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   IMPLEMENT_UNORDERED(Ty, Src1, Src2)
   MASK_VECTOR_NANS(Ty, Src1, Src2, true)
@@ -512,8 +548,8 @@ static GenericValue executeFCMP_UGE(GenericValue Src1, GenericValue Src2,
   return executeFCMP_OGE(Src1, Src2, Ty);
 }
 
-static GenericValue executeFCMP_ULT(GenericValue Src1, GenericValue Src2,
-                                   Type *Ty) {
+static GenericValue executeFCMP_ULT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   IMPLEMENT_UNORDERED(Ty, Src1, Src2)
   MASK_VECTOR_NANS(Ty, Src1, Src2, true)
@@ -521,8 +557,8 @@ static GenericValue executeFCMP_ULT(GenericValue Src1, GenericValue Src2,
   return executeFCMP_OLT(Src1, Src2, Ty);
 }
 
-static GenericValue executeFCMP_UGT(GenericValue Src1, GenericValue Src2,
-                                     Type *Ty) {
+static GenericValue executeFCMP_UGT(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   IMPLEMENT_UNORDERED(Ty, Src1, Src2)
   MASK_VECTOR_NANS(Ty, Src1, Src2, true)
@@ -530,8 +566,8 @@ static GenericValue executeFCMP_UGT(GenericValue Src1, GenericValue Src2,
   return executeFCMP_OGT(Src1, Src2, Ty);
 }
 
-static GenericValue executeFCMP_ORD(GenericValue Src1, GenericValue Src2,
-                                     Type *Ty) {
+static GenericValue executeFCMP_ORD(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   if(Ty->isVectorTy()) {
     assert(Src1.AggregateVal.size() == Src2.AggregateVal.size());
@@ -561,8 +597,8 @@ static GenericValue executeFCMP_ORD(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeFCMP_UNO(GenericValue Src1, GenericValue Src2,
-                                     Type *Ty) {
+static GenericValue executeFCMP_UNO(const GenericValue &Src1,
+                                    const GenericValue &Src2, Type *Ty) {
   GenericValue Dest;
   if(Ty->isVectorTy()) {
     assert(Src1.AggregateVal.size() == Src2.AggregateVal.size());
@@ -592,8 +628,9 @@ static GenericValue executeFCMP_UNO(GenericValue Src1, GenericValue Src2,
   return Dest;
 }
 
-static GenericValue executeFCMP_BOOL(GenericValue Src1, GenericValue Src2,
-                                     Type *Ty, const bool val) {
+static GenericValue executeFCMP_BOOL(const GenericValue &Src1,
+                                     const GenericValue &Src2, Type *Ty,
+                                     const bool val) {
   GenericValue Dest;
     if(Ty->isVectorTy()) {
       assert(Src1.AggregateVal.size() == Src2.AggregateVal.size());
@@ -608,10 +645,10 @@ static GenericValue executeFCMP_BOOL(GenericValue Src1, GenericValue Src2,
 }
 
 void Interpreter::visitFCmpInst(FCmpInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Type *Ty    = I.getOperand(0)->getType();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue R;   // Result
   
   switch (I.getPredicate()) {
@@ -639,11 +676,11 @@ void Interpreter::visitFCmpInst(FCmpInst &I) {
   case FCmpInst::FCMP_OGE:   R = executeFCMP_OGE(Src1, Src2, Ty); break;
   }
  
-  SetValue(&I, R, SF);
+  SetResult(R, SF);
 }
 
-static GenericValue executeCmpInst(unsigned predicate, GenericValue Src1, 
-                                   GenericValue Src2, Type *Ty) {
+static GenericValue executeCmpInst(unsigned predicate, const GenericValue &Src1,
+                                   const GenericValue &Src2, Type *Ty) {
   GenericValue Result;
   switch (predicate) {
   case ICmpInst::ICMP_EQ:    return executeICMP_EQ(Src1, Src2, Ty);
@@ -679,10 +716,10 @@ static GenericValue executeCmpInst(unsigned predicate, GenericValue Src1,
 }
 
 void Interpreter::visitBinaryOperator(BinaryOperator &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Type *Ty    = I.getOperand(0)->getType();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue R;   // Result
 
   // First process vector operation
@@ -784,11 +821,12 @@ void Interpreter::visitBinaryOperator(BinaryOperator &I) {
     case Instruction::Xor:   R.IntVal = Src1.IntVal ^ Src2.IntVal; break;
     }
   }
-  SetValue(&I, R, SF);
+  SetResult(R, SF);
 }
 
-static GenericValue executeSelectInst(GenericValue Src1, GenericValue Src2,
-                                      GenericValue Src3, Type *Ty) {
+static GenericValue executeSelectInst(const GenericValue &Src1,
+                                      const GenericValue &Src2,
+                                      const GenericValue &Src3, Type *Ty) {
     GenericValue Dest;
     if(Ty->isVectorTy()) {
       assert(Src1.AggregateVal.size() == Src2.AggregateVal.size());
@@ -804,13 +842,13 @@ static GenericValue executeSelectInst(GenericValue Src1, GenericValue Src2,
 }
 
 void Interpreter::visitSelectInst(SelectInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Type * Ty = I.getOperand(0)->getType();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
-  GenericValue Src3 = getOperandValue(I.getOperand(2), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
+  const GenericValue &Src3 = readOperand(I, 2, SF);
   GenericValue R = executeSelectInst(Src1, Src2, Src3, Ty);
-  SetValue(&I, R, SF);
+  SetResult(R, SF);
 }
 
 //===----------------------------------------------------------------------===//
@@ -821,7 +859,7 @@ void Interpreter::exitCalled(GenericValue GV) {
   // runAtExitHandlers() assumes there are no stack frames, but
   // if exit() was called, then it had a stack frame. Blow away
   // the stack before interpreting atexit handlers.
-  ECStack.clear();
+  getThread().ECStack.clear();
   runAtExitHandlers();
   exit(GV.IntVal.zextOrTrunc(32).getZExtValue());
 }
@@ -836,23 +874,25 @@ void Interpreter::exitCalled(GenericValue GV) {
 ///
 void Interpreter::popStackAndReturnValueToCaller(Type *RetTy,
                                                  GenericValue Result) {
+  InterpreterThread &Thread = getThread();
+
   // Pop the current stack frame.
-  ECStack.pop_back();
+  Thread.ECStack.pop_back();
 
-  if (ECStack.empty()) {  // Finished main.  Put result into exit code...
+  if (Thread.ECStack.empty()) {  // Finished main.  Put result into exit code...
     if (RetTy && !RetTy->isVoidTy()) {          // Nonvoid return type?
-      ExitValue = Result;   // Capture the exit value of the program
+      Thread.ExitValue = Result;   // Capture the exit value of the program
     } else {
-      memset(&ExitValue.Untyped, 0, sizeof(ExitValue.Untyped));
+      memset(&Thread.ExitValue.Untyped, 0, sizeof(Thread.ExitValue.Untyped));
     }
   } else {
     // If we have a previous stack frame, and we have a previous call,
     // fill in the return value...
-    ExecutionContext &CallingSF = ECStack.back();
+    ExecutionContext &CallingSF = Thread.ECStack.back();
     if (Instruction *I = CallingSF.Caller.getInstruction()) {
       // Save result...
       if (!CallingSF.Caller.getType()->isVoidTy())
-        SetValue(I, Result, CallingSF);
+        SetResult(Result, CallingSF);
       if (InvokeInst *II = dyn_cast<InvokeInst> (I))
         SwitchToNewBasicBlock (II->getNormalDest (), CallingSF);
       CallingSF.Caller = CallSite();          // We returned from the call...
@@ -861,14 +901,14 @@ void Interpreter::popStackAndReturnValueToCaller(Type *RetTy,
 }
 
 void Interpreter::visitReturnInst(ReturnInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Type *RetTy = Type::getVoidTy(I.getContext());
   GenericValue Result;
 
   // Save away the return value... (if we are not 'ret void')
   if (I.getNumOperands()) {
     RetTy  = I.getReturnValue()->getType();
-    Result = getOperandValue(I.getReturnValue(), SF);
+    Result = readOperand(I, 0, SF);
   }
 
   popStackAndReturnValueToCaller(RetTy, Result);
@@ -879,28 +919,27 @@ void Interpreter::visitUnreachableInst(UnreachableInst &I) {
 }
 
 void Interpreter::visitBranchInst(BranchInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   BasicBlock *Dest;
 
   Dest = I.getSuccessor(0);          // Uncond branches have a fixed dest...
   if (!I.isUnconditional()) {
-    Value *Cond = I.getCondition();
-    if (getOperandValue(Cond, SF).IntVal == 0) // If false cond...
+    if (readOperand(I, 0, SF).IntVal == 0) // If false cond...
       Dest = I.getSuccessor(1);
   }
   SwitchToNewBasicBlock(Dest, SF);
 }
 
 void Interpreter::visitSwitchInst(SwitchInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  Value* Cond = I.getCondition();
-  Type *ElTy = Cond->getType();
-  GenericValue CondVal = getOperandValue(Cond, SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  Type *ElTy = I.getCondition()->getType();
+  const GenericValue &CondVal = readOperand(I, 0, SF);
 
   // Check to see if any of the cases match...
   BasicBlock *Dest = nullptr;
   for (SwitchInst::CaseIt i = I.case_begin(), e = I.case_end(); i != e; ++i) {
-    GenericValue CaseVal = getOperandValue(i.getCaseValue(), SF);
+    // Case values are operands 2, 4, ... after the condition and default.
+    const GenericValue &CaseVal = readOperand(I, 2 + 2 * i.getCaseIndex(), SF);
     if (executeICMP_EQ(CondVal, CaseVal, ElTy).IntVal != 0) {
       Dest = cast<BasicBlock>(i.getCaseSuccessor());
       break;
@@ -911,8 +950,8 @@ void Interpreter::visitSwitchInst(SwitchInst &I) {
 }
 
 void Interpreter::visitIndirectBrInst(IndirectBrInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  void *Dest = GVTOP(getOperandValue(I.getAddress(), SF));
+  ExecutionContext &SF = getThread().ECStack.back();
+  void *Dest = GVTOP(readOperand(I, 0, SF));
   SwitchToNewBasicBlock((BasicBlock*)Dest, SF);
 }
 
@@ -928,14 +967,20 @@ void Interpreter::visitIndirectBrInst(IndirectBrInst &I) {
 // results can happen.  Thus we use a two phase approach.
 //
 void Interpreter::SwitchToNewBasicBlock(BasicBlock *Dest, ExecutionContext &SF){
+  if (TierUp)
+    noteBranch(SF, Dest);
+
   BasicBlock *PrevBB = SF.CurBB;      // Remember where we came from...
   SF.CurBB   = Dest;                  // Update CurBB to branch destination
   SF.CurInst = SF.CurBB->begin();     // Update new instruction ptr...
+  SF.NextOps = &SF.Slots->Code[SF.Slots->BlockStart.lookup(Dest)];
 
   if (!isa<PHINode>(SF.CurInst)) return;  // Nothing fancy to do
 
   // Loop over all of the PHI nodes in the current block, reading their inputs.
+  // The incoming values are the operands of the PHI nodes' records.
   std::vector<GenericValue> ResultValues;
+  const unsigned *Ops = SF.NextOps;
 
   for (; PHINode *PN = dyn_cast<PHINode>(SF.CurInst); ++SF.CurInst) {
     // Search for the value corresponding to this previous bb...
@@ -944,14 +989,16 @@ void Interpreter::SwitchToNewBasicBlock(BasicBlock *Dest, ExecutionContext &SF){
     Value *IncomingValue = PN->getIncomingValue(i);
 
     // Save the incoming value for this PHI node...
-    ResultValues.push_back(getOperandValue(IncomingValue, SF));
+    ResultValues.push_back(readRef(Ops[1 + i], IncomingValue, SF));
+    Ops += 1 + PN->getNumOperands();
   }
 
   // Now loop over all of the PHI nodes setting their values...
   SF.CurInst = SF.CurBB->begin();
   for (unsigned i = 0; isa<PHINode>(SF.CurInst); ++SF.CurInst, ++i) {
     PHINode *PN = cast<PHINode>(SF.CurInst);
-    SetValue(PN, ResultValues[i], SF);
+    SF.Values[SF.NextOps[0]] = std::move(ResultValues[i]);
+    SF.NextOps += 1 + PN->getNumOperands();
   }
 }
 
@@ -960,13 +1007,13 @@ void Interpreter::SwitchToNewBasicBlock(BasicBlock *Dest, ExecutionContext &SF){
 //===----------------------------------------------------------------------===//
 
 void Interpreter::visitAllocaInst(AllocaInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
 
   Type *Ty = I.getType()->getElementType();  // Type to be allocated
 
   // Get the number of elements being allocated by the array...
   unsigned NumElements = 
-    getOperandValue(I.getOperand(0), SF).IntVal.getZExtValue();
+    readOperand(I, 0, SF).IntVal.getZExtValue();
 
   unsigned TypeSize = (size_t)getDataLayout().getTypeAllocSize(Ty);
 
@@ -982,23 +1029,27 @@ void Interpreter::visitAllocaInst(AllocaInst &I) {
 
   GenericValue Result = PTOGV(Memory);
   assert(Result.PointerVal && "Null pointer returned by malloc!");
-  SetValue(&I, Result, SF);
+  SetResult(Result, SF);
 
   if (I.getOpcode() == Instruction::Alloca)
-    ECStack.back().Allocas.add(Memory);
+    getThread().ECStack.back().Allocas.add(Memory);
 }
 
 // getElementOffset - The workhorse for getelementptr.
 //
+// Refs are the decoded operand references of the instruction being executed,
+// or null for a constant expression.
+//
 GenericValue Interpreter::executeGEPOperation(Value *Ptr, gep_type_iterator I,
                                               gep_type_iterator E,
-                                              ExecutionContext &SF) {
+                                              ExecutionContext &SF,
+                                              const unsigned *Refs) {
   assert(Ptr->getType()->isPointerTy() &&
          "Cannot getElementOffset of a nonpointer type!");
 
   uint64_t Total = 0;
 
-  for (; I != E; ++I) {
+  for (unsigned OpNo = 1; I != E; ++I, ++OpNo) {
     if (StructType *STy = dyn_cast<StructType>(*I)) {
       const StructLayout *SLO = getDataLayout().getStructLayout(STy);
 
@@ -1009,7 +1060,10 @@ GenericValue Interpreter::executeGEPOperation(Value *Ptr, gep_type_iterator I,
     } else {
       SequentialType *ST = cast<SequentialType>(*I);
       // Get the index number for the array... which must be long type...
-      GenericValue IdxGV = getOperandValue(I.getOperand(), SF);
+      GenericValue ConstIdx;
+      const GenericValue &IdxGV =
+          Refs ? readRef(Refs[OpNo], I.getOperand(), SF)
+               : (ConstIdx = getOperandValue(I.getOperand(), SF));
 
       int64_t Idx;
       unsigned BitWidth = 
@@ -1025,44 +1079,126 @@ GenericValue Interpreter::executeGEPOperation(Value *Ptr, gep_type_iterator I,
   }
 
   GenericValue Result;
-  Result.PointerVal = ((char*)getOperandValue(Ptr, SF).PointerVal) + Total;
+  void *Base = Refs ? readRef(Refs[0], Ptr, SF).PointerVal
+                    : getOperandValue(Ptr, SF).PointerVal;
+  Result.PointerVal = (char *)Base + Total;
   DEBUG(dbgs() << "GEP Index " << Total << " bytes.\n");
   return Result;
 }
 
 void Interpreter::visitGetElementPtrInst(GetElementPtrInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeGEPOperation(I.getPointerOperand(),
-                                   gep_type_begin(I), gep_type_end(I), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  SetResult(executeGEPOperation(I.getPointerOperand(), gep_type_begin(I),
+                                gep_type_end(I), SF, SF.CurOps + 1),
+            SF);
 }
 
 void Interpreter::visitLoadInst(LoadInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  GenericValue SRC = getOperandValue(I.getPointerOperand(), SF);
-  GenericValue *Ptr = (GenericValue*)GVTOP(SRC);
+  ExecutionContext &SF = getThread().ECStack.back();
+  GenericValue *Ptr = (GenericValue *)GVTOP(readOperand(I, 0, SF));
   GenericValue Result;
-  LoadValueFromMemory(Result, Ptr, I.getType());
-  SetValue(&I, Result, SF);
+  if (I.isAtomic()) {
+    std::lock_guard<std::mutex> Guard(getAtomicLock(Ptr));
+    LoadValueFromMemory(Result, Ptr, I.getType());
+  } else
+    LoadValueFromMemory(Result, Ptr, I.getType());
+  SetResult(Result, SF);
   if (I.isVolatile() && PrintVolatile)
     dbgs() << "Volatile load " << I;
 }
 
 void Interpreter::visitStoreInst(StoreInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  GenericValue Val = getOperandValue(I.getOperand(0), SF);
-  GenericValue SRC = getOperandValue(I.getPointerOperand(), SF);
-  StoreValueToMemory(Val, (GenericValue *)GVTOP(SRC),
-                     I.getOperand(0)->getType());
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Val = readOperand(I, 0, SF);
+  GenericValue *Ptr = (GenericValue *)GVTOP(readOperand(I, 1, SF));
+  if (I.isAtomic()) {
+    std::lock_guard<std::mutex> Guard(getAtomicLock(Ptr));
+    StoreValueToMemory(Val, Ptr, I.getOperand(0)->getType());
+  } else
+    StoreValueToMemory(Val, Ptr, I.getOperand(0)->getType());
   if (I.isVolatile() && PrintVolatile)
     dbgs() << "Volatile store: " << I;
 }
 
+//===----------------------------------------------------------------------===//
+//                 Atomic Memory Instruction Implementations
+//===----------------------------------------------------------------------===//
+//
+// The interpreter makes atomic operations atomic with respect to each other
+// by locking the stripe of their address, which also orders them.
+
+void Interpreter::visitFenceInst(FenceInst &I) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Interpreter::visitAtomicCmpXchgInst(AtomicCmpXchgInst &I) {
+  ExecutionContext &SF = getThread().ECStack.back();
+  GenericValue *Ptr =
+      (GenericValue *)GVTOP(readOperand(I, 0, SF));
+  const GenericValue &Cmp = readOperand(I, 1, SF);
+  const GenericValue &New = readOperand(I, 2, SF);
+  Type *Ty = I.getCompareOperand()->getType();
+
+  GenericValue Old;
+  bool Success;
+  {
+    std::lock_guard<std::mutex> Guard(getAtomicLock(Ptr));
+    LoadValueFromMemory(Old, Ptr, Ty);
+    Success = Ty->isPointerTy() ? Old.PointerVal == Cmp.PointerVal
+                                : Old.IntVal == Cmp.IntVal;
+    if (Success)
+      StoreValueToMemory(New, Ptr, Ty);
+  }
+
+  // The result is { ty, i1 }.
+  GenericValue Result;
+  GenericValue Flag;
+  Flag.IntVal = APInt(1, Success);
+  Result.AggregateVal.push_back(Old);
+  Result.AggregateVal.push_back(Flag);
+  SetResult(Result, SF);
+}
+
+void Interpreter::visitAtomicRMWInst(AtomicRMWInst &I) {
+  ExecutionContext &SF = getThread().ECStack.back();
+  GenericValue *Ptr =
+      (GenericValue *)GVTOP(readOperand(I, 0, SF));
+  const GenericValue &Val = readOperand(I, 1, SF);
+  Type *Ty = I.getType();
+
+  GenericValue Old;
+  {
+    std::lock_guard<std::mutex> Guard(getAtomicLock(Ptr));
+    LoadValueFromMemory(Old, Ptr, Ty);
+
+    GenericValue New;
+    const APInt &L = Old.IntVal, &R = Val.IntVal;
+    switch (I.getOperation()) {
+    default:
+      llvm_unreachable("Unknown atomicrmw operation");
+    case AtomicRMWInst::Xchg: New = Val; break;
+    case AtomicRMWInst::Add:  New.IntVal = L + R; break;
+    case AtomicRMWInst::Sub:  New.IntVal = L - R; break;
+    case AtomicRMWInst::And:  New.IntVal = L & R; break;
+    case AtomicRMWInst::Nand: New.IntVal = ~(L & R); break;
+    case AtomicRMWInst::Or:   New.IntVal = L | R; break;
+    case AtomicRMWInst::Xor:  New.IntVal = L ^ R; break;
+    case AtomicRMWInst::Max:  New.IntVal = L.sgt(R) ? L : R; break;
+    case AtomicRMWInst::Min:  New.IntVal = L.slt(R) ? L : R; break;
+    case AtomicRMWInst::UMax: New.IntVal = L.ugt(R) ? L : R; break;
+    case AtomicRMWInst::UMin: New.IntVal = L.ult(R) ? L : R; break;
+    }
+    StoreValueToMemory(New, Ptr, Ty);
+  }
+  SetResult(Old, SF);
+}
+
 //===----------------------------------------------------------------------===//
 //                 Miscellaneous Instruction Implementations
 //===----------------------------------------------------------------------===//
 
 void Interpreter::visitCallSite(CallSite CS) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
 
   // Check to see if this is an intrinsic function call...
   Function *F = CS.getCalledFunction();
@@ -1072,53 +1208,40 @@ void Interpreter::visitCallSite(CallSite CS) {
       break;
     case Intrinsic::vastart: { // va_start
       GenericValue ArgIndex;
-      ArgIndex.UIntPairVal.first = ECStack.size() - 1;
+      ArgIndex.UIntPairVal.first = getThread().ECStack.size() - 1;
       ArgIndex.UIntPairVal.second = 0;
-      SetValue(CS.getInstruction(), ArgIndex, SF);
+      // va_start returns void in current IR, so the value cannot be read.
+      if (!CS.getType()->isVoidTy())
+        SetResult(ArgIndex, SF);
       return;
     }
     case Intrinsic::vaend:    // va_end is a noop for the interpreter
       return;
     case Intrinsic::vacopy:   // va_copy: dest = src
-      SetValue(CS.getInstruction(), getOperandValue(*CS.arg_begin(), SF), SF);
+      SetResult(readOperand(*CS.getInstruction(), 0, SF), SF);
       return;
     default:
-      // If it is an unknown intrinsic function, use the intrinsic lowering
-      // class to transform it into hopefully tasty LLVM code.
-      //
-      BasicBlock::iterator me(CS.getInstruction());
-      BasicBlock *Parent = CS.getInstruction()->getParent();
-      bool atBegin(Parent->begin() == me);
-      if (!atBegin)
-        --me;
-      IL->LowerIntrinsicCall(cast<CallInst>(CS.getInstruction()));
-
-      // Restore the CurInst pointer to the first instruction newly inserted, if
-      // any.
-      if (atBegin) {
-        SF.CurInst = Parent->begin();
-      } else {
-        SF.CurInst = me;
-        ++SF.CurInst;
-      }
-      return;
+      // Calls to the intrinsics IntrinsicLowering handles were lowered before
+      // the function first ran, so this one is not supported.
+      report_fatal_error("Cannot interpret intrinsic function '" +
+                         F->getName() + "'");
     }
 
 
   SF.Caller = CS;
+  Instruction &I = *CS.getInstruction();
   std::vector<GenericValue> ArgVals;
   const unsigned NumArgs = SF.Caller.arg_size();
   ArgVals.reserve(NumArgs);
-  uint16_t pNum = 1;
-  for (CallSite::arg_iterator i = SF.Caller.arg_begin(),
-         e = SF.Caller.arg_end(); i != e; ++i, ++pNum) {
-    Value *V = *i;
-    ArgVals.push_back(getOperandValue(V, SF));
-  }
+  // The arguments are the first operands of calls and invokes alike.
+  for (unsigned i = 0; i != NumArgs; ++i)
+    ArgVals.push_back(readOperand(I, i, SF));
 
   // To handle indirect calls, we must get the pointer value from the argument
-  // and treat it as a function pointer.
-  GenericValue SRC = getOperandValue(SF.Caller.getCalledValue(), SF);
+  // and treat it as a function pointer. The callee follows the arguments of a
+  // call, and the arguments and the two destinations of an invoke.
+  unsigned CalleeOp = I.getNumOperands() - (isa<InvokeInst>(I) ? 3 : 1);
+  const GenericValue &SRC = readOperand(I, CalleeOp, SF);
   callFunction((Function*)GVTOP(SRC), ArgVals);
 }
 
@@ -1135,9 +1258,9 @@ static unsigned getShiftAmount(uint64_t orgShiftAmount,
 
 
 void Interpreter::visitShl(BinaryOperator &I) {
-  ExecutionContext &SF = ECStack.back();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue Dest;
   Type *Ty = I.getType();
 
@@ -1158,13 +1281,13 @@ void Interpreter::visitShl(BinaryOperator &I) {
     Dest.IntVal = valueToShift.shl(getShiftAmount(shiftAmount, valueToShift));
   }
 
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 void Interpreter::visitLShr(BinaryOperator &I) {
-  ExecutionContext &SF = ECStack.back();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue Dest;
   Type *Ty = I.getType();
 
@@ -1185,13 +1308,13 @@ void Interpreter::visitLShr(BinaryOperator &I) {
     Dest.IntVal = valueToShift.lshr(getShiftAmount(shiftAmount, valueToShift));
   }
 
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 void Interpreter::visitAShr(BinaryOperator &I) {
-  ExecutionContext &SF = ECStack.back();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue Dest;
   Type *Ty = I.getType();
 
@@ -1212,13 +1335,12 @@ void Interpreter::visitAShr(BinaryOperator &I) {
     Dest.IntVal = valueToShift.ashr(getShiftAmount(shiftAmount, valueToShift));
   }
 
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
-GenericValue Interpreter::executeTruncInst(Value *SrcVal, Type *DstTy,
-                                           ExecutionContext &SF) {
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
-  Type *SrcTy = SrcVal->getType();
+GenericValue Interpreter::executeTruncInst(const GenericValue &Src,
+                                           Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
   if (SrcTy->isVectorTy()) {
     Type *DstVecTy = DstTy->getScalarType();
     unsigned DBitWidth = cast<IntegerType>(DstVecTy)->getBitWidth();
@@ -1235,10 +1357,9 @@ GenericValue Interpreter::executeTruncInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeSExtInst(Value *SrcVal, Type *DstTy,
-                                          ExecutionContext &SF) {
-  Type *SrcTy = SrcVal->getType();
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeSExtInst(const GenericValue &Src,
+                                          Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
   if (SrcTy->isVectorTy()) {
     Type *DstVecTy = DstTy->getScalarType();
     unsigned DBitWidth = cast<IntegerType>(DstVecTy)->getBitWidth();
@@ -1255,10 +1376,9 @@ GenericValue Interpreter::executeSExtInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeZExtInst(Value *SrcVal, Type *DstTy,
-                                          ExecutionContext &SF) {
-  Type *SrcTy = SrcVal->getType();
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeZExtInst(const GenericValue &Src,
+                                          Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
   if (SrcTy->isVectorTy()) {
     Type *DstVecTy = DstTy->getScalarType();
     unsigned DBitWidth = cast<IntegerType>(DstVecTy)->getBitWidth();
@@ -1276,12 +1396,12 @@ GenericValue Interpreter::executeZExtInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeFPTruncInst(Value *SrcVal, Type *DstTy,
-                                             ExecutionContext &SF) {
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeFPTruncInst(const GenericValue &Src,
+                                             Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
 
-  if (SrcVal->getType()->getTypeID() == Type::VectorTyID) {
-    assert(SrcVal->getType()->getScalarType()->isDoubleTy() &&
+  if (SrcTy->getTypeID() == Type::VectorTyID) {
+    assert(SrcTy->getScalarType()->isDoubleTy() &&
            DstTy->getScalarType()->isFloatTy() &&
            "Invalid FPTrunc instruction");
 
@@ -1291,7 +1411,7 @@ GenericValue Interpreter::executeFPTruncInst(Value *SrcVal, Type *DstTy,
     for (unsigned i = 0; i < size; i++)
       Dest.AggregateVal[i].FloatVal = (float)Src.AggregateVal[i].DoubleVal;
   } else {
-    assert(SrcVal->getType()->isDoubleTy() && DstTy->isFloatTy() &&
+    assert(SrcTy->isDoubleTy() && DstTy->isFloatTy() &&
            "Invalid FPTrunc instruction");
     Dest.FloatVal = (float)Src.DoubleVal;
   }
@@ -1299,12 +1419,12 @@ GenericValue Interpreter::executeFPTruncInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeFPExtInst(Value *SrcVal, Type *DstTy,
-                                           ExecutionContext &SF) {
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeFPExtInst(const GenericValue &Src,
+                                           Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
 
-  if (SrcVal->getType()->getTypeID() == Type::VectorTyID) {
-    assert(SrcVal->getType()->getScalarType()->isFloatTy() &&
+  if (SrcTy->getTypeID() == Type::VectorTyID) {
+    assert(SrcTy->getScalarType()->isFloatTy() &&
            DstTy->getScalarType()->isDoubleTy() && "Invalid FPExt instruction");
 
     unsigned size = Src.AggregateVal.size();
@@ -1313,7 +1433,7 @@ GenericValue Interpreter::executeFPExtInst(Value *SrcVal, Type *DstTy,
     for (unsigned i = 0; i < size; i++)
       Dest.AggregateVal[i].DoubleVal = (double)Src.AggregateVal[i].FloatVal;
   } else {
-    assert(SrcVal->getType()->isFloatTy() && DstTy->isDoubleTy() &&
+    assert(SrcTy->isFloatTy() && DstTy->isDoubleTy() &&
            "Invalid FPExt instruction");
     Dest.DoubleVal = (double)Src.FloatVal;
   }
@@ -1321,10 +1441,9 @@ GenericValue Interpreter::executeFPExtInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeFPToUIInst(Value *SrcVal, Type *DstTy,
-                                            ExecutionContext &SF) {
-  Type *SrcTy = SrcVal->getType();
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeFPToUIInst(const GenericValue &Src,
+                                            Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
 
   if (SrcTy->getTypeID() == Type::VectorTyID) {
     Type *DstVecTy = DstTy->getScalarType();
@@ -1359,10 +1478,9 @@ GenericValue Interpreter::executeFPToUIInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeFPToSIInst(Value *SrcVal, Type *DstTy,
-                                            ExecutionContext &SF) {
-  Type *SrcTy = SrcVal->getType();
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeFPToSIInst(const GenericValue &Src,
+                                            Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
 
   if (SrcTy->getTypeID() == Type::VectorTyID) {
     Type *DstVecTy = DstTy->getScalarType();
@@ -1396,11 +1514,11 @@ GenericValue Interpreter::executeFPToSIInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeUIToFPInst(Value *SrcVal, Type *DstTy,
-                                            ExecutionContext &SF) {
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeUIToFPInst(const GenericValue &Src,
+                                            Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
 
-  if (SrcVal->getType()->getTypeID() == Type::VectorTyID) {
+  if (SrcTy->getTypeID() == Type::VectorTyID) {
     Type *DstVecTy = DstTy->getScalarType();
     unsigned size = Src.AggregateVal.size();
     // the sizes of src and dst vectors must be equal
@@ -1428,11 +1546,11 @@ GenericValue Interpreter::executeUIToFPInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executeSIToFPInst(Value *SrcVal, Type *DstTy,
-                                            ExecutionContext &SF) {
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeSIToFPInst(const GenericValue &Src,
+                                            Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
 
-  if (SrcVal->getType()->getTypeID() == Type::VectorTyID) {
+  if (SrcTy->getTypeID() == Type::VectorTyID) {
     Type *DstVecTy = DstTy->getScalarType();
     unsigned size = Src.AggregateVal.size();
     // the sizes of src and dst vectors must be equal
@@ -1462,36 +1580,33 @@ GenericValue Interpreter::executeSIToFPInst(Value *SrcVal, Type *DstTy,
   return Dest;
 }
 
-GenericValue Interpreter::executePtrToIntInst(Value *SrcVal, Type *DstTy,
-                                              ExecutionContext &SF) {
+GenericValue Interpreter::executePtrToIntInst(const GenericValue &Src,
+                                              Type *SrcTy, Type *DstTy) {
   uint32_t DBitWidth = cast<IntegerType>(DstTy)->getBitWidth();
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
-  assert(SrcVal->getType()->isPointerTy() && "Invalid PtrToInt instruction");
+  GenericValue Dest;
+  assert(SrcTy->isPointerTy() && "Invalid PtrToInt instruction");
 
   Dest.IntVal = APInt(DBitWidth, (intptr_t) Src.PointerVal);
   return Dest;
 }
 
-GenericValue Interpreter::executeIntToPtrInst(Value *SrcVal, Type *DstTy,
-                                              ExecutionContext &SF) {
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+GenericValue Interpreter::executeIntToPtrInst(const GenericValue &Src,
+                                              Type *SrcTy, Type *DstTy) {
+  GenericValue Dest;
   assert(DstTy->isPointerTy() && "Invalid PtrToInt instruction");
 
   uint32_t PtrSize = getDataLayout().getPointerSizeInBits();
-  if (PtrSize != Src.IntVal.getBitWidth())
-    Src.IntVal = Src.IntVal.zextOrTrunc(PtrSize);
-
-  Dest.PointerVal = PointerTy(intptr_t(Src.IntVal.getZExtValue()));
+  Dest.PointerVal =
+      PointerTy(intptr_t(Src.IntVal.zextOrTrunc(PtrSize).getZExtValue()));
   return Dest;
 }
 
-GenericValue Interpreter::executeBitCastInst(Value *SrcVal, Type *DstTy,
-                                             ExecutionContext &SF) {
+GenericValue Interpreter::executeBitCastInst(const GenericValue &Src,
+                                             Type *SrcTy, Type *DstTy) {
 
   // This instruction supports bitwise conversion of vectors to integers and
   // to vectors of other types (as long as they have the same size)
-  Type *SrcTy = SrcVal->getType();
-  GenericValue Dest, Src = getOperandValue(SrcVal, SF);
+  GenericValue Dest;
 
   if ((SrcTy->getTypeID() == Type::VectorTyID) ||
       (DstTy->getTypeID() == Type::VectorTyID)) {
@@ -1653,76 +1768,88 @@ GenericValue Interpreter::executeBitCastInst(Value *SrcVal, Type *DstTy,
 }
 
 void Interpreter::visitTruncInst(TruncInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeTruncInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeTruncInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitSExtInst(SExtInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeSExtInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeSExtInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitZExtInst(ZExtInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeZExtInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeZExtInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitFPTruncInst(FPTruncInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeFPTruncInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeFPTruncInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitFPExtInst(FPExtInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeFPExtInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeFPExtInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitUIToFPInst(UIToFPInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeUIToFPInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeUIToFPInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitSIToFPInst(SIToFPInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeSIToFPInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeSIToFPInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitFPToUIInst(FPToUIInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeFPToUIInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeFPToUIInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitFPToSIInst(FPToSIInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeFPToSIInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeFPToSIInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitPtrToIntInst(PtrToIntInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executePtrToIntInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executePtrToIntInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitIntToPtrInst(IntToPtrInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeIntToPtrInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeIntToPtrInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 void Interpreter::visitBitCastInst(BitCastInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  SetValue(&I, executeBitCastInst(I.getOperand(0), I.getType(), SF), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src = readOperand(I, 0, SF);
+  SetResult(executeBitCastInst(Src, I.getSrcTy(), I.getDestTy()), SF);
 }
 
 #define IMPLEMENT_VAARG(TY) \
    case Type::TY##TyID: Dest.TY##Val = Src.TY##Val; break
 
 void Interpreter::visitVAArgInst(VAArgInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
 
   // Get the incoming valist parameter.  LLI treats the valist as a
   // (ec-stack-depth var-arg-index) pair.
-  GenericValue VAList = getOperandValue(I.getOperand(0), SF);
+  GenericValue VAList = readOperand(I, 0, SF);
   GenericValue Dest;
-  GenericValue Src = ECStack[VAList.UIntPairVal.first]
+  GenericValue Src = getThread().ECStack[VAList.UIntPairVal.first]
                       .VarArgs[VAList.UIntPairVal.second];
   Type *Ty = I.getType();
   switch (Ty->getTypeID()) {
@@ -1738,16 +1865,16 @@ void Interpreter::visitVAArgInst(VAArgInst &I) {
   }
 
   // Set the Value of this Instruction.
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 
   // Move the pointer to the next vararg.
   ++VAList.UIntPairVal.second;
 }
 
 void Interpreter::visitExtractElementInst(ExtractElementInst &I) {
-  ExecutionContext &SF = ECStack.back();
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  ExecutionContext &SF = getThread().ECStack.back();
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue Dest;
 
   Type *Ty = I.getType();
@@ -1774,19 +1901,19 @@ void Interpreter::visitExtractElementInst(ExtractElementInst &I) {
     dbgs() << "Invalid index in extractelement instruction\n";
   }
 
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 void Interpreter::visitInsertElementInst(InsertElementInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Type *Ty = I.getType();
 
   if(!(Ty->isVectorTy()) )
     llvm_unreachable("Unhandled dest type for insertelement instruction");
 
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
-  GenericValue Src3 = getOperandValue(I.getOperand(2), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
+  const GenericValue &Src3 = readOperand(I, 2, SF);
   GenericValue Dest;
 
   Type *TyContained = Ty->getContainedType(0);
@@ -1809,19 +1936,19 @@ void Interpreter::visitInsertElementInst(InsertElementInst &I) {
       Dest.AggregateVal[indx].DoubleVal = Src2.DoubleVal;
       break;
   }
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 void Interpreter::visitShuffleVectorInst(ShuffleVectorInst &I){
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
 
   Type *Ty = I.getType();
   if(!(Ty->isVectorTy()))
     llvm_unreachable("Unhandled dest type for shufflevector instruction");
 
-  GenericValue Src1 = getOperandValue(I.getOperand(0), SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
-  GenericValue Src3 = getOperandValue(I.getOperand(2), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
+  const GenericValue &Src3 = readOperand(I, 2, SF);
   GenericValue Dest;
 
   // There is no need to check types of src1 and src2, because the compiled
@@ -1879,18 +2006,18 @@ void Interpreter::visitShuffleVectorInst(ShuffleVectorInst &I){
       }
       break;
   }
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 void Interpreter::visitExtractValueInst(ExtractValueInst &I) {
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Value *Agg = I.getAggregateOperand();
   GenericValue Dest;
-  GenericValue Src = getOperandValue(Agg, SF);
+  const GenericValue &Src = readOperand(I, 0, SF);
 
   ExtractValueInst::idx_iterator IdxBegin = I.idx_begin();
   unsigned Num = I.getNumIndices();
-  GenericValue *pSrc = &Src;
+  const GenericValue *pSrc = &Src;
 
   for (unsigned i = 0 ; i < Num; ++i) {
     pSrc = &pSrc->AggregateVal[*IdxBegin];
@@ -1921,16 +2048,16 @@ void Interpreter::visitExtractValueInst(ExtractValueInst &I) {
     break;
   }
 
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 void Interpreter::visitInsertValueInst(InsertValueInst &I) {
 
-  ExecutionContext &SF = ECStack.back();
+  ExecutionContext &SF = getThread().ECStack.back();
   Value *Agg = I.getAggregateOperand();
 
-  GenericValue Src1 = getOperandValue(Agg, SF);
-  GenericValue Src2 = getOperandValue(I.getOperand(1), SF);
+  const GenericValue &Src1 = readOperand(I, 0, SF);
+  const GenericValue &Src2 = readOperand(I, 1, SF);
   GenericValue Dest = Src1; // Dest is a slightly changed Src1
 
   ExtractValueInst::idx_iterator IdxBegin = I.idx_begin();
@@ -1968,36 +2095,41 @@ void Interpreter::visitInsertValueInst(InsertValueInst &I) {
     break;
   }
 
-  SetValue(&I, Dest, SF);
+  SetResult(Dest, SF);
 }
 
 GenericValue Interpreter::getConstantExprValue (ConstantExpr *CE,
                                                 ExecutionContext &SF) {
+  GenericValue Src;
+  Type *SrcTy = CE->getOperand(0)->getType();
+  if (CE->isCast())
+    Src = getOperandValue(CE->getOperand(0), SF);
+
   switch (CE->getOpcode()) {
   case Instruction::Trunc:
-      return executeTruncInst(CE->getOperand(0), CE->getType(), SF);
+      return executeTruncInst(Src, SrcTy, CE->getType());
   case Instruction::ZExt:
-      return executeZExtInst(CE->getOperand(0), CE->getType(), SF);
+      return executeZExtInst(Src, SrcTy, CE->getType());
   case Instruction::SExt:
-      return executeSExtInst(CE->getOperand(0), CE->getType(), SF);
+      return executeSExtInst(Src, SrcTy, CE->getType());
   case Instruction::FPTrunc:
-      return executeFPTruncInst(CE->getOperand(0), CE->getType(), SF);
+      return executeFPTruncInst(Src, SrcTy, CE->getType());
   case Instruction::FPExt:
-      return executeFPExtInst(CE->getOperand(0), CE->getType(), SF);
+      return executeFPExtInst(Src, SrcTy, CE->getType());
   case Instruction::UIToFP:
-      return executeUIToFPInst(CE->getOperand(0), CE->getType(), SF);
+      return executeUIToFPInst(Src, SrcTy, CE->getType());
   case Instruction::SIToFP:
-      return executeSIToFPInst(CE->getOperand(0), CE->getType(), SF);
+      return executeSIToFPInst(Src, SrcTy, CE->getType());
   case Instruction::FPToUI:
-      return executeFPToUIInst(CE->getOperand(0), CE->getType(), SF);
+      return executeFPToUIInst(Src, SrcTy, CE->getType());
   case Instruction::FPToSI:
-      return executeFPToSIInst(CE->getOperand(0), CE->getType(), SF);
+      return executeFPToSIInst(Src, SrcTy, CE->getType());
   case Instruction::PtrToInt:
-      return executePtrToIntInst(CE->getOperand(0), CE->getType(), SF);
+      return executePtrToIntInst(Src, SrcTy, CE->getType());
   case Instruction::IntToPtr:
-      return executeIntToPtrInst(CE->getOperand(0), CE->getType(), SF);
+      return executeIntToPtrInst(Src, SrcTy, CE->getType());
   case Instruction::BitCast:
-      return executeBitCastInst(CE->getOperand(0), CE->getType(), SF);
+      return executeBitCastInst(Src, SrcTy, CE->getType());
   case Instruction::GetElementPtr:
     return executeGEPOperation(CE->getOperand(0), gep_type_begin(CE),
                                gep_type_end(CE), SF);
@@ -2062,7 +2194,9 @@ GenericValue Interpreter::getOperandValue(Value *V, ExecutionContext &SF) {
   } else if (GlobalValue *GV = dyn_cast<GlobalValue>(V)) {
     return PTOGV(getPointerToGlobal(GV));
   } else {
-    return SF.Values[V];
+    // Operands of instructions are read through the decoded code of their
+    // function, see readOperand.
+    return GenericValue();
   }
 }
 
@@ -2070,10 +2204,102 @@ GenericValue Interpreter::getOperandValue(Value *V, ExecutionContext &SF) {
 //                        Dispatch and Execution Code
 //===----------------------------------------------------------------------===//
 
+// isDecodableConstant - Return true if C is evaluated when its function is
+// decoded. Constants the interpreter may fail to evaluate are left until they
+// are read, so that code which never runs cannot fail.
+static bool isDecodableConstant(const Constant *C) {
+  if (isa<UndefValue>(C) || isa<ConstantInt>(C) || isa<ConstantFP>(C) ||
+      isa<ConstantPointerNull>(C) || isa<Function>(C) || isa<GlobalVariable>(C))
+    return true;
+  if (C->getType()->isVectorTy() && !isa<ConstantExpr>(C))
+    return std::all_of(C->op_begin(), C->op_end(), [](const Use &Op) {
+      return isa<ConstantInt>(Op) || isa<ConstantFP>(Op) || isa<UndefValue>(Op);
+    });
+  if (const ConstantExpr *CE = dyn_cast<ConstantExpr>(C))
+    if ((CE->isCast() || CE->getOpcode() == Instruction::GetElementPtr) &&
+        !CE->getType()->isVectorTy())
+      return std::all_of(CE->op_begin(), CE->op_end(), [](const Use &Op) {
+        return isDecodableConstant(cast<Constant>(Op));
+      });
+  return false;
+}
+
+void Interpreter::decodeFunction(Function &F, FunctionSlots &Slots) {
+  DenseMap<const Value *, unsigned> Numbers;
+  for (Argument &A : F.args())
+    Numbers.insert(std::make_pair(&A, Numbers.size()));
+  for (BasicBlock &BB : F)
+    for (Instruction &I : BB)
+      if (!I.getType()->isVoidTy())
+        Numbers.insert(std::make_pair(&I, Numbers.size()));
+  Slots.NumSlots = Numbers.size();
+
+  // The first constant is the empty value of operands that are never read as
+  // values, such as basic blocks.
+  Slots.Constants.emplace_back();
+  DenseMap<const Constant *, unsigned> ConstantNumbers;
+  ExecutionContext NoFrame;   // Constants do not depend on the frame.
+
+  for (BasicBlock &BB : F) {
+    Slots.BlockStart[&BB] = Slots.Code.size();
+    for (Instruction &I : BB) {
+      Slots.Code.push_back(I.getType()->isVoidTy() ? FunctionSlots::NoSlot
+                                                   : Numbers.lookup(&I));
+      for (Value *Op : I.operands()) {
+        unsigned Ref = FunctionSlots::ConstantRef;
+        auto N = Numbers.find(Op);
+        if (N != Numbers.end()) {
+          Ref = N->second;
+        } else if (Constant *C = dyn_cast<Constant>(Op)) {
+          if (isDecodableConstant(C)) {
+            auto CN = ConstantNumbers.insert(
+                std::make_pair(C, unsigned(Slots.Constants.size())));
+            if (CN.second)
+              Slots.Constants.push_back(getOperandValue(C, NoFrame));
+            Ref = FunctionSlots::ConstantRef + CN.first->second;
+          } else {
+            Ref = FunctionSlots::NoSlot;
+          }
+        }
+        Slots.Code.push_back(Ref);
+      }
+    }
+  }
+}
+
+FunctionSlots &Interpreter::getFunctionSlots(Function *F) {
+  if (!Threaded) {
+    std::unique_ptr<FunctionSlots> &Slots = FunctionSlotMap[F];
+    if (!Slots) {
+      lowerIntrinsics(*F);
+      Slots.reset(new FunctionSlots());
+      decodeFunction(*F, *Slots);
+    }
+    return *Slots;
+  }
+
+  // enableThreads() decoded every function and FunctionSlotMap no longer
+  // changes, so it is read without the lock. Only functions of modules added
+  // since then are decoded here. No thread can be running such a function
+  // before its first call, so lowering it is safe.
+  auto I = FunctionSlotMap.find(F);
+  if (I != FunctionSlotMap.end())
+    return *I->second;
+  sys::ScopedLock Guard(ThreadLock);
+  std::unique_ptr<FunctionSlots> &Slots = LateFunctionSlotMap[F];
+  if (!Slots) {
+    lowerIntrinsics(*F);
+    Slots.reset(new FunctionSlots());
+    decodeFunction(*F, *Slots);
+  }
+  return *Slots;
+}
+
 //===----------------------------------------------------------------------===//
 // callFunction - Execute the specified function...
 //
 void Interpreter::callFunction(Function *F, ArrayRef<GenericValue> ArgVals) {
+  std::vector<ExecutionContext> &ECStack = getThread().ECStack;
   assert((ECStack.empty() || !ECStack.back().Caller.getInstruction() ||
           ECStack.back().Caller.arg_size() == ArgVals.size()) &&
          "Incorrect number of arguments passed into function call!");
@@ -2090,9 +2316,22 @@ void Interpreter::callFunction(Function *F, ArrayRef<GenericValue> ArgVals) {
     return;
   }
 
+  // Hot functions run as native code once they have been compiled.
+  if (TierUp)
+    if (TieredEntryPoint Entry = getTieredEntryPoint(F)) {
+      GenericValue Result = callTieredFunction(F, Entry, ArgVals);
+      popStackAndReturnValueToCaller(F->getReturnType(), Result);
+      return;
+    }
+
+  // Allocate the whole value plane up front.
+  StackFrame.Slots = &getFunctionSlots(F);
+  StackFrame.Values.resize(StackFrame.Slots->size());
+
   // Get pointers to first LLVM BB & Instruction in function.
   StackFrame.CurBB     = F->begin();
   StackFrame.CurInst   = StackFrame.CurBB->begin();
+  StackFrame.NextOps   = StackFrame.Slots->Code.data();
 
   // Run through the function arguments and initialize their values...
   assert((ArgVals.size() == F->arg_size() ||
@@ -2103,7 +2342,7 @@ void Interpreter::callFunction(Function *F, ArrayRef<GenericValue> ArgVals) {
   unsigned i = 0;
   for (Function::arg_iterator AI = F->arg_begin(), E = F->arg_end(); 
        AI != E; ++AI, ++i)
-    SetValue(AI, ArgVals[i], StackFrame);
+    StackFrame.Values[i] = ArgVals[i];   // Arguments have the first slots.
 
   // Handle varargs arguments...
   StackFrame.VarArgs.assign(ArgVals.begin()+i, ArgVals.end());
@@ -2111,10 +2350,13 @@ void Interpreter::callFunction(Function *F, ArrayRef<GenericValue> ArgVals) {
 
 
 void Interpreter::run() {
+  std::vector<ExecutionContext> &ECStack = getThread().ECStack;
   while (!ECStack.empty()) {
     // Interpret a single instruction & increment the "PC".
     ExecutionContext &SF = ECStack.back();  // Current stack frame
     Instruction &I = *SF.CurInst++;         // Increment before execute
+    SF.CurOps = SF.NextOps;                 // Decoded operands of I
+    SF.NextOps += 1 + I.getNumOperands();
 
     // Track the number of dynamic instructions executed.
     ++NumDynamicInsts;
@@ -2127,7 +2369,7 @@ DEBUG(
     if (!isa<CallInst>(I) && !isa<InvokeInst>(I) && 
         I.getType() != Type::VoidTy) {
       dbgs() << "  --> ";
-      const GenericValue &Val = SF.Values[&I];
+      const GenericValue &Val = SF.Values[SF.CurOps[0]];
       switch (I.getType()->getTypeID()) {
       default: llvm_unreachable("Invalid GenericValue Type");
       case Type::VoidTyID:    dbgs() << "void"; break;
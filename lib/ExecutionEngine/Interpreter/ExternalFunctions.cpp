@@ -29,6 +29,7 @@
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Mutex.h"
 #include "llvm/Support/UniqueLock.h"
+#include <atomic>
 #include <cmath>
 #include <csignal>
 #include <cstdio>
@@ -45,9 +46,15 @@
 #endif
 #endif
 
+#if LLVM_ENABLE_THREADS != 0 && defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#define INTERPRET_PTHREADS
+#endif
+
 using namespace llvm;
 
 static ManagedStatic<sys::Mutex> FunctionsLock;
+static ManagedStatic<sys::Mutex> OutputLock;
 
 typedef GenericValue (*ExFunc)(FunctionType *, ArrayRef<GenericValue>);
 static ManagedStatic<std::map<const Function *, ExFunc> > ExportedFunctions;
@@ -60,6 +67,39 @@ static ManagedStatic<std::map<const Function *, RawFunc> > RawFunctions;
 
 static Interpreter *TheInterpreter;
 
+static const unsigned FunctionCacheSize = 512;
+static const unsigned FunctionCacheProbes = 8;
+
+static const CachedFunction *findCachedFunction(const CachedFunction *Cache,
+                                                const Function *F) {
+  unsigned Hash = DenseMapInfo<const Function *>::getHashValue(F);
+  for (unsigned i = 0; i != FunctionCacheProbes; ++i) {
+    const CachedFunction &Entry = Cache[(Hash + i) % FunctionCacheSize];
+    const Function *Key = Entry.F.load(std::memory_order_acquire);
+    if (Key == F)
+      return &Entry;
+    if (!Key)
+      return nullptr;
+  }
+  return nullptr;
+}
+
+// Return a free cache entry for F, or null if its probe sequence is full. The
+// caller must hold FunctionsLock, fill in the entry and then publish it.
+static CachedFunction *allocateCachedFunction(CachedFunction *Cache,
+                                              const Function *F) {
+  unsigned Hash = DenseMapInfo<const Function *>::getHashValue(F);
+  for (unsigned i = 0; i != FunctionCacheProbes; ++i) {
+    CachedFunction &Entry = Cache[(Hash + i) % FunctionCacheSize];
+    const Function *Key = Entry.F.load(std::memory_order_relaxed);
+    if (Key == F)
+      return nullptr;
+    if (!Key)
+      return &Entry;
+  }
+  return nullptr;
+}
+
 static char getTypeID(Type *Ty) {
   switch (Ty->getTypeID()) {
   case Type::VoidTyID:    return 'V';
@@ -246,6 +286,18 @@ GenericValue Interpreter::callExternalFunction(Function *F,
                                                ArrayRef<GenericValue> ArgVals) {
   TheInterpreter = this;
 
+  // Functions called before are found without taking the lock.
+  CachedFunction *Cache = FunctionCache.get();
+  if (const CachedFunction *Cached = findCachedFunction(Cache, F)) {
+    if (Cached->Fn)
+      return Cached->Fn(F->getFunctionType(), ArgVals);
+#ifdef USE_LIBFFI
+    GenericValue Result;
+    if (ffiInvoke(Cached->RawFn, F, ArgVals, getDataLayout(), Result))
+      return Result;
+#endif
+  }
+
   unique_lock<sys::Mutex> Guard(*FunctionsLock);
 
   // Do a lookup to see if the function is in our cache... this should just be a
@@ -253,6 +305,10 @@ GenericValue Interpreter::callExternalFunction(Function *F,
   std::map<const Function *, ExFunc>::iterator FI = ExportedFunctions->find(F);
   if (ExFunc Fn = (FI == ExportedFunctions->end()) ? lookupFunction(F)
                                                    : FI->second) {
+    if (CachedFunction *Entry = allocateCachedFunction(Cache, F)) {
+      Entry->Fn = Fn;
+      Entry->F.store(F, std::memory_order_release);
+    }
     Guard.unlock();
     return Fn(F->getFunctionType(), ArgVals);
   }
@@ -271,6 +327,13 @@ GenericValue Interpreter::callExternalFunction(Function *F,
     RawFn = RF->second;
   }
 
+  if (RawFn)
+    if (CachedFunction *Entry = allocateCachedFunction(Cache, F)) {
+      Entry->Fn = nullptr;
+      Entry->RawFn = RawFn;
+      Entry->F.store(F, std::memory_order_release);
+    }
+
   Guard.unlock();
 
   GenericValue Result;
@@ -319,6 +382,63 @@ static GenericValue lle_X_abort(FunctionType *FT, ArrayRef<GenericValue> Args) {
   return GenericValue();
 }
 
+#ifdef INTERPRET_PTHREADS
+namespace {
+struct GuestThread {
+  Interpreter *Interp;
+  Function *StartRoutine;
+  void *Arg;
+};
+}
+
+static void *startGuestThread(void *P) {
+  std::unique_ptr<GuestThread> Thread(static_cast<GuestThread *>(P));
+  return Thread->Interp->runGuestThread(Thread->StartRoutine, Thread->Arg);
+}
+
+// int pthread_create(pthread_t *, const pthread_attr_t *,
+//                    void *(*)(void *), void *)
+static GenericValue lle_X_pthread_create(FunctionType *FT,
+                                         ArrayRef<GenericValue> Args) {
+  assert(Args.size() == 4);
+  TheInterpreter->enableThreads();
+
+  // The start routine is a function of the interpreted program, so the new
+  // thread starts out in the interpreter.
+  GuestThread *Thread = new GuestThread();
+  Thread->Interp = TheInterpreter;
+  Thread->StartRoutine = (Function *)GVTOP(Args[2]);
+  Thread->Arg = GVTOP(Args[3]);
+  int Result = pthread_create((pthread_t *)GVTOP(Args[0]),
+                              (const pthread_attr_t *)GVTOP(Args[1]),
+                              startGuestThread, Thread);
+  if (Result)
+    delete Thread;
+
+  GenericValue GV;
+  GV.IntVal = APInt(32, Result);
+  return GV;
+}
+
+// int pthread_join(pthread_t, void **)
+static GenericValue lle_X_pthread_join(FunctionType *FT,
+                                       ArrayRef<GenericValue> Args) {
+  assert(Args.size() == 2);
+  // pthread_t is an integer or a pointer depending on the host.
+  static_assert(sizeof(pthread_t) == sizeof(uintptr_t),
+                "pthread_t does not fit a GenericValue");
+  uintptr_t Handle = FT->getParamType(0)->isPointerTy()
+                         ? reinterpret_cast<uintptr_t>(GVTOP(Args[0]))
+                         : Args[0].IntVal.getZExtValue();
+  pthread_t Thread;
+  memcpy(&Thread, &Handle, sizeof(Thread));
+
+  GenericValue GV;
+  GV.IntVal = APInt(32, pthread_join(Thread, (void **)GVTOP(Args[1])));
+  return GV;
+}
+#endif // INTERPRET_PTHREADS
+
 // int sprintf(char *, const char *, ...) - a very rough implementation to make
 // output useful.
 static GenericValue lle_X_sprintf(FunctionType *FT,
@@ -410,6 +530,7 @@ static GenericValue lle_X_printf(FunctionType *FT,
   NewArgs.push_back(PTOGV((void*)&Buffer[0]));
   NewArgs.insert(NewArgs.end(), Args.begin(), Args.end());
   GenericValue GV = lle_X_sprintf(FT, NewArgs);
+  sys::ScopedLock Guard(*OutputLock);
   outs() << Buffer;
   return GV;
 }
@@ -487,6 +608,10 @@ void Interpreter::initializeExternalFunctions() {
   (*FuncNames)["lle_X_atexit"]       = lle_X_atexit;
   (*FuncNames)["lle_X_exit"]         = lle_X_exit;
   (*FuncNames)["lle_X_abort"]        = lle_X_abort;
+#ifdef INTERPRET_PTHREADS
+  (*FuncNames)["lle_X_pthread_create"] = lle_X_pthread_create;
+  (*FuncNames)["lle_X_pthread_join"] = lle_X_pthread_join;
+#endif
 
   (*FuncNames)["lle_X_printf"]       = lle_X_printf;
   (*FuncNames)["lle_X_sprintf"]      = lle_X_sprintf;
@@ -495,4 +620,21 @@ void Interpreter::initializeExternalFunctions() {
   (*FuncNames)["lle_X_fprintf"]      = lle_X_fprintf;
   (*FuncNames)["lle_X_memset"]       = lle_X_memset;
   (*FuncNames)["lle_X_memcpy"]       = lle_X_memcpy;
+
+  FunctionCache.reset(new CachedFunction[FunctionCacheSize]());
+}
+
+void Interpreter::clearExternalFunctions(Module &M) {
+  sys::ScopedLock Writer(*FunctionsLock);
+  for (Function &F : M) {
+    ExportedFunctions->erase(&F);
+#ifdef USE_LIBFFI
+    RawFunctions->erase(&F);
+#endif
+  }
+
+  // Open addressing cannot delete single entries, so start the cache over.
+  // The program must not be running while a module is removed.
+  for (unsigned i = 0; i != FunctionCacheSize; ++i)
+    FunctionCache[i].F.store(nullptr, std::memory_order_relaxed);
 }
@@ -14,8 +14,11 @@
 //===----------------------------------------------------------------------===//
 
 #include "Interpreter.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/CodeGen/IntrinsicLowering.h"
 #include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
 #include <cstring>
 using namespace llvm;
@@ -48,10 +51,11 @@ ExecutionEngine *Interpreter::create(std::unique_ptr<Module> M,
 //===----------------------------------------------------------------------===//
 // Interpreter ctor - Initialize stuff
 //
+LLVM_THREAD_LOCAL InterpreterThread *Interpreter::CurrentThread = nullptr;
+
 Interpreter::Interpreter(std::unique_ptr<Module> M)
-    : ExecutionEngine(std::move(M)) {
+    : ExecutionEngine(std::move(M)), Threaded(false), TierUpThreshold(0) {
 
-  memset(&ExitValue.Untyped, 0, sizeof(ExitValue.Untyped));
   // Initialize the "backend"
   initializeExecutionEngine();
   initializeExternalFunctions();
@@ -95,5 +99,151 @@ GenericValue Interpreter::runFunction(Function *F,
   // Start executing the function.
   run();
 
-  return ExitValue;
+  return getThread().ExitValue;
+}
+
+/// Returns true if IntrinsicLowering knows how to lower calls to ID.
+static bool isLowerableIntrinsic(Intrinsic::ID ID) {
+  switch (ID) {
+  default:
+    return false;
+  case Intrinsic::expect:
+  case Intrinsic::setjmp:
+  case Intrinsic::sigsetjmp:
+  case Intrinsic::longjmp:
+  case Intrinsic::siglongjmp:
+  case Intrinsic::ctpop:
+  case Intrinsic::bswap:
+  case Intrinsic::ctlz:
+  case Intrinsic::cttz:
+  case Intrinsic::stacksave:
+  case Intrinsic::stackrestore:
+  case Intrinsic::returnaddress:
+  case Intrinsic::frameaddress:
+  case Intrinsic::prefetch:
+  case Intrinsic::pcmarker:
+  case Intrinsic::readcyclecounter:
+  case Intrinsic::dbg_declare:
+  case Intrinsic::eh_typeid_for:
+  case Intrinsic::annotation:
+  case Intrinsic::ptr_annotation:
+  case Intrinsic::assume:
+  case Intrinsic::var_annotation:
+  case Intrinsic::memcpy:
+  case Intrinsic::memmove:
+  case Intrinsic::memset:
+  case Intrinsic::sqrt:
+  case Intrinsic::log:
+  case Intrinsic::log2:
+  case Intrinsic::log10:
+  case Intrinsic::exp:
+  case Intrinsic::exp2:
+  case Intrinsic::pow:
+  case Intrinsic::sin:
+  case Intrinsic::cos:
+  case Intrinsic::floor:
+  case Intrinsic::ceil:
+  case Intrinsic::trunc:
+  case Intrinsic::round:
+  case Intrinsic::copysign:
+  case Intrinsic::flt_rounds:
+  case Intrinsic::invariant_start:
+  case Intrinsic::lifetime_start:
+  case Intrinsic::invariant_end:
+  case Intrinsic::lifetime_end:
+    return true;
+  }
+}
+
+/// Lower the calls in F to the intrinsics IntrinsicLowering knows about. The
+/// interpreter does this before F first runs, so F's value numbering is
+/// complete when it is built and F does not change while it runs.
+void Interpreter::lowerIntrinsics(Function &F) {
+  for (BasicBlock &BB : F)
+    for (auto I = BB.begin(), E = BB.end(); I != E;) {
+      auto *II = dyn_cast<IntrinsicInst>(&*I++);
+      if (II && isLowerableIntrinsic(II->getIntrinsicID()))
+        IL->LowerIntrinsicCall(II);
+    }
+}
+
+void Interpreter::enableThreads() {
+  sys::ScopedLock Guard(ThreadLock);
+  if (Threaded)
+    return;
+
+  // Functions that have been called were lowered and decoded then. Do the
+  // others now, while the calling thread is the only one: rewriting code that
+  // other threads may be running is not safe, and once threads run
+  // FunctionSlotMap is only read, so that calls don't take ThreadLock.
+  for (auto &M : Modules)
+    for (Function &F : *M) {
+      if (F.isDeclaration())
+        continue;
+      std::unique_ptr<FunctionSlots> &Slots = FunctionSlotMap[&F];
+      if (!Slots) {
+        lowerIntrinsics(F);
+        Slots.reset(new FunctionSlots());
+        decodeFunction(F, *Slots);
+      }
+    }
+
+  // DataLayout computes struct layouts on first use, which is not safe from
+  // several threads. Compute those of every type the program uses now.
+  SmallVector<Type *, 32> Worklist;
+  SmallPtrSet<Type *, 32> Visited;
+  for (auto &M : Modules) {
+    for (GlobalVariable &GV : M->globals())
+      Worklist.push_back(GV.getValueType());
+    for (Function &F : *M)
+      for (BasicBlock &BB : F)
+        for (Instruction &I : BB) {
+          Worklist.push_back(I.getType());
+          for (Value *Op : I.operands())
+            Worklist.push_back(Op->getType());
+          if (auto *AI = dyn_cast<AllocaInst>(&I))
+            Worklist.push_back(AI->getAllocatedType());
+          else if (auto *GEP = dyn_cast<GetElementPtrInst>(&I))
+            Worklist.push_back(GEP->getSourceElementType());
+        }
+  }
+  while (!Worklist.empty()) {
+    Type *Ty = Worklist.pop_back_val();
+    if (!Visited.insert(Ty).second)
+      continue;
+    if (auto *STy = dyn_cast<StructType>(Ty))
+      if (STy->isSized())
+        getDataLayout().getStructLayout(STy);
+    Worklist.append(Ty->subtype_begin(), Ty->subtype_end());
+  }
+
+  // Native code would not see the locks that make the program's atomic
+  // operations atomic in the interpreter.
+  TierUp = nullptr;
+
+  Threaded = true;
+}
+
+bool Interpreter::removeModule(Module *M) {
+  if (!ExecutionEngine::removeModule(M))
+    return false;
+
+  // The functions of M may be freed and their addresses reused, so drop
+  // everything that is keyed by them.
+  clearExternalFunctions(*M);
+  for (Function &F : *M) {
+    FunctionSlotMap.erase(&F);
+    LateFunctionSlotMap.erase(&F);
+    TieredFunctions.erase(&F);
+  }
+  MainThread.LazyConstants.clear();
+  return true;
+}
+
+void *Interpreter::runGuestThread(Function *F, void *Arg) {
+  InterpreterThread Thread;
+  CurrentThread = &Thread;
+  GenericValue Result = runFunction(F, PTOGV(Arg));
+  CurrentThread = nullptr;
+  return GVTOP(Result);
 }
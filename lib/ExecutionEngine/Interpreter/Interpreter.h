@@ -14,6 +14,8 @@
 #ifndef LLVM_LIB_EXECUTIONENGINE_INTERPRETER_INTERPRETER_H
 #define LLVM_LIB_EXECUTIONENGINE_INTERPRETER_INTERPRETER_H
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/IR/CallSite.h"
@@ -22,7 +24,12 @@
 #include "llvm/IR/InstVisitor.h"
 #include "llvm/Support/DataTypes.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/Mutex.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 namespace llvm {
 
 class IntrinsicLowering;
@@ -59,6 +66,36 @@ public:
 
 typedef std::vector<GenericValue> ValuePlaneTy;
 
+// FunctionSlots - A function decoded for the interpreter loop. Its arguments
+// and non-void instructions are numbered densely, arguments first; the numbers
+// index the value planes of the function's stack frames, so a call allocates
+// its whole frame at once.
+//
+// Code holds a record for each instruction, in layout order: the slot of the
+// instruction's value (NoSlot if it has none), then a reference for each of
+// its operands. A reference is a slot, ConstantRef plus the index of the
+// operand's value in Constants, or NoSlot for a constant that is evaluated
+// when it is read. Running an instruction thus reads its operands by index
+// instead of looking them up.
+//
+// A function is decoded when it is first called. The interpreter lowers its
+// intrinsics first, so the function does not change afterwards and threads of
+// the program can share the decoded form without locking.
+//
+struct FunctionSlots {
+  static const unsigned NoSlot = ~0U;
+  static const unsigned ConstantRef = 1U << 31;
+
+  unsigned NumSlots;
+  std::vector<unsigned> Code;
+  std::vector<GenericValue> Constants;
+  DenseMap<const BasicBlock *, unsigned> BlockStart; // First record of a block
+
+  FunctionSlots() : NumSlots(0) {}
+
+  unsigned size() const { return NumSlots; }
+};
+
 // ExecutionContext struct - This struct represents one stack frame currently
 // executing.
 //
@@ -68,15 +105,21 @@ struct ExecutionContext {
   BasicBlock::iterator  CurInst;    // The next instruction to execute
   CallSite             Caller;     // Holds the call that called subframes.
                                    // NULL if main func or debugger invoked fn
-  std::map<Value *, GenericValue> Values; // LLVM values used in this invocation
+  FunctionSlots        *Slots;      // CurFunction, decoded
+  const unsigned       *CurOps;     // Record of the executing instruction
+  const unsigned       *NextOps;    // Record of CurInst
+  ValuePlaneTy          Values;     // LLVM values used in this invocation
   std::vector<GenericValue>  VarArgs; // Values passed through an ellipsis
   AllocaHolder Allocas;            // Track memory allocated by alloca
 
-  ExecutionContext() : CurFunction(nullptr), CurBB(nullptr), CurInst(nullptr) {}
+  ExecutionContext()
+      : CurFunction(nullptr), CurBB(nullptr), CurInst(nullptr),
+        Slots(nullptr), CurOps(nullptr), NextOps(nullptr) {}
 
   ExecutionContext(ExecutionContext &&O)
       : CurFunction(O.CurFunction), CurBB(O.CurBB), CurInst(O.CurInst),
-        Caller(O.Caller), Values(std::move(O.Values)),
+        Caller(O.Caller), Slots(O.Slots), CurOps(O.CurOps),
+        NextOps(O.NextOps), Values(std::move(O.Values)),
         VarArgs(std::move(O.VarArgs)), Allocas(std::move(O.Allocas)) {}
 
   ExecutionContext &operator=(ExecutionContext &&O) {
@@ -84,6 +127,9 @@ struct ExecutionContext {
     CurBB = O.CurBB;
     CurInst = O.CurInst;
     Caller = O.Caller;
+    Slots = O.Slots;
+    CurOps = O.CurOps;
+    NextOps = O.NextOps;
     Values = std::move(O.Values);
     VarArgs = std::move(O.VarArgs);
     Allocas = std::move(O.Allocas);
@@ -91,20 +137,89 @@ struct ExecutionContext {
   }
 };
 
+// InterpreterThread - The execution state of one thread of the interpreted
+// program.
+//
+struct InterpreterThread {
+  // The runtime stack of executing code.  The top of the stack is the current
+  // function record.
+  std::vector<ExecutionContext> ECStack;
+  GenericValue ExitValue;          // The return value of the called function
+
+  // Constant operands evaluated when they were first read, see
+  // FunctionSlots.
+  std::map<const Constant *, GenericValue> LazyConstants;
+
+  InterpreterThread() {
+    memset(&ExitValue.Untyped, 0, sizeof(ExitValue.Untyped));
+  }
+};
+
+// TieredFunction - The tiered execution state of a function.
+//
+struct TieredFunction {
+  unsigned Count;                   // Calls and loop back-edges taken so far
+  bool Rejected;                    // Must stay interpreted
+  TieredEntryPoint Entry;           // Native code, once compiled
+  DenseSet<std::pair<const BasicBlock *, const BasicBlock *>> BackEdges;
+
+  TieredFunction() : Count(0), Rejected(false), Entry(nullptr) {}
+};
+
+// CachedFunction - A lock-free cache entry for an external function. Entries
+// are filled in under the functions lock and published by storing F last, and
+// do not change until the module of F is removed.
+//
+struct CachedFunction {
+  std::atomic<const Function *> F;
+  GenericValue (*Fn)(FunctionType *, ArrayRef<GenericValue>);
+  void (*RawFn)();
+};
+
 // Interpreter - This class represents the entirety of the interpreter.
 //
 class Interpreter : public ExecutionEngine, public InstVisitor<Interpreter> {
-  GenericValue ExitValue;          // The return value of the called function
   IntrinsicLowering *IL;
 
-  // The runtime stack of executing code.  The top of the stack is the current
-  // function record.
-  std::vector<ExecutionContext> ECStack;
+  // The execution state of threads the interpreted program did not create
+  // itself, such as the one running main().
+  InterpreterThread MainThread;
+
+  // The execution state of the calling thread if the interpreted program
+  // created it with pthread_create, null otherwise.
+  static LLVM_THREAD_LOCAL InterpreterThread *CurrentThread;
+
+  // Threaded - Set once the program has started a thread. From then on the
+  // interpreter's own tables are guarded by ThreadLock.
+  bool Threaded;
+  sys::Mutex ThreadLock;
+
+  // Atomic memory operations of the program lock the stripe of their address.
+  static const unsigned NumAtomicLocks = 32;
+  std::mutex AtomicLocks[NumAtomicLocks];
 
   // AtExitHandlers - List of functions to call when the program exits,
   // registered with the atexit() library function.
   std::vector<Function*> AtExitHandlers;
 
+  // The native implementations of the external functions the program called,
+  // see callExternalFunction.
+  std::unique_ptr<CachedFunction[]> FunctionCache;
+
+  // The decoded form of each function that has been called. Once threads
+  // run this holds every function and is only read.
+  DenseMap<const Function *, std::unique_ptr<FunctionSlots>> FunctionSlotMap;
+
+  // Functions of modules added after threads started, guarded by ThreadLock.
+  DenseMap<const Function *, std::unique_ptr<FunctionSlots>>
+      LateFunctionSlotMap;
+
+  // Tiered execution: functions that become hot are compiled by TierUp and
+  // run natively from then on.
+  TierUpCompiler TierUp;
+  unsigned TierUpThreshold;
+  DenseMap<const Function *, std::unique_ptr<TieredFunction>> TieredFunctions;
+
 public:
   explicit Interpreter(std::unique_ptr<Module> M);
   ~Interpreter() override;
@@ -134,6 +249,11 @@ public:
     return nullptr;
   }
 
+  void setTierUpCompiler(unsigned Threshold, TierUpCompiler Compiler) override;
+
+  /// removeModule - Forget the state kept for the functions of M as well.
+  bool removeModule(Module *M) override;
+
   // Methods used to execute code:
   // Place a call on the stack
   void callFunction(Function *F, ArrayRef<GenericValue> ArgVals);
@@ -170,6 +290,10 @@ public:
   void visitSelectInst(SelectInst &I);
 
 
+  void visitFenceInst(FenceInst &I);
+  void visitAtomicCmpXchgInst(AtomicCmpXchgInst &I);
+  void visitAtomicRMWInst(AtomicRMWInst &I);
+
   void visitCallSite(CallSite CS);
   void visitCallInst(CallInst &I) { visitCallSite (CallSite (&I)); }
   void visitInvokeInst(InvokeInst &I) { visitCallSite (CallSite (&I)); }
@@ -197,16 +321,36 @@ public:
   void exitCalled(GenericValue GV);
 
   void addAtExitHandler(Function *F) {
+    std::unique_lock<sys::Mutex> Guard(ThreadLock, std::defer_lock);
+    if (Threaded)
+      Guard.lock();
     AtExitHandlers.push_back(F);
   }
 
   GenericValue *getFirstVarArg () {
-    return &(ECStack.back ().VarArgs[0]);
+    return &(getThread().ECStack.back ().VarArgs[0]);
   }
 
+  /// enableThreads - Prepare for the interpreted program to run on several
+  /// threads. Called before it starts its first thread.
+  void enableThreads();
+
+  /// runGuestThread - Run F(Arg) as the body of a thread created by the
+  /// interpreted program.
+  void *runGuestThread(Function *F, void *Arg);
+
 private:  // Helper functions
+  InterpreterThread &getThread() {
+    return CurrentThread ? *CurrentThread : MainThread;
+  }
+  std::mutex &getAtomicLock(const void *Ptr) {
+    return AtomicLocks[(reinterpret_cast<uintptr_t>(Ptr) >> 4) %
+                       NumAtomicLocks];
+  }
+
   GenericValue executeGEPOperation(Value *Ptr, gep_type_iterator I,
-                                   gep_type_iterator E, ExecutionContext &SF);
+                                   gep_type_iterator E, ExecutionContext &SF,
+                                   const unsigned *Refs = nullptr);
 
   // SwitchToNewBasicBlock - Start execution in a new basic block and run any
   // PHI nodes in the top of the block.  This is used for intraprocedural
@@ -218,35 +362,51 @@ private:  // Helper functions
 
   void initializeExecutionEngine() { }
   void initializeExternalFunctions();
+  void clearExternalFunctions(Module &M);
+  void lowerIntrinsics(Function &F);
   GenericValue getConstantExprValue(ConstantExpr *CE, ExecutionContext &SF);
   GenericValue getOperandValue(Value *V, ExecutionContext &SF);
-  GenericValue executeTruncInst(Value *SrcVal, Type *DstTy,
-                                ExecutionContext &SF);
-  GenericValue executeSExtInst(Value *SrcVal, Type *DstTy,
-                               ExecutionContext &SF);
-  GenericValue executeZExtInst(Value *SrcVal, Type *DstTy,
-                               ExecutionContext &SF);
-  GenericValue executeFPTruncInst(Value *SrcVal, Type *DstTy,
-                                  ExecutionContext &SF);
-  GenericValue executeFPExtInst(Value *SrcVal, Type *DstTy,
-                                ExecutionContext &SF);
-  GenericValue executeFPToUIInst(Value *SrcVal, Type *DstTy,
-                                 ExecutionContext &SF);
-  GenericValue executeFPToSIInst(Value *SrcVal, Type *DstTy,
-                                 ExecutionContext &SF);
-  GenericValue executeUIToFPInst(Value *SrcVal, Type *DstTy,
-                                 ExecutionContext &SF);
-  GenericValue executeSIToFPInst(Value *SrcVal, Type *DstTy,
-                                 ExecutionContext &SF);
-  GenericValue executePtrToIntInst(Value *SrcVal, Type *DstTy,
-                                   ExecutionContext &SF);
-  GenericValue executeIntToPtrInst(Value *SrcVal, Type *DstTy,
-                                   ExecutionContext &SF);
-  GenericValue executeBitCastInst(Value *SrcVal, Type *DstTy,
+  const GenericValue &readOperand(User &I, unsigned OpNo,
                                   ExecutionContext &SF);
+  const GenericValue &readRef(unsigned Ref, Value *V, ExecutionContext &SF);
+  const GenericValue &getLazyConstant(Constant *C, ExecutionContext &SF);
+  GenericValue executeTruncInst(const GenericValue &Src, Type *SrcTy,
+                                Type *DstTy);
+  GenericValue executeSExtInst(const GenericValue &Src, Type *SrcTy,
+                               Type *DstTy);
+  GenericValue executeZExtInst(const GenericValue &Src, Type *SrcTy,
+                               Type *DstTy);
+  GenericValue executeFPTruncInst(const GenericValue &Src, Type *SrcTy,
+                                  Type *DstTy);
+  GenericValue executeFPExtInst(const GenericValue &Src, Type *SrcTy,
+                                Type *DstTy);
+  GenericValue executeFPToUIInst(const GenericValue &Src, Type *SrcTy,
+                                 Type *DstTy);
+  GenericValue executeFPToSIInst(const GenericValue &Src, Type *SrcTy,
+                                 Type *DstTy);
+  GenericValue executeUIToFPInst(const GenericValue &Src, Type *SrcTy,
+                                 Type *DstTy);
+  GenericValue executeSIToFPInst(const GenericValue &Src, Type *SrcTy,
+                                 Type *DstTy);
+  GenericValue executePtrToIntInst(const GenericValue &Src, Type *SrcTy,
+                                   Type *DstTy);
+  GenericValue executeIntToPtrInst(const GenericValue &Src, Type *SrcTy,
+                                   Type *DstTy);
+  GenericValue executeBitCastInst(const GenericValue &Src, Type *SrcTy,
+                                  Type *DstTy);
   GenericValue executeCastOperation(Instruction::CastOps opcode, Value *SrcVal, 
                                     Type *Ty, ExecutionContext &SF);
   void popStackAndReturnValueToCaller(Type *RetTy, GenericValue Result);
+  FunctionSlots &getFunctionSlots(Function *F);
+  void decodeFunction(Function &F, FunctionSlots &Slots);
+
+  // Tiered execution helpers, see Tiering.cpp.
+  TieredEntryPoint getTieredEntryPoint(Function *F);
+  void noteBranch(ExecutionContext &SF, BasicBlock *Dest);
+  void tierUp(Function &F, TieredFunction &TF);
+  bool canRunNatively(Function &F);
+  GenericValue callTieredFunction(Function *F, TieredEntryPoint Entry,
+                                  ArrayRef<GenericValue> ArgVals);
 
 };
 
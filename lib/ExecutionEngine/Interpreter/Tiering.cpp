@@ -0,0 +1,220 @@
+//===-- Tiering.cpp - Promote hot functions to native code ----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+//  This file implements tiered execution for the interpreter: functions are
+//  interpreted until they have been called, or have looped, often enough, and
+//  are then compiled by a client-supplied compiler and called natively.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Interpreter.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/CFG.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/MathExtras.h"
+#include <cstdio>
+using namespace llvm;
+
+#define DEBUG_TYPE "interpreter"
+
+STATISTIC(NumTieredUp, "Number of functions promoted to native code");
+STATISTIC(NumTierRejected, "Number of hot functions kept interpreted");
+STATISTIC(NumNativeCalls, "Number of calls into native code");
+
+void Interpreter::setTierUpCompiler(unsigned Threshold,
+                                    TierUpCompiler Compiler) {
+  TierUpThreshold = Threshold;
+  TierUp = std::move(Compiler);
+  TieredFunctions.clear();
+}
+
+/// Return the native entry point for F, counting this call towards promoting
+/// it.
+TieredEntryPoint Interpreter::getTieredEntryPoint(Function *F) {
+  std::unique_ptr<TieredFunction> &Slot = TieredFunctions[F];
+  if (!Slot) {
+    Slot.reset(new TieredFunction());
+    SmallVector<std::pair<const BasicBlock *, const BasicBlock *>, 8> Edges;
+    FindFunctionBackedges(*F, Edges);
+    Slot->BackEdges.insert(Edges.begin(), Edges.end());
+  }
+
+  TieredFunction &TF = *Slot;
+  if (!TF.Entry && !TF.Rejected && ++TF.Count >= TierUpThreshold)
+    tierUp(*F, TF);
+  return TF.Entry;
+}
+
+/// Count loop back-edges towards promoting the current function. Without
+/// on-stack replacement a long running loop only makes later calls native.
+void Interpreter::noteBranch(ExecutionContext &SF, BasicBlock *Dest) {
+  auto I = TieredFunctions.find(SF.CurFunction);
+  if (I == TieredFunctions.end())
+    return;
+  TieredFunction &TF = *I->second;
+  if (TF.Entry || TF.Rejected ||
+      !TF.BackEdges.count(std::make_pair(SF.CurBB, Dest)))
+    return;
+  if (++TF.Count >= TierUpThreshold)
+    tierUp(*SF.CurFunction, TF);
+}
+
+void Interpreter::tierUp(Function &F, TieredFunction &TF) {
+  if (!canRunNatively(F)) {
+    DEBUG(dbgs() << "Keeping hot function '" << F.getName()
+                 << "' interpreted\n");
+    ++NumTierRejected;
+    TF.Rejected = true;
+    return;
+  }
+
+  DEBUG(dbgs() << "Promoting '" << F.getName() << "' to native code after "
+               << TF.Count << " calls and back-edges\n");
+  TF.Entry = TierUp(F);
+  if (!TF.Entry) {
+    ++NumTierRejected;
+    TF.Rejected = true;
+    return;
+  }
+  ++NumTieredUp;
+}
+
+/// Returns true if C refers to a function or a block address. Function
+/// pointers in the interpreter are Function objects, and block addresses are
+/// BasicBlocks, so native code must not see either.
+static bool referencesCode(const Constant *C) {
+  if (isa<Function>(C) || isa<BlockAddress>(C))
+    return true;
+  if (isa<GlobalValue>(C))
+    return false;
+  for (const Use &Op : C->operands())
+    if (referencesCode(cast<Constant>(Op)))
+      return true;
+  return false;
+}
+
+/// Returns true if F's body behaves the same natively as when interpreted,
+/// and adds the functions it calls directly to Callees.
+static bool isNativeSafe(const Function &F,
+                         SmallVectorImpl<const Function *> &Callees) {
+  for (const BasicBlock &BB : F) {
+    for (const Instruction &I : BB) {
+      if (isa<IndirectBrInst>(I))
+        return false;
+
+      ImmutableCallSite CS(&I);
+      if (CS) {
+        const Function *Callee = CS.getCalledFunction();
+        if (!Callee) {
+          if (!isa<InlineAsm>(CS.getCalledValue()))
+            return false;
+        } else if (!Callee->isDeclaration()) {
+          Callees.push_back(Callee);
+        } else if (!Callee->isIntrinsic()) {
+          // The interpreter implements these itself to keep track of its own
+          // exit handlers.
+          StringRef Name = Callee->getName();
+          if (Name == "exit" || Name == "atexit" || Name == "abort")
+            return false;
+          // Native code can only call functions the process provides.
+          if (!sys::DynamicLibrary::SearchForAddressOfSymbol(Name))
+            return false;
+        }
+      }
+
+      for (const Use &Op : I.operands()) {
+        if (CS && CS.isCallee(&Op))
+          continue;
+        if (auto *C = dyn_cast<Constant>(Op))
+          if (referencesCode(C))
+            return false;
+      }
+    }
+  }
+  return true;
+}
+
+/// Returns true if F can be called natively. Native code can only call native
+/// code, so everything F reaches has to be safe to run natively too.
+bool Interpreter::canRunNatively(Function &F) {
+  FunctionType *FTy = F.getFunctionType();
+  if (FTy->isVarArg())
+    return false;
+  if (!FTy->getReturnType()->isVoidTy() &&
+      !isTieredSlotType(FTy->getReturnType()))
+    return false;
+  for (Type *ParamTy : FTy->params())
+    if (!isTieredSlotType(ParamTy))
+      return false;
+
+  SmallVector<const Function *, 16> Worklist;
+  SmallPtrSet<const Function *, 16> Visited;
+  Worklist.push_back(&F);
+  Visited.insert(&F);
+  while (!Worklist.empty()) {
+    const Function *Fn = Worklist.pop_back_val();
+
+    // Functions already promoted were checked when they were.
+    auto I = TieredFunctions.find(Fn);
+    if (Fn != &F && I != TieredFunctions.end() && I->second->Entry)
+      continue;
+
+    SmallVector<const Function *, 8> Callees;
+    if (!isNativeSafe(*Fn, Callees))
+      return false;
+    for (const Function *Callee : Callees)
+      if (Visited.insert(Callee).second)
+        Worklist.push_back(Callee);
+  }
+  return true;
+}
+
+GenericValue Interpreter::callTieredFunction(Function *F,
+                                             TieredEntryPoint Entry,
+                                             ArrayRef<GenericValue> ArgVals) {
+  FunctionType *FTy = F->getFunctionType();
+  SmallVector<uint64_t, 8> Args;
+  for (unsigned i = 0, e = ArgVals.size(); i != e; ++i) {
+    Type *Ty = FTy->getParamType(i);
+    const GenericValue &Val = ArgVals[i];
+    if (Ty->isIntegerTy())
+      Args.push_back(Val.IntVal.getZExtValue());
+    else if (Ty->isFloatTy())
+      Args.push_back(FloatToBits(Val.FloatVal));
+    else if (Ty->isDoubleTy())
+      Args.push_back(DoubleToBits(Val.DoubleVal));
+    else
+      Args.push_back(reinterpret_cast<uintptr_t>(Val.PointerVal));
+  }
+
+  // The interpreter prints through outs() and native code through stdio, so
+  // flush both at the boundary to keep the program's output in order.
+  outs().flush();
+  uint64_t Slot = 0;
+  ++NumNativeCalls;
+  Entry(Args.data(), &Slot);
+  fflush(stdout);
+
+  GenericValue Result;
+  Type *RetTy = FTy->getReturnType();
+  if (RetTy->isIntegerTy())
+    Result.IntVal = APInt(RetTy->getIntegerBitWidth(), Slot);
+  else if (RetTy->isFloatTy())
+    Result.FloatVal = BitsToFloat(static_cast<uint32_t>(Slot));
+  else if (RetTy->isDoubleTy())
+    Result.DoubleVal = BitsToDouble(Slot);
+  else if (RetTy->isPointerTy())
+    Result.PointerVal = reinterpret_cast<void *>(static_cast<uintptr_t>(Slot));
+  return Result;
+}
@@ -8,6 +8,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "MCJIT.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
@@ -42,6 +43,69 @@ static struct RegisterJIT {
 extern "C" void LLVMLinkInMCJIT() {
 }
 
+FinalizedSymbolTable::FinalizedSymbolTable()
+    : Current(nullptr), NumEntries(0) {}
+
+RuntimeDyld::SymbolInfo FinalizedSymbolTable::lookup(StringRef Name) const {
+  const Table *T = Current.load(std::memory_order_acquire);
+  if (!T)
+    return nullptr;
+
+  // Tables are never more than half full, so probing always reaches an empty
+  // entry.
+  unsigned Mask = T->Capacity - 1;
+  for (unsigned I = hash_value(Name) & Mask;; I = (I + 1) & Mask) {
+    const Entry &E = T->Entries[I];
+    const char *EntryName = E.Name.load(std::memory_order_acquire);
+    if (!EntryName)
+      return nullptr;
+    if (E.NameLen == Name.size() &&
+        memcmp(EntryName, Name.data(), Name.size()) == 0)
+      return RuntimeDyld::SymbolInfo(E.Address, E.Flags);
+  }
+}
+
+void FinalizedSymbolTable::insertInto(Table &T, const char *Name,
+                                      size_t NameLen, uint64_t Address,
+                                      JITSymbolFlags Flags) {
+  unsigned Mask = T.Capacity - 1;
+  unsigned I = hash_value(StringRef(Name, NameLen)) & Mask;
+  while (T.Entries[I].Name.load(std::memory_order_relaxed))
+    I = (I + 1) & Mask;
+  Entry &E = T.Entries[I];
+  E.NameLen = NameLen;
+  E.Address = Address;
+  E.Flags = Flags;
+  E.Name.store(Name, std::memory_order_release);
+}
+
+void FinalizedSymbolTable::insert(StringRef Name,
+                                  RuntimeDyld::SymbolInfo Sym) {
+  if (Name.empty() || lookup(Name))
+    return;
+
+  Table *T = Current.load(std::memory_order_relaxed);
+  if (!T || 2 * (NumEntries + 1) > T->Capacity) {
+    // Readers may still be probing the old table, so fill in a new one and
+    // publish it once it is complete.
+    Table *NewT = new Table(T ? 2 * T->Capacity : 64);
+    Tables.emplace_back(NewT);
+    if (T)
+      for (unsigned I = 0; I != T->Capacity; ++I) {
+        const Entry &E = T->Entries[I];
+        if (const char *EntryName = E.Name.load(std::memory_order_relaxed))
+          insertInto(*NewT, EntryName, E.NameLen, E.Address, E.Flags);
+      }
+    Current.store(NewT, std::memory_order_release);
+    T = NewT;
+  }
+
+  char *NameCopy = Names.Allocate<char>(Name.size());
+  memcpy(NameCopy, Name.data(), Name.size());
+  insertInto(*T, NameCopy, Name.size(), Sym.getAddress(), Sym.getFlags());
+  ++NumEntries;
+}
+
 ExecutionEngine*
 MCJIT::createJIT(std::unique_ptr<Module> M,
                  std::string *ErrorStr,
@@ -112,10 +176,20 @@ bool MCJIT::removeModule(Module *M) {
 }
 
 void MCJIT::addObjectFile(std::unique_ptr<object::ObjectFile> Obj) {
-  std::unique_ptr<RuntimeDyld::LoadedObjectInfo> L = Dyld.loadObject(*Obj);
+  MutexGuard locked(lock);
+
+  std::unique_ptr<RuntimeDyld::LoadedObjectInfo> L;
+  {
+    JITCompilePhaseTimer Timer(JITEventListener::ObjectLoadPhase,
+                               Obj->getFileName(), EventListeners);
+    Timer.setSize(Obj->getData().size());
+    L = Dyld.loadObject(*Obj);
+  }
   if (Dyld.hasError())
     report_fatal_error(Dyld.getErrorString());
 
+  recordExportedSymbols(*Obj);
+
   NotifyObjectEmitted(*Obj, *L);
 
   LoadedObjects.push_back(std::move(Obj));
@@ -156,12 +230,18 @@ std::unique_ptr<MemoryBuffer> MCJIT::emitObject(Module *M) {
   if (TM->addPassesToEmitMC(PM, Ctx, ObjStream, !getVerifyModules()))
     report_fatal_error("Target does not support MC emission!");
 
-  // Initialize passes.
-  PM.run(*M);
-  // Flush the output buffer to get the generated code into memory
+  std::unique_ptr<MemoryBuffer> CompiledObjBuffer;
+  {
+    JITCompilePhaseTimer Timer(JITEventListener::CodeGenPhase,
+                               M->getModuleIdentifier(), EventListeners);
+
+    // Initialize passes.
+    PM.run(*M);
+    // Flush the output buffer to get the generated code into memory
 
-  std::unique_ptr<MemoryBuffer> CompiledObjBuffer(
-                                new ObjectMemoryBuffer(std::move(ObjBufferSV)));
+    Timer.setSize(ObjBufferSV.size());
+    CompiledObjBuffer.reset(new ObjectMemoryBuffer(std::move(ObjBufferSV)));
+  }
 
   // If we have an object cache, tell it about the new object.
   // Note that we're using the compiled image, not the loaded image (as below).
@@ -208,12 +288,19 @@ void MCJIT::generateCodeForModule(Module *M) {
   // MCJIT now owns the ObjectImage pointer (via its LoadedObjects list).
   ErrorOr<std::unique_ptr<object::ObjectFile>> LoadedObject =
     object::ObjectFile::createObjectFile(ObjectToLoad->getMemBufferRef());
-  std::unique_ptr<RuntimeDyld::LoadedObjectInfo> L =
-    Dyld.loadObject(*LoadedObject.get());
+  std::unique_ptr<RuntimeDyld::LoadedObjectInfo> L;
+  {
+    JITCompilePhaseTimer Timer(JITEventListener::ObjectLoadPhase,
+                               M->getModuleIdentifier(), EventListeners);
+    Timer.setSize(ObjectToLoad->getBufferSize());
+    L = Dyld.loadObject(*LoadedObject.get());
+  }
 
   if (Dyld.hasError())
     report_fatal_error(Dyld.getErrorString());
 
+  recordExportedSymbols(*LoadedObject.get());
+
   NotifyObjectEmitted(*LoadedObject.get(), *L);
 
   Buffers.push_back(std::move(ObjectToLoad));
@@ -225,16 +312,48 @@ void MCJIT::generateCodeForModule(Module *M) {
 void MCJIT::finalizeLoadedModules() {
   MutexGuard locked(lock);
 
-  // Resolve any outstanding relocations.
-  Dyld.resolveRelocations();
+  {
+    JITCompilePhaseTimer Timer(JITEventListener::RelocationPhase, "",
+                               EventListeners);
 
-  OwnedModules.markAllLoadedModulesAsFinalized();
+    // Resolve any outstanding relocations.
+    Dyld.resolveRelocations();
 
-  // Register EH frame data for any module we own which has been loaded
-  Dyld.registerEHFrames();
+    OwnedModules.markAllLoadedModulesAsFinalized();
 
-  // Set page permissions.
-  MemMgr->finalizeMemory();
+    // Register EH frame data for any module we own which has been loaded
+    Dyld.registerEHFrames();
+
+    // Set page permissions.
+    MemMgr->finalizeMemory();
+  }
+
+  // The code is ready to run now, so let lookups find it without the lock.
+  // Globals the client has mapped explicitly take precedence over the object's
+  // own definitions and are left to the locked path.
+  for (const std::string &Name : UnfinalizedSymbols)
+    if (!getPointerToGlobalIfAvailable(Name))
+      if (auto Sym = Dyld.getSymbol(Name))
+        FinalizedSymbols.insert(Name, Sym);
+  UnfinalizedSymbols.clear();
+}
+
+void MCJIT::recordExportedSymbols(const object::ObjectFile &Obj) {
+  for (const object::SymbolRef &Sym : Obj.symbols()) {
+    uint32_t Flags = Sym.getFlags();
+    if ((Flags & object::SymbolRef::SF_Undefined) ||
+        !(Flags & object::SymbolRef::SF_Global))
+      continue;
+    ErrorOr<StringRef> Name = Sym.getName();
+    if (Name)
+      UnfinalizedSymbols.push_back(*Name);
+  }
+}
+
+RuntimeDyld::SymbolInfo MCJIT::findFinalizedSymbol(const std::string &Name) {
+  SmallString<128> FullName;
+  Mangler::getNameWithPrefix(FullName, Name, getDataLayout());
+  return FinalizedSymbols.lookup(FullName);
 }
 
 // FIXME: Rename this.
@@ -308,6 +427,10 @@ uint64_t MCJIT::getSymbolAddress(const std::string &Name,
 
 RuntimeDyld::SymbolInfo MCJIT::findSymbol(const std::string &Name,
                                           bool CheckFunctionsOnly) {
+  // Symbols of finalized objects never change, so they need no lock.
+  if (auto Sym = findFinalizedSymbol(Name))
+    return Sym;
+
   MutexGuard locked(lock);
 
   // First, check to see if we already have this symbol.
@@ -358,6 +481,9 @@ RuntimeDyld::SymbolInfo MCJIT::findSymbol(const std::string &Name,
 }
 
 uint64_t MCJIT::getGlobalValueAddress(const std::string &Name) {
+  if (auto Sym = findFinalizedSymbol(Name))
+    return Sym.getAddress();
+
   MutexGuard locked(lock);
   uint64_t Result = getSymbolAddress(Name, false);
   if (Result != 0)
@@ -366,6 +492,9 @@ uint64_t MCJIT::getGlobalValueAddress(const std::string &Name) {
 }
 
 uint64_t MCJIT::getFunctionAddress(const std::string &Name) {
+  if (auto Sym = findFinalizedSymbol(Name))
+    return Sym.getAddress();
+
   MutexGuard locked(lock);
   uint64_t Result = getSymbolAddress(Name, true);
   if (Result != 0)
@@ -19,6 +19,8 @@
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/Allocator.h"
+#include <atomic>
 
 namespace llvm {
 class MCJIT;
@@ -46,6 +48,52 @@ private:
   std::shared_ptr<RuntimeDyld::SymbolResolver> ClientResolver;
 };
 
+// An index of the symbols defined by finalized objects. Symbols are only ever
+// added, by one thread at a time, while any number of threads look them up
+// without locking: entries are published by storing their name last, and the
+// table is replaced rather than resized in place when it fills up. Replaced
+// tables are kept until the index is destroyed, which at most doubles the
+// memory it uses, so that readers still probing them are never left with
+// dangling pointers.
+class FinalizedSymbolTable {
+public:
+  FinalizedSymbolTable();
+
+  /// Return the symbol named Name, or a null SymbolInfo. Safe to call from any
+  /// thread at any time.
+  RuntimeDyld::SymbolInfo lookup(StringRef Name) const;
+
+  /// Add a symbol unless one of that name is already present. Calls must be
+  /// serialized by the caller.
+  void insert(StringRef Name, RuntimeDyld::SymbolInfo Sym);
+
+private:
+  struct Entry {
+    std::atomic<const char *> Name;
+    size_t NameLen;
+    uint64_t Address;
+    JITSymbolFlags Flags;
+  };
+
+  struct Table {
+    explicit Table(unsigned Capacity)
+        : Capacity(Capacity), Entries(new Entry[Capacity]) {
+      for (unsigned I = 0; I != Capacity; ++I)
+        Entries[I].Name.store(nullptr, std::memory_order_relaxed);
+    }
+    unsigned Capacity;
+    std::unique_ptr<Entry[]> Entries;
+  };
+
+  static void insertInto(Table &T, const char *Name, size_t NameLen,
+                         uint64_t Address, JITSymbolFlags Flags);
+
+  std::atomic<Table *> Current;
+  std::vector<std::unique_ptr<Table>> Tables;
+  unsigned NumEntries;
+  BumpPtrAllocator Names;
+};
+
 // About Module states: added->loaded->finalized.
 //
 // The purpose of the "added" state is having modules in standby. (added=known
@@ -192,6 +240,12 @@ class MCJIT : public ExecutionEngine {
 
   SmallVector<std::unique_ptr<object::ObjectFile>, 2> LoadedObjects;
 
+  // Symbols exported by objects that have been loaded but not finalized yet,
+  // and the index of those of objects that have been finalized. Lookups of
+  // finalized symbols go through the index without taking the engine lock.
+  std::vector<std::string> UnfinalizedSymbols;
+  FinalizedSymbolTable FinalizedSymbols;
+
   // An optional ObjectCache to be notified of compiled objects and used to
   // perform lookup of pre-compiled code to avoid re-compilation.
   ObjectCache *ObjCache;
@@ -330,6 +384,9 @@ protected:
                            const RuntimeDyld::LoadedObjectInfo &L);
   void NotifyFreeingObject(const object::ObjectFile& Obj);
 
+  void recordExportedSymbols(const object::ObjectFile &Obj);
+  RuntimeDyld::SymbolInfo findFinalizedSymbol(const std::string &Name);
+
   RuntimeDyld::SymbolInfo findExistingSymbol(const std::string &Name);
   Module *findModuleForSymbol(const std::string &Name,
                               bool CheckFunctionsOnly);
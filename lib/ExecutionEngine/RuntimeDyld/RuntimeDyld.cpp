@@ -21,6 +21,8 @@
 #include "llvm/Object/COFF.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/thread.h"
+#include <atomic>
 
 using namespace llvm;
 using namespace llvm::object;
@@ -78,10 +80,38 @@ static void dumpSectionMemory(const SectionEntry &S, StringRef State) {
 }
 #endif
 
+// Below this many relocations it is cheaper to apply them on the calling
+// thread than to start workers.
+static const unsigned MinRelocationsPerThread = 4096;
+
 // Resolve the relocations for all symbols we currently know about.
 void RuntimeDyldImpl::resolveRelocations() {
   MutexGuard locked(lock);
 
+  bool Concurrent = NumResolveThreads > 1 && canResolveRelocationsConcurrently();
+#ifndef NDEBUG
+  // Keep the debug output of the target handlers readable.
+  if (DebugFlag)
+    Concurrent = false;
+#endif
+
+  if (Concurrent) {
+    // Look up every symbol and section address once, then apply the
+    // relocations grouped by the section they patch.
+    std::vector<std::pair<RelocationList, uint64_t>> Pending;
+    resolveExternalSymbols(&Pending);
+    for (int i = 0, e = Sections.size(); i != e; ++i) {
+      auto I = Relocations.find(i);
+      if (I == Relocations.end())
+        continue;
+      Pending.push_back(
+          std::make_pair(std::move(I->second), Sections[i].LoadAddress));
+      Relocations.erase(I);
+    }
+    applyRelocationsConcurrently(Pending);
+    return;
+  }
+
   // First, resolve relocations associated with external symbols.
   resolveExternalSymbols();
 
@@ -101,6 +131,54 @@ void RuntimeDyldImpl::resolveRelocations() {
   }
 }
 
+void RuntimeDyldImpl::applyRelocationsConcurrently(
+    std::vector<std::pair<RelocationList, uint64_t>> &Pending) {
+  typedef std::pair<const RelocationEntry *, uint64_t> ResolvedRelocation;
+
+  // Bucket the relocations by the section they apply to. Each bucket keeps
+  // the order in which the serial path would apply its relocations, so
+  // relocations patching the same bytes still see each other's results.
+  std::vector<std::vector<ResolvedRelocation>> BySection(Sections.size());
+  unsigned NumRelocations = 0;
+  for (const auto &List : Pending) {
+    for (const RelocationEntry &RE : List.first) {
+      // Ignore relocations for sections that were not loaded
+      if (Sections[RE.SectionID].Address == nullptr)
+        continue;
+      BySection[RE.SectionID].push_back(std::make_pair(&RE, List.second));
+      ++NumRelocations;
+    }
+  }
+
+  std::vector<unsigned> Work;
+  for (unsigned i = 0, e = BySection.size(); i != e; ++i)
+    if (!BySection[i].empty())
+      Work.push_back(i);
+
+  // Hand out the biggest sections first so that one large section is not
+  // left to run on its own at the end.
+  std::sort(Work.begin(), Work.end(), [&](unsigned LHS, unsigned RHS) {
+    return BySection[LHS].size() > BySection[RHS].size();
+  });
+
+  std::atomic<unsigned> NextSection(0);
+  auto Worker = [&]() {
+    for (unsigned I = NextSection++; I < Work.size(); I = NextSection++)
+      for (const ResolvedRelocation &R : BySection[Work[I]])
+        resolveRelocation(*R.first, R.second);
+  };
+
+  unsigned NumThreads = std::min<unsigned>(
+      std::min<unsigned>(NumResolveThreads, Work.size()),
+      NumRelocations / MinRelocationsPerThread);
+  std::vector<llvm::thread> Threads;
+  for (unsigned i = 1; i < NumThreads; ++i)
+    Threads.push_back(llvm::thread(Worker));
+  Worker();
+  for (llvm::thread &T : Threads)
+    T.join();
+}
+
 void RuntimeDyldImpl::mapSectionAddress(const void *LocalAddress,
                                         uint64_t TargetAddress) {
   MutexGuard locked(lock);
@@ -767,7 +845,8 @@ void RuntimeDyldImpl::resolveRelocationList(const RelocationList &Relocs,
   }
 }
 
-void RuntimeDyldImpl::resolveExternalSymbols() {
+void RuntimeDyldImpl::resolveExternalSymbols(
+    std::vector<std::pair<RelocationList, uint64_t>> *Pending) {
   while (!ExternalSymbolRelocations.empty()) {
     StringMap<RelocationList>::iterator i = ExternalSymbolRelocations.begin();
 
@@ -777,7 +856,10 @@ void RuntimeDyldImpl::resolveExternalSymbols() {
       DEBUG(dbgs() << "Resolving absolute relocations."
                    << "\n");
       RelocationList &Relocs = i->second;
-      resolveRelocationList(Relocs, 0);
+      if (Pending)
+        Pending->push_back(std::make_pair(std::move(Relocs), uint64_t(0)));
+      else
+        resolveRelocationList(Relocs, 0);
     } else {
       uint64_t Addr = 0;
       RTDyldSymbolTable::const_iterator Loc = GlobalSymbolTable.find(Name);
@@ -813,7 +895,10 @@ void RuntimeDyldImpl::resolveExternalSymbols() {
         // This list may have been updated when we called getSymbolAddress, so
         // don't change this code to get the list earlier.
         RelocationList &Relocs = i->second;
-        resolveRelocationList(Relocs, Addr);
+        if (Pending)
+          Pending->push_back(std::make_pair(std::move(Relocs), Addr));
+        else
+          resolveRelocationList(Relocs, Addr);
       }
     }
 
@@ -856,6 +941,7 @@ RuntimeDyld::RuntimeDyld(RuntimeDyld::MemoryManager &MemMgr,
   // permissions are applied.
   Dyld = nullptr;
   ProcessAllSections = false;
+  NumResolveThreads = 1;
   Checker = nullptr;
 }
 
@@ -909,6 +995,7 @@ RuntimeDyld::loadObject(const ObjectFile &Obj) {
                ProcessAllSections, Checker);
     else
       report_fatal_error("Incompatible object format!");
+    Dyld->setResolveThreads(NumResolveThreads);
   }
 
   if (!Dyld->isCompatibleFile(Obj))
@@ -931,6 +1018,12 @@ RuntimeDyld::SymbolInfo RuntimeDyld::getSymbol(StringRef Name) const {
 
 void RuntimeDyld::resolveRelocations() { Dyld->resolveRelocations(); }
 
+void RuntimeDyld::setResolveThreads(unsigned NumThreads) {
+  NumResolveThreads = NumThreads;
+  if (Dyld)
+    Dyld->setResolveThreads(NumThreads);
+}
+
 void RuntimeDyld::reassignSectionAddress(unsigned SectionID, uint64_t Addr) {
   Dyld->reassignSectionAddress(SectionID, Addr);
 }
@@ -1817,4 +1817,17 @@ bool RuntimeDyldELF::isCompatibleFile(const object::ObjectFile &Obj) const {
   return Obj.isELF();
 }
 
+bool RuntimeDyldELF::canResolveRelocationsConcurrently() const {
+  // The MIPS handlers fill in GOT entries shared between sections.
+  switch (Arch) {
+  case Triple::mips:
+  case Triple::mipsel:
+  case Triple::mips64:
+  case Triple::mips64el:
+    return false;
+  default:
+    return true;
+  }
+}
+
 } // namespace llvm
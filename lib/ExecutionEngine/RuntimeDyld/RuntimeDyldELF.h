@@ -167,6 +167,7 @@ public:
                        ObjSectionToIDMap &ObjSectionToID,
                        StubMap &Stubs) override;
   bool isCompatibleFile(const object::ObjectFile &Obj) const override;
+  bool canResolveRelocationsConcurrently() const override;
   void registerEHFrames() override;
   void deregisterEHFrames() override;
   void finalizeLoad(const ObjectFile &Obj,
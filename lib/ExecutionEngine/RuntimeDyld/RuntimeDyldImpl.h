@@ -243,6 +243,10 @@ protected:
   // sections containing relocations should be. Defaults to 'false'.
   bool ProcessAllSections;
 
+  // The number of threads resolveRelocations may use to apply relocations.
+  // Defaults to 1.
+  unsigned NumResolveThreads;
+
   // This mutex prevents simultaneously loading objects from two different
   // threads.  This keeps us from having to protect individual data structures
   // and guarantees that section allocation requests to the memory manager
@@ -351,6 +355,11 @@ protected:
   /// \brief Resolves relocations from Relocs list with address from Value.
   void resolveRelocationList(const RelocationList &Relocs, uint64_t Value);
 
+  /// \brief Returns true if resolveRelocation only writes to the section the
+  /// relocation applies to and does not modify any other state, so that the
+  /// relocations of different sections can be applied concurrently.
+  virtual bool canResolveRelocationsConcurrently() const { return false; }
+
   /// \brief A object file specific relocation resolver
   /// \param RE The relocation to be resolved
   /// \param Value Target symbol address to apply the relocation action
@@ -366,7 +375,17 @@ protected:
                        StubMap &Stubs) = 0;
 
   /// \brief Resolve relocations to external symbols.
-  void resolveExternalSymbols();
+  ///
+  /// If \p Pending is non-null the symbol addresses are looked up, but the
+  /// relocation lists are moved to \p Pending together with their addresses
+  /// instead of being applied.
+  void resolveExternalSymbols(
+      std::vector<std::pair<RelocationList, uint64_t>> *Pending = nullptr);
+
+  /// \brief Apply the relocation lists in \p Pending, fanning the work out
+  /// across NumResolveThreads threads by the section being relocated.
+  void applyRelocationsConcurrently(
+      std::vector<std::pair<RelocationList, uint64_t>> &Pending);
 
   // \brief Compute an upper bound of the memory that is required to load all
   // sections
@@ -384,7 +403,7 @@ public:
   RuntimeDyldImpl(RuntimeDyld::MemoryManager &MemMgr,
                   RuntimeDyld::SymbolResolver &Resolver)
     : MemMgr(MemMgr), Resolver(Resolver), Checker(nullptr),
-      ProcessAllSections(false), HasError(false) {
+      ProcessAllSections(false), NumResolveThreads(1), HasError(false) {
   }
 
   virtual ~RuntimeDyldImpl();
@@ -393,6 +412,10 @@ public:
     this->ProcessAllSections = ProcessAllSections;
   }
 
+  void setResolveThreads(unsigned NumThreads) {
+    NumResolveThreads = NumThreads ? NumThreads : 1;
+  }
+
   void setRuntimeDyldChecker(RuntimeDyldCheckerImpl *Checker) {
     this->Checker = Checker;
   }
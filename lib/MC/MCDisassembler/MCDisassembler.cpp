@@ -16,6 +16,25 @@ using namespace llvm;
 MCDisassembler::~MCDisassembler() {
 }
 
+size_t MCDisassembler::getInstructions(MutableArrayRef<DecodedInstruction> Insts,
+                                       ArrayRef<uint8_t> Bytes, uint64_t Length,
+                                       uint64_t Address, raw_ostream &VStream,
+                                       raw_ostream &CStream) const {
+  size_t Count = 0;
+  for (uint64_t Index = 0; Index < Length && Count != Insts.size(); ++Count) {
+    DecodedInstruction &D = Insts[Count];
+    D.Inst.clear();
+    D.Address = Address + Index;
+    D.Status = getInstruction(D.Inst, D.Size, Bytes.slice(Index), D.Address,
+                              VStream, CStream);
+    if (D.Status == Fail && D.Size == 0)
+      D.Size = 1; // Skip illegible bytes.
+    D.CommentEnd = CStream.tell();
+    Index += D.Size;
+  }
+  return Count;
+}
+
 bool MCDisassembler::tryAddingSymbolicOperand(MCInst &Inst, int64_t Value,
                                               uint64_t Address, bool IsBranch,
                                               uint64_t Offset,
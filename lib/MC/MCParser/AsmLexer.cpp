@@ -19,6 +19,7 @@
 #include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 using namespace llvm;
 
 AsmLexer::AsmLexer(const MCAsmInfo &MAI) : MAI(MAI) {
@@ -190,17 +191,30 @@ AsmToken AsmLexer::LexSlash() {
   }
 }
 
+/// findEndOfLine - Return the first '\n' or '\r' at or after Ptr, or End if
+/// there is none. Compiler generated assembly is dominated by comments, so
+/// this is done with memchr, which the C library implements with vector
+/// instructions, rather than by stepping through getNextChar.
+static const char *findEndOfLine(const char *Ptr, const char *End) {
+  const char *EOL = static_cast<const char *>(memchr(Ptr, '\n', End - Ptr));
+  if (!EOL)
+    EOL = End;
+  // A '\r' can only end the line early if it comes before the '\n'.
+  if (const void *CR = memchr(Ptr, '\r', EOL - Ptr))
+    return static_cast<const char *>(CR);
+  return EOL;
+}
+
 /// LexLineComment: Comment: #[^\n]*
 ///                        : //[^\n]*
 AsmToken AsmLexer::LexLineComment() {
   // FIXME: This is broken if we happen to a comment at the end of a file, which
   // was .included, and which doesn't end with a newline.
-  int CurChar = getNextChar();
-  while (CurChar != '\n' && CurChar != '\r' && CurChar != EOF)
-    CurChar = getNextChar();
-
-  if (CurChar == EOF)
+  CurPtr = findEndOfLine(CurPtr, CurBuf.end());
+  if (CurPtr == CurBuf.end())
     return AsmToken(AsmToken::Eof, StringRef(TokStart, 0));
+
+  ++CurPtr; // Consume the end of line.
   return AsmToken(AsmToken::EndOfStatement, StringRef(TokStart, 0));
 }
 
@@ -428,11 +442,7 @@ StringRef AsmLexer::LexUntilEndOfStatement() {
 
 StringRef AsmLexer::LexUntilEndOfLine() {
   TokStart = CurPtr;
-
-  while (*CurPtr != '\n' && *CurPtr != '\r' &&
-         (*CurPtr != 0 || CurPtr != CurBuf.end())) {
-    ++CurPtr;
-  }
+  CurPtr = findEndOfLine(CurPtr, CurBuf.end());
   return StringRef(TokStart, CurPtr-TokStart);
 }
 
@@ -527,7 +537,10 @@ AsmToken AsmLexer::LexToken() {
   case ' ':
   case '\t':
     if (SkipSpace) {
-      // Ignore whitespace.
+      // Ignore whitespace, skipping the whole run at once rather than
+      // re-entering LexToken for every character.
+      while (*CurPtr == ' ' || *CurPtr == '\t')
+        ++CurPtr;
       return LexToken();
     } else {
       int len = 1;
@@ -1262,12 +1262,15 @@ bool AsmParser::parseStatement(ParseStatementInfo &Info,
 
   // Handle conditional assembly here before checking for skipping.  We
   // have to do this so that .endif isn't skipped in a ".if 0" block for
-  // example.
-  StringMap<DirectiveKind>::const_iterator DirKindIt =
-      DirectiveKindMap.find(IDVal);
-  DirectiveKind DirKind = (DirKindIt == DirectiveKindMap.end())
-                              ? DK_NO_DIRECTIVE
-                              : DirKindIt->getValue();
+  // example. Every directive name starts with '.', so instructions and
+  // labels don't need the lookup.
+  DirectiveKind DirKind = DK_NO_DIRECTIVE;
+  if (!IDVal.empty() && IDVal[0] == '.') {
+    StringMap<DirectiveKind>::const_iterator DirKindIt =
+        DirectiveKindMap.find(IDVal);
+    if (DirKindIt != DirectiveKindMap.end())
+      DirKind = DirKindIt->getValue();
+  }
   switch (DirKind) {
   default:
     break;
@@ -1384,7 +1387,7 @@ bool AsmParser::parseStatement(ParseStatementInfo &Info,
   }
 
   // If macros are enabled, check to see if this is a macro instantiation.
-  if (areMacrosEnabled())
+  if (areMacrosEnabled() && !MacroMap.empty())
     if (const MCAsmMacro *M = lookupMacro(IDVal)) {
       return handleMacroEntry(M, IDLoc);
     }
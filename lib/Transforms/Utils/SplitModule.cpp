@@ -14,18 +14,27 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Transforms/Utils/SplitModule.h"
-#include "llvm/ADT/Hashing.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/GlobalAlias.h"
 #include "llvm/IR/GlobalObject.h"
 #include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
-#include "llvm/Support/MD5.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include <algorithm>
 
 using namespace llvm;
 
+static cl::opt<bool> PrintBalance(
+    "split-module-print-balance", cl::Hidden,
+    cl::desc("Print the estimated codegen cost of each module partition"));
+
 static void externalize(GlobalValue *GV) {
   if (GV->hasLocalLinkage()) {
     GV->setLinkage(GlobalValue::ExternalLinkage);
@@ -38,45 +47,169 @@ static void externalize(GlobalValue *GV) {
     GV->setName("__llvmsplit_unnamed");
 }
 
-// Returns whether GV should be in partition (0-based) I of N.
-static bool isInPartition(const GlobalValue *GV, unsigned I, unsigned N) {
-  if (auto GA = dyn_cast<GlobalAlias>(GV))
-    if (const GlobalObject *Base = GA->getBaseObject())
-      GV = Base;
+typedef EquivalenceClasses<const GlobalValue *> ClusterMapType;
+typedef DenseMap<const Comdat *, const GlobalValue *> ComdatMembersType;
+typedef DenseMap<const GlobalValue *, unsigned> ClusterIDMapType;
+
+// Adds the global value that U belongs to (the function containing an
+// instruction, or the global itself) to the same cluster as GV.
+static void addNonConstUser(ClusterMapType &GVtoClusterMap,
+                            const GlobalValue *GV, const User *U) {
+  assert((!isa<Constant>(U) || isa<GlobalValue>(U)) && "Bad user");
 
-  StringRef Name;
-  if (const Comdat *C = GV->getComdat())
-    Name = C->getName();
+  if (const Instruction *I = dyn_cast<Instruction>(U))
+    GVtoClusterMap.unionSets(GV, I->getParent()->getParent());
   else
-    Name = GV->getName();
-
-  // Partition by MD5 hash. We only need a few bits for evenness as the number
-  // of partitions will generally be in the 1-2 figure range; the low 16 bits
-  // are enough.
-  MD5 H;
-  MD5::MD5Result R;
-  H.update(Name);
-  H.final(R);
-  return (R[0] | (R[1] << 8)) % N == I;
+    GVtoClusterMap.unionSets(GV, cast<GlobalValue>(U));
+}
+
+// Adds all global value users of V to the same cluster as GV, looking through
+// constant expressions and aggregates.
+static void addAllGlobalValueUsers(ClusterMapType &GVtoClusterMap,
+                                   const GlobalValue *GV, const Value *V) {
+  SmallVector<const User *, 4> Worklist(V->user_begin(), V->user_end());
+  while (!Worklist.empty()) {
+    const User *U = Worklist.pop_back_val();
+    if (isa<Constant>(U) && !isa<GlobalValue>(U)) {
+      Worklist.append(U->user_begin(), U->user_end());
+      continue;
+    }
+    addNonConstUser(GVtoClusterMap, GV, U);
+  }
+}
+
+// Returns an estimate of the cost of generating code for GV. Functions are
+// measured by their number of non-debug instructions; every other definition
+// gets a nominal cost of one.
+static unsigned getCodeGenCost(const GlobalValue *GV) {
+  const Function *F = dyn_cast<Function>(GV);
+  if (!F)
+    return isa<GlobalAlias>(GV) ? 0 : 1;
+
+  unsigned Cost = 0;
+  for (const BasicBlock &BB : *F)
+    for (const Instruction &I : BB)
+      if (!isa<DbgInfoIntrinsic>(I))
+        ++Cost;
+  return std::max(Cost, 1u);
+}
+
+// Groups the definitions in M into clusters that must be placed in the same
+// partition and assigns the clusters to N partitions so that their estimated
+// codegen cost is balanced. Members of a comdat, aliases and their base
+// objects, and (with PreserveLocals) local symbols and their users form a
+// cluster. Clusters are assigned largest first to the least loaded partition.
+static void findPartitions(Module *M, ClusterIDMapType &ClusterIDMap,
+                           unsigned N, bool PreserveLocals) {
+  ClusterMapType GVtoClusterMap;
+  ComdatMembersType ComdatMembers;
+  SmallVector<const GlobalValue *, 64> Definitions;
+
+  auto recordGVSet = [&](GlobalValue &GV) {
+    if (GV.isDeclaration())
+      return;
+
+    GVtoClusterMap.insert(&GV);
+    Definitions.push_back(&GV);
+
+    if (const Comdat *C = GV.getComdat()) {
+      auto &Member = ComdatMembers[C];
+      if (Member)
+        GVtoClusterMap.unionSets(Member, &GV);
+      else
+        Member = &GV;
+    }
+
+    if (auto *GA = dyn_cast<GlobalAlias>(&GV))
+      if (const GlobalObject *Base = GA->getBaseObject())
+        GVtoClusterMap.unionSets(&GV, Base);
+
+    if (PreserveLocals && GV.hasLocalLinkage())
+      addAllGlobalValueUsers(GVtoClusterMap, &GV, &GV);
+  };
+
+  std::for_each(M->begin(), M->end(), recordGVSet);
+  std::for_each(M->global_begin(), M->global_end(), recordGVSet);
+  std::for_each(M->alias_begin(), M->alias_end(), recordGVSet);
+
+  // Collect the clusters in module order, rather than in the order of the
+  // equivalence class set, so that the result is deterministic.
+  struct Cluster {
+    const GlobalValue *Leader;
+    uint64_t Cost;
+  };
+  SmallVector<Cluster, 64> Clusters;
+  DenseMap<const GlobalValue *, unsigned> ClusterIndex;
+  for (const GlobalValue *GV : Definitions) {
+    const GlobalValue *Leader = GVtoClusterMap.getLeaderValue(GV);
+    auto Ins = ClusterIndex.insert(std::make_pair(Leader, Clusters.size()));
+    if (Ins.second)
+      Clusters.push_back({Leader, 0});
+    Clusters[Ins.first->second].Cost += getCodeGenCost(GV);
+  }
+  std::stable_sort(Clusters.begin(), Clusters.end(),
+                   [](const Cluster &A, const Cluster &B) {
+                     return A.Cost > B.Cost;
+                   });
+
+  SmallVector<uint64_t, 16> PartitionCost(N);
+  SmallVector<unsigned, 16> PartitionSize(N);
+  for (const Cluster &C : Clusters) {
+    unsigned Part = std::min_element(PartitionCost.begin(),
+                                     PartitionCost.end()) -
+                    PartitionCost.begin();
+    PartitionCost[Part] += C.Cost;
+    for (auto MI = GVtoClusterMap.member_begin(GVtoClusterMap.findValue(
+             C.Leader));
+         MI != GVtoClusterMap.member_end(); ++MI) {
+      ClusterIDMap[*MI] = Part;
+      ++PartitionSize[Part];
+    }
+  }
+
+  if (PrintBalance) {
+    uint64_t Total = 0, Max = 0;
+    for (uint64_t Cost : PartitionCost) {
+      Total += Cost;
+      Max = std::max(Max, Cost);
+    }
+    errs() << "SplitModule: " << Clusters.size() << " clusters, total cost "
+           << Total << '\n';
+    for (unsigned I = 0; I != N; ++I)
+      errs() << "  partition " << I << ": cost " << PartitionCost[I] << ", "
+             << PartitionSize[I] << " globals\n";
+    if (Total)
+      errs() << "  imbalance: "
+             << format("%.2f", double(Max) * N / double(Total)) << '\n';
+  }
 }
 
 void llvm::SplitModule(
     std::unique_ptr<Module> M, unsigned N,
-    std::function<void(std::unique_ptr<Module> MPart)> ModuleCallback) {
-  for (Function &F : *M)
-    externalize(&F);
-  for (GlobalVariable &GV : M->globals())
-    externalize(&GV);
-  for (GlobalAlias &GA : M->aliases())
-    externalize(&GA);
+    std::function<void(std::unique_ptr<Module> MPart)> ModuleCallback,
+    bool PreserveLocals) {
+  if (!PreserveLocals) {
+    for (Function &F : *M)
+      externalize(&F);
+    for (GlobalVariable &GV : M->globals())
+      externalize(&GV);
+    for (GlobalAlias &GA : M->aliases())
+      externalize(&GA);
+  }
+
+  ClusterIDMapType ClusterIDMap;
+  findPartitions(M.get(), ClusterIDMap, N, PreserveLocals);
 
   // FIXME: We should be able to reuse M as the last partition instead of
   // cloning it.
   for (unsigned I = 0; I != N; ++I) {
     ValueToValueMapTy VMap;
     std::unique_ptr<Module> MPart(
-        CloneModule(M.get(), VMap, [=](const GlobalValue *GV) {
-          return isInPartition(GV, I, N);
+        CloneModule(M.get(), VMap, [&ClusterIDMap, I](const GlobalValue *GV) {
+          // Declarations are not assigned to a partition; keep them as
+          // they are.
+          auto It = ClusterIDMap.find(GV);
+          return It == ClusterIDMap.end() || It->second == I;
         }));
     if (I != 0)
       MPart->setModuleInlineAsm("");
@@ -0,0 +1,17 @@
+; RUN: llc < %s -mtriple=x86_64-unknown-linux-gnu -cgp-region-sinking | FileCheck %s
+
+; With the shift sunk into the block of the add, both are selected together
+; as a single lea.
+
+; CHECK-LABEL: lea:
+; CHECK: leaq (%rdi,%rsi,8), %rax
+define i64 @lea(i64 %x, i64 %i, i1 %c) {
+entry:
+  %off = shl i64 %i, 3
+  br i1 %c, label %then, label %else
+then:
+  %r = add i64 %x, %off
+  ret i64 %r
+else:
+  ret i64 %x
+}
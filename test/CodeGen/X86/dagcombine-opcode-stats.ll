@@ -0,0 +1,21 @@
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -combiner-opcode-stats \
+; RUN:   -o /dev/null 2>&1 | FileCheck %s --check-prefix=STATS
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown \
+; RUN:   -combiner-node-visit-limit=1 | FileCheck %s
+
+; The per-opcode table is printed at exit and lists the combined opcodes.
+; STATS: DAG combiner attempts per opcode
+; STATS: Attempts    Combined  Hit rate  Opcode
+; STATS-DAG: {{ +[0-9]+ +[0-9]+ +[0-9.]+%}}  add
+; STATS-DAG: {{ +[0-9]+ +[0-9]+ +[0-9.]+%}}  shl
+
+; A visit limit only skips combines, it never breaks correctness.
+; CHECK-LABEL: f:
+; CHECK: leaq
+; CHECK: retq
+
+define i64 @f(i64 %a, i64 %b) {
+  %s = shl i64 %b, 3
+  %r = add i64 %a, %s
+  ret i64 %r
+}
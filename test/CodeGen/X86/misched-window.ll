@@ -0,0 +1,152 @@
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -misched-window=16 \
+; RUN:   -misched-region-stats -o /dev/null 2>&1 | FileCheck %s --check-prefix=WINDOW
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -misched-region-stats \
+; RUN:   -o /dev/null 2>&1 | FileCheck %s --check-prefix=NOWINDOW
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -sched-mem-dep-window=8 \
+; RUN:   -verify-machineinstrs | FileCheck %s
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -sched-mem-dep-window=8 \
+; RUN:   -misched-window=16 -stats -o /dev/null 2>&1 | FileCheck %s --check-prefix=STATS
+; REQUIRES: asserts
+
+; A long straight-line block is cut into regions of at most -misched-window
+; instructions, and -misched-region-stats reports each scheduled region.
+
+; WINDOW: misched-region: window:BB#0 instrs=16 edges={{[0-9]+}} windowed time={{[0-9.]+}}us
+; WINDOW: misched-region: window:BB#0 instrs=16 edges={{[0-9]+}} windowed time={{[0-9.]+}}us
+
+; NOWINDOW: misched-region: window:BB#0 instrs={{[0-9]+}} edges={{[0-9]+}} time={{[0-9.]+}}us
+; NOWINDOW-NOT: windowed
+
+; Capping the memory dependency lists only adds barriers, so every load is
+; still emitted and the block stays correct.
+
+; STATS: misched {{.*}} Number of memory barriers forced by the dependency window
+; STATS: misched {{.*}} Number of scheduling regions cut at the scheduling window
+
+; CHECK-LABEL: window:
+; CHECK: retq
+
+define void @window(i64* %p, i64* %q) {
+entry:
+  %a0.p = getelementptr i64, i64* %p, i64 0
+  %a0 = load i64, i64* %a0.p
+  %m0 = add i64 %a0, 1
+  %s0.p = getelementptr i64, i64* %q, i64 0
+  store i64 %m0, i64* %s0.p
+  %a1.p = getelementptr i64, i64* %p, i64 1
+  %a1 = load i64, i64* %a1.p
+  %m1 = add i64 %a1, 2
+  %s1.p = getelementptr i64, i64* %q, i64 1
+  store i64 %m1, i64* %s1.p
+  %a2.p = getelementptr i64, i64* %p, i64 2
+  %a2 = load i64, i64* %a2.p
+  %m2 = add i64 %a2, 3
+  %s2.p = getelementptr i64, i64* %q, i64 2
+  store i64 %m2, i64* %s2.p
+  %a3.p = getelementptr i64, i64* %p, i64 3
+  %a3 = load i64, i64* %a3.p
+  %m3 = add i64 %a3, 4
+  %s3.p = getelementptr i64, i64* %q, i64 3
+  store i64 %m3, i64* %s3.p
+  %a4.p = getelementptr i64, i64* %p, i64 4
+  %a4 = load i64, i64* %a4.p
+  %m4 = add i64 %a4, 5
+  %s4.p = getelementptr i64, i64* %q, i64 4
+  store i64 %m4, i64* %s4.p
+  %a5.p = getelementptr i64, i64* %p, i64 5
+  %a5 = load i64, i64* %a5.p
+  %m5 = add i64 %a5, 6
+  %s5.p = getelementptr i64, i64* %q, i64 5
+  store i64 %m5, i64* %s5.p
+  %a6.p = getelementptr i64, i64* %p, i64 6
+  %a6 = load i64, i64* %a6.p
+  %m6 = add i64 %a6, 7
+  %s6.p = getelementptr i64, i64* %q, i64 6
+  store i64 %m6, i64* %s6.p
+  %a7.p = getelementptr i64, i64* %p, i64 7
+  %a7 = load i64, i64* %a7.p
+  %m7 = add i64 %a7, 8
+  %s7.p = getelementptr i64, i64* %q, i64 7
+  store i64 %m7, i64* %s7.p
+  %a8.p = getelementptr i64, i64* %p, i64 8
+  %a8 = load i64, i64* %a8.p
+  %m8 = add i64 %a8, 9
+  %s8.p = getelementptr i64, i64* %q, i64 8
+  store i64 %m8, i64* %s8.p
+  %a9.p = getelementptr i64, i64* %p, i64 9
+  %a9 = load i64, i64* %a9.p
+  %m9 = add i64 %a9, 10
+  %s9.p = getelementptr i64, i64* %q, i64 9
+  store i64 %m9, i64* %s9.p
+  %a10.p = getelementptr i64, i64* %p, i64 10
+  %a10 = load i64, i64* %a10.p
+  %m10 = add i64 %a10, 11
+  %s10.p = getelementptr i64, i64* %q, i64 10
+  store i64 %m10, i64* %s10.p
+  %a11.p = getelementptr i64, i64* %p, i64 11
+  %a11 = load i64, i64* %a11.p
+  %m11 = add i64 %a11, 12
+  %s11.p = getelementptr i64, i64* %q, i64 11
+  store i64 %m11, i64* %s11.p
+  %a12.p = getelementptr i64, i64* %p, i64 12
+  %a12 = load i64, i64* %a12.p
+  %m12 = add i64 %a12, 13
+  %s12.p = getelementptr i64, i64* %q, i64 12
+  store i64 %m12, i64* %s12.p
+  %a13.p = getelementptr i64, i64* %p, i64 13
+  %a13 = load i64, i64* %a13.p
+  %m13 = add i64 %a13, 14
+  %s13.p = getelementptr i64, i64* %q, i64 13
+  store i64 %m13, i64* %s13.p
+  %a14.p = getelementptr i64, i64* %p, i64 14
+  %a14 = load i64, i64* %a14.p
+  %m14 = add i64 %a14, 15
+  %s14.p = getelementptr i64, i64* %q, i64 14
+  store i64 %m14, i64* %s14.p
+  %a15.p = getelementptr i64, i64* %p, i64 15
+  %a15 = load i64, i64* %a15.p
+  %m15 = add i64 %a15, 16
+  %s15.p = getelementptr i64, i64* %q, i64 15
+  store i64 %m15, i64* %s15.p
+  %a16.p = getelementptr i64, i64* %p, i64 16
+  %a16 = load i64, i64* %a16.p
+  %m16 = add i64 %a16, 17
+  %s16.p = getelementptr i64, i64* %q, i64 16
+  store i64 %m16, i64* %s16.p
+  %a17.p = getelementptr i64, i64* %p, i64 17
+  %a17 = load i64, i64* %a17.p
+  %m17 = add i64 %a17, 18
+  %s17.p = getelementptr i64, i64* %q, i64 17
+  store i64 %m17, i64* %s17.p
+  %a18.p = getelementptr i64, i64* %p, i64 18
+  %a18 = load i64, i64* %a18.p
+  %m18 = add i64 %a18, 19
+  %s18.p = getelementptr i64, i64* %q, i64 18
+  store i64 %m18, i64* %s18.p
+  %a19.p = getelementptr i64, i64* %p, i64 19
+  %a19 = load i64, i64* %a19.p
+  %m19 = add i64 %a19, 20
+  %s19.p = getelementptr i64, i64* %q, i64 19
+  store i64 %m19, i64* %s19.p
+  %a20.p = getelementptr i64, i64* %p, i64 20
+  %a20 = load i64, i64* %a20.p
+  %m20 = add i64 %a20, 21
+  %s20.p = getelementptr i64, i64* %q, i64 20
+  store i64 %m20, i64* %s20.p
+  %a21.p = getelementptr i64, i64* %p, i64 21
+  %a21 = load i64, i64* %a21.p
+  %m21 = add i64 %a21, 22
+  %s21.p = getelementptr i64, i64* %q, i64 21
+  store i64 %m21, i64* %s21.p
+  %a22.p = getelementptr i64, i64* %p, i64 22
+  %a22 = load i64, i64* %a22.p
+  %m22 = add i64 %a22, 23
+  %s22.p = getelementptr i64, i64* %q, i64 22
+  store i64 %m22, i64* %s22.p
+  %a23.p = getelementptr i64, i64* %p, i64 23
+  %a23 = load i64, i64* %a23.p
+  %m23 = add i64 %a23, 24
+  %s23.p = getelementptr i64, i64* %q, i64 23
+  store i64 %m23, i64* %s23.p
+  ret void
+}
@@ -0,0 +1,147 @@
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -stats -o /dev/null 2>&1 \
+; RUN:   | FileCheck %s
+; REQUIRES: asserts
+
+; Twenty values are live across a call, so some of them must be spilled. The
+; "regalloc-greedy-budget" attribute caps the eviction and splitting work for
+; @budgeted only; once the budget is used up, the remaining ranges are spilled
+; directly.
+
+; CHECK: 1 regalloc {{.*}} Number of functions that exhausted the allocation work budget
+; CHECK: regalloc {{.*}} Number of live ranges spilled because the work budget ran out
+
+declare void @g()
+
+define void @unbudgeted(i32* %p, i32* %q) {
+entry:
+  %a0.p = getelementptr i32, i32* %p, i64 0
+  %a0 = load volatile i32, i32* %a0.p
+  %a1.p = getelementptr i32, i32* %p, i64 1
+  %a1 = load volatile i32, i32* %a1.p
+  %a2.p = getelementptr i32, i32* %p, i64 2
+  %a2 = load volatile i32, i32* %a2.p
+  %a3.p = getelementptr i32, i32* %p, i64 3
+  %a3 = load volatile i32, i32* %a3.p
+  %a4.p = getelementptr i32, i32* %p, i64 4
+  %a4 = load volatile i32, i32* %a4.p
+  %a5.p = getelementptr i32, i32* %p, i64 5
+  %a5 = load volatile i32, i32* %a5.p
+  %a6.p = getelementptr i32, i32* %p, i64 6
+  %a6 = load volatile i32, i32* %a6.p
+  %a7.p = getelementptr i32, i32* %p, i64 7
+  %a7 = load volatile i32, i32* %a7.p
+  %a8.p = getelementptr i32, i32* %p, i64 8
+  %a8 = load volatile i32, i32* %a8.p
+  %a9.p = getelementptr i32, i32* %p, i64 9
+  %a9 = load volatile i32, i32* %a9.p
+  %a10.p = getelementptr i32, i32* %p, i64 10
+  %a10 = load volatile i32, i32* %a10.p
+  %a11.p = getelementptr i32, i32* %p, i64 11
+  %a11 = load volatile i32, i32* %a11.p
+  %a12.p = getelementptr i32, i32* %p, i64 12
+  %a12 = load volatile i32, i32* %a12.p
+  %a13.p = getelementptr i32, i32* %p, i64 13
+  %a13 = load volatile i32, i32* %a13.p
+  %a14.p = getelementptr i32, i32* %p, i64 14
+  %a14 = load volatile i32, i32* %a14.p
+  %a15.p = getelementptr i32, i32* %p, i64 15
+  %a15 = load volatile i32, i32* %a15.p
+  %a16.p = getelementptr i32, i32* %p, i64 16
+  %a16 = load volatile i32, i32* %a16.p
+  %a17.p = getelementptr i32, i32* %p, i64 17
+  %a17 = load volatile i32, i32* %a17.p
+  %a18.p = getelementptr i32, i32* %p, i64 18
+  %a18 = load volatile i32, i32* %a18.p
+  %a19.p = getelementptr i32, i32* %p, i64 19
+  %a19 = load volatile i32, i32* %a19.p
+  call void @g()
+  store volatile i32 %a0, i32* %q
+  store volatile i32 %a1, i32* %q
+  store volatile i32 %a2, i32* %q
+  store volatile i32 %a3, i32* %q
+  store volatile i32 %a4, i32* %q
+  store volatile i32 %a5, i32* %q
+  store volatile i32 %a6, i32* %q
+  store volatile i32 %a7, i32* %q
+  store volatile i32 %a8, i32* %q
+  store volatile i32 %a9, i32* %q
+  store volatile i32 %a10, i32* %q
+  store volatile i32 %a11, i32* %q
+  store volatile i32 %a12, i32* %q
+  store volatile i32 %a13, i32* %q
+  store volatile i32 %a14, i32* %q
+  store volatile i32 %a15, i32* %q
+  store volatile i32 %a16, i32* %q
+  store volatile i32 %a17, i32* %q
+  store volatile i32 %a18, i32* %q
+  store volatile i32 %a19, i32* %q
+  ret void
+}
+
+define void @budgeted(i32* %p, i32* %q) #0 {
+entry:
+  %a0.p = getelementptr i32, i32* %p, i64 0
+  %a0 = load volatile i32, i32* %a0.p
+  %a1.p = getelementptr i32, i32* %p, i64 1
+  %a1 = load volatile i32, i32* %a1.p
+  %a2.p = getelementptr i32, i32* %p, i64 2
+  %a2 = load volatile i32, i32* %a2.p
+  %a3.p = getelementptr i32, i32* %p, i64 3
+  %a3 = load volatile i32, i32* %a3.p
+  %a4.p = getelementptr i32, i32* %p, i64 4
+  %a4 = load volatile i32, i32* %a4.p
+  %a5.p = getelementptr i32, i32* %p, i64 5
+  %a5 = load volatile i32, i32* %a5.p
+  %a6.p = getelementptr i32, i32* %p, i64 6
+  %a6 = load volatile i32, i32* %a6.p
+  %a7.p = getelementptr i32, i32* %p, i64 7
+  %a7 = load volatile i32, i32* %a7.p
+  %a8.p = getelementptr i32, i32* %p, i64 8
+  %a8 = load volatile i32, i32* %a8.p
+  %a9.p = getelementptr i32, i32* %p, i64 9
+  %a9 = load volatile i32, i32* %a9.p
+  %a10.p = getelementptr i32, i32* %p, i64 10
+  %a10 = load volatile i32, i32* %a10.p
+  %a11.p = getelementptr i32, i32* %p, i64 11
+  %a11 = load volatile i32, i32* %a11.p
+  %a12.p = getelementptr i32, i32* %p, i64 12
+  %a12 = load volatile i32, i32* %a12.p
+  %a13.p = getelementptr i32, i32* %p, i64 13
+  %a13 = load volatile i32, i32* %a13.p
+  %a14.p = getelementptr i32, i32* %p, i64 14
+  %a14 = load volatile i32, i32* %a14.p
+  %a15.p = getelementptr i32, i32* %p, i64 15
+  %a15 = load volatile i32, i32* %a15.p
+  %a16.p = getelementptr i32, i32* %p, i64 16
+  %a16 = load volatile i32, i32* %a16.p
+  %a17.p = getelementptr i32, i32* %p, i64 17
+  %a17 = load volatile i32, i32* %a17.p
+  %a18.p = getelementptr i32, i32* %p, i64 18
+  %a18 = load volatile i32, i32* %a18.p
+  %a19.p = getelementptr i32, i32* %p, i64 19
+  %a19 = load volatile i32, i32* %a19.p
+  call void @g()
+  store volatile i32 %a0, i32* %q
+  store volatile i32 %a1, i32* %q
+  store volatile i32 %a2, i32* %q
+  store volatile i32 %a3, i32* %q
+  store volatile i32 %a4, i32* %q
+  store volatile i32 %a5, i32* %q
+  store volatile i32 %a6, i32* %q
+  store volatile i32 %a7, i32* %q
+  store volatile i32 %a8, i32* %q
+  store volatile i32 %a9, i32* %q
+  store volatile i32 %a10, i32* %q
+  store volatile i32 %a11, i32* %q
+  store volatile i32 %a12, i32* %q
+  store volatile i32 %a13, i32* %q
+  store volatile i32 %a14, i32* %q
+  store volatile i32 %a15, i32* %q
+  store volatile i32 %a16, i32* %q
+  store volatile i32 %a17, i32* %q
+  store volatile i32 %a18, i32* %q
+  store volatile i32 %a19, i32* %q
+  ret void
+}
+
+attributes #0 = { "regalloc-greedy-budget"="1" }
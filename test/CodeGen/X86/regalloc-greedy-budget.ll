@@ -0,0 +1,132 @@
+; RUN: llc < %s -mtriple=x86_64-unknown-unknown -verify-machineinstrs | FileCheck %s
+
+; Ten values are loaded before a loop and used in its latch, and a rarely
+; executed block in the loop calls @g. Without a budget, greedy splits the
+; ranges around the call so only the cold block spills and reloads them. The
+; "regalloc-greedy-budget" attribute caps the eviction and splitting work for
+; @budgeted; once the budget is used up the ranges are spilled whole instead,
+; so nothing is spilled around the call and the hot latch reloads from the
+; stack.
+
+; CHECK-LABEL: unbudgeted:
+; CHECK: # %cold
+; CHECK: 4-byte Spill
+; CHECK: callq g
+; CHECK-NEXT: 4-byte Reload
+; CHECK: # %latch
+; CHECK-NOT: Reload
+; CHECK: jne
+
+; CHECK-LABEL: budgeted:
+; CHECK: # %cold
+; CHECK-NEXT: in Loop
+; CHECK-NEXT: callq g
+; CHECK-NEXT: jmp
+; CHECK: # %latch
+; CHECK: Folded Reload
+; CHECK: jne
+
+declare void @g()
+
+define i32 @unbudgeted(i32* %p, i32 %n) {
+entry:
+  %x0.p = getelementptr i32, i32* %p, i64 0
+  %x0 = load i32, i32* %x0.p
+  %x1.p = getelementptr i32, i32* %p, i64 1
+  %x1 = load i32, i32* %x1.p
+  %x2.p = getelementptr i32, i32* %p, i64 2
+  %x2 = load i32, i32* %x2.p
+  %x3.p = getelementptr i32, i32* %p, i64 3
+  %x3 = load i32, i32* %x3.p
+  %x4.p = getelementptr i32, i32* %p, i64 4
+  %x4 = load i32, i32* %x4.p
+  %x5.p = getelementptr i32, i32* %p, i64 5
+  %x5 = load i32, i32* %x5.p
+  %x6.p = getelementptr i32, i32* %p, i64 6
+  %x6 = load i32, i32* %x6.p
+  %x7.p = getelementptr i32, i32* %p, i64 7
+  %x7 = load i32, i32* %x7.p
+  %x8.p = getelementptr i32, i32* %p, i64 8
+  %x8 = load i32, i32* %x8.p
+  %x9.p = getelementptr i32, i32* %p, i64 9
+  %x9 = load i32, i32* %x9.p
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %latch ]
+  %c = icmp eq i32 %i, 1000
+  br i1 %c, label %cold, label %latch, !prof !0
+cold:
+  call void @g()
+  br label %latch
+latch:
+  %s0 = mul i32 %acc, %x0
+  %s1 = mul i32 %s0, %x1
+  %s2 = mul i32 %s1, %x2
+  %s3 = mul i32 %s2, %x3
+  %s4 = mul i32 %s3, %x4
+  %s5 = mul i32 %s4, %x5
+  %s6 = mul i32 %s5, %x6
+  %s7 = mul i32 %s6, %x7
+  %s8 = mul i32 %s7, %x8
+  %s9 = mul i32 %s8, %x9
+  %acc.next = add i32 %s9, %i
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+exit:
+  ret i32 %acc.next
+}
+
+define i32 @budgeted(i32* %p, i32 %n) #0 {
+entry:
+  %x0.p = getelementptr i32, i32* %p, i64 0
+  %x0 = load i32, i32* %x0.p
+  %x1.p = getelementptr i32, i32* %p, i64 1
+  %x1 = load i32, i32* %x1.p
+  %x2.p = getelementptr i32, i32* %p, i64 2
+  %x2 = load i32, i32* %x2.p
+  %x3.p = getelementptr i32, i32* %p, i64 3
+  %x3 = load i32, i32* %x3.p
+  %x4.p = getelementptr i32, i32* %p, i64 4
+  %x4 = load i32, i32* %x4.p
+  %x5.p = getelementptr i32, i32* %p, i64 5
+  %x5 = load i32, i32* %x5.p
+  %x6.p = getelementptr i32, i32* %p, i64 6
+  %x6 = load i32, i32* %x6.p
+  %x7.p = getelementptr i32, i32* %p, i64 7
+  %x7 = load i32, i32* %x7.p
+  %x8.p = getelementptr i32, i32* %p, i64 8
+  %x8 = load i32, i32* %x8.p
+  %x9.p = getelementptr i32, i32* %p, i64 9
+  %x9 = load i32, i32* %x9.p
+  br label %loop
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %latch ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %latch ]
+  %c = icmp eq i32 %i, 1000
+  br i1 %c, label %cold, label %latch, !prof !0
+cold:
+  call void @g()
+  br label %latch
+latch:
+  %s0 = mul i32 %acc, %x0
+  %s1 = mul i32 %s0, %x1
+  %s2 = mul i32 %s1, %x2
+  %s3 = mul i32 %s2, %x3
+  %s4 = mul i32 %s3, %x4
+  %s5 = mul i32 %s4, %x5
+  %s6 = mul i32 %s5, %x6
+  %s7 = mul i32 %s6, %x7
+  %s8 = mul i32 %s7, %x8
+  %s9 = mul i32 %s8, %x9
+  %acc.next = add i32 %s9, %i
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+exit:
+  ret i32 %acc.next
+}
+
+!0 = !{!"branch_weights", i32 1, i32 1000}
+attributes #0 = { "regalloc-greedy-budget"="1" }
@@ -0,0 +1,12 @@
+; RUN: %lli -jit-latency-csv=%t.csv %s
+; RUN: FileCheck %s < %t.csv
+;
+; CHECK: module,phase,start_us,duration_us,bytes
+; CHECK-NEXT: "{{.*}}jit-latency-csv.ll",codegen,{{[0-9]+}},{{[0-9]+}},{{[1-9][0-9]*$}}
+; CHECK-NEXT: "{{.*}}jit-latency-csv.ll",load,{{[0-9]+}},{{[0-9]+}},{{[1-9][0-9]*$}}
+; CHECK-NEXT: "",relocation,{{[0-9]+}},{{[0-9]+}},0
+
+define i32 @main() {
+entry:
+  ret i32 0
+}
@@ -0,0 +1,20 @@
+; RUN: rm -rf %t.cache
+; RUN: %lli -object-cache-dir=%t.cache -stats %s 2>&1 | FileCheck %s -check-prefix=COLD
+; RUN: %lli -object-cache-dir=%t.cache -stats %s 2>&1 | FileCheck %s -check-prefix=WARM
+; RUN: ls %t.cache | count 1
+;
+; A different target configuration does not reuse the object.
+; RUN: %lli -object-cache-dir=%t.cache -O0 -stats %s 2>&1 | FileCheck %s -check-prefix=COLD
+; RUN: ls %t.cache | count 2
+; REQUIRES: asserts
+
+; COLD: 1 object-cache - Number of modules missing from the object cache
+; COLD: 1 object-cache - Number of objects written to the object cache
+
+; WARM: 1 object-cache - Number of objects loaded from the object cache
+; WARM-NOT: object-cache - Number of modules missing
+
+define i32 @main() {
+entry:
+  ret i32 0
+}
@@ -0,0 +1,69 @@
+; RUN: lli -jit-kind=orc-lazy -jit-code-cache -jit-code-cache-stats %s \
+; RUN:   2> %t.stats | FileCheck %s
+; RUN: FileCheck --check-prefix=STATS %s < %t.stats
+;
+; Each lazily compiled function is linked with a memory manager of its own.
+; With the code cache the sections of all of them fit in a few shared pages
+; instead of taking a page each.
+;
+; CHECK: sum 36
+;
+; STATS: JIT code cache:
+; STATS: shared pages: {{[0-9]}}, 0 sealed, holding {{[0-9][0-9]}} sections
+
+@fmt = private unnamed_addr constant [8 x i8] c"sum %d\0A\00"
+
+declare i32 @printf(i8*, ...)
+
+define i32 @f1() {
+  ret i32 1
+}
+
+define i32 @f2() {
+  ret i32 2
+}
+
+define i32 @f3() {
+  ret i32 3
+}
+
+define i32 @f4() {
+  ret i32 4
+}
+
+define i32 @f5() {
+  ret i32 5
+}
+
+define i32 @f6() {
+  ret i32 6
+}
+
+define i32 @f7() {
+  ret i32 7
+}
+
+define i32 @f8() {
+  ret i32 8
+}
+
+define i32 @main() {
+entry:
+  %a1 = call i32 @f1()
+  %a2 = call i32 @f2()
+  %s2 = add i32 %a1, %a2
+  %a3 = call i32 @f3()
+  %s3 = add i32 %s2, %a3
+  %a4 = call i32 @f4()
+  %s4 = add i32 %s3, %a4
+  %a5 = call i32 @f5()
+  %s5 = add i32 %s4, %a5
+  %a6 = call i32 @f6()
+  %s6 = add i32 %s5, %a6
+  %a7 = call i32 @f7()
+  %s7 = add i32 %s6, %a7
+  %a8 = call i32 @f8()
+  %s8 = add i32 %s7, %a8
+  %p = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([8 x i8], [8 x i8]* @fmt, i64 0, i64 0), i32 %s8)
+  ret i32 0
+}
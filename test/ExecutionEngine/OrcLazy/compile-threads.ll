@@ -0,0 +1,51 @@
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-compile-threads=2 %s | FileCheck %s
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-compile-threads=2 -orc-lazy-speculate=2 %s | FileCheck %s
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-compile-threads=4 -orc-lazy-speculate=3 %s | FileCheck %s
+;
+; The compile threads speculatively compile the callees of each compiled
+; function (one level deep by default), each in an LLVMContext of its own.
+;
+; CHECK: leaf 1
+; CHECK: leaf 2
+; CHECK: middle
+;
+; @unused is queued for speculative compilation but never called; it may still
+; be in the queue when the JIT is torn down.
+
+@str.leaf = private unnamed_addr constant [9 x i8] c"leaf %d\0A\00"
+@str.middle = private unnamed_addr constant [7 x i8] c"middle\00"
+
+declare i32 @printf(i8* nocapture readonly, ...)
+declare i32 @puts(i8* nocapture readonly)
+
+define void @leaf(i32 %n) {
+entry:
+  %call = tail call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([9 x i8], [9 x i8]* @str.leaf, i64 0, i64 0), i32 %n)
+  ret void
+}
+
+define void @unused() {
+entry:
+  ret void
+}
+
+define void @middle(i1 %c) {
+entry:
+  tail call void @leaf(i32 1)
+  tail call void @leaf(i32 2)
+  %puts = tail call i32 @puts(i8* getelementptr inbounds ([7 x i8], [7 x i8]* @str.middle, i64 0, i64 0))
+  br i1 %c, label %never, label %done
+
+never:
+  tail call void @unused()
+  br label %done
+
+done:
+  ret void
+}
+
+define i32 @main(i32 %argc, i8** nocapture readnone %argv) {
+entry:
+  tail call void @middle(i1 false)
+  ret i32 0
+}
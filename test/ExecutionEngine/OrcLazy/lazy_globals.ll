@@ -0,0 +1,38 @@
+; RUN: lli -jit-kind=orc-lazy -orc-lazy-debug=mods-to-stderr %s 2>&1 \
+; RUN:   | FileCheck --implicit-check-not=@unused %s
+;
+; Global variables are only emitted once code referring to them is compiled,
+; together with the variables their initializers refer to. @never is not
+; called, so @unused is never emitted.
+;
+; CHECK: ModuleID = '{{.*}}.globals.table'
+; CHECK-DAG: @table = global [2 x i32*] [i32* @a, i32* @b]
+; CHECK-DAG: @a = global i32 20
+; CHECK-DAG: @b = global i32 22
+; CHECK: sum 42
+
+@table = global [2 x i32*] [i32* @a, i32* @b]
+@a = global i32 20
+@b = global i32 22
+@unused = constant [4 x i32] [i32 1, i32 2, i32 3, i32 4]
+@fmt = private unnamed_addr constant [8 x i8] c"sum %d\0A\00"
+
+declare i32 @printf(i8* nocapture readonly, ...)
+
+define i32 @never(i64 %i) {
+entry:
+  %p = getelementptr inbounds [4 x i32], [4 x i32]* @unused, i64 0, i64 %i
+  %v = load i32, i32* %p
+  ret i32 %v
+}
+
+define i32 @main(i32 %argc, i8** nocapture readnone %argv) {
+entry:
+  %pa = load i32*, i32** getelementptr inbounds ([2 x i32*], [2 x i32*]* @table, i64 0, i64 0)
+  %pb = load i32*, i32** getelementptr inbounds ([2 x i32*], [2 x i32*]* @table, i64 0, i64 1)
+  %a = load i32, i32* %pa
+  %b = load i32, i32* %pb
+  %s = add i32 %a, %b
+  %call = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([8 x i8], [8 x i8]* @fmt, i64 0, i64 0), i32 %s)
+  ret i32 0
+}
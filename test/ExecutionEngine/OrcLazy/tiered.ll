@@ -0,0 +1,76 @@
+; RUN: lli -jit-kind=tiered -tier-up-threshold=1 %s | FileCheck %s
+; RUN: lli -jit-kind=tiered -tier-up-threshold=3 %s | FileCheck %s
+; RUN: lli -jit-kind=tiered -tier-up-threshold=100000 %s | FileCheck %s
+;
+; CHECK: sum 0
+; CHECK-NEXT: sum 1
+; CHECK-NEXT: sum 3
+; CHECK-NEXT: sum 6
+; CHECK-NEXT: sum 10
+; CHECK-NEXT: calls 5
+; CHECK-NEXT: scaled 3.00
+; CHECK-NEXT: apply 42
+; CHECK-NEXT: calls 6
+;
+; @main passes the address of @add to @apply, so both stay interpreted while
+; @add, @report and @scale may run natively. @calls is updated by both tiers.
+
+@calls = global i32 0
+@fmt.sum = private unnamed_addr constant [8 x i8] c"sum %d\0A\00"
+@fmt.calls = private unnamed_addr constant [10 x i8] c"calls %d\0A\00"
+@fmt.scaled = private unnamed_addr constant [13 x i8] c"scaled %.2f\0A\00"
+@fmt.apply = private unnamed_addr constant [10 x i8] c"apply %d\0A\00"
+
+declare i32 @printf(i8* nocapture readonly, ...)
+
+define i32 @add(i32 %a, i32 %b) {
+entry:
+  %c = load i32, i32* @calls
+  %c.next = add i32 %c, 1
+  store i32 %c.next, i32* @calls
+  %r = add i32 %a, %b
+  ret i32 %r
+}
+
+define void @report(i32 %s) {
+entry:
+  %call = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([8 x i8], [8 x i8]* @fmt.sum, i64 0, i64 0), i32 %s)
+  ret void
+}
+
+define double @scale(double %d) {
+entry:
+  %r = fmul double %d, 2.000000e+00
+  ret double %r
+}
+
+define i32 @apply(i32 (i32, i32)* %f) {
+entry:
+  %r = call i32 %f(i32 20, i32 22)
+  ret i32 %r
+}
+
+define i32 @main(i32 %argc, i8** nocapture readnone %argv) {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %s = phi i32 [ 0, %entry ], [ %s.next, %loop ]
+  %s.next = call i32 @add(i32 %s, i32 %i)
+  call void @report(i32 %s.next)
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, 5
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %c = load i32, i32* @calls
+  %call1 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([10 x i8], [10 x i8]* @fmt.calls, i64 0, i64 0), i32 %c)
+  %d = call double @scale(double 1.500000e+00)
+  %call2 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([13 x i8], [13 x i8]* @fmt.scaled, i64 0, i64 0), double %d)
+  %a = call i32 @apply(i32 (i32, i32)* @add)
+  %call3 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([10 x i8], [10 x i8]* @fmt.apply, i64 0, i64 0), i32 %a)
+  %c2 = load i32, i32* @calls
+  %call4 = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([10 x i8], [10 x i8]* @fmt.calls, i64 0, i64 0), i32 %c2)
+  ret i32 0
+}
@@ -0,0 +1,46 @@
+# RUN: llvm-mc -triple=x86_64-pc-linux -filetype=obj -o %T/test_ELF_resolve_threads.o %s
+# RUN: llvm-rtdyld -triple=x86_64-pc-linux -verify -resolve-threads=4 -dummy-extern ext=0x123456789 -check=%s %T/test_ELF_resolve_threads.o
+# RUN: llvm-rtdyld -triple=x86_64-pc-linux -verify -resolve-threads=1 -dummy-extern ext=0x123456789 -check=%s %T/test_ELF_resolve_threads.o
+
+# Enough relocations spread over several sections that resolveRelocations
+# applies them on more than one thread.
+
+        .text
+        .globl  target
+target:
+        retq
+
+        .section .data.a,"aw",@progbits
+# rtdyld-check: *{8}table_a = target
+# rtdyld-check: *{8}table_a_last = target
+table_a:
+        .rept   2999
+        .quad   target
+        .endr
+table_a_last:
+        .quad   target
+
+        .section .data.b,"aw",@progbits
+# rtdyld-check: *{8}table_b = ext
+# rtdyld-check: *{8}table_b_last = ext
+table_b:
+        .rept   2999
+        .quad   ext
+        .endr
+table_b_last:
+        .quad   ext
+
+        .section .data.c,"aw",@progbits
+# rtdyld-check: *{8}table_c = table_a + 16
+# rtdyld-check: *{8}table_c_last = table_a + 16
+table_c:
+        .rept   2999
+        .quad   table_a + 16
+        .endr
+table_c_last:
+        .quad   table_a + 16
+
+# PC-relative relocations use the address of the patched section.
+# rtdyld-check: *{4}pcrel = (target - pcrel - 4)[31:0]
+pcrel:
+        .long   target - . - 4
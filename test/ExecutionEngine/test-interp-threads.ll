@@ -0,0 +1,65 @@
+; RUN: %lli -force-interpreter=true %s | FileCheck %s
+; XFAIL: win32
+;
+; CHECK: counter 4000
+; CHECK-NEXT: winners 1
+
+@counter = global i32 0
+@claimed = global i32 0
+@winners = global i32 0
+@fmt = private unnamed_addr constant [23 x i8] c"counter %d\0Awinners %d\0A\00"
+
+declare i32 @pthread_create(i64*, i8*, i8* (i8*)*, i8*)
+declare i32 @pthread_join(i64, i8**)
+declare i32 @printf(i8* nocapture readonly, ...)
+
+define i8* @worker(i8* %arg) {
+entry:
+  %won = cmpxchg i32* @claimed, i32 0, i32 1 seq_cst seq_cst
+  %first = extractvalue { i32, i1 } %won, 1
+  br i1 %first, label %winner, label %loop
+
+winner:
+  %w = atomicrmw add i32* @winners, i32 1 seq_cst
+  br label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ 0, %winner ], [ %i.next, %loop ]
+  %old = atomicrmw add i32* @counter, i32 1 seq_cst
+  %i.next = add i32 %i, 1
+  %done = icmp eq i32 %i.next, 1000
+  br i1 %done, label %exit, label %loop
+
+exit:
+  fence seq_cst
+  ret i8* null
+}
+
+define i32 @main() {
+entry:
+  %threads = alloca [4 x i64]
+  br label %create
+
+create:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %create ]
+  %t = getelementptr [4 x i64], [4 x i64]* %threads, i64 0, i64 %i
+  %r = call i32 @pthread_create(i64* %t, i8* null, i8* (i8*)* @worker, i8* null)
+  %i.next = add i64 %i, 1
+  %created = icmp eq i64 %i.next, 4
+  br i1 %created, label %join, label %create
+
+join:
+  %j = phi i64 [ 0, %create ], [ %j.next, %join ]
+  %tj = getelementptr [4 x i64], [4 x i64]* %threads, i64 0, i64 %j
+  %handle = load i64, i64* %tj
+  %rj = call i32 @pthread_join(i64 %handle, i8** null)
+  %j.next = add i64 %j, 1
+  %joined = icmp eq i64 %j.next, 4
+  br i1 %joined, label %print, label %join
+
+print:
+  %c = load atomic i32, i32* @counter seq_cst, align 4
+  %w = load atomic i32, i32* @winners seq_cst, align 4
+  %p = call i32 (i8*, ...) @printf(i8* getelementptr inbounds ([23 x i8], [23 x i8]* @fmt, i64 0, i64 0), i32 %c, i32 %w)
+  ret i32 0
+}
@@ -0,0 +1,24 @@
+# RUN: llvm-mc -triple x86_64-unknown-unknown %s | FileCheck %s
+
+# Trailing comments, including one at the end of the file without a
+# newline, are skipped.
+
+# CHECK: .globl foo
+# CHECK: foo:
+# CHECK: movl %edi, %eax
+# CHECK-NEXT: addl %esi, %eax
+# CHECK-NEXT: retq
+# CHECK: .size foo, .Lfunc_end0-foo
+
+	.text
+	.globl	foo                     # -- Begin function foo
+	.p2align	4, 0x90
+	.type	foo,@function
+foo:                                    # @foo
+# BB#0:                                 # %entry
+	movl	%edi, %eax              # comment after an instruction
+	addl	%esi, %eax
+	retq
+.Lfunc_end0:
+	.size	foo, .Lfunc_end0-foo
+	# comment at the end of the file without a newline
\ No newline at end of file
@@ -0,0 +1,40 @@
+// RUN: rm -rf %t && mkdir -p %t
+// RUN: echo "# Comment lines and blank lines are ignored." > %t/batch.rsp
+// RUN: echo "%s %t/first.s" >> %t/batch.rsp
+// RUN: echo "" >> %t/batch.rsp
+// RUN: echo "%s %t/second.s" >> %t/batch.rsp
+// RUN: llvm-mc -triple x86_64-unknown-unknown -batch %t/batch.rsp -j 2
+// RUN: FileCheck %s < %t/first.s
+// RUN: FileCheck %s < %t/second.s
+
+// RUN: llvm-mc -triple x86_64-unknown-unknown -filetype=obj \
+// RUN:   -batch %t/batch.rsp -batch-summary | FileCheck %s --check-prefix=SUMMARY
+// RUN: llvm-objdump -d %t/first.s | FileCheck %s --check-prefix=OBJ
+
+// RUN: echo "%t/missing.s %t/missing.o" > %t/bad.rsp
+// RUN: echo "%s %t/third.s" >> %t/bad.rsp
+// RUN: not llvm-mc -triple x86_64-unknown-unknown -batch %t/bad.rsp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=MISSING
+// RUN: FileCheck %s < %t/third.s
+
+// RUN: echo "%s" > %t/malformed.rsp
+// RUN: not llvm-mc -triple x86_64-unknown-unknown -batch %t/malformed.rsp 2>&1 \
+// RUN:   | FileCheck %s --check-prefix=MALFORMED
+
+// CHECK: movl %eax, %ebx
+// CHECK: retq
+
+// SUMMARY: Bytes Wall(s) MB/s File
+// SUMMARY: batch-mode.s
+// SUMMARY: batch-mode.s
+// SUMMARY: total (2 files, {{[0-9]+}} threads)
+
+// OBJ: movl %eax, %ebx
+// OBJ: retq
+
+// MISSING: missing.s: {{[Nn]}}o such file or directory
+
+// MALFORMED: expected '<input> <output>'
+
+  movl %eax, %ebx
+  retq
@@ -0,0 +1,74 @@
+; RUN: opt -codegenprepare -cgp-region-sinking -S < %s | FileCheck %s
+
+; Single-use expression trees are sunk into the block of their user when that
+; does not make more values live across blocks or move code into a loop.
+
+; CHECK-LABEL: @tree(
+; CHECK: entry:
+; CHECK-NEXT: br i1 %c
+; CHECK: then:
+; CHECK-NEXT: %a = add i64 %x, 1
+; CHECK-NEXT: %b = xor i64 %a, 5
+; CHECK-NEXT: %d = sub i64 %b, %y
+; CHECK-NEXT: %r = mul i64 %d, %x
+define i64 @tree(i64 %x, i64 %y, i1 %c) {
+entry:
+  %a = add i64 %x, 1
+  %b = xor i64 %a, 5
+  %d = sub i64 %b, %y
+  br i1 %c, label %then, label %else
+then:
+  %r = mul i64 %d, %x
+  ret i64 %r
+else:
+  ret i64 %y
+}
+
+; Sinking %s would make both %x and %y live into %then instead of %s.
+; CHECK-LABEL: @livein(
+; CHECK: entry:
+; CHECK-NEXT: %s = add i64 %x, %y
+define i64 @livein(i64 %x, i64 %y, i1 %c) {
+entry:
+  %s = add i64 %x, %y
+  br i1 %c, label %then, label %else
+then:
+  %r = shl i64 %s, 2
+  ret i64 %r
+else:
+  ret i64 0
+}
+
+; Nothing is sunk into a loop.
+; CHECK-LABEL: @loop(
+; CHECK: entry:
+; CHECK-NEXT: %m = mul i64 %x, 7
+define void @loop(i64 %x, i64 %n, i64* %q) {
+entry:
+  %m = mul i64 %x, 7
+  br label %loop
+loop:
+  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]
+  %s = add i64 %i, %m
+  store i64 %s, i64* %q
+  %i.next = add i64 %i, 1
+  %c = icmp ult i64 %i.next, %n
+  br i1 %c, label %loop, label %exit
+exit:
+  ret void
+}
+
+; Loads are not moved.
+; CHECK-LABEL: @load(
+; CHECK: entry:
+; CHECK-NEXT: %v = load i64, i64* %p
+define i64 @load(i64* %p, i1 %c) {
+entry:
+  %v = load i64, i64* %p
+  store i64 0, i64* %p
+  br i1 %c, label %then, label %else
+then:
+  ret i64 %v
+else:
+  ret i64 0
+}
@@ -0,0 +1,118 @@
+# RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux %s -o %t.o
+# RUN: llvm-objdump -d -r %t.o > %t.serial
+# RUN: llvm-objdump -d -r -disassemble-threads=4 %t.o > %t.parallel
+# RUN: diff %t.serial %t.parallel
+# RUN: FileCheck %s < %t.parallel
+# RUN: llvm-objdump -d -disassemble-threads=3 -stats %t.o 2>&1 >/dev/null \
+# RUN:   | FileCheck %s --check-prefix=STATS
+
+# Disassembling the symbols of a section on several threads produces the same
+# output, in the same order, as disassembling them on one. The callees are
+# undefined so that every call carries a relocation.
+
+# CHECK:      Disassembly of section .text:
+# CHECK:      f0:
+# CHECK:      callq
+# CHECK-NEXT: R_X86_64_PC32 g1-4
+# CHECK:      f1:
+# CHECK:      f15:
+# CHECK-NEXT: movl %edi, %eax
+
+# STATS: bytes disassembled in {{.*}} MB/s, 3 threads)
+
+  .text
+  .globl f0
+f0:
+  movl %edi, %eax
+  addl $0, %eax
+  callq g1
+  retq
+  .globl f1
+f1:
+  movl %edi, %eax
+  addl $1, %eax
+  callq g2
+  retq
+  .globl f2
+f2:
+  movl %edi, %eax
+  addl $2, %eax
+  callq g3
+  retq
+  .globl f3
+f3:
+  movl %edi, %eax
+  addl $3, %eax
+  callq g4
+  retq
+  .globl f4
+f4:
+  movl %edi, %eax
+  addl $4, %eax
+  callq g5
+  retq
+  .globl f5
+f5:
+  movl %edi, %eax
+  addl $5, %eax
+  callq g6
+  retq
+  .globl f6
+f6:
+  movl %edi, %eax
+  addl $6, %eax
+  callq g7
+  retq
+  .globl f7
+f7:
+  movl %edi, %eax
+  addl $7, %eax
+  callq g8
+  retq
+  .globl f8
+f8:
+  movl %edi, %eax
+  addl $8, %eax
+  callq g9
+  retq
+  .globl f9
+f9:
+  movl %edi, %eax
+  addl $9, %eax
+  callq g10
+  retq
+  .globl f10
+f10:
+  movl %edi, %eax
+  addl $10, %eax
+  callq g11
+  retq
+  .globl f11
+f11:
+  movl %edi, %eax
+  addl $11, %eax
+  callq g12
+  retq
+  .globl f12
+f12:
+  movl %edi, %eax
+  addl $12, %eax
+  callq g13
+  retq
+  .globl f13
+f13:
+  movl %edi, %eax
+  addl $13, %eax
+  callq g14
+  retq
+  .globl f14
+f14:
+  movl %edi, %eax
+  addl $14, %eax
+  callq g15
+  retq
+  .globl f15
+f15:
+  movl %edi, %eax
+  addl $15, %eax
+  retq
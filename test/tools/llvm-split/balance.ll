@@ -0,0 +1,37 @@
+; RUN: llvm-split -split-module-print-balance -o %t %s 2>&1 \
+; RUN:   | FileCheck --check-prefix=REPORT %s
+; RUN: llvm-dis -o - %t0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-dis -o - %t1 | FileCheck --check-prefix=CHECK1 %s
+
+; Partitions are balanced by instruction count: the large function gets a
+; partition of its own and the small ones share the other.
+
+; REPORT: SplitModule: 3 clusters, total cost 10
+; REPORT-NEXT: partition 0: cost 6, 1 globals
+; REPORT-NEXT: partition 1: cost 4, 2 globals
+; REPORT-NEXT: imbalance: 1.20
+
+; CHECK0: declare i32 @small1(i32)
+; CHECK1: define i32 @small1(i32 %a)
+define i32 @small1(i32 %a) {
+  %b = add i32 %a, 1
+  ret i32 %b
+}
+
+; CHECK0: define i32 @big(i32 %a)
+; CHECK1: declare i32 @big(i32)
+define i32 @big(i32 %a) {
+  %b = add i32 %a, 1
+  %c = mul i32 %b, %a
+  %d = xor i32 %c, %b
+  %e = call i32 @small1(i32 %d)
+  %f = call i32 @small2(i32 %e)
+  ret i32 %f
+}
+
+; CHECK0: declare i32 @small2(i32)
+; CHECK1: define i32 @small2(i32 %a)
+define i32 @small2(i32 %a) {
+  %b = sub i32 %a, 1
+  ret i32 %b
+}
@@ -0,0 +1,39 @@
+; RUN: llvm-split -preserve-locals -o %t %s
+; RUN: llvm-dis -o - %t0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-dis -o - %t1 | FileCheck --check-prefix=CHECK1 %s
+
+; Local symbols stay local and are placed together with all of their users.
+
+; CHECK0: @table = internal global
+; CHECK1: @table = external global
+@table = internal global [2 x i32 ()*] [i32 ()* @local1, i32 ()* @local2]
+
+; CHECK0: define internal i32 @local1()
+; CHECK1: declare i32 @local1()
+define internal i32 @local1() {
+  %a = add i32 1, 2
+  %b = mul i32 %a, %a
+  %c = xor i32 %b, %a
+  ret i32 %c
+}
+
+; CHECK0: define internal i32 @local2()
+; CHECK1: declare i32 @local2()
+define internal i32 @local2() {
+  ret i32 2
+}
+
+; CHECK0: define i32 @user()
+; CHECK1: declare i32 @user()
+define i32 @user() {
+  %p = getelementptr [2 x i32 ()*], [2 x i32 ()*]* @table, i32 0, i32 1
+  %f = load i32 ()*, i32 ()** %p
+  %r = call i32 %f()
+  ret i32 %r
+}
+
+; CHECK0: declare i32 @other()
+; CHECK1: define i32 @other()
+define i32 @other() {
+  ret i32 0
+}
@@ -5,6 +5,8 @@
 #include "llvm/Support/Memory.h"
 #include <assert.h>
 #include <map>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <string>
 #include <vector>
@@ -13,7 +15,9 @@ using namespace llvm;
 
 class LLIChildTarget {
 public:
+  LLIChildTarget() : UseSharedMemory(false) {}
   void initialize();
+  void attachSharedMemory(int FD, size_t Size);
   LLIMessageType waitForIncomingMessage();
   void handleMessage(LLIMessageType messageType);
   RemoteTarget *RT;
@@ -24,6 +28,7 @@ private:
   void handleAllocateSpace();
   void handleLoadSection(bool IsCode);
   void handleExecute();
+  void handleProtectCode();
 
   // Outgoing message handlers
   void sendChildActive();
@@ -42,11 +47,17 @@ private:
 
   // Communication handles (OS-specific)
   void *ConnectionData;
+
+  // Whether the parent passed a shared memory region, even if it could not
+  // be mapped.
+  bool UseSharedMemory;
 };
 
-int main() {
+int main(int argc, char **argv) {
   LLIChildTarget  ThisChild;
   ThisChild.RT = new RemoteTarget();
+  if (argc == 4 && strcmp(argv[1], "-shared-memory") == 0)
+    ThisChild.attachSharedMemory(atoi(argv[2]), strtoull(argv[3], nullptr, 10));
   ThisChild.initialize();
   LLIMessageType MsgType;
   do {
@@ -64,6 +75,11 @@ void LLIChildTarget::initialize() {
   sendChildActive();
 }
 
+void LLIChildTarget::attachSharedMemory(int FD, size_t Size) {
+  UseSharedMemory = true;
+  RPC.attachSharedMemory(FD, Size);
+}
+
 LLIMessageType LLIChildTarget::waitForIncomingMessage() {
   int32_t MsgType = -1;
   if (ReadBytes(&MsgType, 4) > 0)
@@ -85,6 +101,9 @@ void LLIChildTarget::handleMessage(LLIMessageType messageType) {
     case LLI_Execute:
       handleExecute();
       break;
+    case LLI_ProtectCode:
+      handleProtectCode();
+      break;
     case LLI_Terminate:
       RT->stop();
       break;
@@ -169,6 +188,29 @@ void LLIChildTarget::handleExecute() {
   sendExecutionComplete(Result);
 }
 
+void LLIChildTarget::handleProtectCode() {
+  // Read and verify the message data size.
+  uint32_t DataSize = 0;
+  int rc = ReadBytes(&DataSize, 4);
+  (void)rc;
+  assert(rc == 4);
+  assert(DataSize == 16);
+
+  // Read the code range. The parent has already written the code to the
+  // shared region, so it only needs to be made executable.
+  uint64_t Addr = 0;
+  uint64_t Size = 0;
+  rc = ReadBytes(&Addr, 8);
+  assert(rc == 8);
+  rc = ReadBytes(&Size, 8);
+  assert(rc == 8);
+
+  bool Protected = RPC.protectSharedCode(Addr, Size);
+  (void)Protected;
+  assert(Protected && "Could not make shared code executable");
+  sys::Memory::InvalidateInstructionCache((void *)Addr, Size);
+}
+
 // Outgoing message handlers
 void LLIChildTarget::sendChildActive() {
   // Write the message type.
@@ -178,9 +220,17 @@ void LLIChildTarget::sendChildActive() {
   assert(rc == 4);
 
   // Write the data size.
-  uint32_t DataSize = 0;
+  uint32_t DataSize = UseSharedMemory ? 8 : 0;
   rc = WriteBytes(&DataSize, 4);
   assert(rc == 4);
+
+  // Write the address of the shared memory region, or 0 if it could not be
+  // mapped.
+  if (UseSharedMemory) {
+    uint64_t Addr = (uint64_t)RPC.SharedMemory;
+    rc = WriteBytes(&Addr, 8);
+    assert(rc == 8);
+  }
 }
 
 void LLIChildTarget::sendAllocationResult(uint64_t Addr) {
@@ -8,9 +8,14 @@
 //===----------------------------------------------------------------------===//
 
 #include "OrcLazyJIT.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ExecutionEngine/CodeCacheMemoryManager.h"
 #include "llvm/ExecutionEngine/Orc/OrcTargetSupport.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 #include <cstdio>
 #include <system_error>
 
@@ -39,6 +44,20 @@ namespace {
                                              "working directory. (WARNING: "
                                              "will overwrite existing files)."),
                                   clEnumValEnd));
+
+  cl::opt<unsigned> OrcCompileThreads("orc-lazy-compile-threads",
+                                      cl::desc("Number of background threads "
+                                               "to compile functions on for "
+                                               "the orc-lazy JIT."),
+                                      cl::init(0));
+
+  cl::opt<unsigned> OrcSpeculationDepth("orc-lazy-speculate",
+                                        cl::desc("Levels of callees of each "
+                                                 "compiled function to compile "
+                                                 "ahead of their first call on "
+                                                 "the compile threads (0 "
+                                                 "disables the threads)."),
+                                        cl::init(1));
 }
 
 OrcLazyJIT::CallbackManagerBuilder
@@ -58,6 +77,25 @@ OrcLazyJIT::createCallbackManagerBuilder(Triple T) {
   }
 }
 
+OrcLazyJIT::CompileLayerT::CompileFtor
+OrcLazyJIT::createCompiler(TargetMachine &TM, bool Concurrent) {
+  if (!Concurrent)
+    return orc::SimpleCompiler(TM);
+
+  const Target &T = TM.getTarget();
+  std::string TT = TM.getTargetTriple().str();
+  std::string CPU = TM.getTargetCPU();
+  std::string FS = TM.getTargetFeatureString();
+  TargetOptions Options = TM.Options;
+  Reloc::Model RM = TM.getRelocationModel();
+  CodeModel::Model CM = TM.getCodeModel();
+  CodeGenOpt::Level OL = TM.getOptLevel();
+  return orc::ConcurrentIRCompiler([=, &T]() {
+    return std::unique_ptr<TargetMachine>(
+        T.createTargetMachine(TT, CPU, FS, Options, RM, CM, OL));
+  });
+}
+
 OrcLazyJIT::TransformFtor OrcLazyJIT::createDebugDumper() {
 
   switch (OrcDumpKind) {
@@ -66,20 +104,22 @@ OrcLazyJIT::TransformFtor OrcLazyJIT::createDebugDumper() {
 
   case DumpKind::DumpFuncsToStdOut:
     return [](std::unique_ptr<Module> M) {
-      printf("[ ");
+      // Print the line in one go: modules may be compiled on several threads.
+      std::string Line = "[ ";
 
       for (const auto &F : *M) {
         if (F.isDeclaration())
           continue;
 
         if (F.hasName()) {
-          std::string Name(F.getName());
-          printf("%s ", Name.c_str());
+          Line += F.getName();
+          Line += ' ';
         } else
-          printf("<anon> ");
+          Line += "<anon> ";
       }
 
-      printf("]\n");
+      Line += "]\n";
+      fputs(Line.c_str(), stdout);
       return M;
     };
 
@@ -110,8 +150,11 @@ OrcLazyJIT::TransformFtor OrcLazyJIT::createDebugDumper() {
 
 // Defined in lli.cpp.
 CodeGenOpt::Level getOptLevel();
+JITCodeCache *getJITCodeCache();
+void printJITCodeCacheStats();
 
-int llvm::runOrcLazyJIT(std::unique_ptr<Module> M, int ArgC, char* ArgV[]) {
+int llvm::runOrcLazyJIT(std::unique_ptr<Module> M, int ArgC, char* ArgV[],
+                        JITEventListener *Listener) {
   // Add the program's symbols into the JIT's search space.
   if (sys::DynamicLibrary::LoadLibraryPermanently(nullptr)) {
     errs() << "Error loading program symbols.\n";
@@ -138,7 +181,14 @@ int llvm::runOrcLazyJIT(std::unique_ptr<Module> M, int ArgC, char* ArgV[]) {
 
   // Everything looks good. Build the JIT.
   auto &DL = M->getDataLayout();
-  OrcLazyJIT J(std::move(TM), DL, Context, CallbackMgrBuilder);
+  OrcLazyJIT J(std::move(TM), DL, Context, CallbackMgrBuilder,
+               OrcCompileThreads, OrcSpeculationDepth);
+  if (Listener)
+    J.setEventListener(Listener);
+  if (JITCodeCache *Cache = getJITCodeCache())
+    J.setMemoryManagerBuilder([Cache]() {
+      return llvm::make_unique<CodeCacheMemoryManager>(*Cache);
+    });
 
   // Add the module, look up main and run it.
   auto MainHandle = J.addModule(std::move(M));
@@ -151,5 +201,137 @@ int llvm::runOrcLazyJIT(std::unique_ptr<Module> M, int ArgC, char* ArgV[]) {
 
   typedef int (*MainFnPtr)(int, char*[]);
   auto Main = OrcLazyJIT::fromTargetAddress<MainFnPtr>(MainSym.getAddress());
-  return Main(ArgC, ArgV);
+  int Result = Main(ArgC, ArgV);
+  printJITCodeCacheStats();
+  return Result;
+}
+
+std::unique_ptr<OrcTierUpCompiler> OrcTierUpCompiler::create(Module &M) {
+  EngineBuilder EB;
+  EB.setOptLevel(getOptLevel());
+  auto TM = std::unique_ptr<TargetMachine>(EB.selectTarget());
+  auto CallbackMgrBuilder =
+    OrcLazyJIT::createCallbackManagerBuilder(Triple(TM->getTargetTriple()));
+  if (!CallbackMgrBuilder)
+    return nullptr;
+
+  std::unique_ptr<OrcTierUpCompiler> TierUp(
+      new OrcTierUpCompiler(std::move(TM), std::move(CallbackMgrBuilder)));
+  M.setDataLayout(TierUp->DL);
+  return TierUp;
+}
+
+static Value *fromSlot(IRBuilder<> &B, Value *Slot, Type *Ty) {
+  if (Ty->isIntegerTy())
+    return B.CreateZExtOrTrunc(Slot, Ty);
+  if (Ty->isFloatTy())
+    return B.CreateBitCast(B.CreateTrunc(Slot, B.getInt32Ty()), Ty);
+  if (Ty->isDoubleTy())
+    return B.CreateBitCast(Slot, Ty);
+  return B.CreateIntToPtr(Slot, Ty);
+}
+
+static Value *toSlot(IRBuilder<> &B, Value *V) {
+  Type *Ty = V->getType();
+  if (Ty->isIntegerTy())
+    return B.CreateZExtOrTrunc(V, B.getInt64Ty());
+  if (Ty->isFloatTy())
+    return B.CreateZExt(B.CreateBitCast(V, B.getInt32Ty()), B.getInt64Ty());
+  if (Ty->isDoubleTy())
+    return B.CreateBitCast(V, B.getInt64Ty());
+  return B.CreatePtrToInt(V, B.getInt64Ty());
+}
+
+/// Build 'void @Name(i64* %args, i64* %result)', which calls F with arguments
+/// unpacked from %args and stores F's return value to %result. This is the
+/// calling convention of TieredEntryPoint.
+static void createEntryThunk(Function &F, const std::string &Name) {
+  LLVMContext &Context = F.getContext();
+  Type *SlotPtrTy = Type::getInt64PtrTy(Context);
+  Type *Params[] = { SlotPtrTy, SlotPtrTy };
+  Function *Thunk =
+    Function::Create(FunctionType::get(Type::getVoidTy(Context), Params, false),
+                     GlobalValue::ExternalLinkage, Name, F.getParent());
+
+  IRBuilder<> B(BasicBlock::Create(Context, "entry", Thunk));
+  auto AI = Thunk->arg_begin();
+  Value *ArgSlots = &*AI++;
+  Value *ResultSlot = &*AI;
+
+  SmallVector<Value *, 8> Args;
+  for (Type *Ty : F.getFunctionType()->params()) {
+    Value *Slot = B.CreateLoad(B.CreateConstGEP1_32(ArgSlots, Args.size()));
+    Args.push_back(fromSlot(B, Slot, Ty));
+  }
+  CallInst *Call = B.CreateCall(&F, Args);
+  Call->setCallingConv(F.getCallingConv());
+  if (!F.getReturnType()->isVoidTy())
+    B.CreateStore(toSlot(B, Call), ResultSlot);
+  B.CreateRetVoid();
+}
+
+bool OrcTierUpCompiler::attach(ExecutionEngine &EE, Module &M,
+                               unsigned Threshold) {
+  // Aliases and thread-local variables cannot be redirected to the
+  // interpreter's storage.
+  if (!M.alias_empty())
+    return false;
+  for (const GlobalVariable &GV : M.globals())
+    if (GV.isThreadLocal())
+      return false;
+
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> Copy(CloneModule(&M, VMap));
+
+  // Replace the copy's variables with declarations resolving to the memory the
+  // interpreter allocated for them. The interpreter has already initialized
+  // them and runs the static constructors and destructors itself.
+  unsigned NumGlobals = 0;
+  for (GlobalVariable &GV : M.globals()) {
+    auto *NewGV = cast<GlobalVariable>(VMap[&GV]);
+    if (GV.getName().startswith("llvm.")) {
+      NewGV->eraseFromParent();
+      continue;
+    }
+    if (GV.isDeclaration())
+      continue;
+
+    std::string Name = "__tier_gv." + utostr(NumGlobals++);
+    sys::DynamicLibrary::AddSymbol(Name, EE.getPointerToGlobal(&GV));
+    NewGV->setName(Name);
+    NewGV->setInitializer(nullptr);
+    NewGV->setComdat(nullptr);
+    NewGV->setLinkage(GlobalValue::ExternalLinkage);
+    NewGV->setVisibility(GlobalValue::DefaultVisibility);
+  }
+
+  for (Function &F : M) {
+    FunctionType *FTy = F.getFunctionType();
+    if (F.isDeclaration() || FTy->isVarArg() ||
+        (!FTy->getReturnType()->isVoidTy() &&
+         !isTieredSlotType(FTy->getReturnType())) ||
+        !std::all_of(FTy->param_begin(), FTy->param_end(), isTieredSlotType))
+      continue;
+    std::string Name = "__tier_entry." + utostr(EntryNames.size());
+    createEntryThunk(*cast<Function>(VMap[&F]), Name);
+    EntryNames[&F] = Name;
+  }
+
+  J = llvm::make_unique<OrcLazyJIT>(std::move(TM), DL, M.getContext(),
+                                    BuildCallbackMgr);
+  J->addModule(std::move(Copy));
+  EE.setTierUpCompiler(Threshold,
+                       [this](Function &F) { return compile(F); });
+  return true;
+}
+
+TieredEntryPoint OrcTierUpCompiler::compile(Function &F) {
+  auto I = EntryNames.find(&F);
+  if (I == EntryNames.end())
+    return nullptr;
+  // This is the thunk's lazy-compilation stub: F is compiled on its first
+  // native call.
+  if (auto Sym = J->findSymbol(I->second))
+    return OrcLazyJIT::fromTargetAddress<TieredEntryPoint>(Sym.getAddress());
+  return nullptr;
 }
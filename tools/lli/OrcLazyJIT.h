@@ -15,6 +15,7 @@
 #ifndef LLVM_TOOLS_LLI_ORCLAZYJIT_H
 #define LLVM_TOOLS_LLI_ORCLAZYJIT_H
 
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/ExecutionEngine/Orc/CompileOnDemandLayer.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
@@ -49,14 +50,23 @@ public:
   const DataLayout &DL;
 
   OrcLazyJIT(std::unique_ptr<TargetMachine> TM, const DataLayout &DL,
-             LLVMContext &Context, CallbackManagerBuilder &BuildCallbackMgr)
+             LLVMContext &Context, CallbackManagerBuilder &BuildCallbackMgr,
+             unsigned NumCompileThreads = 0, unsigned SpeculationDepth = 0)
       : DL(DL), TM(std::move(TM)), ObjectLayer(),
-        CompileLayer(ObjectLayer, orc::SimpleCompiler(*this->TM)),
+        CompileLayer(ObjectLayer,
+                     createCompiler(*this->TM, NumCompileThreads != 0 &&
+                                                   SpeculationDepth != 0)),
         IRDumpLayer(CompileLayer, createDebugDumper()),
         CCMgr(BuildCallbackMgr(IRDumpLayer, CCMgrMemMgr, Context)),
-        CODLayer(IRDumpLayer, *CCMgr, false),
+        CODLayer(IRDumpLayer, *CCMgr, false, NumCompileThreads,
+                 SpeculationDepth),
         CXXRuntimeOverrides(
-            [this](const std::string &S) { return mangle(S); }) {}
+            [this](const std::string &S) { return mangle(S); }) {
+    // The compile-on-demand layer's threads compile partitions in contexts of
+    // their own and add them to the layers below concurrently.
+    if (NumCompileThreads != 0 && SpeculationDepth != 0)
+      CompileLayer.setConcurrentCompiles(true);
+  }
 
   ~OrcLazyJIT() {
     // Run any destructors registered with __cxa_atexit.
@@ -123,6 +133,17 @@ public:
     return H;
   }
 
+  /// Build the memory manager of each module set the JIT links with Builder.
+  void setMemoryManagerBuilder(CODLayerT::MemoryManagerBuilderT Builder) {
+    CODLayer.setMemoryManagerBuilder(std::move(Builder));
+  }
+
+    /// Report the time spent compiling and linking modules to Listener.
+  void setEventListener(JITEventListener *Listener) {
+    CompileLayer.setEventListener(Listener);
+    ObjectLayer.setEventListener(Listener);
+  }
+
   orc::JITSymbol findSymbol(const std::string &Name) {
     return CODLayer.findSymbol(mangle(Name), true);
   }
@@ -143,6 +164,11 @@ private:
 
   static TransformFtor createDebugDumper();
 
+  // Create the compile functor for CompileLayer. If Concurrent, it may be
+  // called from several threads, each of which gets a copy of TM.
+  static CompileLayerT::CompileFtor createCompiler(TargetMachine &TM,
+                                                   bool Concurrent);
+
   std::unique_ptr<TargetMachine> TM;
   SectionMemoryManager CCMgrMemMgr;
 
@@ -156,7 +182,38 @@ private:
   std::vector<orc::CtorDtorRunner<CODLayerT>> IRStaticDestructorRunners;
 };
 
-int runOrcLazyJIT(std::unique_ptr<Module> M, int ArgC, char* ArgV[]);
+int runOrcLazyJIT(std::unique_ptr<Module> M, int ArgC, char* ArgV[],
+                  JITEventListener *Listener = nullptr);
+
+/// Compiles the hot functions of an interpreted module for tiered execution.
+/// A copy of the module is handed to an OrcLazyJIT with its global variables
+/// redirected to the interpreter's, so both tiers share the program's memory.
+class OrcTierUpCompiler {
+public:
+  /// Select a target for M and give M its data layout so that the interpreter
+  /// lays out memory the way native code expects. Returns null if there is no
+  /// lazy JIT support for the host.
+  static std::unique_ptr<OrcTierUpCompiler> create(Module &M);
+
+  /// Copy M into the JIT and make this EE's tier-up compiler. Returns false if
+  /// M uses features the JIT copy cannot share with the interpreter.
+  bool attach(ExecutionEngine &EE, Module &M, unsigned Threshold);
+
+  /// Return a native entry point for F, or null if F has no entry thunk.
+  TieredEntryPoint compile(Function &F);
+
+private:
+  OrcTierUpCompiler(std::unique_ptr<TargetMachine> TM,
+                    OrcLazyJIT::CallbackManagerBuilder BuildCallbackMgr)
+      : TM(std::move(TM)), DL(this->TM->createDataLayout()),
+        BuildCallbackMgr(std::move(BuildCallbackMgr)) {}
+
+  std::unique_ptr<TargetMachine> TM;
+  DataLayout DL;
+  OrcLazyJIT::CallbackManagerBuilder BuildCallbackMgr;
+  std::unique_ptr<OrcLazyJIT> J;
+  DenseMap<const Function *, std::string> EntryNames;
+};
 
 } // end namespace llvm
 
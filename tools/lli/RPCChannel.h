@@ -15,6 +15,7 @@
 #ifndef LLVM_TOOLS_LLI_RPCCHANNEL_H
 #define LLVM_TOOLS_LLI_RPCCHANNEL_H
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string>
 
@@ -24,10 +25,13 @@ class RPCChannel {
 public:
   std::string ChildName;
 
-  RPCChannel() {}
+  RPCChannel()
+      : ConnectionData(nullptr), SharedMemory(nullptr), SharedMemorySize(0),
+        SharedMemoryFD(-1) {}
   ~RPCChannel();
 
-  /// Start the remote process.
+  /// Start the remote process. If a shared memory region has been created,
+  /// the child is told how to map it.
   ///
   /// @returns True on success. On failure, ErrorMsg is updated with
   ///          descriptive text of the encountered error.
@@ -35,6 +39,25 @@ public:
 
   bool createClient();
 
+  /// Create a region of Size bytes that the child process maps too, so that
+  /// code and data can be written to it directly. Must be called before
+  /// createServer.
+  ///
+  /// @returns The region's address in this process, or null if shared memory
+  ///          is not available.
+  void *createSharedMemory(size_t Size);
+
+  /// Map the region the parent created, given the descriptor and size it
+  /// passed on the command line. The mapping is writable, and pages can be
+  /// made executable with protectSharedCode.
+  ///
+  /// @returns The region's address in this process, or null on failure.
+  void *attachSharedMemory(int FD, size_t Size);
+
+  /// Make the pages covering [Addr, Addr + Size) of an attached region
+  /// readable and executable instead of writable.
+  bool protectSharedCode(uint64_t Addr, uint64_t Size);
+
   // This will get filled in as a point to an OS-specific structure.
   void *ConnectionData;
 
@@ -42,6 +65,13 @@ public:
   bool ReadBytes(void *Data, size_t Size);
 
   void Wait();
+
+  // The shared memory region, if any.
+  void *SharedMemory;
+  size_t SharedMemorySize;
+
+private:
+  int SharedMemoryFD;
 };
 
 } // end namespace llvm
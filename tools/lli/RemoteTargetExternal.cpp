@@ -20,18 +20,80 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/Memory.h"
+#include "llvm/Support/Process.h"
 #include "llvm/Support/Program.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstring>
 #include <string>
 
 using namespace llvm;
 
 #define DEBUG_TYPE "lli"
 
+bool RemoteTargetExternal::create() {
+  RPC.ChildName = ChildName;
+  if (SharedMemorySize && !RPC.createSharedMemory(SharedMemorySize))
+    DEBUG(dbgs() << "Shared memory not available, using the pipe\n");
+  if (!RPC.createServer())
+    return true;
+
+  // We must get Ack from the client (blocking read)
+  bool Active = RPC.SharedMemory ? Receive(LLI_ChildActive, SharedBase)
+                                 : Receive(LLI_ChildActive);
+  if (!Active) {
+    ErrorMsg += ", (RPCChannel::create) - Stopping process!";
+    stop();
+    return false;
+  }
+
+  DEBUG(if (RPC.SharedMemory) {
+    if (SharedBase)
+      dbgs() << "Shared memory mapped at 0x" << format("%llx", SharedBase)
+             << " in the child\n";
+    else
+      dbgs() << "Child could not map shared memory, using the pipe\n";
+  });
+  return true;
+}
+
+char *RemoteTargetExternal::getSharedAddress(uint64_t Address, size_t Size) {
+  if (!SharedBase || Address < SharedBase ||
+      Address + Size > SharedBase + RPC.SharedMemorySize)
+    return nullptr;
+  return static_cast<char *>(RPC.SharedMemory) + (Address - SharedBase);
+}
+
+bool RemoteTargetExternal::SendQueuedMessages() {
+  if (QueuedMessages.empty())
+    return true;
+  DEBUG(dbgs() << "Sending " << QueuedMessages.size()
+               << " bytes of queued messages\n");
+  bool Sent = WriteBytes(QueuedMessages.data(), QueuedMessages.size());
+  QueuedMessages.clear();
+  if (!Sent)
+    ErrorMsg += ", (RemoteTargetExternal::SendQueuedMessages)";
+  return Sent;
+}
+
 bool RemoteTargetExternal::allocateSpace(size_t Size, unsigned Alignment,
                                  uint64_t &Address) {
   DEBUG(dbgs() << "Message [allocate space] size: " << Size <<
                   ", align: " << Alignment << "\n");
+  if (SharedBase) {
+    // Carve the space out of the shared region, keeping each allocation on
+    // its own pages so that code and data never share one.
+    uint64_t Align = std::max<uint64_t>(Alignment, sys::Process::getPageSize());
+    uint64_t Offset = (SharedUsed + Align - 1) / Align * Align;
+    if (Offset + Size <= RPC.SharedMemorySize) {
+      Address = SharedBase + Offset;
+      SharedUsed = Offset + Size;
+      DEBUG(dbgs() << "Shared [allocate space] addr: 0x" <<
+                      format("%llx", Address) << "\n");
+      return true;
+    }
+    // Once the region is full, further space comes from the child's heap.
+  }
   if (!SendAllocateSpace(Alignment, Size)) {
     ErrorMsg += ", (RemoteTargetExternal::allocateSpace)";
     return false;
@@ -50,6 +112,11 @@ bool RemoteTargetExternal::allocateSpace(size_t Size, unsigned Alignment,
 }
 
 bool RemoteTargetExternal::loadData(uint64_t Address, const void *Data, size_t Size) {
+  if (char *Dest = getSharedAddress(Address, Size)) {
+    memcpy(Dest, Data, Size);
+    return true;
+  }
+
   DEBUG(dbgs() << "Message [load data] addr: 0x" << format("%llx", Address) <<
                   ", size: " << Size << "\n");
   if (!SendLoadSection(Address, Data, (uint32_t)Size, false)) {
@@ -74,6 +141,21 @@ bool RemoteTargetExternal::loadData(uint64_t Address, const void *Data, size_t S
 }
 
 bool RemoteTargetExternal::loadCode(uint64_t Address, const void *Data, size_t Size) {
+  if (char *Dest = getSharedAddress(Address, Size)) {
+    memcpy(Dest, Data, Size);
+
+    // The child makes the pages executable when it next reads a message.
+    uint32_t MsgType = LLI_ProtectCode;
+    uint32_t DataSize = 16;
+    uint64_t CodeSize = Size;
+    const char *Fields[] = { (const char *)&MsgType, (const char *)&DataSize,
+                             (const char *)&Address, (const char *)&CodeSize };
+    const unsigned FieldSizes[] = { 4, 4, 8, 8 };
+    for (unsigned I = 0; I != 4; ++I)
+      QueuedMessages.append(Fields[I], Fields[I] + FieldSizes[I]);
+    return true;
+  }
+
   DEBUG(dbgs() << "Message [load code] addr: 0x" << format("%llx", Address) <<
                   ", size: " << Size << "\n");
   if (!SendLoadSection(Address, Data, (uint32_t)Size, true)) {
@@ -269,6 +351,10 @@ bool RemoteTargetExternal::SendHeader(LLIMessageType MsgType) {
   assert(SendData.empty() && Sizes.empty() &&
          "Payload vector not empty to send header");
 
+  // Anything queued must reach the child before it acts on this message.
+  if (!SendQueuedMessages())
+    return false;
+
   // Message header, with type to follow
   if (!WriteBytes(&MsgType, 4)) {
     ErrorMsg += ", (RemoteTargetExternal::SendHeader)";
@@ -87,30 +87,36 @@ public:
   /// @returns Page alignment return value. Default of 4k.
   unsigned getPageAlignment() override { return 4096; }
 
-  bool create() override {
-    RPC.ChildName = ChildName;
-    if (!RPC.createServer())
-      return true;
-
-    // We must get Ack from the client (blocking read)
-    if (!Receive(LLI_ChildActive)) {
-      ErrorMsg += ", (RPCChannel::create) - Stopping process!";
-      stop();
-      return false;
-    }
-
-    return true;
-  }
+  bool create() override;
 
   /// Terminate the remote process.
   void stop() override;
 
-  RemoteTargetExternal(std::string &Name) : RemoteTarget(), ChildName(Name) {}
+  /// Create a remote target running the executable Name. If SharedMemorySize
+  /// is not zero and the host supports it, code and data are written to a
+  /// region of that size shared with the child instead of being sent through
+  /// the pipe.
+  RemoteTargetExternal(std::string &Name, size_t SharedMemorySize = 0)
+      : RemoteTarget(), ChildName(Name), SharedMemorySize(SharedMemorySize),
+        SharedBase(0), SharedUsed(0) {}
   ~RemoteTargetExternal() override {}
 
 private:
   std::string ChildName;
 
+  // The shared memory region, if the child mapped it: its size, its address
+  // in the child, and how much of it has been allocated.
+  size_t SharedMemorySize;
+  uint64_t SharedBase;
+  uint64_t SharedUsed;
+
+  // Messages without replies, waiting to be sent with the next message that
+  // has one.
+  SmallVector<char, 128> QueuedMessages;
+
+  char *getSharedAddress(uint64_t Address, size_t Size);
+  bool SendQueuedMessages();
+
   bool SendAllocateSpace(uint32_t Alignment, uint32_t Size);
   bool SendLoadSection(uint64_t Addr,
                        const void *Data,
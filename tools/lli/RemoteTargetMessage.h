@@ -54,6 +54,20 @@ namespace llvm {
 //   Parent: { LLI_Execute, 8, Address }
 //    Child: { LLI_ExecutionResult, 4, Result }
 //
+// When the child is started with a shared memory region it maps the region,
+// and instead of the empty LLI_ChildActive message it replies with
+//    Child: { LLI_ChildActive, 8, Address }
+// giving the region's address in its address space, or 0 if it could not map
+// it. The parent then allocates space and writes sections in the region
+// itself, and only tells the child which pages hold code:
+//
+//  * Protect Code:
+//   Parent: { LLI_ProtectCode, 16, Address, Size }
+//
+// These messages have no reply. The parent queues them and sends them all at
+// once before the next message that does, so a program is loaded without any
+// round trips.
+//
 // It is the responsibility of either side to check for correct headers,
 // sizes and payloads, since any inconsistency would misalign the pipe, and
 // result in data corruption.
@@ -71,7 +85,9 @@ enum LLIMessageType {
   LLI_Execute,                // Data = uint64_t Address
   LLI_ExecutionResult,        // Data = uint32_t Result
 
-  LLI_Terminate               // Data = not used
+  LLI_Terminate,              // Data = not used
+
+  LLI_ProtectCode             // Data = uint64_t Address, uint64_t Size
 };
 
 enum LLIMessageStatus {
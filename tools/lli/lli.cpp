@@ -21,6 +21,8 @@
 #include "llvm/ADT/Triple.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/CodeGen/LinkAllCodegenComponents.h"
+#include "llvm/ExecutionEngine/CodeCacheMemoryManager.h"
+#include "llvm/ExecutionEngine/FileObjectCache.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/Interpreter.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
@@ -43,6 +45,7 @@
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/Memory.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/MutexGuard.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/PluginLoader.h"
 #include "llvm/Support/PrettyStackTrace.h"
@@ -68,7 +71,7 @@ using namespace llvm;
 
 namespace {
 
-  enum class JITKind { MCJIT, OrcMCJITReplacement, OrcLazy };
+  enum class JITKind { MCJIT, OrcMCJITReplacement, OrcLazy, Tiered };
 
   cl::opt<std::string>
   InputFile(cl::desc("<input bitcode>"), cl::Positional, cl::init("-"));
@@ -92,8 +95,32 @@ namespace {
                                 clEnumValN(JITKind::OrcLazy,
                                            "orc-lazy",
                                            "Orc-based lazy JIT."),
+                                clEnumValN(JITKind::Tiered,
+                                           "tiered",
+                                           "Interpret, then compile hot "
+                                           "functions with the Orc-based "
+                                           "lazy JIT."),
                                 clEnumValEnd));
 
+  cl::opt<unsigned>
+  TierUpThreshold("tier-up-threshold",
+                  cl::desc("Number of calls and loop iterations after which "
+                           "-jit-kind=tiered compiles a function"),
+                  cl::init(1000));
+
+  cl::opt<bool>
+  UseJITCodeCache("jit-code-cache",
+                  cl::desc("Allocate the memory of JIT'd code from a code "
+                           "cache that packs small sections of different "
+                           "modules into shared pages"),
+                  cl::init(false));
+
+  cl::opt<bool>
+  PrintJITCodeCacheStats("jit-code-cache-stats",
+                         cl::desc("Print the memory use of the JIT code cache "
+                                  "after main returns"),
+                         cl::init(false));
+
   // The MCJIT supports building for a target address space separate from
   // the JIT compilation process. Use a forked process and a copying
   // memory manager with IPC to execute using this functionality.
@@ -112,6 +139,15 @@ namespace {
                          "\n\tremote execution will be simulated in-process."),
                 cl::value_desc("filename"), cl::init(""));
 
+  // Code and data are written to memory shared with the child process when
+  // possible, rather than sent through the pipe one section at a time.
+  cl::opt<unsigned>
+  RemoteSharedMemory("remote-shared-memory",
+                     cl::desc("Size in MB of the memory region shared with "
+                              "the remote process (0 = send code and data "
+                              "through the pipe)"),
+                     cl::value_desc("MB"), cl::init(64));
+
   // Determine optimization level.
   cl::opt<char>
   OptLevel("O",
@@ -170,9 +206,24 @@ namespace {
   cl::opt<std::string>
   ObjectCacheDir("object-cache-dir",
                   cl::desc("Directory to store cached object files "
-                           "(must be user writable)"),
+                           "(must be user writable). Without "
+                           "-enable-cache-manager objects are cached under "
+                           "a hash of their IR and target configuration."),
                   cl::init(""));
 
+  cl::opt<unsigned>
+  ObjectCacheSize("object-cache-size",
+                  cl::desc("Megabytes of objects to keep in -object-cache-dir, "
+                           "deleting the least recently used ones "
+                           "(0 = unlimited)"),
+                  cl::init(0));
+
+  cl::opt<std::string>
+  JITLatencyCSV("jit-latency-csv",
+                cl::desc("Write the time spent in each JIT compile phase of "
+                         "each module to this file as CSV"),
+                cl::value_desc("filename"), cl::init(""));
+
   cl::opt<std::string>
   FakeArgv0("fake-argv0",
             cl::desc("Override the 'argv[0]' value passed into the executing"
@@ -312,8 +363,44 @@ private:
   }
 };
 
+//===----------------------------------------------------------------------===//
+// Compile latency log
+//
+// Writes one CSV row per JIT compile phase: the module, the phase, when it
+// started and how long it took in microseconds since the log was opened, and
+// the size of the object it worked on.
+//
+class JITLatencyLog : public JITEventListener {
+public:
+  JITLatencyLog(StringRef Path, std::error_code &EC)
+      : Out(Path, EC, sys::fs::F_Text), Start(sys::TimeValue::now()) {
+    Out << "module,phase,start_us,duration_us,bytes\n";
+  }
+
+  void NotifyCompilePhase(const CompilePhaseInfo &Info) override {
+    MutexGuard Locked(Lock);
+    Out << '"';
+    for (char C : Info.Name) {
+      if (C == '"')
+        Out << '"';
+      Out << C;
+    }
+    Out << "\"," << getCompilePhaseName(Info.Phase) << ','
+        << (Info.Start - Start).usec() << ','
+        << (Info.End - Info.Start).usec() << ',' << Info.Size << '\n';
+    // lli may exit without running destructors.
+    Out.flush();
+  }
+
+private:
+  sys::Mutex Lock;
+  raw_fd_ostream Out;
+  sys::TimeValue Start;
+};
+
 static ExecutionEngine *EE = nullptr;
-static LLIObjectCache *CacheManager = nullptr;
+static ObjectCache *CacheManager = nullptr;
+static JITEventListener *LatencyLog = nullptr;
 
 static void do_shutdown() {
   // Cygwin-1.5 invokes DLL's dtors before atexit handler.
@@ -321,6 +408,7 @@ static void do_shutdown() {
   delete EE;
   if (CacheManager)
     delete CacheManager;
+  delete LatencyLog;
   llvm_shutdown();
 #endif
 }
@@ -378,6 +466,17 @@ CodeGenOpt::Level getOptLevel() {
   llvm_unreachable("Unrecognized opt level.");
 }
 
+JITCodeCache *getJITCodeCache() {
+  static ManagedStatic<JITCodeCache> Cache;
+  return UseJITCodeCache ? &*Cache : nullptr;
+}
+
+void printJITCodeCacheStats() {
+  if (PrintJITCodeCacheStats)
+    if (JITCodeCache *Cache = getJITCodeCache())
+      Cache->getStatistics().print(errs());
+}
+
 //===----------------------------------------------------------------------===//
 // main Driver function
 //
@@ -410,8 +509,30 @@ int main(int argc, char **argv, char * const *envp) {
     return 1;
   }
 
+  if (!JITLatencyCSV.empty()) {
+    std::error_code EC;
+    LatencyLog = new JITLatencyLog(JITLatencyCSV, EC);
+    if (EC) {
+      errs() << argv[0] << ": cannot open '" << JITLatencyCSV
+             << "': " << EC.message() << "\n";
+      exit(1);
+    }
+  }
+
   if (UseJITKind == JITKind::OrcLazy)
-    return runOrcLazyJIT(std::move(Owner), argc, argv);
+    return runOrcLazyJIT(std::move(Owner), argc, argv, LatencyLog);
+
+  // Tiered execution starts out in the interpreter.
+  std::unique_ptr<OrcTierUpCompiler> TierUp;
+  if (UseJITKind == JITKind::Tiered) {
+    TierUp = OrcTierUpCompiler::create(*Mod);
+    if (!TierUp) {
+      errs() << argv[0] << ": tiered execution is not supported for this "
+                           "target.\n";
+      return 1;
+    }
+    ForceInterpreter = true;
+  }
 
   if (EnableCacheManager) {
     std::string CacheName("file:");
@@ -450,6 +571,8 @@ int main(int argc, char **argv, char * const *envp) {
   if (!ForceInterpreter) {
     if (RemoteMCJIT)
       RTDyldMM = new RemoteMemoryManager();
+    else if (JITCodeCache *Cache = getJITCodeCache())
+      RTDyldMM = new CodeCacheMemoryManager(*Cache);
     else
       RTDyldMM = new SectionMemoryManager();
 
@@ -483,8 +606,16 @@ int main(int argc, char **argv, char * const *envp) {
   if (EnableCacheManager) {
     CacheManager = new LLIObjectCache(ObjectCacheDir);
     EE->setObjectCache(CacheManager);
+  } else if (!ObjectCacheDir.empty() && EE->getTargetMachine()) {
+    CacheManager = new FileObjectCache(ObjectCacheDir, *EE->getTargetMachine(),
+                                       uint64_t(ObjectCacheSize) << 20);
+    EE->setObjectCache(CacheManager);
   }
 
+  if (TierUp && !TierUp->attach(*EE, *Mod, TierUpThreshold))
+    errs() << "warning: module cannot be compiled for tiered execution, "
+              "interpreting only\n";
+
   // Load any additional modules specified on the command line.
   for (unsigned i = 0, e = ExtraModules.size(); i != e; ++i) {
     std::unique_ptr<Module> XMod = parseIRFile(ExtraModules[i], Err, Context);
@@ -545,6 +676,8 @@ int main(int argc, char **argv, char * const *envp) {
                 JITEventListener::createOProfileJITEventListener());
   EE->RegisterJITEventListener(
                 JITEventListener::createIntelJITEventListener());
+  if (LatencyLog)
+    EE->RegisterJITEventListener(LatencyLog);
 
   if (!NoLazyCompilation && RemoteMCJIT) {
     errs() << "warning: remote mcjit does not support lazy compilation\n";
@@ -599,12 +732,14 @@ int main(int argc, char **argv, char * const *envp) {
     // Trigger compilation separately so code regions that need to be
     // invalidated will be known.
     (void)EE->getPointerToFunction(EntryFn);
-    // Clear instruction cache before code will be executed.
-    if (RTDyldMM)
+    // Clear instruction cache before code will be executed. The code cache
+    // does so when the code is finalized.
+    if (RTDyldMM && !getJITCodeCache())
       static_cast<SectionMemoryManager*>(RTDyldMM)->invalidateInstructionCache();
 
     // Run main.
     Result = EE->runFunctionAsMain(EntryFn, InputArgv, envp);
+    printJITCodeCacheStats();
 
     // Run static destructors.
     EE->runStaticConstructorsDestructors(true);
@@ -649,7 +784,8 @@ int main(int argc, char **argv, char * const *envp) {
                << "'\n";
         return -1;
       }
-      Target.reset(new RemoteTargetExternal(ChildExecPath));
+      Target.reset(new RemoteTargetExternal(
+          ChildExecPath, (size_t)RemoteSharedMemory * 1024 * 1024));
 #endif
     } else {
       // No child process name provided, use simulated remote execution.
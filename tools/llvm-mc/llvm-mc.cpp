@@ -13,6 +13,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "Disassembler.h"
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/MC/MCAsmBackend.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/MC/MCContext.h"
@@ -29,6 +30,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compression.h"
 #include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/Host.h"
 #include "llvm/Support/ManagedStatic.h"
@@ -38,7 +40,10 @@
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/thread.h"
+#include <atomic>
 using namespace llvm;
 
 static cl::opt<std::string>
@@ -167,6 +172,20 @@ static cl::opt<bool> SaveTempLabels("save-temp-labels",
 static cl::opt<bool> NoExecStack("no-exec-stack",
                                  cl::desc("File doesn't need an exec stack"));
 
+static cl::opt<std::string>
+BatchFile("batch", cl::desc("Assemble every '<input> <output>' pair listed "
+                            "one per line in this file"),
+          cl::value_desc("filename"));
+
+static cl::opt<unsigned>
+BatchThreads("j", cl::desc("Number of worker threads used by -batch "
+                           "(default: number of hardware threads)"),
+             cl::init(0));
+
+static cl::opt<bool>
+BatchSummary("batch-summary",
+             cl::desc("Print per-file assembly throughput for -batch"));
+
 enum ActionType {
   AC_AsLex,
   AC_Assemble,
@@ -365,6 +384,245 @@ static int AssembleInput(const char *ProgName, const Target *TheTarget,
   return Res;
 }
 
+static void configureContext(MCContext &Ctx, unsigned DwarfVersion) {
+  if (SaveTempLabels)
+    Ctx.setAllowTemporaryLabels(false);
+
+  Ctx.setGenDwarfForAssembly(GenDwarfForAssembly);
+  Ctx.setDwarfVersion(DwarfVersion);
+  if (!DwarfDebugFlags.empty())
+    Ctx.setDwarfDebugFlags(StringRef(DwarfDebugFlags));
+  if (!DwarfDebugProducer.empty())
+    Ctx.setDwarfDebugProducer(StringRef(DwarfDebugProducer));
+  if (!DebugCompilationDir.empty())
+    Ctx.setCompilationDir(DebugCompilationDir);
+  if (!MainFileName.empty())
+    Ctx.setMainFileName(MainFileName);
+}
+
+/// Create the streamer selected by -filetype, writing to \p Out. \p BOS is
+/// filled in when object output has to be buffered because \p Out cannot
+/// seek, and \p IP is set to the instruction printer of an assembly streamer.
+static std::unique_ptr<MCStreamer>
+createOutputStreamer(const Target *TheTarget, const Triple &TheTriple,
+                     MCContext &Ctx, const MCAsmInfo &MAI,
+                     const MCRegisterInfo &MRI, const MCInstrInfo &MCII,
+                     const MCSubtargetInfo &STI, tool_output_file &Out,
+                     std::unique_ptr<buffer_ostream> &BOS,
+                     MCInstPrinter *&IP) {
+  raw_pwrite_stream *OS = &Out.os();
+  std::unique_ptr<MCStreamer> Str;
+
+  if (FileType == OFT_AssemblyFile) {
+    IP = TheTarget->createMCInstPrinter(TheTriple, OutputAsmVariant, MAI,
+                                        MCII, MRI);
+
+    // Set the display preference for hex vs. decimal immediates.
+    IP->setPrintImmHex(PrintImmHex);
+
+    // Set up the AsmStreamer.
+    MCCodeEmitter *CE = nullptr;
+    MCAsmBackend *MAB = nullptr;
+    if (ShowEncoding) {
+      CE = TheTarget->createMCCodeEmitter(MCII, MRI, Ctx);
+      MAB = TheTarget->createMCAsmBackend(MRI, TripleName, MCPU);
+    }
+    auto FOut = llvm::make_unique<formatted_raw_ostream>(*OS);
+    Str.reset(TheTarget->createAsmStreamer(
+        Ctx, std::move(FOut), /*asmverbose*/ true,
+        /*useDwarfDirectory*/ true, IP, CE, MAB, ShowInst));
+
+  } else if (FileType == OFT_Null) {
+    Str.reset(TheTarget->createNullStreamer(Ctx));
+  } else {
+    assert(FileType == OFT_ObjectFile && "Invalid file type!");
+
+    // Don't waste memory on names of temp labels.
+    Ctx.setUseNamesOnTempLabels(false);
+
+    if (!Out.os().supportsSeeking()) {
+      BOS = make_unique<buffer_ostream>(Out.os());
+      OS = BOS.get();
+    }
+
+    MCCodeEmitter *CE = TheTarget->createMCCodeEmitter(MCII, MRI, Ctx);
+    MCAsmBackend *MAB = TheTarget->createMCAsmBackend(MRI, TripleName, MCPU);
+    Str.reset(TheTarget->createMCObjectStreamer(TheTriple, Ctx, *MAB, *OS, CE,
+                                                STI, RelaxAll,
+                                                /*DWARFMustBeAtTheEnd*/ false));
+    if (NoExecStack)
+      Str->InitSections(true);
+  }
+
+  return Str;
+}
+
+namespace {
+/// One '<input> <output>' line of a -batch file, together with the
+/// diagnostics and timing collected while assembling it.
+struct BatchJob {
+  std::string InputFile;
+  std::string OutputFile;
+  std::string Diagnostics;
+  uint64_t InputSize = 0;
+  double WallTime = 0.0;
+  int Result = 1;
+};
+}
+
+static void handleBatchDiagnostic(const SMDiagnostic &Diag, void *Context) {
+  Diag.print(nullptr, *static_cast<raw_ostream *>(Context),
+             /*ShowColors*/ false);
+}
+
+/// Assemble a single -batch entry. Everything that is mutated while parsing
+/// and emitting (the SourceMgr, MCContext and streamer) is local to the job so
+/// that jobs can run concurrently; only the Target and the command line
+/// options are shared.
+static void AssembleBatchJob(const char *ProgName, const Target *TheTarget,
+                             const Triple &TheTriple,
+                             MCTargetOptions &MCOptions,
+                             StringRef FeaturesStr, unsigned DwarfVersion,
+                             BatchJob &Job) {
+  raw_string_ostream Diag(Job.Diagnostics);
+  TimeRecord Start = TimeRecord::getCurrentTime(/*Start*/ true);
+
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufferPtr =
+      MemoryBuffer::getFile(Job.InputFile);
+  if (std::error_code EC = BufferPtr.getError()) {
+    Diag << ProgName << ": " << Job.InputFile << ": " << EC.message() << '\n';
+    return;
+  }
+  Job.InputSize = (*BufferPtr)->getBufferSize();
+
+  SourceMgr SrcMgr;
+  SrcMgr.setDiagHandler(handleBatchDiagnostic, &Diag);
+  SrcMgr.AddNewSourceBuffer(std::move(*BufferPtr), SMLoc());
+  SrcMgr.setIncludeDirs(IncludeDirs);
+
+  std::unique_ptr<MCRegisterInfo> MRI(TheTarget->createMCRegInfo(TripleName));
+  std::unique_ptr<MCAsmInfo> MAI(TheTarget->createMCAsmInfo(*MRI, TripleName));
+  if (CompressDebugSections)
+    MAI->setCompressDebugSections(true);
+
+  MCObjectFileInfo MOFI;
+  MCContext Ctx(MAI.get(), MRI.get(), &MOFI, &SrcMgr);
+  MOFI.InitMCObjectFileInfo(TheTriple, RelocModel, CMModel, Ctx);
+  configureContext(Ctx, DwarfVersion);
+
+  std::error_code EC;
+  tool_output_file Out(Job.OutputFile, EC, sys::fs::F_None);
+  if (EC) {
+    Diag << ProgName << ": " << Job.OutputFile << ": " << EC.message() << '\n';
+    return;
+  }
+
+  std::unique_ptr<MCInstrInfo> MCII(TheTarget->createMCInstrInfo());
+  std::unique_ptr<MCSubtargetInfo> STI(
+      TheTarget->createMCSubtargetInfo(TripleName, MCPU, FeaturesStr));
+
+  std::unique_ptr<buffer_ostream> BOS;
+  MCInstPrinter *IP = nullptr;
+  std::unique_ptr<MCStreamer> Str = createOutputStreamer(
+      TheTarget, TheTriple, Ctx, *MAI, *MRI, *MCII, *STI, Out, BOS, IP);
+
+  Job.Result = AssembleInput(ProgName, TheTarget, SrcMgr, Ctx, *Str, *MAI,
+                             *STI, *MCII, MCOptions);
+
+  // Flush buffered object output before the file is closed.
+  Str.reset();
+  BOS.reset();
+  if (Job.Result == 0)
+    Out.keep();
+
+  Job.WallTime = TimeRecord::getCurrentTime(/*Start*/ false).getWallTime() -
+                 Start.getWallTime();
+}
+
+/// Assemble all of the inputs listed in -batch on a pool of worker threads.
+/// Diagnostics are buffered per input and printed in file order once every
+/// job has finished, so the output does not depend on scheduling.
+static int AssembleBatch(const char *ProgName, const Target *TheTarget,
+                         const Triple &TheTriple, MCTargetOptions &MCOptions,
+                         StringRef FeaturesStr, unsigned DwarfVersion) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BatchBuffer =
+      MemoryBuffer::getFileOrSTDIN(BatchFile);
+  if (std::error_code EC = BatchBuffer.getError()) {
+    errs() << ProgName << ": " << BatchFile << ": " << EC.message() << '\n';
+    return 1;
+  }
+
+  std::vector<BatchJob> Jobs;
+  SmallVector<StringRef, 16> Lines;
+  (*BatchBuffer)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty*/ false);
+  for (StringRef Line : Lines) {
+    Line = Line.trim();
+    if (Line.empty() || Line[0] == '#')
+      continue;
+    SmallVector<StringRef, 2> Fields;
+    SplitString(Line, Fields);
+    if (Fields.size() != 2) {
+      errs() << ProgName << ": " << BatchFile
+             << ": expected '<input> <output>', got '" << Line << "'\n";
+      return 1;
+    }
+    Jobs.emplace_back();
+    Jobs.back().InputFile = Fields[0];
+    Jobs.back().OutputFile = Fields[1];
+  }
+  if (Jobs.empty())
+    return 0;
+
+  unsigned NumThreads = BatchThreads;
+#if LLVM_ENABLE_THREADS
+  if (NumThreads == 0)
+    NumThreads = std::thread::hardware_concurrency();
+#endif
+  NumThreads = std::max(1u, std::min<unsigned>(NumThreads, Jobs.size()));
+
+  TimeRecord Start = TimeRecord::getCurrentTime(/*Start*/ true);
+  std::atomic<unsigned> NextJob(0);
+  auto Worker = [&]() {
+    for (unsigned I = NextJob++; I < Jobs.size(); I = NextJob++)
+      AssembleBatchJob(ProgName, TheTarget, TheTriple, MCOptions, FeaturesStr,
+                       DwarfVersion, Jobs[I]);
+  };
+  std::vector<thread> Workers;
+  for (unsigned I = 0; I != NumThreads; ++I)
+    Workers.emplace_back(Worker);
+  for (thread &T : Workers)
+    T.join();
+  double TotalTime = TimeRecord::getCurrentTime(/*Start*/ false).getWallTime() -
+                     Start.getWallTime();
+
+  int Res = 0;
+  uint64_t TotalSize = 0;
+  for (const BatchJob &Job : Jobs) {
+    errs() << Job.Diagnostics;
+    if (Job.Result)
+      Res = 1;
+    TotalSize += Job.InputSize;
+  }
+
+  if (BatchSummary) {
+    auto PrintRate = [](raw_ostream &OS, uint64_t Size, double Time) {
+      OS << format("%10" PRIu64 " %10.4f %10.2f", Size, Time,
+                   Time > 0.0 ? Size / Time / (1024.0 * 1024.0) : 0.0);
+    };
+    raw_ostream &OS = outs();
+    OS << "     Bytes    Wall(s)       MB/s  File\n";
+    for (const BatchJob &Job : Jobs) {
+      PrintRate(OS, Job.InputSize, Job.WallTime);
+      OS << "  " << Job.InputFile << (Job.Result ? " (failed)\n" : "\n");
+    }
+    PrintRate(OS, TotalSize, TotalTime);
+    OS << "  total (" << Jobs.size() << " files, " << NumThreads
+       << " threads)\n";
+  }
+
+  return Res;
+}
+
 int main(int argc, char **argv) {
   // Print a stack trace if we signal out.
   sys::PrintStackTraceOnErrorSignal();
@@ -395,6 +653,38 @@ int main(int argc, char **argv) {
   // construct the Triple object.
   Triple TheTriple(TripleName);
 
+  if (CompressDebugSections && !zlib::isAvailable()) {
+    errs() << ProgName
+           << ": build tools with zlib to enable -compress-debug-sections";
+    return 1;
+  }
+
+  // Default to 4 for dwarf version.
+  unsigned DwarfVersion = MCOptions.DwarfVersion ? MCOptions.DwarfVersion : 4;
+  if (DwarfVersion < 2 || DwarfVersion > 4) {
+    errs() << ProgName << ": Dwarf version " << DwarfVersion
+           << " is not supported." << '\n';
+    return 1;
+  }
+
+  // Package up features to be passed to target/subtarget
+  std::string FeaturesStr;
+  if (MAttrs.size()) {
+    SubtargetFeatures Features;
+    for (unsigned i = 0; i != MAttrs.size(); ++i)
+      Features.AddFeature(MAttrs[i]);
+    FeaturesStr = Features.getString();
+  }
+
+  if (!BatchFile.empty()) {
+    if (Action != AC_Assemble) {
+      errs() << ProgName << ": -batch is only supported with -assemble\n";
+      return 1;
+    }
+    return AssembleBatch(ProgName, TheTarget, TheTriple, MCOptions,
+                         FeaturesStr, DwarfVersion);
+  }
+
   ErrorOr<std::unique_ptr<MemoryBuffer>> BufferPtr =
       MemoryBuffer::getFileOrSTDIN(InputFilename);
   if (std::error_code EC = BufferPtr.getError()) {
@@ -418,104 +708,28 @@ int main(int argc, char **argv) {
   std::unique_ptr<MCAsmInfo> MAI(TheTarget->createMCAsmInfo(*MRI, TripleName));
   assert(MAI && "Unable to create target asm info!");
 
-  if (CompressDebugSections) {
-    if (!zlib::isAvailable()) {
-      errs() << ProgName
-             << ": build tools with zlib to enable -compress-debug-sections";
-      return 1;
-    }
+  if (CompressDebugSections)
     MAI->setCompressDebugSections(true);
-  }
 
   // FIXME: This is not pretty. MCContext has a ptr to MCObjectFileInfo and
   // MCObjectFileInfo needs a MCContext reference in order to initialize itself.
   MCObjectFileInfo MOFI;
   MCContext Ctx(MAI.get(), MRI.get(), &MOFI, &SrcMgr);
   MOFI.InitMCObjectFileInfo(TheTriple, RelocModel, CMModel, Ctx);
-
-  if (SaveTempLabels)
-    Ctx.setAllowTemporaryLabels(false);
-
-  Ctx.setGenDwarfForAssembly(GenDwarfForAssembly);
-  // Default to 4 for dwarf version.
-  unsigned DwarfVersion = MCOptions.DwarfVersion ? MCOptions.DwarfVersion : 4;
-  if (DwarfVersion < 2 || DwarfVersion > 4) {
-    errs() << ProgName << ": Dwarf version " << DwarfVersion
-           << " is not supported." << '\n';
-    return 1;
-  }
-  Ctx.setDwarfVersion(DwarfVersion);
-  if (!DwarfDebugFlags.empty())
-    Ctx.setDwarfDebugFlags(StringRef(DwarfDebugFlags));
-  if (!DwarfDebugProducer.empty())
-    Ctx.setDwarfDebugProducer(StringRef(DwarfDebugProducer));
-  if (!DebugCompilationDir.empty())
-    Ctx.setCompilationDir(DebugCompilationDir);
-  if (!MainFileName.empty())
-    Ctx.setMainFileName(MainFileName);
-
-  // Package up features to be passed to target/subtarget
-  std::string FeaturesStr;
-  if (MAttrs.size()) {
-    SubtargetFeatures Features;
-    for (unsigned i = 0; i != MAttrs.size(); ++i)
-      Features.AddFeature(MAttrs[i]);
-    FeaturesStr = Features.getString();
-  }
+  configureContext(Ctx, DwarfVersion);
 
   std::unique_ptr<tool_output_file> Out = GetOutputStream();
   if (!Out)
     return 1;
 
-  std::unique_ptr<buffer_ostream> BOS;
-  raw_pwrite_stream *OS = &Out->os();
-  std::unique_ptr<MCStreamer> Str;
-
   std::unique_ptr<MCInstrInfo> MCII(TheTarget->createMCInstrInfo());
   std::unique_ptr<MCSubtargetInfo> STI(
       TheTarget->createMCSubtargetInfo(TripleName, MCPU, FeaturesStr));
 
+  std::unique_ptr<buffer_ostream> BOS;
   MCInstPrinter *IP = nullptr;
-  if (FileType == OFT_AssemblyFile) {
-    IP = TheTarget->createMCInstPrinter(Triple(TripleName), OutputAsmVariant,
-                                        *MAI, *MCII, *MRI);
-
-    // Set the display preference for hex vs. decimal immediates.
-    IP->setPrintImmHex(PrintImmHex);
-
-    // Set up the AsmStreamer.
-    MCCodeEmitter *CE = nullptr;
-    MCAsmBackend *MAB = nullptr;
-    if (ShowEncoding) {
-      CE = TheTarget->createMCCodeEmitter(*MCII, *MRI, Ctx);
-      MAB = TheTarget->createMCAsmBackend(*MRI, TripleName, MCPU);
-    }
-    auto FOut = llvm::make_unique<formatted_raw_ostream>(*OS);
-    Str.reset(TheTarget->createAsmStreamer(
-        Ctx, std::move(FOut), /*asmverbose*/ true,
-        /*useDwarfDirectory*/ true, IP, CE, MAB, ShowInst));
-
-  } else if (FileType == OFT_Null) {
-    Str.reset(TheTarget->createNullStreamer(Ctx));
-  } else {
-    assert(FileType == OFT_ObjectFile && "Invalid file type!");
-
-    // Don't waste memory on names of temp labels.
-    Ctx.setUseNamesOnTempLabels(false);
-
-    if (!Out->os().supportsSeeking()) {
-      BOS = make_unique<buffer_ostream>(Out->os());
-      OS = BOS.get();
-    }
-
-    MCCodeEmitter *CE = TheTarget->createMCCodeEmitter(*MCII, *MRI, Ctx);
-    MCAsmBackend *MAB = TheTarget->createMCAsmBackend(*MRI, TripleName, MCPU);
-    Str.reset(TheTarget->createMCObjectStreamer(TheTriple, Ctx, *MAB, *OS, CE,
-                                                *STI, RelaxAll,
-                                                /*DWARFMustBeAtTheEnd*/ false));
-    if (NoExecStack)
-      Str->InitSections(true);
-  }
+  std::unique_ptr<MCStreamer> Str = createOutputStreamer(
+      TheTarget, TheTriple, Ctx, *MAI, *MRI, *MCII, *STI, *Out, BOS, IP);
 
   int Res = 1;
   bool disassemble = false;
@@ -19,6 +19,7 @@
 #include "llvm-objdump.h"
 #include "llvm/ADT/Optional.h"
 #include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/CodeGen/FaultMaps.h"
@@ -53,8 +54,11 @@
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/TargetRegistry.h"
 #include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Timer.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/thread.h"
 #include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <cstring>
 #include <system_error>
@@ -176,6 +180,12 @@ cl::opt<bool>
 cl::opt<bool> PrintFaultMaps("fault-map-section",
                              cl::desc("Display contents of faultmap section"));
 
+static cl::opt<unsigned>
+DisassembleThreads("disassemble-threads",
+                   cl::desc("Number of threads used to disassemble the "
+                            "symbols of a section (default 1)"),
+                   cl::init(1));
+
 static StringRef ToolName;
 
 namespace {
@@ -304,12 +314,12 @@ public:
                          ArrayRef<uint8_t> Bytes, uint64_t Address,
                          raw_ostream &OS, StringRef Annot,
                          MCSubtargetInfo const &STI) {
-    outs() << format("%8" PRIx64 ":", Address);
+    OS << format("%8" PRIx64 ":", Address);
     if (!NoShowRawInsn) {
-      outs() << "\t";
-      dumpBytes(Bytes, outs());
+      OS << "\t";
+      dumpBytes(Bytes, OS);
     }
-    IP.printInst(MI, outs(), "", STI);
+    IP.printInst(MI, OS, "", STI);
   }
 };
 PrettyPrinter PrettyPrinterInst;
@@ -515,9 +525,51 @@ static std::error_code getRelocationValueString(const COFFObjectFile *Obj,
   return std::error_code();
 }
 
-static void printRelocationTargetName(const MachOObjectFile *O,
-                                      const MachO::any_relocation_info &RE,
-                                      raw_string_ostream &fmt) {
+namespace {
+/// Malformed relocation pairs found while printing MachO relocations. These
+/// are returned as error codes rather than reported on the spot, since the
+/// relocations may be printed on one of several disassembly threads.
+enum class reloc_pair_error {
+  x86_64_subtractor = 1,
+  generic_sectdiff,
+  generic_local_sectdiff,
+  arm_half
+};
+
+class RelocPairErrorCategory : public std::error_category {
+public:
+  const char *name() const LLVM_NOEXCEPT override {
+    return "llvm.objdump.reloc";
+  }
+  std::string message(int EV) const override {
+    switch (static_cast<reloc_pair_error>(EV)) {
+    case reloc_pair_error::x86_64_subtractor:
+      return "Expected X86_64_RELOC_UNSIGNED after X86_64_RELOC_SUBTRACTOR";
+    case reloc_pair_error::generic_sectdiff:
+      return "Expected GENERIC_RELOC_PAIR after GENERIC_RELOC_SECTDIFF";
+    case reloc_pair_error::generic_local_sectdiff:
+      return "Expected GENERIC_RELOC_PAIR after GENERIC_RELOC_LOCAL_SECTDIFF";
+    case reloc_pair_error::arm_half:
+      return "Expected ARM_RELOC_PAIR after ARM_RELOC_HALF";
+    }
+    llvm_unreachable("unknown relocation pair error");
+  }
+};
+}
+
+static ManagedStatic<RelocPairErrorCategory> RelocPairCategory;
+
+static std::error_code make_error_code(reloc_pair_error E) {
+  return std::error_code(static_cast<int>(E), *RelocPairCategory);
+}
+
+/// Print the target of \p RE to \p fmt. Errors reading the object are
+/// returned rather than reported, since this may run on one of several
+/// disassembly threads.
+static std::error_code
+printRelocationTargetName(const MachOObjectFile *O,
+                          const MachO::any_relocation_info &RE,
+                          raw_string_ostream &fmt) {
   bool IsScattered = O->isRelocationScattered(RE);
 
   // Target of a scattered relocation is an address.  In the interest of
@@ -528,36 +580,33 @@ static void printRelocationTargetName(const MachOObjectFile *O,
     uint32_t Val = O->getPlainRelocationSymbolNum(RE);
 
     for (const SymbolRef &Symbol : O->symbols()) {
-      std::error_code ec;
       ErrorOr<uint64_t> Addr = Symbol.getAddress();
-      if ((ec = Addr.getError()))
-        report_fatal_error(ec.message());
+      if (std::error_code EC = Addr.getError())
+        return EC;
       if (*Addr != Val)
         continue;
       ErrorOr<StringRef> Name = Symbol.getName();
       if (std::error_code EC = Name.getError())
-        report_fatal_error(EC.message());
+        return EC;
       fmt << *Name;
-      return;
+      return std::error_code();
     }
 
     // If we couldn't find a symbol that this relocation refers to, try
     // to find a section beginning instead.
     for (const SectionRef &Section : ToolSectionFilter(*O)) {
-      std::error_code ec;
-
       StringRef Name;
       uint64_t Addr = Section.getAddress();
       if (Addr != Val)
         continue;
-      if ((ec = Section.getName(Name)))
-        report_fatal_error(ec.message());
+      if (std::error_code EC = Section.getName(Name))
+        return EC;
       fmt << Name;
-      return;
+      return std::error_code();
     }
 
     fmt << format("0x%x", Val);
-    return;
+    return std::error_code();
   }
 
   StringRef S;
@@ -568,7 +617,8 @@ static void printRelocationTargetName(const MachOObjectFile *O,
     symbol_iterator SI = O->symbol_begin();
     advance(SI, Val);
     ErrorOr<StringRef> SOrErr = SI->getName();
-    error(SOrErr.getError());
+    if (std::error_code EC = SOrErr.getError())
+      return EC;
     S = *SOrErr;
   } else {
     section_iterator SI = O->section_begin();
@@ -578,6 +628,7 @@ static void printRelocationTargetName(const MachOObjectFile *O,
   }
 
   fmt << S;
+  return std::error_code();
 }
 
 static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
@@ -603,7 +654,8 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
     switch (Type) {
     case MachO::X86_64_RELOC_GOT_LOAD:
     case MachO::X86_64_RELOC_GOT: {
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       fmt << "@GOT";
       if (isPCRel)
         fmt << "PCREL";
@@ -619,36 +671,42 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
       // NOTE: Scattered relocations don't exist on x86_64.
       unsigned RType = Obj->getAnyRelocationType(RENext);
       if (RType != MachO::X86_64_RELOC_UNSIGNED)
-        report_fatal_error("Expected X86_64_RELOC_UNSIGNED after "
-                           "X86_64_RELOC_SUBTRACTOR.");
+        return make_error_code(reloc_pair_error::x86_64_subtractor);
 
       // The X86_64_RELOC_UNSIGNED contains the minuend symbol;
       // X86_64_RELOC_SUBTRACTOR contains the subtrahend.
-      printRelocationTargetName(Obj, RENext, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RENext, fmt))
+        return EC;
       fmt << "-";
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       break;
     }
     case MachO::X86_64_RELOC_TLV:
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       fmt << "@TLV";
       if (isPCRel)
         fmt << "P";
       break;
     case MachO::X86_64_RELOC_SIGNED_1:
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       fmt << "-1";
       break;
     case MachO::X86_64_RELOC_SIGNED_2:
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       fmt << "-2";
       break;
     case MachO::X86_64_RELOC_SIGNED_4:
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       fmt << "-4";
       break;
     default:
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       break;
     }
     // X86 and ARM share some relocation types in common.
@@ -668,12 +726,13 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
       unsigned RType = Obj->getAnyRelocationType(RENext);
 
       if (RType != MachO::GENERIC_RELOC_PAIR)
-        report_fatal_error("Expected GENERIC_RELOC_PAIR after "
-                           "GENERIC_RELOC_SECTDIFF.");
+        return make_error_code(reloc_pair_error::generic_sectdiff);
 
-      printRelocationTargetName(Obj, RE, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+        return EC;
       fmt << "-";
-      printRelocationTargetName(Obj, RENext, fmt);
+      if (std::error_code EC = printRelocationTargetName(Obj, RENext, fmt))
+        return EC;
       break;
     }
     }
@@ -689,23 +748,26 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
         // GENERIC_RELOC_PAIR.
         unsigned RType = Obj->getAnyRelocationType(RENext);
         if (RType != MachO::GENERIC_RELOC_PAIR)
-          report_fatal_error("Expected GENERIC_RELOC_PAIR after "
-                             "GENERIC_RELOC_LOCAL_SECTDIFF.");
+          return make_error_code(reloc_pair_error::generic_local_sectdiff);
 
-        printRelocationTargetName(Obj, RE, fmt);
+        if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+          return EC;
         fmt << "-";
-        printRelocationTargetName(Obj, RENext, fmt);
+        if (std::error_code EC = printRelocationTargetName(Obj, RENext, fmt))
+          return EC;
         break;
       }
       case MachO::GENERIC_RELOC_TLV: {
-        printRelocationTargetName(Obj, RE, fmt);
+        if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+          return EC;
         fmt << "@TLV";
         if (IsPCRel)
           fmt << "P";
         break;
       }
       default:
-        printRelocationTargetName(Obj, RE, fmt);
+        if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+          return EC;
       }
     } else { // ARM-specific relocations
       switch (Type) {
@@ -719,7 +781,8 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
           fmt << ":upper16:(";
         else
           fmt << ":lower16:(";
-        printRelocationTargetName(Obj, RE, fmt);
+        if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+          return EC;
 
         DataRefImpl RelNext = Rel;
         Obj->moveRelocationNext(RelNext);
@@ -729,8 +792,7 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
         // ARM_RELOC_PAIR.
         unsigned RType = Obj->getAnyRelocationType(RENext);
         if (RType != MachO::ARM_RELOC_PAIR)
-          report_fatal_error("Expected ARM_RELOC_PAIR after "
-                             "ARM_RELOC_HALF");
+          return make_error_code(reloc_pair_error::arm_half);
 
         // NOTE: The half of the target virtual address is stashed in the
         // address field of the secondary relocation, but we can't reverse
@@ -741,17 +803,21 @@ static std::error_code getRelocationValueString(const MachOObjectFile *Obj,
         // symbol/section pointer of the follow-on relocation.
         if (Type == MachO::ARM_RELOC_HALF_SECTDIFF) {
           fmt << "-";
-          printRelocationTargetName(Obj, RENext, fmt);
+          if (std::error_code EC = printRelocationTargetName(Obj, RENext, fmt))
+            return EC;
         }
 
         fmt << ")";
         break;
       }
-      default: { printRelocationTargetName(Obj, RE, fmt); }
+      default:
+        if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+          return EC;
       }
     }
   } else
-    printRelocationTargetName(Obj, RE, fmt);
+    if (std::error_code EC = printRelocationTargetName(Obj, RE, fmt))
+      return EC;
 
   fmt.flush();
   Result.append(fmtbuf.begin(), fmtbuf.end());
@@ -802,6 +868,187 @@ static bool getHidden(RelocationRef RelRef) {
   return false;
 }
 
+namespace {
+/// The target objects shared by every thread disassembling an object file.
+/// None of these are modified while decoding or printing.
+struct DisassemblyTarget {
+  const Target *TheTarget;
+  const MCRegisterInfo *MRI;
+  const MCAsmInfo *AsmInfo;
+  const MCSubtargetInfo *STI;
+  const MCInstrInfo *MII;
+  const MCInstrAnalysis *MIA;
+  PrettyPrinter *PIP;
+  StringRef RelocFmt;
+  /// Function symbols sorted by address, used to name branch targets.
+  std::vector<std::pair<uint64_t, StringRef>> AllSymbols;
+};
+
+/// The objects a thread needs to decode and print instructions. The
+/// disassembler and printer keep state in their MCContext, so every thread
+/// gets its own.
+struct DisassemblerState {
+  MCObjectFileInfo MOFI;
+  MCContext Ctx;
+  std::unique_ptr<MCDisassembler> DisAsm;
+  std::unique_ptr<MCInstPrinter> IP;
+
+  DisassemblerState(const DisassemblyTarget &DT)
+      : Ctx(DT.AsmInfo, DT.MRI, &MOFI),
+        DisAsm(DT.TheTarget->createMCDisassembler(*DT.STI, Ctx)),
+        IP(DT.TheTarget->createMCInstPrinter(
+            Triple(TripleName), DT.AsmInfo->getAssemblerDialect(), *DT.AsmInfo,
+            *DT.MII, *DT.MRI)) {
+    if (IP)
+      IP->setPrintImmHex(PrintImmHex);
+  }
+};
+
+/// A section to disassemble, with its symbols and relocations sorted by
+/// address.
+struct SectionDisassembly {
+  uint64_t SectionAddr;
+  uint64_t SectSize;
+  ArrayRef<uint8_t> Bytes;
+  std::vector<std::pair<uint64_t, StringRef>> Symbols;
+  std::vector<RelocationRef> Rels;
+};
+
+/// A run of consecutive symbols of a section, disassembled as one unit of
+/// work. Output and warnings are buffered so that they can be printed in
+/// address order no matter which thread produced them.
+struct DisassemblyJob {
+  unsigned FirstSymbol;
+  unsigned EndSymbol;
+  std::string Output;
+  std::string Warnings;
+  std::error_code EC;
+};
+}
+
+/// Disassemble the symbols [FirstSymbol, EndSymbol) of \p Sec, printing the
+/// instructions and any inline relocations to \p OS and decoding warnings to
+/// \p WarnOS. Returns the number of bytes decoded. If a relocation cannot be
+/// read, stops there and sets \p EC; the caller reports it, since this may
+/// run on a worker thread.
+static uint64_t disassembleSymbols(const DisassemblyTarget &DT,
+                                   DisassemblerState &DS,
+                                   const SectionDisassembly &Sec,
+                                   unsigned FirstSymbol, unsigned EndSymbol,
+                                   raw_ostream &OS, raw_ostream &WarnOS,
+                                   std::error_code &EC) {
+  const std::vector<std::pair<uint64_t, StringRef>> &Symbols = Sec.Symbols;
+  uint64_t SectionAddr = Sec.SectionAddr;
+
+  SmallString<40> Comments;
+  raw_svector_ostream CommentStream(Comments);
+
+  // Decode a batch of instructions at a time, reusing the MCInsts' operand
+  // storage from one batch to the next.
+  MCDisassembler::DecodedInstruction Batch[64];
+  uint64_t DecodedBytes = 0;
+
+  // Start with the first relocation at or after this run of symbols.
+  std::vector<RelocationRef>::const_iterator rel_cur = std::lower_bound(
+      Sec.Rels.begin(), Sec.Rels.end(), Symbols[FirstSymbol].first,
+      [](const RelocationRef &R, uint64_t Addr) {
+        return R.getOffset() < Addr;
+      });
+  std::vector<RelocationRef>::const_iterator rel_end = Sec.Rels.end();
+  // Disassemble symbol by symbol.
+  for (unsigned si = FirstSymbol, se = Symbols.size(); si != EndSymbol; ++si) {
+
+    uint64_t Start = Symbols[si].first;
+    // The end is either the section end or the beginning of the next symbol.
+    uint64_t End = (si == se - 1) ? Sec.SectSize : Symbols[si + 1].first;
+    // If this symbol has the same address as the next symbol, then skip it.
+    if (Start == End)
+      continue;
+
+    OS << '\n' << Symbols[si].second << ":\n";
+
+#ifndef NDEBUG
+    raw_ostream &DebugOut = DebugFlag ? dbgs() : nulls();
+#else
+    raw_ostream &DebugOut = nulls();
+#endif
+
+    for (uint64_t Index = Start; Index < End;) {
+      size_t NumDecoded = DS.DisAsm->getInstructions(
+          Batch, Sec.Bytes.slice(Index), End - Index, SectionAddr + Index,
+          DebugOut, CommentStream);
+
+      StringRef AllComments = CommentStream.str();
+      uint64_t CommentStart = 0;
+      for (const MCDisassembler::DecodedInstruction &D :
+           makeArrayRef(Batch, NumDecoded)) {
+        uint64_t Size = D.Size;
+        if (D.Status != MCDisassembler::Fail) {
+          const MCInst &Inst = D.Inst;
+          DT.PIP->printInst(*DS.IP, &Inst, Sec.Bytes.slice(Index, Size),
+                            SectionAddr + Index, OS, "", *DT.STI);
+          OS << AllComments.slice(CommentStart, D.CommentEnd);
+          const MCInstrAnalysis *MIA = DT.MIA;
+          if (MIA && (MIA->isCall(Inst) || MIA->isUnconditionalBranch(Inst) ||
+                      MIA->isConditionalBranch(Inst))) {
+            uint64_t Target;
+            if (MIA->evaluateBranch(Inst, SectionAddr + Index, Size, Target)) {
+              auto TargetSym = std::upper_bound(
+                  DT.AllSymbols.begin(), DT.AllSymbols.end(), Target,
+                  [](uint64_t LHS, const std::pair<uint64_t, StringRef> &RHS) {
+                    return LHS < RHS.first;
+                  });
+              if (TargetSym != DT.AllSymbols.begin())
+                --TargetSym;
+              else
+                TargetSym = DT.AllSymbols.end();
+
+              if (TargetSym != DT.AllSymbols.end()) {
+                OS << " <" << TargetSym->second;
+                uint64_t Disp = Target - TargetSym->first;
+                if (Disp)
+                  OS << '+' << utohexstr(Disp);
+                OS << '>';
+              }
+            }
+          }
+          OS << "\n";
+        } else {
+          WarnOS << ToolName << ": warning: invalid instruction encoding\n";
+        }
+        CommentStart = D.CommentEnd;
+
+        // Print relocation for instruction.
+        while (rel_cur != rel_end) {
+          bool hidden = getHidden(*rel_cur);
+          uint64_t addr = rel_cur->getOffset();
+          SmallString<16> name;
+          SmallString<32> val;
+
+          // If this relocation is hidden, skip it.
+          if (hidden) goto skip_print_rel;
+
+          // Stop when rel_cur's address is past the current instruction.
+          if (addr >= Index + Size) break;
+          rel_cur->getTypeName(name);
+          if ((EC = getRelocationValueString(*rel_cur, val)))
+            return DecodedBytes;
+          OS << format(DT.RelocFmt.data(), SectionAddr + addr) << name
+             << "\t" << val << "\n";
+
+        skip_print_rel:
+          ++rel_cur;
+        }
+
+        Index += Size;
+        DecodedBytes += Size;
+      }
+      Comments.clear();
+    }
+  }
+  return DecodedBytes;
+}
+
 static void DisassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
   const Target *TheTarget = getTarget(Obj);
   // getTarget() will have already issued a diagnostic if necessary, so
@@ -846,33 +1093,32 @@ static void DisassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
     return;
   }
 
-  std::unique_ptr<const MCObjectFileInfo> MOFI(new MCObjectFileInfo);
-  MCContext Ctx(AsmInfo.get(), MRI.get(), MOFI.get());
-
-  std::unique_ptr<MCDisassembler> DisAsm(
-    TheTarget->createMCDisassembler(*STI, Ctx));
+  std::unique_ptr<const MCInstrAnalysis> MIA(
+      TheTarget->createMCInstrAnalysis(MII.get()));
 
-  if (!DisAsm) {
+  DisassemblyTarget DT;
+  DT.TheTarget = TheTarget;
+  DT.MRI = MRI.get();
+  DT.AsmInfo = AsmInfo.get();
+  DT.STI = STI.get();
+  DT.MII = MII.get();
+  DT.MIA = MIA.get();
+  DT.PIP = &selectPrettyPrinter(Triple(TripleName));
+  DT.RelocFmt = Obj->getBytesInAddress() > 4 ? "\t\t%016" PRIx64 ":  " :
+                                               "\t\t\t%08" PRIx64 ":  ";
+
+  // The state used on the main thread, which also disassembles everything
+  // when running single threaded.
+  DisassemblerState MainState(DT);
+  if (!MainState.DisAsm) {
     errs() << "error: no disassembler for target " << TripleName << "\n";
     return;
   }
-
-  std::unique_ptr<const MCInstrAnalysis> MIA(
-      TheTarget->createMCInstrAnalysis(MII.get()));
-
-  int AsmPrinterVariant = AsmInfo->getAssemblerDialect();
-  std::unique_ptr<MCInstPrinter> IP(TheTarget->createMCInstPrinter(
-      Triple(TripleName), AsmPrinterVariant, *AsmInfo, *MII, *MRI));
-  if (!IP) {
+  if (!MainState.IP) {
     errs() << "error: no instruction printer for target " << TripleName
       << '\n';
     return;
   }
-  IP->setPrintImmHex(PrintImmHex);
-  PrettyPrinter &PIP = selectPrettyPrinter(Triple(TripleName));
-
-  StringRef Fmt = Obj->getBytesInAddress() > 4 ? "\t\t%016" PRIx64 ":  " :
-                                                 "\t\t\t%08" PRIx64 ":  ";
 
   // Create a mapping, RelocSecs = SectionRelocMap[S], where sections
   // in RelocSecs contain the relocations for section S.
@@ -886,7 +1132,6 @@ static void DisassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
 
   // Create a mapping from virtual address to symbol name.  This is used to
   // pretty print the target of a call.
-  std::vector<std::pair<uint64_t, StringRef>> AllSymbols;
   if (MIA) {
     for (const SymbolRef &Symbol : Obj->symbols()) {
       if (Symbol.getType() != SymbolRef::ST_Function)
@@ -900,30 +1145,36 @@ static void DisassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
       error(Name.getError());
       if (Name->empty())
         continue;
-      AllSymbols.push_back(std::make_pair(Address, *Name));
+      DT.AllSymbols.push_back(std::make_pair(Address, *Name));
     }
 
-    array_pod_sort(AllSymbols.begin(), AllSymbols.end());
+    array_pod_sort(DT.AllSymbols.begin(), DT.AllSymbols.end());
   }
 
+  unsigned NumThreads = std::max(1u, unsigned(DisassembleThreads));
+  std::vector<std::unique_ptr<DisassemblerState>> WorkerStates;
+  std::atomic<uint64_t> DecodedBytes(0);
+  TimeRecord StartTime = TimeRecord::getCurrentTime(/*Start*/ true);
+
   for (const SectionRef &Section : ToolSectionFilter(*Obj)) {
     if (!DisassembleAll && (!Section.isText() || Section.isVirtual()))
       continue;
 
-    uint64_t SectionAddr = Section.getAddress();
-    uint64_t SectSize = Section.getSize();
-    if (!SectSize)
+    SectionDisassembly Sec;
+    Sec.SectionAddr = Section.getAddress();
+    Sec.SectSize = Section.getSize();
+    if (!Sec.SectSize)
       continue;
 
     // Make a list of all the symbols in this section.
-    std::vector<std::pair<uint64_t, StringRef>> Symbols;
+    std::vector<std::pair<uint64_t, StringRef>> &Symbols = Sec.Symbols;
     for (const SymbolRef &Symbol : Obj->symbols()) {
       if (Section.containsSymbol(Symbol)) {
         ErrorOr<uint64_t> AddressOrErr = Symbol.getAddress();
         error(AddressOrErr.getError());
         uint64_t Address = *AddressOrErr;
-        Address -= SectionAddr;
-        if (Address >= SectSize)
+        Address -= Sec.SectionAddr;
+        if (Address >= Sec.SectSize)
           continue;
 
         ErrorOr<StringRef> Name = Symbol.getName();
@@ -936,17 +1187,16 @@ static void DisassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
     array_pod_sort(Symbols.begin(), Symbols.end());
 
     // Make a list of all the relocations for this section.
-    std::vector<RelocationRef> Rels;
     if (InlineRelocs) {
       for (const SectionRef &RelocSec : SectionRelocMap[Section]) {
         for (const RelocationRef &Reloc : RelocSec.relocations()) {
-          Rels.push_back(Reloc);
+          Sec.Rels.push_back(Reloc);
         }
       }
     }
 
     // Sort relocations by address.
-    std::sort(Rels.begin(), Rels.end(), RelocAddressLess);
+    std::sort(Sec.Rels.begin(), Sec.Rels.end(), RelocAddressLess);
 
     StringRef SegmentName = "";
     if (const MachOObjectFile *MachO = dyn_cast<const MachOObjectFile>(Obj)) {
@@ -964,101 +1214,75 @@ static void DisassembleObject(const ObjectFile *Obj, bool InlineRelocs) {
     if (Symbols.empty() || Symbols[0].first != 0)
       Symbols.insert(Symbols.begin(), std::make_pair(0, name));
 
-    SmallString<40> Comments;
-    raw_svector_ostream CommentStream(Comments);
-
     StringRef BytesStr;
     error(Section.getContents(BytesStr));
-    ArrayRef<uint8_t> Bytes(reinterpret_cast<const uint8_t *>(BytesStr.data()),
-                            BytesStr.size());
-
-    uint64_t Size;
-    uint64_t Index;
-
-    std::vector<RelocationRef>::const_iterator rel_cur = Rels.begin();
-    std::vector<RelocationRef>::const_iterator rel_end = Rels.end();
-    // Disassemble symbol by symbol.
-    for (unsigned si = 0, se = Symbols.size(); si != se; ++si) {
-
-      uint64_t Start = Symbols[si].first;
-      // The end is either the section end or the beginning of the next symbol.
-      uint64_t End = (si == se - 1) ? SectSize : Symbols[si + 1].first;
-      // If this symbol has the same address as the next symbol, then skip it.
-      if (Start == End)
-        continue;
-
-      outs() << '\n' << Symbols[si].second << ":\n";
+    Sec.Bytes = ArrayRef<uint8_t>(
+        reinterpret_cast<const uint8_t *>(BytesStr.data()), BytesStr.size());
 
-#ifndef NDEBUG
-      raw_ostream &DebugOut = DebugFlag ? dbgs() : nulls();
-#else
-      raw_ostream &DebugOut = nulls();
-#endif
-
-      for (Index = Start; Index < End; Index += Size) {
-        MCInst Inst;
-
-        if (DisAsm->getInstruction(Inst, Size, Bytes.slice(Index),
-                                   SectionAddr + Index, DebugOut,
-                                   CommentStream)) {
-          PIP.printInst(*IP, &Inst,
-                        Bytes.slice(Index, Size),
-                        SectionAddr + Index, outs(), "", *STI);
-          outs() << CommentStream.str();
-          Comments.clear();
-          if (MIA && (MIA->isCall(Inst) || MIA->isUnconditionalBranch(Inst) ||
-                      MIA->isConditionalBranch(Inst))) {
-            uint64_t Target;
-            if (MIA->evaluateBranch(Inst, SectionAddr + Index, Size, Target)) {
-              auto TargetSym = std::upper_bound(
-                  AllSymbols.begin(), AllSymbols.end(), Target,
-                  [](uint64_t LHS, const std::pair<uint64_t, StringRef> &RHS) {
-                    return LHS < RHS.first;
-                  });
-              if (TargetSym != AllSymbols.begin())
-                --TargetSym;
-              else
-                TargetSym = AllSymbols.end();
-
-              if (TargetSym != AllSymbols.end()) {
-                outs() << " <" << TargetSym->second;
-                uint64_t Disp = Target - TargetSym->first;
-                if (Disp)
-                  outs() << '+' << utohexstr(Disp);
-                outs() << '>';
-              }
-            }
-          }
-          outs() << "\n";
-        } else {
-          errs() << ToolName << ": warning: invalid instruction encoding\n";
-          if (Size == 0)
-            Size = 1; // skip illegible bytes
-        }
-
-        // Print relocation for instruction.
-        while (rel_cur != rel_end) {
-          bool hidden = getHidden(*rel_cur);
-          uint64_t addr = rel_cur->getOffset();
-          SmallString<16> name;
-          SmallString<32> val;
-
-          // If this relocation is hidden, skip it.
-          if (hidden) goto skip_print_rel;
+    if (NumThreads == 1) {
+      DecodedBytes += disassembleSymbols(DT, MainState, Sec, 0, Symbols.size(),
+                                         outs(), errs(), EC);
+      error(EC);
+      continue;
+    }
 
-          // Stop when rel_cur's address is past the current instruction.
-          if (addr >= Index + Size) break;
-          rel_cur->getTypeName(name);
-          error(getRelocationValueString(*rel_cur, val));
-          outs() << format(Fmt.data(), SectionAddr + addr) << name
-                 << "\t" << val << "\n";
+    // Split the symbols into runs of roughly equal size, several per thread
+    // so that a few large functions don't leave the other threads idle.
+    std::vector<DisassemblyJob> Jobs;
+    uint64_t ChunkSize = std::max<uint64_t>(Sec.SectSize / (NumThreads * 8), 1);
+    for (unsigned si = 0, se = Symbols.size(); si != se;) {
+      DisassemblyJob Job;
+      Job.FirstSymbol = si;
+      uint64_t ChunkEnd = Symbols[si].first + ChunkSize;
+      do
+        ++si;
+      while (si != se && Symbols[si].first < ChunkEnd);
+      Job.EndSymbol = si;
+      Jobs.push_back(std::move(Job));
+    }
 
-        skip_print_rel:
-          ++rel_cur;
-        }
+    unsigned NumWorkers = std::min<unsigned>(NumThreads, Jobs.size());
+    while (WorkerStates.size() < NumWorkers)
+      WorkerStates.push_back(llvm::make_unique<DisassemblerState>(DT));
+
+    std::atomic<unsigned> NextJob(0);
+    auto Worker = [&](DisassemblerState *DS) {
+      for (unsigned I = NextJob++; I < Jobs.size(); I = NextJob++) {
+        DisassemblyJob &Job = Jobs[I];
+        raw_string_ostream OS(Job.Output);
+        raw_string_ostream WarnOS(Job.Warnings);
+        DecodedBytes += disassembleSymbols(DT, *DS, Sec, Job.FirstSymbol,
+                                           Job.EndSymbol, OS, WarnOS, Job.EC);
+      }
+    };
+    std::vector<thread> Workers;
+    for (unsigned I = 0; I != NumWorkers; ++I)
+      Workers.emplace_back(Worker, WorkerStates[I].get());
+    for (thread &T : Workers)
+      T.join();
+
+    // Print the runs in address order. An error in one run is reported
+    // after its partial output, as the single-threaded path would.
+    for (const DisassemblyJob &Job : Jobs) {
+      outs() << Job.Output;
+      if (!Job.Warnings.empty()) {
+        outs().flush();
+        errs() << Job.Warnings;
       }
+      error(Job.EC);
     }
   }
+
+  if (AreStatisticsEnabled()) {
+    double Seconds = TimeRecord::getCurrentTime(/*Start*/ false).getWallTime() -
+                     StartTime.getWallTime();
+    uint64_t Bytes = DecodedBytes;
+    errs() << format("%" PRIu64 " bytes disassembled in %.3f s (%.2f MB/s, "
+                     "%u threads)\n",
+                     Bytes, Seconds,
+                     Seconds > 0.0 ? Bytes / Seconds / (1024.0 * 1024.0) : 0.0,
+                     NumThreads);
+  }
 }
 
 void llvm::PrintRelocations(const ObjectFile *Obj) {
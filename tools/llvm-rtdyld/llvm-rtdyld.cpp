@@ -93,6 +93,11 @@ CheckFiles("check",
            cl::desc("File containing RuntimeDyld verifier checks."),
            cl::ZeroOrMore);
 
+static cl::opt<unsigned>
+ResolveThreads("resolve-threads",
+               cl::desc("Number of threads to apply relocations on."),
+               cl::init(1));
+
 static cl::opt<uint64_t>
 TargetAddrStart("target-addr-start",
                 cl::desc("For -verify only: start of phony target address "
@@ -244,6 +249,7 @@ static int printLineInfoForInput(bool LoadObjects, bool UseDebugObj) {
     // Instantiate a dynamic linker.
     TrivialMemoryManager MemMgr;
     RuntimeDyld Dyld(MemMgr, MemMgr);
+    Dyld.setResolveThreads(ResolveThreads);
 
     // Load the input memory buffer.
 
@@ -337,6 +343,7 @@ static int executeInput() {
   // Instantiate a dynamic linker.
   TrivialMemoryManager MemMgr;
   RuntimeDyld Dyld(MemMgr, MemMgr);
+  Dyld.setResolveThreads(ResolveThreads);
 
   // FIXME: Preserve buffers until resolveRelocations time to work around a bug
   //        in RuntimeDyldELF.
@@ -614,6 +621,7 @@ static int linkAndVerify() {
   TrivialMemoryManager MemMgr;
   RuntimeDyld Dyld(MemMgr, MemMgr);
   Dyld.setProcessAllSections(true);
+  Dyld.setResolveThreads(ResolveThreads);
   RuntimeDyldChecker Checker(Dyld, Disassembler.get(), InstPrinter.get(),
                              llvm::dbgs());
 
@@ -0,0 +1,270 @@
+//===- CodeCacheMemoryManagerTest.cpp - Unit tests for the JIT code cache -===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/CodeCacheMemoryManager.h"
+#include "llvm/Support/Process.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+TEST(CodeCacheMemoryManagerTest, BasicAllocations) {
+  JITCodeCache Cache;
+  std::unique_ptr<CodeCacheMemoryManager> MemMgr(
+      new CodeCacheMemoryManager(Cache));
+
+  uint8_t *code1 = MemMgr->allocateCodeSection(256, 0, 1, "");
+  uint8_t *data1 = MemMgr->allocateDataSection(256, 0, 2, "", true);
+  uint8_t *code2 = MemMgr->allocateCodeSection(256, 0, 3, "");
+  uint8_t *data2 = MemMgr->allocateDataSection(256, 0, 4, "", false);
+
+  EXPECT_NE((uint8_t*)nullptr, code1);
+  EXPECT_NE((uint8_t*)nullptr, code2);
+  EXPECT_NE((uint8_t*)nullptr, data1);
+  EXPECT_NE((uint8_t*)nullptr, data2);
+
+  // Initialize the data
+  for (unsigned i = 0; i < 256; ++i) {
+    code1[i] = 1;
+    code2[i] = 2;
+    data1[i] = 3;
+    data2[i] = 4;
+  }
+
+  // Verify the data (this is checking for overlaps in the addresses)
+  for (unsigned i = 0; i < 256; ++i) {
+    EXPECT_EQ(1, code1[i]);
+    EXPECT_EQ(2, code2[i]);
+    EXPECT_EQ(3, data1[i]);
+    EXPECT_EQ(4, data2[i]);
+  }
+
+  std::string Error;
+  EXPECT_FALSE(MemMgr->finalizeMemory(&Error));
+
+  // Data stays readable after finalization.
+  EXPECT_EQ(3, data1[0]);
+  EXPECT_EQ(4, data2[255]);
+}
+
+TEST(CodeCacheMemoryManagerTest, Alignment) {
+  JITCodeCache Cache;
+  CodeCacheMemoryManager MemMgr(Cache);
+
+  for (unsigned Align = 1; Align <= 256; Align *= 2) {
+    uint8_t *Code = MemMgr.allocateCodeSection(3, Align, Align, "");
+    ASSERT_NE((uint8_t*)nullptr, Code);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(Code) & (Align - 1));
+  }
+}
+
+TEST(CodeCacheMemoryManagerTest, ReservedSpaceIsUsed) {
+  size_t PageSize = sys::Process::getPageSize();
+  JITCodeCache Cache;
+  CodeCacheMemoryManager MemMgr(Cache);
+
+  MemMgr.reserveAllocationSpace(4 * PageSize, 2 * PageSize, 2 * PageSize);
+  JITCodeCache::Statistics Before = Cache.getStatistics();
+
+  for (unsigned i = 0; i != 8; ++i)
+    EXPECT_NE((uint8_t*)nullptr,
+              MemMgr.allocateCodeSection(PageSize / 2, 16, i, ""));
+  EXPECT_NE((uint8_t*)nullptr,
+            MemMgr.allocateDataSection(2 * PageSize, 4, 8, "", true));
+  EXPECT_NE((uint8_t*)nullptr,
+            MemMgr.allocateDataSection(2 * PageSize, 4, 9, "", false));
+
+  // Everything fit into the reserved regions.
+  JITCodeCache::Statistics After = Cache.getStatistics();
+  EXPECT_EQ(Before.AllocatedBytes, After.AllocatedBytes);
+  EXPECT_EQ(3u, After.NumReusedAllocations + After.NumMappedAllocations);
+  EXPECT_EQ(0u, After.NumSlots);
+}
+
+TEST(CodeCacheMemoryManagerTest, SmallReservationsUseSharedPages) {
+  size_t PageSize = sys::Process::getPageSize();
+  JITCodeCache Cache;
+
+  // Small objects of different memory managers share one page per kind and
+  // slot size instead of taking pages of their own.
+  std::unique_ptr<CodeCacheMemoryManager> MemMgrs[16];
+  for (auto &MemMgr : MemMgrs) {
+    MemMgr.reset(new CodeCacheMemoryManager(Cache));
+    MemMgr->reserveAllocationSpace(100, 40, 24);
+    uint8_t *Code = MemMgr->allocateCodeSection(100, 16, 0, "");
+    uint8_t *RO = MemMgr->allocateDataSection(40, 8, 1, "", true);
+    uint8_t *RW = MemMgr->allocateDataSection(24, 8, 2, "", false);
+    ASSERT_NE((uint8_t*)nullptr, Code);
+    ASSERT_NE((uint8_t*)nullptr, RO);
+    ASSERT_NE((uint8_t*)nullptr, RW);
+    Code[0] = 0xc3;
+    RO[0] = 1;
+    RW[0] = 2;
+    EXPECT_FALSE(MemMgr->finalizeMemory());
+    // Read-write data stays writable after finalization.
+    RW[1] = 3;
+  }
+
+  JITCodeCache::Statistics S = Cache.getStatistics();
+  EXPECT_EQ(3 * PageSize, S.AllocatedBytes);
+  EXPECT_EQ(3u, S.NumSlotPages);
+  EXPECT_EQ(48u, S.NumSlots);
+  EXPECT_EQ(0u, S.NumSealedSlotPages);
+
+  for (auto &MemMgr : MemMgrs)
+    MemMgr.reset();
+  S = Cache.getStatistics();
+  EXPECT_EQ(0u, S.AllocatedBytes);
+  EXPECT_EQ(0u, S.SectionBytes);
+  EXPECT_EQ(0u, S.NumSlotPages);
+  EXPECT_EQ(0u, S.NumSlots);
+}
+
+TEST(CodeCacheMemoryManagerTest, FullSharedPagesAreSealed) {
+  size_t PageSize = sys::Process::getPageSize();
+  unsigned SlotsPerPage = PageSize / 256;
+  JITCodeCache Cache;
+
+  // A page is sealed once every slot is taken and finalized. Sections of a
+  // memory manager that has not finalized yet keep the page open.
+  CodeCacheMemoryManager Pending(Cache);
+  ASSERT_NE((uint8_t*)nullptr, Pending.allocateCodeSection(200, 16, 0, ""));
+
+  std::unique_ptr<CodeCacheMemoryManager> MemMgrs[2];
+  MemMgrs[0].reset(new CodeCacheMemoryManager(Cache));
+  MemMgrs[1].reset(new CodeCacheMemoryManager(Cache));
+  for (unsigned i = 1; i != SlotsPerPage; ++i)
+    ASSERT_NE((uint8_t*)nullptr,
+              MemMgrs[i % 2]->allocateCodeSection(200, 16, i, ""));
+  EXPECT_FALSE(MemMgrs[0]->finalizeMemory());
+  EXPECT_FALSE(MemMgrs[1]->finalizeMemory());
+  EXPECT_EQ(1u, Cache.getStatistics().NumSlotPages);
+  EXPECT_EQ(0u, Cache.getStatistics().NumSealedSlotPages);
+
+  EXPECT_FALSE(Pending.finalizeMemory());
+  EXPECT_EQ(1u, Cache.getStatistics().NumSealedSlotPages);
+
+  // New sections go into a fresh page.
+  ASSERT_NE((uint8_t*)nullptr, MemMgrs[0]->allocateCodeSection(200, 16, 0, ""));
+  EXPECT_EQ(2u, Cache.getStatistics().NumSlotPages);
+
+  // The sealed page is only given back once all of its slots are released.
+  MemMgrs[1].reset();
+  EXPECT_EQ(1u, Cache.getStatistics().NumSealedSlotPages);
+  MemMgrs[0].reset();
+  EXPECT_EQ(1u, Cache.getStatistics().NumSealedSlotPages);
+  EXPECT_EQ(1u, Cache.getStatistics().NumSlotPages);
+}
+
+TEST(CodeCacheMemoryManagerTest, MemoryIsReusedAfterRelease) {
+  size_t PageSize = sys::Process::getPageSize();
+  JITCodeCache Cache(16 * PageSize);
+
+  uint8_t *FirstCode;
+  {
+    CodeCacheMemoryManager MemMgr(Cache);
+    FirstCode = MemMgr.allocateCodeSection(64, 16, 0, "");
+    ASSERT_NE((uint8_t*)nullptr, FirstCode);
+    EXPECT_FALSE(MemMgr.finalizeMemory());
+    EXPECT_NE(0u, Cache.getStatistics().SectionBytes);
+  }
+
+  JITCodeCache::Statistics Released = Cache.getStatistics();
+  EXPECT_EQ(0u, Released.AllocatedBytes);
+  EXPECT_EQ(0u, Released.SectionBytes);
+  EXPECT_EQ(Released.MappedBytes, Released.FreeBytes);
+  EXPECT_EQ(1u, Released.NumFreeRanges);
+
+  // The released page was made writable again and is handed out again.
+  CodeCacheMemoryManager MemMgr(Cache);
+  uint8_t *Code = MemMgr.allocateCodeSection(64, 16, 0, "");
+  EXPECT_EQ(FirstCode, Code);
+  Code[0] = 0xc3;
+  EXPECT_FALSE(MemMgr.finalizeMemory());
+
+  JITCodeCache::Statistics Reused = Cache.getStatistics();
+  EXPECT_EQ(1u, Reused.NumSlabs);
+  EXPECT_EQ(1u, Reused.NumMappedAllocations);
+  EXPECT_EQ(1u, Reused.NumReusedAllocations);
+}
+
+TEST(CodeCacheMemoryManagerTest, FinalizeBatchesPermissionChanges) {
+  size_t PageSize = sys::Process::getPageSize();
+  JITCodeCache Cache(64 * PageSize);
+  CodeCacheMemoryManager MemMgr(Cache);
+
+  // Sections bigger than a page each need their own region, but the regions
+  // are adjacent and are made executable together.
+  for (unsigned i = 0; i != 4; ++i)
+    ASSERT_NE((uint8_t*)nullptr,
+              MemMgr.allocateCodeSection(PageSize + 1, 16, i, ""));
+  EXPECT_FALSE(MemMgr.finalizeMemory());
+  EXPECT_EQ(1u, Cache.getStatistics().NumProtectCalls);
+
+  // New sections after finalization go into fresh, writable memory.
+  uint8_t *Late = MemMgr.allocateCodeSection(16, 16, 4, "");
+  ASSERT_NE((uint8_t*)nullptr, Late);
+  Late[0] = 0xc3;
+  EXPECT_FALSE(MemMgr.finalizeMemory());
+}
+
+TEST(CodeCacheMemoryManagerTest, FreeSlabsAreUnmapped) {
+  size_t PageSize = sys::Process::getPageSize();
+  JITCodeCache Cache(4 * PageSize, /*RetainedBytes*/ 0);
+
+  {
+    CodeCacheMemoryManager A(Cache);
+    CodeCacheMemoryManager B(Cache);
+    EXPECT_NE((uint8_t*)nullptr, A.allocateCodeSection(64, 16, 0, ""));
+    EXPECT_NE((uint8_t*)nullptr, B.allocateCodeSection(64, 16, 0, ""));
+    EXPECT_NE((uint8_t*)nullptr,
+              B.allocateDataSection(8 * PageSize, 16, 1, "", false));
+    EXPECT_EQ(2u, Cache.getStatistics().NumSlabs);
+  }
+
+  JITCodeCache::Statistics S = Cache.getStatistics();
+  EXPECT_EQ(0u, S.NumSlabs);
+  EXPECT_EQ(0u, S.MappedBytes);
+  EXPECT_EQ(0u, S.FreeBytes);
+  EXPECT_EQ(0.0, S.getExternalFragmentation());
+}
+
+TEST(CodeCacheMemoryManagerTest, FragmentationStatistics) {
+  size_t PageSize = sys::Process::getPageSize();
+  JITCodeCache Cache(8 * PageSize);
+
+  // Sections too large for a shared page take one page each.
+  std::unique_ptr<CodeCacheMemoryManager> MemMgrs[8];
+  for (auto &MemMgr : MemMgrs) {
+    MemMgr.reset(new CodeCacheMemoryManager(Cache));
+    EXPECT_NE((uint8_t*)nullptr,
+              MemMgr->allocateCodeSection(PageSize / 2 + 1, 16, 0, ""));
+  }
+  EXPECT_EQ(1u, Cache.getStatistics().NumSlabs);
+  EXPECT_EQ(0u, Cache.getStatistics().NumSlotPages);
+  EXPECT_LT(0.4, Cache.getStatistics().getInternalFragmentation());
+
+  // Releasing every other page leaves four separate one page holes.
+  for (unsigned i = 0; i < 8; i += 2)
+    MemMgrs[i].reset();
+  JITCodeCache::Statistics S = Cache.getStatistics();
+  EXPECT_EQ(4u, S.NumFreeRanges);
+  EXPECT_EQ(PageSize, S.LargestFreeRange);
+  EXPECT_DOUBLE_EQ(0.75, S.getExternalFragmentation());
+
+  // Releasing the rest coalesces the holes again.
+  for (unsigned i = 1; i < 8; i += 2)
+    MemMgrs[i].reset();
+  S = Cache.getStatistics();
+  EXPECT_EQ(1u, S.NumFreeRanges);
+  EXPECT_EQ(8 * PageSize, S.LargestFreeRange);
+}
+
+} // end anonymous namespace
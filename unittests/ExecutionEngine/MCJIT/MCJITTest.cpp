@@ -13,9 +13,12 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/Config/llvm-config.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "MCJITTestBase.h"
 #include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
 
 using namespace llvm;
 
@@ -281,4 +284,56 @@ TEST_F(MCJITTest, lazy_function_creator_lambda) {
   EXPECT_FALSE(std::find(I, E, "Foo2") == E);
 }
 
+#if LLVM_ENABLE_THREADS != 0
+// Look up finalized symbols from several threads while more modules are
+// compiled and finalized, growing the symbol index under the readers.
+TEST_F(MCJITTest, concurrent_symbol_lookup) {
+  SKIP_UNSUPPORTED_PLATFORM;
+
+  Function *Add = insertAddFunction(M.get());
+  GlobalValue *Global = insertGlobalInt32(M.get(), "test_global", 7);
+  std::string AddName = Add->getName().str();
+  std::string GlobalName = Global->getName().str();
+  createJIT(std::move(M));
+
+  uint64_t AddAddr = TheJIT->getFunctionAddress(AddName);
+  uint64_t GlobalAddr = TheJIT->getGlobalValueAddress(GlobalName);
+  ASSERT_TRUE(AddAddr != 0) << "Unable to get pointer to function from JIT";
+  ASSERT_TRUE(GlobalAddr != 0) << "Unable to get pointer to global from JIT";
+
+  std::atomic<bool> Done(false);
+  std::atomic<unsigned> Mismatches(0);
+  std::vector<std::thread> Readers;
+  for (unsigned T = 0; T != 4; ++T)
+    Readers.emplace_back([&] {
+      while (!Done.load()) {
+        if (TheJIT->getFunctionAddress(AddName) != AddAddr ||
+            TheJIT->getGlobalValueAddress(GlobalName) != GlobalAddr)
+          ++Mismatches;
+      }
+    });
+
+  std::vector<std::pair<std::string, uint64_t>> Added;
+  for (unsigned I = 0; I != 40; ++I) {
+    std::unique_ptr<Module> Extra(createEmptyModule("extra"));
+    std::string Name = "add_" + std::to_string(I);
+    insertAddFunction(Extra.get(), Name);
+    TheJIT->addModule(std::move(Extra));
+    uint64_t Addr = TheJIT->getFunctionAddress(Name);
+    EXPECT_TRUE(Addr != 0) << "Unable to get pointer to " << Name;
+    Added.push_back(std::make_pair(Name, Addr));
+  }
+
+  Done = true;
+  for (std::thread &Reader : Readers)
+    Reader.join();
+
+  EXPECT_EQ(0u, Mismatches.load());
+  for (auto &Entry : Added)
+    EXPECT_EQ(Entry.second, TheJIT->getFunctionAddress(Entry.first));
+  int (*AddPtr)(int, int) = (int(*)(int, int))Added.back().second;
+  EXPECT_EQ(3, AddPtr(1, 2));
+}
+#endif
+
 }
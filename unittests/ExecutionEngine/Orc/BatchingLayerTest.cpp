@@ -0,0 +1,243 @@
+//===- BatchingLayerTest.cpp - Unit tests for the module batching layer ---===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/Orc/BatchingLayer.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/DerivedTypes.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "gtest/gtest.h"
+#include <algorithm>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace {
+
+class MockMemoryManager : public RuntimeDyld::MemoryManager {
+public:
+  uint8_t *allocateCodeSection(uintptr_t Size, unsigned Alignment,
+                               unsigned SectionID,
+                               StringRef SectionName) override {
+    return nullptr;
+  }
+  uint8_t *allocateDataSection(uintptr_t Size, unsigned Alignment,
+                               unsigned SectionID, StringRef SectionName,
+                               bool IsReadOnly) override {
+    return nullptr;
+  }
+  void registerEHFrames(uint8_t *Addr, uint64_t LoadAddr,
+                        size_t Size) override {}
+  void deregisterEHFrames(uint8_t *Addr, uint64_t LoadAddr,
+                          size_t Size) override {}
+  bool finalizeMemory(std::string *ErrMsg) override { return false; }
+};
+
+// Resolves a single name to a fixed address.
+class MockResolver : public RuntimeDyld::SymbolResolver {
+public:
+  MockResolver(std::string Name, uint64_t Addr)
+      : Name(std::move(Name)), Addr(Addr) {}
+  RuntimeDyld::SymbolInfo findSymbol(const std::string &N) override {
+    if (N == Name)
+      return RuntimeDyld::SymbolInfo(Addr, JITSymbolFlags::Exported);
+    return nullptr;
+  }
+  RuntimeDyld::SymbolInfo
+  findSymbolInLogicalDylib(const std::string &N) override {
+    return nullptr;
+  }
+
+private:
+  std::string Name;
+  uint64_t Addr;
+};
+
+// Records the module sets it is given. Each symbol is placed at an address
+// derived from its set and its position in the module.
+struct MockBaseLayer {
+  typedef unsigned ModuleSetHandleT;
+
+  struct EmittedSet {
+    std::vector<std::string> Functions;
+    RuntimeDyld::MemoryManager *MemMgr;
+    RuntimeDyld::SymbolResolver *Resolver;
+  };
+
+  template <typename ModuleSetT>
+  ModuleSetHandleT addModuleSet(ModuleSetT Ms,
+                                RuntimeDyld::MemoryManager *MemMgr,
+                                RuntimeDyld::SymbolResolver *Resolver) {
+    EmittedSet Set;
+    EXPECT_EQ(1u, Ms.size()) << "Batches should be a single module";
+    for (auto &M : Ms)
+      for (auto &F : *M)
+        if (!F.isDeclaration())
+          Set.Functions.push_back(F.getName());
+    Set.MemMgr = MemMgr;
+    Set.Resolver = Resolver;
+    Sets.push_back(Set);
+    return Sets.size() - 1;
+  }
+
+  void removeModuleSet(ModuleSetHandleT H) { Removed.push_back(H); }
+
+  JITSymbol findSymbolIn(ModuleSetHandleT H, const std::string &Name,
+                         bool ExportedSymbolsOnly) {
+    auto &Fns = Sets[H].Functions;
+    auto I = std::find(Fns.begin(), Fns.end(), Name);
+    if (I == Fns.end())
+      return nullptr;
+    return JITSymbol(getAddress(H, I - Fns.begin()), JITSymbolFlags::Exported);
+  }
+
+  void emitAndFinalize(ModuleSetHandleT H) { Finalized.push_back(H); }
+
+  static TargetAddress getAddress(unsigned Set, unsigned Index) {
+    return 0x1000 * (Set + 1) + 0x10 * Index;
+  }
+
+  std::vector<EmittedSet> Sets;
+  std::vector<ModuleSetHandleT> Removed;
+  std::vector<ModuleSetHandleT> Finalized;
+};
+
+class BatchingLayerTest : public testing::Test {
+protected:
+  typedef BatchingLayer<MockBaseLayer> LayerT;
+
+  // Build a module defining a function for each name in Defs, each of which
+  // calls the function named Calls if it is not empty.
+  std::vector<std::unique_ptr<Module>>
+  createSet(std::initializer_list<const char *> Defs, StringRef Calls = "") {
+    auto M = llvm::make_unique<Module>("batched", Context);
+    FunctionType *FTy = FunctionType::get(Type::getVoidTy(Context), false);
+    for (const char *Name : Defs) {
+      Function *F =
+          Function::Create(FTy, GlobalValue::ExternalLinkage, Name, M.get());
+      BasicBlock *BB = BasicBlock::Create(Context, "entry", F);
+      if (!Calls.empty())
+        CallInst::Create(M->getOrInsertFunction(Calls, FTy), "", BB);
+      ReturnInst::Create(Context, BB);
+    }
+    std::vector<std::unique_ptr<Module>> Ms;
+    Ms.push_back(std::move(M));
+    return Ms;
+  }
+
+  LayerT::ModuleSetHandleT add(LayerT &L,
+                               std::vector<std::unique_ptr<Module>> Ms,
+                               std::string Resolves = "",
+                               uint64_t ResolvesTo = 0) {
+    return L.addModuleSet(std::move(Ms), llvm::make_unique<MockMemoryManager>(),
+                          llvm::make_unique<MockResolver>(Resolves,
+                                                          ResolvesTo));
+  }
+
+  LLVMContext Context;
+  MockBaseLayer Base;
+};
+
+TEST_F(BatchingLayerTest, LinksSetsIntoOneBatch) {
+  LayerT L(Base, 100);
+  auto HFoo = add(L, createSet({"foo"}));
+  auto HBar = add(L, createSet({"bar"}, "foo"));
+  add(L, createSet({"baz"}));
+  EXPECT_TRUE(Base.Sets.empty()) << "Batch emitted before it was needed";
+
+  // Looking a symbol up does not emit the batch, but using its address does.
+  auto Sym = L.findSymbol("bar", true);
+  EXPECT_TRUE(!!Sym) << "Could not find symbol in pending batch";
+  EXPECT_TRUE(Base.Sets.empty()) << "Batch emitted by lookup";
+  EXPECT_EQ(MockBaseLayer::getAddress(0, 1), Sym.getAddress());
+  ASSERT_EQ(1u, Base.Sets.size());
+  EXPECT_EQ(3u, Base.Sets[0].Functions.size());
+
+  // Handles still refer to their own sets.
+  EXPECT_FALSE(L.findSymbolIn(HFoo, "bar", false));
+  EXPECT_EQ(MockBaseLayer::getAddress(0, 0),
+            L.findSymbolIn(HFoo, "foo", false).getAddress());
+  EXPECT_EQ(MockBaseLayer::getAddress(0, 1),
+            L.findSymbolIn(HBar, "bar", true).getAddress());
+  EXPECT_FALSE(L.findSymbol("nothere", false));
+
+  // Later sets start a new batch.
+  auto HQux = add(L, createSet({"qux"}));
+  EXPECT_EQ(1u, Base.Sets.size());
+  L.emitAndFinalize(HQux);
+  ASSERT_EQ(2u, Base.Sets.size());
+  EXPECT_EQ(std::vector<MockBaseLayer::ModuleSetHandleT>(1, 1),
+            Base.Finalized);
+}
+
+TEST_F(BatchingLayerTest, EmitsFullBatches) {
+  // Each function has a single instruction.
+  LayerT L(Base, 2);
+  add(L, createSet({"a"}));
+  EXPECT_TRUE(Base.Sets.empty());
+  add(L, createSet({"b"}));
+  ASSERT_EQ(1u, Base.Sets.size());
+  EXPECT_EQ(2u, Base.Sets[0].Functions.size());
+
+  // A set that does not fit in the pending batch goes into the next one.
+  add(L, createSet({"c"}));
+  EXPECT_EQ(1u, Base.Sets.size());
+  add(L, createSet({"d", "e"}));
+  ASSERT_EQ(3u, Base.Sets.size());
+  EXPECT_EQ(1u, Base.Sets[1].Functions.size());
+  EXPECT_EQ(2u, Base.Sets[2].Functions.size());
+
+  // Flushing with nothing pending does nothing.
+  L.flush();
+  EXPECT_EQ(3u, Base.Sets.size());
+}
+
+TEST_F(BatchingLayerTest, RedefinitionStartsNewBatch) {
+  LayerT L(Base, 100);
+  auto H1 = add(L, createSet({"foo"}));
+  auto H2 = add(L, createSet({"foo"}));
+  ASSERT_EQ(1u, Base.Sets.size());
+  L.flush();
+  ASSERT_EQ(2u, Base.Sets.size());
+
+  // The first definition wins, as in the base layers.
+  EXPECT_EQ(MockBaseLayer::getAddress(0, 0),
+            L.findSymbol("foo", true).getAddress());
+  EXPECT_EQ(MockBaseLayer::getAddress(1, 0),
+            L.findSymbolIn(H2, "foo", true).getAddress());
+  L.removeModuleSet(H1);
+  EXPECT_EQ(MockBaseLayer::getAddress(1, 0),
+            L.findSymbol("foo", true).getAddress());
+  L.removeModuleSet(H2);
+  EXPECT_FALSE(L.findSymbol("foo", true));
+}
+
+TEST_F(BatchingLayerTest, SharesResources) {
+  LayerT L(Base, 100);
+  auto H1 = add(L, createSet({"a"}), "x", 0x42);
+  auto H2 = add(L, createSet({"b"}), "y", 0x43);
+  L.flush();
+  ASSERT_EQ(1u, Base.Sets.size());
+
+  // External symbols are resolved by whichever set's resolver knows them.
+  auto *Resolver = Base.Sets[0].Resolver;
+  EXPECT_EQ(0x42u, Resolver->findSymbol("x").getAddress());
+  EXPECT_EQ(0x43u, Resolver->findSymbol("y").getAddress());
+  EXPECT_FALSE(Resolver->findSymbol("z"));
+  EXPECT_TRUE(Base.Sets[0].MemMgr != nullptr);
+
+  // The batch stays until all of its sets are removed.
+  L.removeModuleSet(H1);
+  EXPECT_TRUE(Base.Removed.empty());
+  L.removeModuleSet(H2);
+  EXPECT_EQ(std::vector<MockBaseLayer::ModuleSetHandleT>(1, 0), Base.Removed);
+}
+
+}
@@ -0,0 +1,100 @@
+//===- ObjectLinkingLayerTest.cpp - Unit tests for ObjectLinkingLayer -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/Orc/ObjectLinkingLayer.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Mangler.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/TargetSelect.h"
+#include "gtest/gtest.h"
+
+using namespace llvm;
+using namespace llvm::orc;
+
+namespace {
+
+class ObjectLinkingLayerTest : public testing::Test {
+protected:
+  typedef ObjectLinkingLayer<> ObjLayerT;
+
+  void SetUp() override {
+    if (InitializeNativeTarget() || InitializeNativeTargetAsmPrinter())
+      return;
+    TM.reset(EngineBuilder().selectTarget());
+  }
+
+  // Compile a module defining "int Name() { return 42; }" and add it to L.
+  ObjLayerT::ObjSetHandleT addFunction(ObjLayerT &L, StringRef Name) {
+    Module M(Name, Context);
+    M.setDataLayout(TM->createDataLayout());
+    Type *Int32Ty = Type::getInt32Ty(Context);
+    Function *F = Function::Create(FunctionType::get(Int32Ty, false),
+                                   GlobalValue::ExternalLinkage, Name, &M);
+    ReturnInst::Create(Context, ConstantInt::get(Int32Ty, 42),
+                       BasicBlock::Create(Context, "entry", F));
+
+    Objects.push_back(SimpleCompiler(*TM)(M));
+    std::vector<object::ObjectFile*> Objs;
+    Objs.push_back(Objects.back().getBinary());
+    auto Resolver = createLambdaResolver(
+        [](const std::string &) { return RuntimeDyld::SymbolInfo(nullptr); },
+        [](const std::string &) { return RuntimeDyld::SymbolInfo(nullptr); });
+    return L.addObjectSet(Objs, llvm::make_unique<SectionMemoryManager>(),
+                          std::move(Resolver));
+  }
+
+  std::string mangle(StringRef Name) {
+    std::string MangledName;
+    raw_string_ostream MangledNameStream(MangledName);
+    Mangler::getNameWithPrefix(MangledNameStream, Name,
+                               TM->createDataLayout());
+    return MangledNameStream.str();
+  }
+
+  LLVMContext Context;
+  std::unique_ptr<TargetMachine> TM;
+  std::vector<object::OwningBinary<object::ObjectFile>> Objects;
+};
+
+TEST_F(ObjectLinkingLayerTest, NotifyFinalized) {
+  if (!TM)
+    return;
+
+  unsigned NumFinalized = 0;
+  ObjLayerT ObjLayer(DoNothingOnNotifyLoaded(),
+                     [&](ObjLayerT::ObjSetHandleT) { ++NumFinalized; });
+
+  // emitAndFinalize notifies, and the set is not finalized again when one of
+  // its symbols is looked up afterwards.
+  auto H1 = addFunction(ObjLayer, "f1");
+  EXPECT_EQ(0u, NumFinalized) << "Adding an object set should not finalize it";
+  ObjLayer.emitAndFinalize(H1);
+  EXPECT_EQ(1u, NumFinalized) << "emitAndFinalize should notify";
+  auto F1 = ObjLayer.findSymbolIn(H1, mangle("f1"), true);
+  ASSERT_TRUE(!!F1) << "Symbol f1 not found";
+  EXPECT_NE(0u, F1.getAddress());
+  EXPECT_EQ(1u, NumFinalized) << "A finalized set should not notify again";
+
+  // Looking up an address finalizes the set and notifies exactly once.
+  auto H2 = addFunction(ObjLayer, "f2");
+  auto F2 = ObjLayer.findSymbolIn(H2, mangle("f2"), true);
+  ASSERT_TRUE(!!F2) << "Symbol f2 not found";
+  EXPECT_NE(0u, F2.getAddress());
+  EXPECT_EQ(2u, NumFinalized) << "getAddress should finalize and notify";
+  F2.getAddress();
+  EXPECT_EQ(2u, NumFinalized) << "A finalized set should not notify again";
+}
+
+}